@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_copies_avoided_total',
+  type: 'counter',
+  help: 'Number of getpage responses received directly into the destination buffer',
+  values: [
+    'getpage_copies_avoided_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
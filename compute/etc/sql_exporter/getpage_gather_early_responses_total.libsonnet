@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_gather_early_responses_total',
+  type: 'counter',
+  help: 'Number of getpage responses received from one shard while a read spanning several shards waited for another',
+  values: [
+    'getpage_gather_early_responses_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
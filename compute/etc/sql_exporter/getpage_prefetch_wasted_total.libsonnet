@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_prefetch_wasted_total',
+  type: 'counter',
+  help: 'Number of prefetched pages thrown away unread to make room in the readahead ring',
+  values: [
+    'getpage_prefetch_wasted_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
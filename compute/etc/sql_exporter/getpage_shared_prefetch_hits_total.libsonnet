@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_shared_prefetch_hits_total',
+  type: 'counter',
+  help: 'Number of getpage requests satisfied by an in-flight request of another backend',
+  values: [
+    'getpage_shared_prefetch_hits_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_stride_prefetch_hits_total',
+  type: 'counter',
+  help: 'Number of reads of pages predicted by the stride detector',
+  values: [
+    'getpage_stride_prefetch_hits_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_stride_prefetch_waste_total',
+  type: 'counter',
+  help: 'Number of pages predicted by the stride detector that were not read through the stream',
+  values: [
+    'getpage_stride_prefetch_waste_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
@@ -0,0 +1,9 @@
+{
+  metric_name: 'getpage_stride_prefetches_total',
+  type: 'counter',
+  help: 'Number of pages prefetched because the stride detector predicted them',
+  values: [
+    'getpage_stride_prefetches_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
@@ -13,9 +13,19 @@ SELECT d.* FROM pg_catalog.jsonb_to_record((SELECT jb FROM c)) AS d(
   compute_getpage_max_inflight_stuck_time_ms numeric,
   getpage_prefetch_misses_total numeric,
   getpage_prefetch_discards_total numeric,
+  getpage_prefetch_wasted_total numeric,
+  getpage_shared_prefetch_hits_total numeric,
+  getpage_gather_early_responses_total numeric,
+  getpage_stride_prefetches_total numeric,
+  getpage_stride_prefetch_hits_total numeric,
+  getpage_stride_prefetch_waste_total numeric,
+  getpage_copies_avoided_total numeric,
   getpage_prefetches_buffered numeric,
   pageserver_requests_sent_total numeric,
   pageserver_disconnects_total numeric,
   pageserver_send_flushes_total numeric,
-  pageserver_open_requests numeric
+  pageserver_open_requests numeric,
+  relsize_cache_hits_total numeric,
+  relsize_cache_misses_total numeric,
+  relsize_cache_contention_total numeric
 );
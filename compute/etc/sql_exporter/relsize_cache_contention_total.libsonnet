@@ -0,0 +1,9 @@
+{
+  metric_name: 'relsize_cache_contention_total',
+  type: 'counter',
+  help: 'Number of times a relation size cache lookup or update waited for a concurrent update',
+  values: [
+    'relsize_cache_contention_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
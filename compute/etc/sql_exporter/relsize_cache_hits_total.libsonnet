@@ -0,0 +1,9 @@
+{
+  metric_name: 'relsize_cache_hits_total',
+  type: 'counter',
+  help: 'Number of relation size lookups answered from the relation size cache',
+  values: [
+    'relsize_cache_hits_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
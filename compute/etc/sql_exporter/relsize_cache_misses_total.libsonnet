@@ -0,0 +1,9 @@
+{
+  metric_name: 'relsize_cache_misses_total',
+  type: 'counter',
+  help: 'Number of relation size lookups that were not found in the relation size cache',
+  values: [
+    'relsize_cache_misses_total',
+  ],
+  query_ref: 'neon_perf_counters',
+}
@@ -264,6 +264,12 @@ pub struct ConfigToml {
     pub load_previous_heatmap: Option<bool>,
     #[serde(skip_serializing_if = "Option::is_none")]
     pub generate_unarchival_heatmap: Option<bool>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pub walredo_batch_records: Option<bool>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pub walredo_shmem_transport: Option<bool>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pub walredo_fork_server: Option<bool>,
     pub tracing: Option<Tracing>,
     pub enable_tls_page_service_api: bool,
     pub dev_mode: bool,
@@ -825,6 +831,9 @@ fn default() -> Self {
             validate_wal_contiguity: None,
             load_previous_heatmap: None,
             generate_unarchival_heatmap: None,
+            walredo_batch_records: None,
+            walredo_shmem_transport: None,
+            walredo_fork_server: None,
             tracing: None,
             enable_tls_page_service_api: false,
             dev_mode: false,
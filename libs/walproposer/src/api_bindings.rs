@@ -478,6 +478,10 @@ pub fn empty_shmem() -> crate::bindings::WalproposerShmemState {
         mineLastElectedTerm: crate::bindings::pg_atomic_uint64 { value: 0 },
         backpressureThrottlingTime: crate::bindings::pg_atomic_uint64 { value: 0 },
         currentClusterSize: crate::bindings::pg_atomic_uint64 { value: 0 },
+        // not used outside of postgres, where ConditionVariableInit() sets it up
+        backpressureCV: unsafe { std::mem::zeroed() },
+        backpressureWaiters: crate::bindings::pg_atomic_uint32 { value: 0 },
+        backpressureBudget: crate::bindings::pg_atomic_uint64 { value: 0 },
         shard_ps_feedback: [empty_feedback; 128],
         num_shards: 0,
         replica_promote: false,
@@ -20,6 +20,16 @@
 //! Criterion will divide that by `n_redos` to compute the "time per iteration".
 //! In our case, "time per iteration" means "time per redo_work execution".
 //!
+//! Separately, `medium_records` replays the records of the `medium` input with a
+//! single client, once sending one message per record and once in batched
+//! `ApplyRecords` messages (`walredo_batch_records`), and reports records/s.
+//!
+//! `spawn` measures the time until a new walredo manager's first ping is
+//! answered, i.e. the process startup, once with processes started from
+//! scratch and once forked from a fork server (`walredo_fork_server`). It
+//! also prints the memory usage of a few processes from each, where the forks
+//! share the pages initialized by the fork server.
+//!
 //! NB: the way by which `iter_custom` determines the "number of iterations"
 //! is called sampling. Apparently the idea here is to detect outliers.
 //! We're not sure whether the current choice of sampling method makes sense.
@@ -120,7 +130,118 @@ macro_rules! bench_group {
         make_redo_work(&REQUEST)
     });
 }
-criterion::criterion_group!(benches, bench);
+
+/// Compare the records/s of per-record and batched messages on the same record stream.
+fn bench_batching(c: &mut Criterion) {
+    static REQUEST: Lazy<Request> = Lazy::new(Request::medium_input);
+
+    let mut group = c.benchmark_group("medium_records");
+    group.throughput(criterion::Throughput::Elements(REQUEST.records.len() as u64));
+    for walredo_batch_records in [false, true] {
+        let id = if walredo_batch_records {
+            "batched"
+        } else {
+            "per_record"
+        };
+
+        let repo_dir = camino_tempfile::tempdir_in(env!("CARGO_TARGET_TMPDIR")).unwrap();
+        let mut conf = PageServerConf::dummy_conf(repo_dir.path().to_path_buf());
+        conf.walredo_batch_records = walredo_batch_records;
+        let conf = Box::leak(Box::new(conf));
+        let tenant_shard_id = TenantShardId::unsharded(TenantId::generate());
+
+        let rt = tokio::runtime::Builder::new_multi_thread()
+            .enable_all()
+            .build()
+            .unwrap();
+        let manager = PostgresRedoManager::new(conf, tenant_shard_id);
+
+        group.bench_function(id, |b| {
+            b.iter(|| {
+                let page = rt.block_on(REQUEST.execute(&manager)).unwrap();
+                assert_eq!(page.remaining(), BLCKSZ as usize);
+            });
+        });
+    }
+    group.finish();
+}
+
+/// Compare the startup latency and memory usage of started and forked walredo processes.
+fn bench_spawn(c: &mut Criterion) {
+    let pg_version = PgMajorVersion::PG14;
+    let rt = tokio::runtime::Builder::new_multi_thread()
+        .enable_all()
+        .build()
+        .unwrap();
+
+    let mut group = c.benchmark_group("spawn");
+    for walredo_fork_server in [false, true] {
+        let id = if walredo_fork_server {
+            "fork_server"
+        } else {
+            "exec"
+        };
+        let repo_dir = camino_tempfile::tempdir_in(env!("CARGO_TARGET_TMPDIR")).unwrap();
+        let mut conf = PageServerConf::dummy_conf(repo_dir.path().to_path_buf());
+        conf.walredo_fork_server = walredo_fork_server;
+        let conf: &'static PageServerConf = Box::leak(Box::new(conf));
+        let new_manager =
+            || PostgresRedoManager::new(conf, TenantShardId::unsharded(TenantId::generate()));
+
+        // start the fork server outside of the measurement
+        rt.block_on(new_manager().ping(pg_version)).unwrap();
+
+        group.bench_function(id, |b| {
+            b.iter_custom(|iters| {
+                let mut elapsed = Duration::ZERO;
+                for _ in 0..iters {
+                    let manager = new_manager();
+                    let start = Instant::now();
+                    rt.block_on(manager.ping(pg_version)).unwrap();
+                    elapsed += start.elapsed();
+                    // killing the process isn't measured
+                    let _guard = rt.enter();
+                    drop(manager);
+                }
+                elapsed
+            });
+        });
+
+        let managers: Vec<_> = (0..8).map(|_| new_manager()).collect();
+        let (mut rss_kb, mut pss_kb) = (0, 0);
+        for manager in &managers {
+            rt.block_on(manager.ping(pg_version)).unwrap();
+            let pid = manager.status().process.unwrap().pid;
+            let (rss, pss) = smaps_rollup(pid);
+            rss_kb += rss;
+            pss_kb += pss;
+        }
+        eprintln!(
+            "spawn/{id}: {} processes, RSS {rss_kb} kB, PSS {pss_kb} kB",
+            managers.len()
+        );
+        let _guard = rt.enter();
+        drop(managers);
+    }
+    group.finish();
+}
+
+/// Returns the RSS and PSS of a process in kB, or zeros where that's not available.
+fn smaps_rollup(pid: u32) -> (u64, u64) {
+    let Ok(smaps) = std::fs::read_to_string(format!("/proc/{pid}/smaps_rollup")) else {
+        return (0, 0);
+    };
+    let field = |name: &str| {
+        smaps
+            .lines()
+            .find_map(|line| line.strip_prefix(name))
+            .and_then(|rest| rest.trim().trim_end_matches("kB").trim().parse().ok())
+            .unwrap_or(0)
+    };
+    (field("Rss:"), field("Pss:"))
+}
+
+criterion::criterion_group!(benches, bench, bench_batching, bench_spawn);
 criterion::criterion_main!(benches);
 
 // Returns the sum of each client's wall-clock time spent executing their share of the n_redos.
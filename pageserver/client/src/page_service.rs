@@ -237,7 +237,8 @@ pub async fn getpage_recv(&mut self) -> anyhow::Result<PagestreamGetPageResponse
             PagestreamBeMessage::Exists(_)
             | PagestreamBeMessage::Nblocks(_)
             | PagestreamBeMessage::DbSize(_)
-            | PagestreamBeMessage::GetSlruSegment(_) => {
+            | PagestreamBeMessage::GetSlruSegment(_)
+            | PagestreamBeMessage::GetPageBatch(_) => {
                 anyhow::bail!(
                     "unexpected be message kind in response to getpage request: {}",
                     next.kind()
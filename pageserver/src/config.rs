@@ -234,6 +234,18 @@ pub struct PageServerConf {
     /// When set, include visible layers in the next uploaded heatmaps of an unarchived timeline.
     pub generate_unarchival_heatmap: bool,
 
+    /// Send the WAL records of a redo request to the walredo process in batched
+    /// `ApplyRecords` messages, instead of one message per record.
+    pub walredo_batch_records: bool,
+
+    /// Pass page images to and from the walredo process through a shared memory
+    /// ring, instead of its pipes. Linux only.
+    pub walredo_shmem_transport: bool,
+
+    /// Fork walredo processes from a pre-initialized fork server per postgres
+    /// version, instead of starting each one from scratch. Linux only.
+    pub walredo_fork_server: bool,
+
     pub tracing: Option<pageserver_api::config::Tracing>,
 
     /// Enable TLS in page service API.
@@ -434,6 +446,9 @@ pub fn parse_and_validate(
             validate_wal_contiguity,
             load_previous_heatmap,
             generate_unarchival_heatmap,
+            walredo_batch_records,
+            walredo_shmem_transport,
+            walredo_fork_server,
             tracing,
             enable_tls_page_service_api,
             dev_mode,
@@ -548,6 +563,9 @@ pub fn parse_and_validate(
             validate_wal_contiguity: validate_wal_contiguity.unwrap_or(false),
             load_previous_heatmap: load_previous_heatmap.unwrap_or(true),
             generate_unarchival_heatmap: generate_unarchival_heatmap.unwrap_or(true),
+            walredo_batch_records: walredo_batch_records.unwrap_or(true),
+            walredo_shmem_transport: walredo_shmem_transport.unwrap_or(false),
+            walredo_fork_server: walredo_fork_server.unwrap_or(false),
             ssl_ca_certs: match ssl_ca_file {
                 Some(ssl_ca_file) => {
                     let buf = std::fs::read(ssl_ca_file)?;
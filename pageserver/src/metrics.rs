@@ -2322,6 +2322,7 @@ pub(crate) fn observe<T>(self, res: &Result<T, QueryError>) {
 
 #[derive(Clone, Copy, enum_map::Enum, IntoStaticStr)]
 pub(crate) enum ComputeCommandKind {
+    PageStreamV4,
     PageStreamV3,
     PageStreamV2,
     Basebackup,
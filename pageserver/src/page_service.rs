@@ -30,9 +30,10 @@
 use pageserver_api::pagestream_api::{
     self, PagestreamBeMessage, PagestreamDbSizeRequest, PagestreamDbSizeResponse,
     PagestreamErrorResponse, PagestreamExistsRequest, PagestreamExistsResponse,
-    PagestreamFeMessage, PagestreamGetPageRequest, PagestreamGetSlruSegmentRequest,
-    PagestreamGetSlruSegmentResponse, PagestreamNblocksRequest, PagestreamNblocksResponse,
-    PagestreamProtocolVersion, PagestreamRequest,
+    PagestreamFeMessage, PagestreamGetPageBatchRequest, PagestreamGetPageBatchResponse,
+    PagestreamGetPageRequest, PagestreamGetSlruSegmentRequest, PagestreamGetSlruSegmentResponse,
+    PagestreamNblocksRequest, PagestreamNblocksResponse, PagestreamProtocolVersion,
+    PagestreamRequest,
 };
 use pageserver_api::reltag::SlruKind;
 use pageserver_api::shard::TenantShardId;
@@ -711,6 +712,10 @@ struct BatchedGetPageRequest {
     // If the request is perf enabled, this contains a context
     // with a perf span tracking the time spent waiting for the executor.
     batch_wait_ctx: Option<RequestContext>,
+    // Set if this page is part of a multi-block GetPageBatch request.
+    // The pages of such a request are always adjacent in a batch, and
+    // they are answered with a single response.
+    getpage_batch: Option<PagestreamGetPageBatchRequest>,
 }
 
 #[cfg(feature = "testing")]
@@ -815,10 +820,10 @@ fn should_break_batch(
                     ..
                 },
             ) => {
-                assert_eq!(this_pages.len(), 1);
-                if accum_pages.len() >= max_batch_size.get() {
+                // More than one page if this is a GetPageBatch request.
+                assert!(!this_pages.is_empty());
+                if accum_pages.len() + this_pages.len() > max_batch_size.get() {
                     trace!(%max_batch_size, "stopping batching because of batch size");
-                    assert_eq!(accum_pages.len(), max_batch_size.get());
 
                     return Some(GetPageBatchBreakReason::BatchFull);
                 }
@@ -850,18 +855,20 @@ fn should_break_batch(
                         // The read path doesn't curently support serving the same page at different LSNs.
                         // While technically possible, it's uncertain if the complexity is worth it.
                         // Break the batch if such a case is encountered.
-                        let same_page_different_lsn = accum_pages.iter().any(|batched| {
-                            batched.req.rel == this_pages[0].req.rel
-                                && batched.req.blkno == this_pages[0].req.blkno
-                                && batched.lsn_range.effective_lsn
-                                    != this_pages[0].lsn_range.effective_lsn
+                        let same_page_different_lsn = this_pages.iter().find(|this| {
+                            accum_pages.iter().any(|batched| {
+                                batched.req.rel == this.req.rel
+                                    && batched.req.blkno == this.req.blkno
+                                    && batched.lsn_range.effective_lsn
+                                        != this.lsn_range.effective_lsn
+                            })
                         });
 
-                        if same_page_different_lsn {
+                        if let Some(this) = same_page_different_lsn {
                             trace!(
-                                rel=%this_pages[0].req.rel,
-                                blkno=%this_pages[0].req.blkno,
-                                lsn=%this_pages[0].lsn_range.effective_lsn,
+                                rel=%this.req.rel,
+                                blkno=%this.req.blkno,
+                                lsn=%this.lsn_range.effective_lsn,
                                 "stopping batching because same page was requested at different LSNs"
                             );
 
@@ -1009,6 +1016,15 @@ async fn pagestream_read_message<IO>(
         let neon_fe_msg =
             PagestreamFeMessage::parse(&mut copy_data_bytes.reader(), protocol_version)?;
 
+        // A GetPageBatch request is routed, throttled and traced like a GetPage
+        // request for its first block; the other blocks are added to the batch below.
+        let (neon_fe_msg, getpage_batch) = match neon_fe_msg {
+            PagestreamFeMessage::GetPageBatch(batch) => {
+                (PagestreamFeMessage::GetPage(batch.page(0)), Some(batch))
+            }
+            msg => (msg, None),
+        };
+
         let batched_msg = match neon_fe_msg {
             PagestreamFeMessage::Exists(req) => {
                 let shard = timeline_handles
@@ -1248,11 +1264,8 @@ macro_rules! respond_error {
                     None
                 };
 
-                BatchedFeMessage::GetPage {
-                    span,
-                    shard: shard.downgrade(),
-                    applied_gc_cutoff_guard,
-                    pages: smallvec![BatchedGetPageRequest {
+                let mut pages: SmallVec<[BatchedGetPageRequest; 1]> =
+                    smallvec![BatchedGetPageRequest {
                         req,
                         timer,
                         lsn_range: LsnRange {
@@ -1261,13 +1274,60 @@ macro_rules! respond_error {
                         },
                         ctx,
                         batch_wait_ctx,
-                    }],
+                        getpage_batch,
+                    }];
+
+                // The remaining blocks of a GetPageBatch request share the LSNs of the
+                // first one, but each page is timed and throttled on its own, like the
+                // pages of a gRPC GetPage request.
+                if let Some(batch) = getpage_batch {
+                    for i in 1..batch.nblocks {
+                        let page_req = batch.page(i);
+                        let key = rel_block_to_key(page_req.rel, page_req.blkno);
+                        if !shard.get_shard_identity().is_key_local(&key) {
+                            MISROUTED_PAGESTREAM_REQUESTS.inc();
+                            return respond_error!(
+                                span,
+                                PageStreamError::Reconnect(
+                                    "getpage@lsn batch request spans multiple shards".into()
+                                )
+                            );
+                        }
+                        let timer = Self::record_op_start_and_throttle(
+                            &shard,
+                            metrics::SmgrQueryType::GetPageAtLsn,
+                            received_at,
+                        )
+                        .await?;
+                        let ctx = pages[0].ctx.attached_child();
+                        pages.push(BatchedGetPageRequest {
+                            req: page_req,
+                            timer,
+                            lsn_range: LsnRange {
+                                effective_lsn,
+                                request_lsn: page_req.hdr.request_lsn,
+                            },
+                            ctx,
+                            batch_wait_ctx: None,
+                            getpage_batch,
+                        });
+                    }
+                }
+
+                BatchedFeMessage::GetPage {
+                    span,
+                    shard: shard.downgrade(),
+                    applied_gc_cutoff_guard,
+                    pages,
                     // The executor grabs the batch when it becomes idle.
                     // Hence, [`GetPageBatchBreakReason::ExecutorSteal`] is the
                     // default reason for breaking the batch.
                     batch_break_reason: GetPageBatchBreakReason::ExecutorSteal,
                 }
             }
+            PagestreamFeMessage::GetPageBatch(_) => {
+                unreachable!("GetPageBatch is handled as GetPage")
+            }
             #[cfg(feature = "testing")]
             PagestreamFeMessage::Test(req) => {
                 let shard = timeline_handles
@@ -1698,6 +1758,10 @@ macro_rules! upgrade_handle_and_set_context {
                     {
                         let npages = pages.len();
                         trace!(npages, "handling getpage request");
+                        let getpage_batches: Option<Vec<_>> = pages
+                            .iter()
+                            .any(|p| p.getpage_batch.is_some())
+                            .then(|| pages.iter().map(|p| p.getpage_batch).collect());
                         let res = Self::handle_get_page_at_lsn_request_batched(
                             &shard,
                             pages,
@@ -1709,7 +1773,12 @@ macro_rules! upgrade_handle_and_set_context {
                         .await;
                         assert_eq!(res.len(), npages);
                         drop(applied_gc_cutoff_guard);
-                        res
+                        match getpage_batches {
+                            Some(getpage_batches) => {
+                                Self::coalesce_getpage_batch_results(res, getpage_batches)
+                            }
+                            None => res,
+                        }
                     },
                     span,
                 )
@@ -1781,6 +1850,74 @@ macro_rules! upgrade_handle_and_set_context {
         })
     }
 
+    /// Folds the per-page results of each GetPageBatch request into a single
+    /// response. If any page of the request failed, the whole request is answered
+    /// with the first error.
+    ///
+    /// `getpage_batches` has an entry for each result, see
+    /// [`BatchedGetPageRequest::getpage_batch`].
+    #[allow(clippy::type_complexity)]
+    fn coalesce_getpage_batch_results(
+        results: Vec<
+            Result<(PagestreamBeMessage, SmgrOpTimer, RequestContext), BatchedPageStreamError>,
+        >,
+        getpage_batches: Vec<Option<PagestreamGetPageBatchRequest>>,
+    ) -> Vec<Result<(PagestreamBeMessage, SmgrOpTimer, RequestContext), BatchedPageStreamError>>
+    {
+        assert_eq!(results.len(), getpage_batches.len());
+
+        fn into_page(msg: PagestreamBeMessage) -> bytes::Bytes {
+            match msg {
+                PagestreamBeMessage::GetPage(resp) => resp.page,
+                msg => unreachable!("unexpected getpage response: {}", msg.kind()),
+            }
+        }
+
+        let mut coalesced = Vec::with_capacity(results.len());
+        let mut results = results.into_iter().zip(getpage_batches);
+        while let Some((result, getpage_batch)) = results.next() {
+            let Some(batch) = getpage_batch else {
+                coalesced.push(result);
+                continue;
+            };
+            let mut combined = result.map(|(msg, timer, ctx)| {
+                let mut pages = Vec::with_capacity(batch.nblocks as usize);
+                pages.push(into_page(msg));
+                (pages, timer, ctx)
+            });
+            // The response is timed with the timer of the first page. Dropping the
+            // timers of the other pages observes the end of their execution.
+            for _ in 1..batch.nblocks {
+                let (result, _) = results
+                    .next()
+                    .expect("pages of a GetPageBatch request are never split across batches");
+                match result {
+                    Ok((msg, _timer, _ctx)) => {
+                        if let Ok((pages, _, _)) = &mut combined {
+                            pages.push(into_page(msg));
+                        }
+                    }
+                    Err(e) => {
+                        if combined.is_ok() {
+                            combined = Err(e);
+                        }
+                    }
+                }
+            }
+            coalesced.push(combined.map(|(pages, timer, ctx)| {
+                (
+                    PagestreamBeMessage::GetPageBatch(PagestreamGetPageBatchResponse {
+                        req: batch,
+                        pages,
+                    }),
+                    timer,
+                    ctx,
+                )
+            }));
+        }
+        coalesced
+    }
+
     /// Pagestream sub-protocol handler.
     ///
     /// It is a simple request-response protocol inside a COPYBOTH session.
@@ -3016,6 +3153,10 @@ fn parse(query: &str) -> anyhow::Result<Self> {
                 other,
                 PagestreamProtocolVersion::V3,
             )?)),
+            "pagestream_v4" => Ok(Self::PageStream(PageStreamCmd::parse(
+                other,
+                PagestreamProtocolVersion::V4,
+            )?)),
             "basebackup" => Ok(Self::BaseBackup(BaseBackupCmd::parse(other)?)),
             "fullbackup" => Ok(Self::FullBackup(FullBackupCmd::parse(other)?)),
             "lease" => {
@@ -3176,6 +3317,7 @@ async fn process_query(
                 let command_kind = match protocol_version {
                     PagestreamProtocolVersion::V2 => ComputeCommandKind::PageStreamV2,
                     PagestreamProtocolVersion::V3 => ComputeCommandKind::PageStreamV3,
+                    PagestreamProtocolVersion::V4 => ComputeCommandKind::PageStreamV4,
                 };
                 COMPUTE_COMMANDS_COUNTERS.for_command(command_kind).inc();
 
@@ -3598,6 +3740,7 @@ async fn get_page(
                 timer,
                 ctx: ctx.attached_child(),
                 batch_wait_ctx: None, // TODO: add tracing
+                getpage_batch: None,
             });
         }
 
@@ -238,6 +238,69 @@ pub async fn request_redo(
         }
     }
 
+    /// Request the WAL redo manager to apply the same WAL records to several
+    /// pages at once, e.g. to a heap page and its visibility map page. Each
+    /// record is shipped to and decoded by the WAL redo process only once.
+    ///
+    /// `pages` are the keys of the pages to reconstruct with their base images,
+    /// if any. Returns the page images in the same order. Only records that are
+    /// applied by postgres are accepted.
+    ///
+    /// # Cancel-Safety
+    ///
+    /// This method is cancellation-safe.
+    pub async fn request_redo_multi(
+        &self,
+        pages: Vec<(Key, Option<Bytes>)>,
+        lsn: Lsn,
+        records: Vec<(Lsn, NeonWalRecord)>,
+        pg_version: PgMajorVersion,
+    ) -> Result<Vec<Bytes>, Error> {
+        if records.is_empty() {
+            bail!("invalid WAL redo request with no records");
+        }
+        if records
+            .iter()
+            .any(|(_, rec)| apply_neon::can_apply_in_neon(rec))
+        {
+            bail!("multi-page WAL redo request with records that are applied by neon");
+        }
+
+        let mut blocks = Vec::with_capacity(pages.len());
+        for (key, img) in pages {
+            let (rel, blknum) = key.to_rel_block().context("invalid record")?;
+            blocks.push((rel, blknum, img));
+        }
+
+        *(self.last_redo_at.lock().unwrap()) = Some(Instant::now());
+
+        let blocks = &blocks;
+        let records = &records;
+        let wal_redo_timeout = self.conf.wal_redo_timeout;
+        self.do_with_walredo_process(pg_version, |proc| async move {
+            let started_at = std::time::Instant::now();
+            let result = proc
+                .apply_wal_records_multi(blocks, records, wal_redo_timeout)
+                .await
+                .context("apply_wal_records_multi");
+            let duration = started_at.elapsed();
+
+            WAL_REDO_TIME.observe(duration.as_secs_f64());
+            WAL_REDO_RECORDS_HISTOGRAM.observe(records.len() as f64);
+
+            debug!(
+                "postgres applied {} WAL records to {} pages in {} us to reconstruct page images at LSN {}",
+                records.len(),
+                blocks.len(),
+                duration.as_micros(),
+                lsn
+            );
+
+            result.map_err(Error::Other)
+        })
+        .await
+    }
+
     /// Do a ping request-response roundtrip.
     ///
     /// Not used in production, but by Rust benchmarks.
@@ -254,6 +317,24 @@ pub async fn ping(&self, pg_version: PgMajorVersion) -> Result<(), Error> {
         .await
     }
 
+    /// Query the counters of the walredo process, e.g. the number of records
+    /// skipped thanks to full-page images.
+    ///
+    /// # Cancel-Safety
+    ///
+    /// This method is cancellation-safe.
+    pub(crate) async fn stats(
+        &self,
+        pg_version: PgMajorVersion,
+    ) -> Result<process::WalRedoStats, Error> {
+        self.do_with_walredo_process(pg_version, |proc| async move {
+            proc.stats(Duration::from_secs(1))
+                .await
+                .map_err(Error::Other)
+        })
+        .await
+    }
+
     pub fn status(&self) -> WalRedoManagerStatus {
         WalRedoManagerStatus {
             last_redo_at: {
@@ -605,10 +686,14 @@ pub struct RedoHarness {
 
     impl RedoHarness {
         pub fn new() -> anyhow::Result<Self> {
+            Self::new_with_conf(|_| {})
+        }
+        pub fn new_with_conf(configure: impl FnOnce(&mut PageServerConf)) -> anyhow::Result<Self> {
             crate::tenant::harness::setup_logging();
 
             let repo_dir = camino_tempfile::tempdir()?;
-            let conf = PageServerConf::dummy_conf(repo_dir.path().to_path_buf());
+            let mut conf = PageServerConf::dummy_conf(repo_dir.path().to_path_buf());
+            configure(&mut conf);
             let conf = Box::leak(Box::new(conf));
             let tenant_shard_id = TenantShardId::unsharded(TenantId::generate());
 
@@ -712,6 +797,330 @@ async fn short_v14_fails_for_wrong_key_but_returns_zero_page() {
         assert_eq!(page, crate::ZERO_PAGE);
     }
 
+    #[cfg(target_os = "linux")]
+    #[tokio::test]
+    async fn short_v14_redo_shmem() {
+        let expected = std::fs::read("test_data/short_v14_redo.page").unwrap();
+
+        let h = RedoHarness::new_with_conf(|conf| conf.walredo_shmem_transport = true).unwrap();
+
+        let key = Key {
+            field1: 0,
+            field2: 1663,
+            field3: 13010,
+            field4: 1259,
+            field5: 0,
+            field6: 0,
+        };
+        // apply the records in two requests, to pass the intermediate page
+        // image as the base image of the second one
+        let mut records = short_records();
+        let second = records.split_off(1);
+        let first_lsn = records[0].0;
+
+        let page = h
+            .manager
+            .request_redo(
+                key,
+                first_lsn,
+                None,
+                records,
+                PgMajorVersion::PG14,
+                RedoAttemptType::ReadPage,
+            )
+            .instrument(h.span())
+            .await
+            .unwrap();
+
+        let page = h
+            .manager
+            .request_redo(
+                key,
+                Lsn::from_str("0/16E2408").unwrap(),
+                Some((first_lsn, page)),
+                second,
+                PgMajorVersion::PG14,
+                RedoAttemptType::ReadPage,
+            )
+            .instrument(h.span())
+            .await
+            .unwrap();
+
+        assert_eq!(&expected, &*page);
+    }
+
+    #[cfg(target_os = "linux")]
+    #[tokio::test]
+    async fn short_v14_redo_shmem_cancelled() {
+        let expected = std::fs::read("test_data/short_v14_redo.page").unwrap();
+
+        let h = RedoHarness::new_with_conf(|conf| conf.walredo_shmem_transport = true).unwrap();
+
+        let key = Key {
+            field1: 0,
+            field2: 1663,
+            field3: 13010,
+            field4: 1259,
+            field5: 0,
+            field6: 0,
+        };
+        let lsn = Lsn::from_str("0/16E2408").unwrap();
+        let redo = || {
+            h.manager
+                .request_redo(
+                    key,
+                    lsn,
+                    None,
+                    short_records(),
+                    PgMajorVersion::PG14,
+                    RedoAttemptType::ReadPage,
+                )
+                .instrument(h.span())
+        };
+
+        // Cancel more requests than there are slots in the ring, at different
+        // points. If their slots weren't returned, the last request would
+        // wait for a slot forever.
+        for i in 0..64 {
+            let _ = tokio::time::timeout(std::time::Duration::from_micros(i * 10), redo()).await;
+        }
+
+        let page = tokio::time::timeout(std::time::Duration::from_secs(30), redo())
+            .await
+            .expect("a slot must be available")
+            .unwrap();
+        assert_eq!(&expected, &*page);
+    }
+
+    #[cfg(target_os = "linux")]
+    #[tokio::test]
+    async fn short_v14_redo_forked() {
+        let expected = std::fs::read("test_data/short_v14_redo.page").unwrap();
+
+        // each harness has its own manager and process, forked from the same
+        // fork server, one of them with the shared memory ring
+        for shmem in [false, true] {
+            let h = RedoHarness::new_with_conf(|conf| {
+                conf.walredo_fork_server = true;
+                conf.walredo_shmem_transport = shmem;
+            })
+            .unwrap();
+
+            let page = h
+                .manager
+                .request_redo(
+                    Key {
+                        field1: 0,
+                        field2: 1663,
+                        field3: 13010,
+                        field4: 1259,
+                        field5: 0,
+                        field6: 0,
+                    },
+                    Lsn::from_str("0/16E2408").unwrap(),
+                    None,
+                    short_records(),
+                    PgMajorVersion::PG14,
+                    RedoAttemptType::ReadPage,
+                )
+                .instrument(h.span())
+                .await
+                .unwrap();
+
+            assert_eq!(&expected, &*page);
+        }
+    }
+
+    #[tokio::test]
+    async fn short_v14_redo_multi() {
+        let expected = std::fs::read("test_data/short_v14_redo.page").unwrap();
+
+        let h = RedoHarness::new().unwrap();
+
+        let key = |field3| Key {
+            field1: 0,
+            field2: 1663,
+            field3,
+            field4: 1259,
+            field5: 0,
+            field6: 0,
+        };
+        // the records don't touch the first page, which comes back as zeros
+        let pages = h
+            .manager
+            .request_redo_multi(
+                vec![(key(13130), None), (key(13010), None)],
+                Lsn::from_str("0/16E2408").unwrap(),
+                short_records(),
+                PgMajorVersion::PG14,
+            )
+            .instrument(h.span())
+            .await
+            .unwrap();
+
+        assert_eq!(pages.len(), 2);
+        assert_eq!(pages[0], crate::ZERO_PAGE);
+        assert_eq!(&expected, &*pages[1]);
+    }
+
+    #[tokio::test]
+    async fn short_v14_redo_multi_one_record_two_targets() {
+        let heap_image = std::fs::read("test_data/short_v14_redo.page").unwrap();
+        let mut vm_image = heap_image.clone();
+        vm_image[8192 - 64..].fill(0xff);
+
+        let h = RedoHarness::new().unwrap();
+
+        // one record that modifies a heap page and its visibility map page
+        let lsn = Lsn::from_str("0/16E2408").unwrap();
+        let records = vec![(
+            lsn,
+            NeonWalRecord::Postgres {
+                will_init: true,
+                rec: fpi_record_v14_multi(&[
+                    (1663, 13010, 1259, 0, 0, &heap_image),
+                    (1663, 13010, 1259, 2, 0, &vm_image),
+                ]),
+            },
+        )];
+        let key = |field5| Key {
+            field1: 0,
+            field2: 1663,
+            field3: 13010,
+            field4: 1259,
+            field5,
+            field6: 0,
+        };
+
+        let pages = h
+            .manager
+            .request_redo_multi(
+                vec![(key(0), None), (key(2), None)],
+                lsn,
+                records.clone(),
+                PgMajorVersion::PG14,
+            )
+            .instrument(h.span())
+            .await
+            .unwrap();
+        assert_eq!(pages.len(), 2);
+
+        for (page, (field5, image)) in pages.iter().zip([(0, &heap_image), (2, &vm_image)]) {
+            let single = h
+                .manager
+                .request_redo(
+                    key(field5),
+                    lsn,
+                    None,
+                    records.clone(),
+                    PgMajorVersion::PG14,
+                    RedoAttemptType::ReadPage,
+                )
+                .instrument(h.span())
+                .await
+                .unwrap();
+            assert_eq!(page, &single);
+            assert_eq!(&page[8..], &image[8..]);
+        }
+    }
+
+    #[tokio::test]
+    async fn short_v14_redo_skips_to_full_page_image() {
+        let image = std::fs::read("test_data/short_v14_redo.page").unwrap();
+
+        let h = RedoHarness::new().unwrap();
+
+        let lsn = Lsn::from_str("0/16E2408").unwrap();
+        let mut records = short_records();
+        records.push((
+            lsn,
+            NeonWalRecord::Postgres {
+                will_init: false,
+                rec: fpi_record_v14(1663, 13010, 1259, 0, &image),
+            },
+        ));
+
+        let page = h
+            .manager
+            .request_redo(
+                Key {
+                    field1: 0,
+                    field2: 1663,
+                    field3: 13010,
+                    field4: 1259,
+                    field5: 0,
+                    field6: 0,
+                },
+                lsn,
+                None,
+                records,
+                PgMajorVersion::PG14,
+                RedoAttemptType::ReadPage,
+            )
+            .instrument(h.span())
+            .await
+            .unwrap();
+
+        // the image, with the LSN of the record
+        assert_eq!(&page[..8], &[0, 0, 0, 0, 0x08, 0x24, 0x6e, 0x01]);
+        assert_eq!(&page[8..], &image[8..]);
+
+        let stats = h
+            .manager
+            .stats(PgMajorVersion::PG14)
+            .instrument(h.span())
+            .await
+            .unwrap();
+        assert_eq!(stats.records_applied, 1);
+        assert_eq!(stats.records_skipped, 2);
+    }
+
+    /// An XLOG_FPI record with an uncompressed image of one block, without a hole.
+    fn fpi_record_v14(spc: u32, db: u32, rel: u32, blkno: u32, image: &[u8]) -> Bytes {
+        fpi_record_v14_multi(&[(spc, db, rel, 0, blkno, image)])
+    }
+
+    /// An XLOG_FPI record with a full-page image of each of the given
+    /// (spcnode, dbnode, relnode, forknum, blkno, image) blocks.
+    fn fpi_record_v14_multi(blocks: &[(u32, u32, u32, u8, u32, &[u8])]) -> Bytes {
+        use bytes::BufMut;
+        use postgres_ffi::pg_constants::{BKPBLOCK_HAS_IMAGE, RM_XLOG_ID, XLOG_FPI};
+        use postgres_ffi::v14::bindings::BKPIMAGE_APPLY;
+
+        // record header, then per block: block header, image header,
+        // RelFileNode, BlockNumber, and the image after all the headers
+        let tot_len = 24
+            + blocks
+                .iter()
+                .map(|(.., image)| 4 + 5 + 12 + 4 + image.len())
+                .sum::<usize>();
+        let mut rec = bytes::BytesMut::with_capacity(tot_len);
+        rec.put_u32_le(tot_len as u32);
+        rec.put_u32_le(0); // xl_xid
+        rec.put_u64_le(0); // xl_prev
+        rec.put_u8(XLOG_FPI);
+        rec.put_u8(RM_XLOG_ID);
+        rec.put_u16_le(0); // padding
+        rec.put_u32_le(0); // xl_crc, not checked by walredo
+        for (block_id, (spc, db, rel, forknum, blkno, image)) in blocks.iter().enumerate() {
+            rec.put_u8(block_id as u8);
+            rec.put_u8(BKPBLOCK_HAS_IMAGE | forknum);
+            rec.put_u16_le(0); // data_length
+            rec.put_u16_le(image.len() as u16);
+            rec.put_u16_le(0); // hole_offset
+            rec.put_u8(BKPIMAGE_APPLY);
+            rec.put_u32_le(*spc);
+            rec.put_u32_le(*db);
+            rec.put_u32_le(*rel);
+            rec.put_u32_le(*blkno);
+        }
+        for (.., image) in blocks {
+            rec.put_slice(image);
+        }
+        assert_eq!(rec.len(), tot_len);
+        rec.freeze()
+    }
+
     #[tokio::test]
     async fn test_stderr() {
         let h = RedoHarness::new().unwrap();
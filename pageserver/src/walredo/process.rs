@@ -1,15 +1,18 @@
+#[cfg(target_os = "linux")]
+mod fork_server;
 mod no_leak_child;
 /// The IPC protocol that pageserver and walredo process speak over their shared pipe.
 mod protocol;
+mod shmem_ring;
 
 use std::collections::VecDeque;
-use std::process::{Command, Stdio};
+use std::process::{ChildStderr, ChildStdin, ChildStdout, Command, Stdio};
 #[cfg(feature = "testing")]
 use std::sync::atomic::AtomicUsize;
 use std::time::Duration;
 
 use anyhow::Context;
-use bytes::Bytes;
+use bytes::{Buf, Bytes};
 use pageserver_api::reltag::RelTag;
 use pageserver_api::shard::TenantShardId;
 use postgres_ffi::{BLCKSZ, PgMajorVersion};
@@ -26,19 +29,58 @@
 use crate::span::debug_assert_current_span_has_tenant_id;
 
 pub struct WalRedoProcess {
-    #[allow(dead_code)]
     conf: &'static PageServerConf,
     #[cfg(feature = "testing")]
     tenant_shard_id: TenantShardId,
     // Some() on construction, only becomes None on Drop.
-    child: Option<NoLeakChild>,
+    child: Option<WalRedoChild>,
     stdout: tokio::sync::Mutex<Poison<ProcessOutput>>,
     stdin: tokio::sync::Mutex<Poison<ProcessInput>>,
+    /// Length of the response to each request that was sent but whose response
+    /// wasn't read yet, in the order of the requests, and the shared memory
+    /// slot that the request uses, if any.
+    response_lens: std::sync::Mutex<VecDeque<(usize, Option<u32>)>>,
+    /// The optional shared memory transport for page images.
+    shmem_ring: Option<shmem_ring::ShmemRing>,
     /// Counter to separate same sized walredo inputs failing at the same millisecond.
     #[cfg(feature = "testing")]
     dump_sequence: AtomicUsize,
 }
 
+/// The walredo process, either started by us or forked by a fork server.
+enum WalRedoChild {
+    Spawned(NoLeakChild),
+    #[cfg(target_os = "linux")]
+    Forked(fork_server::ForkedChild),
+}
+
+impl WalRedoChild {
+    fn id(&self) -> u32 {
+        match self {
+            WalRedoChild::Spawned(child) => child.id(),
+            #[cfg(target_os = "linux")]
+            WalRedoChild::Forked(child) => child.id(),
+        }
+    }
+
+    fn kill_and_wait(self, cause: WalRedoKillCause) {
+        match self {
+            WalRedoChild::Spawned(child) => child.kill_and_wait(cause),
+            #[cfg(target_os = "linux")]
+            WalRedoChild::Forked(child) => child.kill_and_wait(cause),
+        }
+    }
+}
+
+/// Counters of a WAL redo process, since it started.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct WalRedoStats {
+    pub(crate) records_applied: u64,
+    /// Records that weren't applied, because a later record in the same
+    /// batch restores a full-page image of the block.
+    pub(crate) records_skipped: u64,
+}
+
 struct ProcessInput {
     stdin: tokio::process::ChildStdin,
     n_requests: usize,
@@ -62,50 +104,25 @@ pub(crate) fn launch(
     ) -> anyhow::Result<Self> {
         crate::span::debug_assert_current_span_has_tenant_id();
 
-        let pg_bin_dir_path = conf.pg_bin_dir(pg_version).context("pg_bin_dir")?; // TODO these should be infallible.
-        let pg_lib_dir_path = conf.pg_lib_dir(pg_version).context("pg_lib_dir")?;
+        let mut shmem_ring = if conf.walredo_shmem_transport {
+            Some(shmem_ring::ShmemRing::new().context("create walredo shared memory ring")?)
+        } else {
+            None
+        };
 
-        use no_leak_child::NoLeakChildCommandExt;
-        // Start postgres itself
-        let child = Command::new(pg_bin_dir_path.join("postgres"))
-            // the first arg must be --wal-redo so the child process enters into walredo mode
-            .arg("--wal-redo")
-            // the child doesn't process this arg, but, having it in the argv helps indentify the
-            // walredo process for a particular tenant when debugging a pagserver
-            .args(["--tenant-shard-id", &format!("{tenant_shard_id}")])
-            .stdin(Stdio::piped())
-            .stderr(Stdio::piped())
-            .stdout(Stdio::piped())
-            .env_clear()
-            .env("LD_LIBRARY_PATH", &pg_lib_dir_path)
-            .env("DYLD_LIBRARY_PATH", &pg_lib_dir_path)
-            .env(
-                "ASAN_OPTIONS",
-                std::env::var("ASAN_OPTIONS").unwrap_or_default(),
-            )
-            .env(
-                "UBSAN_OPTIONS",
-                std::env::var("UBSAN_OPTIONS").unwrap_or_default(),
-            )
-            // NB: The redo process is not trusted after we sent it the first
-            // walredo work. Before that, it is trusted. Specifically, we trust
-            // it to
-            // 1. close all file descriptors except stdin, stdout, stderr because
-            //    pageserver might not be 100% diligent in setting FD_CLOEXEC on all
-            //    the files it opens, and
-            // 2. to use seccomp to sandbox itself before processing the first
-            //    walredo request.
-            .spawn_no_leak_child(tenant_shard_id)
-            .context("spawn process")?;
-        WAL_REDO_PROCESS_COUNTERS.started.inc();
+        let (child, stdin, stdout, stderr) = if conf.walredo_fork_server {
+            Self::fork(conf, pg_version, shmem_ring.as_ref())?
+        } else {
+            Self::spawn(conf, tenant_shard_id, pg_version, shmem_ring.as_ref())?
+        };
+        if let Some(ring) = &mut shmem_ring {
+            ring.close_fd();
+        }
         let mut child = scopeguard::guard(child, |child| {
             error!("killing wal-redo-postgres process due to a problem during launch");
             child.kill_and_wait(WalRedoKillCause::Startup);
         });
 
-        let stdin = child.stdin.take().unwrap();
-        let stdout = child.stdout.take().unwrap();
-        let stderr = child.stderr.take().unwrap();
         let stderr = tokio::process::ChildStderr::from_std(stderr)
             .context("convert to tokio::ChildStderr")?;
         let stdin =
@@ -116,42 +133,9 @@ pub(crate) fn launch(
         // all fallible operations post-spawn are complete, so get rid of the guard
         let child = scopeguard::ScopeGuard::into_inner(child);
 
-        tokio::spawn(
-            async move {
-                scopeguard::defer! {
-                    debug!("wal-redo-postgres stderr_logger_task finished");
-                    crate::metrics::WAL_REDO_PROCESS_COUNTERS.active_stderr_logger_tasks_finished.inc();
-                }
-                debug!("wal-redo-postgres stderr_logger_task started");
-                crate::metrics::WAL_REDO_PROCESS_COUNTERS.active_stderr_logger_tasks_started.inc();
-
-                use tokio::io::AsyncBufReadExt;
-                let mut stderr_lines = tokio::io::BufReader::new(stderr);
-                let mut buf = Vec::new();
-                let res = loop {
-                    buf.clear();
-                    // TODO we don't trust the process to cap its stderr length.
-                    // Currently it can do unbounded Vec allocation.
-                    match stderr_lines.read_until(b'\n', &mut buf).await {
-                        Ok(0) => break Ok(()), // eof
-                        Ok(num_bytes) => {
-                            let output = String::from_utf8_lossy(&buf[..num_bytes]);
-                            if !output.contains("LOG:") {
-                               error!(%output, "received output");
-                            }
-                        }
-                        Err(e) => {
-                            break Err(e);
-                        }
-                    }
-                };
-                match res {
-                    Ok(()) => (),
-                    Err(e) => {
-                        error!(error=?e, "failed to read from walredo stderr");
-                    }
-                }
-            }.instrument(tracing::info_span!(parent: None, "wal-redo-postgres-stderr", pid = child.id(), tenant_id = %tenant_shard_id.tenant_id, shard_id = %tenant_shard_id.shard_slug(), %pg_version))
+        spawn_stderr_logger(
+            stderr,
+            tracing::info_span!(parent: None, "wal-redo-postgres-stderr", pid = child.id(), tenant_id = %tenant_shard_id.tenant_id, shard_id = %tenant_shard_id.shard_slug(), %pg_version),
         );
 
         Ok(Self {
@@ -174,11 +158,101 @@ pub(crate) fn launch(
                     n_processed_responses: 0,
                 },
             )),
+            response_lens: std::sync::Mutex::new(VecDeque::new()),
+            shmem_ring,
             #[cfg(feature = "testing")]
             dump_sequence: AtomicUsize::default(),
         })
     }
 
+    /// Start a new postgres process.
+    fn spawn(
+        conf: &'static PageServerConf,
+        tenant_shard_id: TenantShardId,
+        pg_version: PgMajorVersion,
+        shmem_ring: Option<&shmem_ring::ShmemRing>,
+    ) -> anyhow::Result<(WalRedoChild, ChildStdin, ChildStdout, ChildStderr)> {
+        use no_leak_child::NoLeakChildCommandExt;
+        let mut command = walredo_command(conf, pg_version)?;
+        command
+            // the child doesn't process this arg, but, having it in the argv helps indentify the
+            // walredo process for a particular tenant when debugging a pagserver
+            .args(["--tenant-shard-id", &format!("{tenant_shard_id}")])
+            .stdin(Stdio::piped())
+            .stderr(Stdio::piped())
+            .stdout(Stdio::piped());
+        if let Some(ring) = shmem_ring {
+            // The walredo process maps the ring before it closes its file
+            // descriptors, see below.
+            let fd = ring.raw_fd();
+            command.args(["--shmem-fd", &fd.to_string()]);
+            use std::os::fd::BorrowedFd;
+            use std::os::unix::process::CommandExt;
+
+            use nix::fcntl::{FcntlArg, FdFlag, fcntl};
+            // SAFETY: only calls fcntl(), which is async-signal-safe, between
+            // fork and exec. See `pre_exec_create_pidfile` in control_plane for
+            // the long story.
+            unsafe {
+                command.pre_exec(move || {
+                    // let the fd survive exec, in the child only
+                    fcntl(
+                        BorrowedFd::borrow_raw(fd),
+                        FcntlArg::F_SETFD(FdFlag::empty()),
+                    )?;
+                    Ok(())
+                });
+            }
+        }
+        let mut child = command
+            // NB: The redo process is not trusted after we sent it the first
+            // walredo work. Before that, it is trusted. Specifically, we trust
+            // it to
+            // 1. close all file descriptors except stdin, stdout, stderr because
+            //    pageserver might not be 100% diligent in setting FD_CLOEXEC on all
+            //    the files it opens, and
+            // 2. to use seccomp to sandbox itself before processing the first
+            //    walredo request.
+            .spawn_no_leak_child(tenant_shard_id)
+            .context("spawn process")?;
+        WAL_REDO_PROCESS_COUNTERS.started.inc();
+
+        let stdin = child.stdin.take().unwrap();
+        let stdout = child.stdout.take().unwrap();
+        let stderr = child.stderr.take().unwrap();
+        Ok((WalRedoChild::Spawned(child), stdin, stdout, stderr))
+    }
+
+    /// Fork a new process from the fork server, see [`fork_server`].
+    #[cfg(target_os = "linux")]
+    fn fork(
+        conf: &'static PageServerConf,
+        pg_version: PgMajorVersion,
+        shmem_ring: Option<&shmem_ring::ShmemRing>,
+    ) -> anyhow::Result<(WalRedoChild, ChildStdin, ChildStdout, ChildStderr)> {
+        use std::os::fd::BorrowedFd;
+
+        // SAFETY: the ring keeps the fd open until after the fork
+        let shmem_fd = shmem_ring.map(|ring| unsafe { BorrowedFd::borrow_raw(ring.raw_fd()) });
+        let forked = fork_server::fork(conf, pg_version, shmem_fd)?;
+        WAL_REDO_PROCESS_COUNTERS.started.inc();
+        Ok((
+            WalRedoChild::Forked(forked.child),
+            forked.stdin,
+            forked.stdout,
+            forked.stderr,
+        ))
+    }
+
+    #[cfg(not(target_os = "linux"))]
+    fn fork(
+        _conf: &'static PageServerConf,
+        _pg_version: PgMajorVersion,
+        _shmem_ring: Option<&shmem_ring::ShmemRing>,
+    ) -> anyhow::Result<(WalRedoChild, ChildStdin, ChildStdout, ChildStderr)> {
+        anyhow::bail!("the walredo fork server is only supported on Linux")
+    }
+
     pub(crate) fn id(&self) -> u32 {
         self.child
             .as_ref()
@@ -214,27 +288,47 @@ pub(crate) async fn apply_wal_records(
         // Most requests start with a before-image with BLCKSZ bytes, followed by
         // by some other WAL records. Start with a buffer that can hold that
         // comfortably.
+        //
+        // With the shared memory transport, the base image and the result are
+        // passed in a slot of the ring instead.
+        let slot = match &self.shmem_ring {
+            Some(ring) => Some(ring.acquire().await),
+            None => None,
+        };
         let mut writebuf: Vec<u8> = Vec::with_capacity((BLCKSZ as usize) * 3);
         protocol::build_begin_redo_for_block_msg(tag, &mut writebuf);
         if let Some(img) = base_img {
-            protocol::build_push_page_msg(tag, img, &mut writebuf);
-        }
-        for (lsn, rec) in records.iter() {
-            if let NeonWalRecord::Postgres {
-                will_init: _,
-                rec: postgres_rec,
-            } = rec
-            {
-                protocol::build_apply_record_msg(*lsn, postgres_rec, &mut writebuf);
-            } else {
-                anyhow::bail!("tried to pass neon wal record to postgres WAL redo");
+            match &slot {
+                Some(slot) => {
+                    slot.write(img);
+                    protocol::build_push_page_shmem_msg(tag, slot.slotno, &mut writebuf);
+                }
+                None => protocol::build_push_page_msg(tag, img, &mut writebuf),
             }
         }
-        protocol::build_get_page_msg(tag, &mut writebuf);
+        self.build_apply_msgs(records, &mut writebuf)?;
+        match &slot {
+            Some(slot) => protocol::build_get_page_shmem_msg(tag, slot.slotno, &mut writebuf),
+            None => protocol::build_get_page_msg(tag, &mut writebuf),
+        }
         WAL_REDO_RECORD_COUNTER.inc_by(records.len() as u64);
 
-        let Ok(res) =
-            tokio::time::timeout(wal_redo_timeout, self.apply_wal_records0(&writebuf)).await
+        let Ok(res) = tokio::time::timeout(wal_redo_timeout, async {
+            match slot {
+                Some(slot) => {
+                    let mut response = self
+                        .apply_wal_records_pages(&writebuf, 1, 4, Some(slot.slotno))
+                        .await?;
+                    let response = response.pop().expect("one response was requested");
+                    if response[..] != slot.slotno.to_be_bytes() {
+                        anyhow::bail!("unexpected WAL redo response for slot {}", slot.slotno);
+                    }
+                    Ok(slot.read())
+                }
+                None => self.apply_wal_records0(&writebuf).await,
+            }
+        })
+        .await
         else {
             anyhow::bail!("WAL redo timed out");
         };
@@ -248,6 +342,120 @@ pub(crate) async fn apply_wal_records(
         res
     }
 
+    /// Apply given WAL records ('records') to a set of pages at once, each
+    /// over its old page image, if any. Each record is decoded and applied only
+    /// once in the WAL redo process, to all the pages that it modifies. Returns
+    /// the new page images, in the order of `blocks`.
+    ///
+    /// # Cancel-Safety
+    ///
+    /// Cancellation safe.
+    #[instrument(skip_all, fields(pid=%self.id()))]
+    pub(crate) async fn apply_wal_records_multi(
+        &self,
+        blocks: &[(RelTag, u32, Option<Bytes>)],
+        records: &[(Lsn, NeonWalRecord)],
+        wal_redo_timeout: Duration,
+    ) -> anyhow::Result<Vec<Bytes>> {
+        debug_assert_current_span_has_tenant_id();
+
+        if blocks.is_empty() || blocks.len() > protocol::MAX_REDO_BLOCKS {
+            anyhow::bail!(
+                "invalid number of pages in a multi-page WAL redo request: {}",
+                blocks.len()
+            );
+        }
+        let tags: Vec<protocol::BufferTag> = blocks
+            .iter()
+            .map(|(rel, blknum, _)| protocol::BufferTag {
+                rel: *rel,
+                blknum: *blknum,
+            })
+            .collect();
+
+        let mut writebuf: Vec<u8> = Vec::with_capacity((BLCKSZ as usize) * (blocks.len() + 2));
+        protocol::build_begin_redo_for_blocks_msg(&tags, &mut writebuf);
+        for (tag, (_, _, base_img)) in tags.iter().zip(blocks) {
+            if let Some(img) = base_img {
+                protocol::build_push_page_msg(*tag, img, &mut writebuf);
+            }
+        }
+        self.build_apply_msgs(records, &mut writebuf)?;
+        protocol::build_get_pages_msg(&mut writebuf);
+        WAL_REDO_RECORD_COUNTER.inc_by(records.len() as u64);
+
+        let Ok(res) = tokio::time::timeout(
+            wal_redo_timeout,
+            self.apply_wal_records_pages(&writebuf, blocks.len(), BLCKSZ as usize, None),
+        )
+        .await
+        else {
+            anyhow::bail!("WAL redo timed out");
+        };
+
+        if res.is_err() {
+            self.record_and_log(&writebuf);
+        }
+
+        res
+    }
+
+    /// Serialize the messages that apply `records`: one `ApplyRecords` message per
+    /// [`protocol::MAX_APPLY_RECORDS_PAYLOAD`] bytes of records, or one `ApplyRecord`
+    /// message per record if `walredo_batch_records` is disabled.
+    fn build_apply_msgs(
+        &self,
+        records: &[(Lsn, NeonWalRecord)],
+        writebuf: &mut Vec<u8>,
+    ) -> anyhow::Result<()> {
+        let mut batch: Vec<(Lsn, &[u8])> = Vec::new();
+        let mut batch_len = 0;
+        for (lsn, rec) in records.iter() {
+            let NeonWalRecord::Postgres {
+                will_init: _,
+                rec: postgres_rec,
+            } = rec
+            else {
+                anyhow::bail!("tried to pass neon wal record to postgres WAL redo");
+            };
+            if !self.conf.walredo_batch_records {
+                protocol::build_apply_record_msg(*lsn, postgres_rec, writebuf);
+                continue;
+            }
+            let entry_len = protocol::apply_records_entry_len(postgres_rec);
+            if !batch.is_empty() && batch_len + entry_len > protocol::MAX_APPLY_RECORDS_PAYLOAD {
+                protocol::build_apply_records_msg(&batch, writebuf);
+                batch.clear();
+                batch_len = 0;
+            }
+            batch.push((*lsn, postgres_rec));
+            batch_len += entry_len;
+        }
+        if !batch.is_empty() {
+            protocol::build_apply_records_msg(&batch, writebuf);
+        }
+        Ok(())
+    }
+
+    /// Query the counters of the WAL redo process.
+    pub(crate) async fn stats(&self, timeout: Duration) -> anyhow::Result<WalRedoStats> {
+        let mut writebuf: Vec<u8> = Vec::with_capacity(5);
+        protocol::build_get_stats_msg(&mut writebuf);
+        let Ok(res) = tokio::time::timeout(
+            timeout,
+            self.apply_wal_records_pages(&writebuf, 1, protocol::STATS_RESPONSE_LEN, None),
+        )
+        .await
+        else {
+            anyhow::bail!("WAL redo stats request timed out");
+        };
+        let mut response = res?.pop().expect("one response was requested");
+        Ok(WalRedoStats {
+            records_applied: response.get_u64(),
+            records_skipped: response.get_u64(),
+        })
+    }
+
     /// Do a ping request-response roundtrip.
     ///
     /// Not used in production, but by Rust benchmarks.
@@ -275,6 +483,32 @@ pub(crate) async fn ping(&self, timeout: Duration) -> anyhow::Result<()> {
     /// calls may fail due to [`utils::poison::Poison::check_and_arm`] calls.
     /// Dispose of this process instance and create a new one.
     async fn apply_wal_records0(&self, writebuf: &[u8]) -> anyhow::Result<Bytes> {
+        let mut pages = self
+            .apply_wal_records_pages(writebuf, 1, BLCKSZ as usize, None)
+            .await?;
+        Ok(pages.pop().expect("one page was requested"))
+    }
+
+    /// Like [`Self::apply_wal_records0`], for requests that are answered with
+    /// `n_pages` responses of `response_len` bytes each: page images, or
+    /// slot numbers with the shared memory transport. Each response takes one
+    /// slot in `pending_responses`, so all kinds of requests can be mixed.
+    ///
+    /// A request that uses `shmem_slot` of the shared memory ring must have
+    /// one response. Whoever reads that response from stdout tells the ring,
+    /// so that the slot is returned even if this request is cancelled.
+    ///
+    /// # Cancel-Safety
+    ///
+    /// Same as [`Self::apply_wal_records0`].
+    async fn apply_wal_records_pages(
+        &self,
+        writebuf: &[u8],
+        n_pages: usize,
+        response_len: usize,
+        shmem_slot: Option<u32>,
+    ) -> anyhow::Result<Vec<Bytes>> {
+        assert!(shmem_slot.is_none() || n_pages == 1);
         let request_no = {
             let mut lock_guard = self.stdin.lock().await;
             let mut poison_guard = lock_guard.check_and_arm()?;
@@ -285,7 +519,17 @@ async fn apply_wal_records0(&self, writebuf: &[u8]) -> anyhow::Result<Bytes> {
                 .await
                 .context("write to walredo stdin")?;
             let request_no = input.n_requests;
-            input.n_requests += 1;
+            input.n_requests += n_pages;
+            self.response_lens
+                .lock()
+                .unwrap()
+                .extend(std::iter::repeat_n((response_len, shmem_slot), n_pages));
+            if let Some(slotno) = shmem_slot {
+                self.shmem_ring
+                    .as_ref()
+                    .expect("shared memory slot without a ring")
+                    .sent(slotno);
+            }
             poison_guard.disarm();
             request_no
         };
@@ -306,15 +550,27 @@ async fn apply_wal_records0(&self, writebuf: &[u8]) -> anyhow::Result<Bytes> {
         let mut poison_guard = lock_guard.check_and_arm()?;
         let output = poison_guard.data_mut();
         let n_processed_responses = output.n_processed_responses;
-        while n_processed_responses + output.pending_responses.len() <= request_no {
-            // We expect the WAL redo process to respond with an 8k page image. We read it
-            // into this buffer.
-            let mut resultbuf = vec![0; BLCKSZ.into()];
+        while n_processed_responses + output.pending_responses.len() < request_no + n_pages {
+            // We expect the WAL redo process to respond with an 8k page image, or a slot
+            // number. We read it into this buffer.
+            let (response_len, shmem_slot) = self
+                .response_lens
+                .lock()
+                .unwrap()
+                .pop_front()
+                .expect("every request pushes the length of its responses");
+            let mut resultbuf = vec![0; response_len];
             output
                 .stdout
                 .read_exact(&mut resultbuf)
                 .await
                 .context("read walredo stdout")?;
+            if let Some(slotno) = shmem_slot {
+                self.shmem_ring
+                    .as_ref()
+                    .expect("shared memory slot without a ring")
+                    .answered(slotno);
+            }
             output
                 .pending_responses
                 .push_back(Some(Bytes::from(resultbuf)));
@@ -351,9 +607,13 @@ async fn apply_wal_records0(&self, writebuf: &[u8]) -> anyhow::Result<Bytes> {
         // T2: does the while loop below
         // pending_responses now looks like this: Front Back
         // n_processed_responses now has value 25
-        let res = output.pending_responses[request_no - n_processed_responses]
-            .take()
-            .expect("we own this request_no, nobody else is supposed to take it");
+        let res = (0..n_pages)
+            .map(|i| {
+                output.pending_responses[request_no - n_processed_responses + i]
+                    .take()
+                    .expect("we own this request_no, nobody else is supposed to take it")
+            })
+            .collect();
         while let Some(front) = output.pending_responses.front() {
             if front.is_none() {
                 output.pending_responses.pop_front();
@@ -402,6 +662,76 @@ fn record_and_log(&self, writebuf: &[u8]) {
     fn record_and_log(&self, _: &[u8]) {}
 }
 
+/// The postgres command in WAL redo mode, without its stdio.
+fn walredo_command(
+    conf: &'static PageServerConf,
+    pg_version: PgMajorVersion,
+) -> anyhow::Result<Command> {
+    let pg_bin_dir_path = conf.pg_bin_dir(pg_version).context("pg_bin_dir")?; // TODO these should be infallible.
+    let pg_lib_dir_path = conf.pg_lib_dir(pg_version).context("pg_lib_dir")?;
+
+    let mut command = Command::new(pg_bin_dir_path.join("postgres"));
+    command
+        // the first arg must be --wal-redo so the child process enters into walredo mode
+        .arg("--wal-redo")
+        .env_clear()
+        .env("LD_LIBRARY_PATH", &pg_lib_dir_path)
+        .env("DYLD_LIBRARY_PATH", &pg_lib_dir_path)
+        .env(
+            "ASAN_OPTIONS",
+            std::env::var("ASAN_OPTIONS").unwrap_or_default(),
+        )
+        .env(
+            "UBSAN_OPTIONS",
+            std::env::var("UBSAN_OPTIONS").unwrap_or_default(),
+        );
+    Ok(command)
+}
+
+/// Log what a walredo process writes to its stderr, until it exits.
+fn spawn_stderr_logger(stderr: tokio::process::ChildStderr, span: tracing::Span) {
+    tokio::spawn(
+        async move {
+            scopeguard::defer! {
+                debug!("wal-redo-postgres stderr_logger_task finished");
+                crate::metrics::WAL_REDO_PROCESS_COUNTERS.active_stderr_logger_tasks_finished.inc();
+            }
+            debug!("wal-redo-postgres stderr_logger_task started");
+            crate::metrics::WAL_REDO_PROCESS_COUNTERS
+                .active_stderr_logger_tasks_started
+                .inc();
+
+            use tokio::io::AsyncBufReadExt;
+            let mut stderr_lines = tokio::io::BufReader::new(stderr);
+            let mut buf = Vec::new();
+            let res = loop {
+                buf.clear();
+                // TODO we don't trust the process to cap its stderr length.
+                // Currently it can do unbounded Vec allocation.
+                match stderr_lines.read_until(b'\n', &mut buf).await {
+                    Ok(0) => break Ok(()), // eof
+                    Ok(num_bytes) => {
+                        let output = String::from_utf8_lossy(&buf[..num_bytes]);
+                        if !output.contains("LOG:") {
+                            error!(%output, "received output");
+                        }
+                    }
+                    Err(e) => {
+                        break Err(e);
+                    }
+                }
+            };
+            match res {
+                Ok(()) => (),
+                Err(e) => {
+                    error!(error=?e, "failed to read from walredo stderr");
+                }
+            }
+        }
+        .instrument(span),
+    );
+}
+
 impl Drop for WalRedoProcess {
     fn drop(&mut self) {
         self.child
@@ -0,0 +1,252 @@
+//! Fork server for walredo processes.
+//!
+//! Starting a walredo process runs the whole postgres startup in it, which
+//! takes a few milliseconds and leaves every process with its own copy of the
+//! memory that the startup touched. With `walredo_fork_server`, one process
+//! per postgres version is started with `--fork-server`, and does the startup
+//! once. New walredo processes are forks of it, which are ready to serve
+//! right away, and share the pages of the template copy-on-write.
+//!
+//! We talk to the fork server over a Unix socket on its stdin: we send it
+//! the stdin, stdout and stderr for a new process, and the shared memory ring
+//! if there is one, and it returns the pid of the fork, and a pidfd for it.
+//! The forks are children of the fork server, not ours, so we can only
+//! signal and wait for them through the pidfd. The fork server ignores
+//! SIGCHLD, so that they get reaped when they exit, and creates the pidfd
+//! together with the fork, so that it can't refer to a reused pid.
+//!
+//! The forks enter seccomp mode themselves, before they process any request,
+//! like the processes that we start directly. The fork server never processes
+//! a request, so it stays trusted.
+//!
+//! This relies on pidfds, so it's only available on Linux.
+
+use std::collections::BTreeMap;
+use std::io::{IoSlice, IoSliceMut};
+use std::os::fd::{AsFd, AsRawFd, BorrowedFd, FromRawFd, OwnedFd, RawFd};
+use std::process::{Child, ChildStderr, ChildStdin, ChildStdout, Stdio};
+
+use anyhow::Context;
+use once_cell::sync::Lazy;
+use postgres_ffi::PgMajorVersion;
+use tracing::{error, info, instrument};
+
+use crate::config::PageServerConf;
+use crate::metrics::{WAL_REDO_PROCESS_COUNTERS, WalRedoKillCause};
+
+/// The running fork servers. A fork server is started on first use, and
+/// replaced if a fork request to it fails.
+static FORK_SERVERS: Lazy<std::sync::Mutex<BTreeMap<PgMajorVersion, ForkServer>>> =
+    Lazy::new(Default::default);
+
+struct ForkServer {
+    child: Child,
+    control: OwnedFd,
+}
+
+/// A walredo process forked by a fork server, to be killed and waited for
+/// through its pidfd.
+pub(crate) struct ForkedChild {
+    pid: u32,
+    pidfd: OwnedFd,
+}
+
+pub(crate) struct Forked {
+    pub(crate) child: ForkedChild,
+    pub(crate) stdin: ChildStdin,
+    pub(crate) stdout: ChildStdout,
+    pub(crate) stderr: ChildStderr,
+}
+
+/// Fork a new walredo process from the fork server for `pg_version`,
+/// starting the fork server if needed. `shmem_fd` is the shared memory ring
+/// for the new process, if any.
+pub(crate) fn fork(
+    conf: &'static PageServerConf,
+    pg_version: PgMajorVersion,
+    shmem_fd: Option<BorrowedFd<'_>>,
+) -> anyhow::Result<Forked> {
+    use nix::fcntl::OFlag;
+    use nix::unistd::pipe2;
+
+    let (stdin_read, stdin_write) = pipe2(OFlag::O_CLOEXEC).context("create stdin pipe")?;
+    let (stdout_read, stdout_write) = pipe2(OFlag::O_CLOEXEC).context("create stdout pipe")?;
+    let (stderr_read, stderr_write) = pipe2(OFlag::O_CLOEXEC).context("create stderr pipe")?;
+    let mut fds = vec![
+        stdin_read.as_raw_fd(),
+        stdout_write.as_raw_fd(),
+        stderr_write.as_raw_fd(),
+    ];
+    if let Some(fd) = shmem_fd {
+        fds.push(fd.as_raw_fd());
+    }
+
+    let mut servers = FORK_SERVERS.lock().unwrap();
+    let server = match servers.entry(pg_version) {
+        std::collections::btree_map::Entry::Occupied(e) => e.into_mut(),
+        std::collections::btree_map::Entry::Vacant(e) => {
+            e.insert(ForkServer::spawn(conf, pg_version).context("start walredo fork server")?)
+        }
+    };
+    let child = match server.fork(&fds) {
+        Ok(child) => child,
+        Err(e) => {
+            // The fork server may have died, or the socket is out of sync;
+            // start a new one for the next request.
+            servers.remove(&pg_version);
+            return Err(e.context("fork walredo process"));
+        }
+    };
+    drop(servers);
+
+    // The fork has its own copies of the other ends now.
+    drop((stdin_read, stdout_write, stderr_write));
+
+    Ok(Forked {
+        child,
+        stdin: ChildStdin::from(stdin_write),
+        stdout: ChildStdout::from(stdout_read),
+        stderr: ChildStderr::from(stderr_read),
+    })
+}
+
+impl ForkServer {
+    fn spawn(conf: &'static PageServerConf, pg_version: PgMajorVersion) -> anyhow::Result<Self> {
+        use nix::sys::socket::{AddressFamily, SockFlag, SockType, socketpair};
+
+        let (control, theirs) = socketpair(
+            AddressFamily::Unix,
+            SockType::Stream,
+            None,
+            SockFlag::SOCK_CLOEXEC,
+        )
+        .context("create control socket")?;
+
+        let mut child = super::walredo_command(conf, pg_version)?
+            .arg("--fork-server")
+            .stdin(Stdio::from(theirs))
+            .stdout(Stdio::null())
+            .stderr(Stdio::piped())
+            .spawn()
+            .context("spawn process")?;
+        info!(pid = child.id(), %pg_version, "started walredo fork server");
+
+        let stderr = child.stderr.take().unwrap();
+        match tokio::process::ChildStderr::from_std(stderr) {
+            Ok(stderr) => super::spawn_stderr_logger(
+                stderr,
+                tracing::info_span!(parent: None, "wal-redo-postgres-stderr", pid = child.id(), fork_server = true, %pg_version),
+            ),
+            Err(e) => {
+                let _ = child.kill();
+                let _ = child.wait();
+                return Err(e).context("convert to tokio::ChildStderr");
+            }
+        }
+
+        Ok(ForkServer { child, control })
+    }
+
+    fn fork(&self, fds: &[RawFd]) -> anyhow::Result<ForkedChild> {
+        use nix::sys::socket::{ControlMessage, ControlMessageOwned, MsgFlags, recvmsg, sendmsg};
+
+        let sent = sendmsg::<()>(
+            self.control.as_raw_fd(),
+            &[IoSlice::new(b"F")],
+            &[ControlMessage::ScmRights(fds)],
+            MsgFlags::empty(),
+            None,
+        )
+        .context("send fork request")?;
+        anyhow::ensure!(sent == 1, "short write of fork request");
+
+        let mut pid = [0u8; 4];
+        let mut cmsg_buffer = nix::cmsg_space!(RawFd);
+        let mut iov = [IoSliceMut::new(&mut pid)];
+        let msg = recvmsg::<()>(
+            self.control.as_raw_fd(),
+            &mut iov,
+            Some(&mut cmsg_buffer),
+            MsgFlags::MSG_CMSG_CLOEXEC,
+        )
+        .context("receive fork response")?;
+        let bytes = msg.bytes;
+
+        // Take ownership of the pidfd first, so that it's closed on error.
+        let mut pidfd = None;
+        for cmsg in msg.cmsgs().context("fork response")? {
+            if let ControlMessageOwned::ScmRights(received) = cmsg {
+                for fd in received {
+                    // SAFETY: the fd was just received, nothing else owns it
+                    let fd = unsafe { OwnedFd::from_raw_fd(fd) };
+                    pidfd.get_or_insert(fd);
+                }
+            }
+        }
+        anyhow::ensure!(bytes == pid.len(), "short read of fork response");
+        let pidfd = pidfd.context("no pidfd in fork response")?;
+
+        Ok(ForkedChild {
+            pid: u32::from_be_bytes(pid),
+            pidfd,
+        })
+    }
+}
+
+impl Drop for ForkServer {
+    fn drop(&mut self) {
+        // Its forks keep running, they're only reparented.
+        let _ = self.child.kill();
+        if let Err(e) = self.child.wait() {
+            error!(error = %e, "failed to wait for walredo fork server");
+        }
+    }
+}
+
+impl ForkedChild {
+    pub(crate) fn id(&self) -> u32 {
+        self.pid
+    }
+
+    #[instrument(skip_all, fields(pid=self.pid, ?cause))]
+    pub(crate) fn kill_and_wait(self, cause: WalRedoKillCause) {
+        use nix::poll::{PollFd, PollFlags, PollTimeout, poll};
+
+        scopeguard::defer! {
+            WAL_REDO_PROCESS_COUNTERS.killed_by_cause[cause].inc();
+        }
+        // SAFETY: plain syscall on a pidfd that we own. Unlike kill(), this
+        // can't hit another process if the pid was reused.
+        let res = unsafe {
+            libc::syscall(
+                libc::SYS_pidfd_send_signal,
+                self.pidfd.as_raw_fd(),
+                libc::SIGKILL,
+                std::ptr::null::<libc::siginfo_t>(),
+                0,
+            )
+        };
+        if res != 0 {
+            // ESRCH if it's already gone, which is fine
+            let e = std::io::Error::last_os_error();
+            if e.raw_os_error() != Some(libc::ESRCH) {
+                error!(error = %e, "failed to SIGKILL");
+                return;
+            }
+        }
+
+        // The pidfd becomes readable when the process has exited.
+        let mut fds = [PollFd::new(self.pidfd.as_fd(), PollFlags::POLLIN)];
+        loop {
+            match poll(&mut fds, PollTimeout::NONE) {
+                Ok(_) => break,
+                Err(nix::errno::Errno::EINTR) => continue,
+                Err(e) => {
+                    error!(error = %e, "failed to wait for exit; the process might leak");
+                    return;
+                }
+            }
+        }
+        info!("wait successful");
+    }
+}
@@ -16,6 +16,10 @@ pub(crate) struct BufferTag {
     pub blknum: u32,
 }
 
+/// Maximum number of blocks in a `BeginRedoForBlocks` message, `MAX_REDO_TARGETS`
+/// in walredoproc.c.
+pub(crate) const MAX_REDO_BLOCKS: usize = 16;
+
 pub(crate) fn build_begin_redo_for_block_msg(tag: BufferTag, buf: &mut Vec<u8>) {
     let len = 4 + 1 + 4 * 4;
 
@@ -26,6 +30,20 @@ pub(crate) fn build_begin_redo_for_block_msg(tag: BufferTag, buf: &mut Vec<u8>)
         .expect("serialize BufferTag should always succeed");
 }
 
+pub(crate) fn build_begin_redo_for_blocks_msg(tags: &[BufferTag], buf: &mut Vec<u8>) {
+    assert!(!tags.is_empty() && tags.len() <= MAX_REDO_BLOCKS);
+
+    let len = 4 + 4 + tags.len() * (1 + 4 * 4);
+
+    buf.put_u8(b'b');
+    buf.put_u32(len as u32);
+    buf.put_u32(tags.len() as u32);
+    for tag in tags {
+        tag.ser_into(buf)
+            .expect("serialize BufferTag should always succeed");
+    }
+}
+
 pub(crate) fn build_push_page_msg(tag: BufferTag, base_img: &[u8], buf: &mut Vec<u8>) {
     assert!(base_img.len() == 8192);
 
@@ -38,6 +56,16 @@ pub(crate) fn build_push_page_msg(tag: BufferTag, base_img: &[u8], buf: &mut Vec
     buf.put(base_img);
 }
 
+pub(crate) fn build_push_page_shmem_msg(tag: BufferTag, slotno: u32, buf: &mut Vec<u8>) {
+    let len = 4 + 1 + 4 * 4 + 4;
+
+    buf.put_u8(b'p');
+    buf.put_u32(len as u32);
+    tag.ser_into(buf)
+        .expect("serialize BufferTag should always succeed");
+    buf.put_u32(slotno);
+}
+
 pub(crate) fn build_apply_record_msg(endlsn: Lsn, rec: &[u8], buf: &mut Vec<u8>) {
     let len = 4 + 8 + rec.len();
 
@@ -47,6 +75,39 @@ pub(crate) fn build_apply_record_msg(endlsn: Lsn, rec: &[u8], buf: &mut Vec<u8>)
     buf.put(rec);
 }
 
+/// Soft limit on the payload of an `ApplyRecords` message. Longer record
+/// sequences are split into several messages, to bound the size of the input
+/// buffer in the walredo process.
+pub(crate) const MAX_APPLY_RECORDS_PAYLOAD: usize = 1024 * 1024;
+
+/// Size of one record in the payload of an `ApplyRecords` message.
+pub(crate) fn apply_records_entry_len(rec: &[u8]) -> usize {
+    8 + 4 + 4 + rec.len().next_multiple_of(8)
+}
+
+pub(crate) fn build_apply_records_msg(records: &[(Lsn, &[u8])], buf: &mut Vec<u8>) {
+    let len = 4
+        + 4
+        + 4
+        + records
+            .iter()
+            .map(|(_, rec)| apply_records_entry_len(rec))
+            .sum::<usize>();
+
+    buf.put_u8(b'a');
+    buf.put_u32(len as u32);
+    buf.put_u32(records.len() as u32);
+    buf.put_u32(0);
+    for (endlsn, rec) in records {
+        buf.put_u64(endlsn.0);
+        buf.put_u32(rec.len() as u32);
+        buf.put_u32(0);
+        buf.put(*rec);
+        // keep the next record 8-byte aligned in the walredo process
+        buf.put_bytes(0, rec.len().next_multiple_of(8) - rec.len());
+    }
+}
+
 pub(crate) fn build_get_page_msg(tag: BufferTag, buf: &mut Vec<u8>) {
     let len = 4 + 1 + 4 * 4;
 
@@ -56,6 +117,30 @@ pub(crate) fn build_get_page_msg(tag: BufferTag, buf: &mut Vec<u8>) {
         .expect("serialize BufferTag should always succeed");
 }
 
+pub(crate) fn build_get_page_shmem_msg(tag: BufferTag, slotno: u32, buf: &mut Vec<u8>) {
+    let len = 4 + 1 + 4 * 4 + 4;
+
+    buf.put_u8(b'r');
+    buf.put_u32(len as u32);
+    tag.ser_into(buf)
+        .expect("serialize BufferTag should always succeed");
+    buf.put_u32(slotno);
+}
+
+pub(crate) fn build_get_pages_msg(buf: &mut Vec<u8>) {
+    buf.put_u8(b'g');
+    buf.put_u32(4);
+}
+
+/// Length of the response to a GetStats message: the number of records applied
+/// and skipped, as u64s.
+pub(crate) const STATS_RESPONSE_LEN: usize = 16;
+
+pub(crate) fn build_get_stats_msg(buf: &mut Vec<u8>) {
+    buf.put_u8(b'S');
+    buf.put_u32(4);
+}
+
 pub(crate) fn build_ping_msg(buf: &mut Vec<u8>) {
     buf.put_u8(b'H');
     buf.put_u32(4);
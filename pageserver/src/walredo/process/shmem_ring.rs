@@ -0,0 +1,223 @@
+//! Shared memory ring for passing page images to and from the walredo process
+//! in place, instead of through its stdin/stdout pipes.
+//!
+//! The ring is a memfd with [`N_SLOTS`] slots of `BLCKSZ` bytes. The walredo
+//! process inherits the fd, maps it before it enters seccomp mode, and closes
+//! it. A request takes a slot for its base image and result, and tells the
+//! walredo process which one in its messages. The messages on the pipes order
+//! the accesses to a slot between the two processes.
+//!
+//! A slot whose request was cancelled after it was sent may still be written
+//! by the walredo process, until it has answered the request. Like the
+//! response on the pipe, the slot is then left behind, and whoever reads the
+//! response from the pipe returns the slot to the ring.
+//!
+//! The walredo process is not trusted, it can scribble over the whole ring at
+//! any time. We only ever copy bytes out of a slot, and the worst it can do
+//! is to corrupt its own tenant's page images, same as through the pipe.
+
+use std::os::fd::{AsRawFd, OwnedFd, RawFd};
+
+use bytes::Bytes;
+use postgres_ffi::BLCKSZ;
+
+/// Number of slots in the ring, which bounds the number of in-flight requests
+/// that use it. The file is sized with `ftruncate`, so only the slots that
+/// get used take memory.
+pub(crate) const N_SLOTS: usize = 32;
+
+pub(crate) struct ShmemRing {
+    /// Only needed until the walredo process is spawned
+    fd: Option<OwnedFd>,
+    ptr: std::ptr::NonNull<u8>,
+    slots: std::sync::Mutex<Slots>,
+    /// One permit per slot in [`Slots::free`]
+    slots_available: tokio::sync::Semaphore,
+}
+
+struct Slots {
+    free: Vec<u32>,
+    state: [SlotState; N_SLOTS],
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+enum SlotState {
+    Free,
+    /// Held by a request that hasn't been sent yet
+    Taken,
+    /// The request was sent, the walredo process may be using the slot
+    Sent,
+    /// The walredo process has answered the request, and is done with the slot
+    Answered,
+    /// The request was cancelled after it was sent; the slot is returned once
+    /// the response has been read
+    Orphaned,
+}
+
+// SAFETY: the mapping is only accessed through raw pointer copies, and a slot
+// is only used by the holder of its `Slot` guard.
+unsafe impl Send for ShmemRing {}
+unsafe impl Sync for ShmemRing {}
+
+/// A slot of the ring, returned to the ring on drop, unless the walredo
+/// process may still be using it.
+pub(crate) struct Slot<'a> {
+    ring: &'a ShmemRing,
+    pub(crate) slotno: u32,
+}
+
+impl ShmemRing {
+    #[cfg(target_os = "linux")]
+    pub(crate) fn new() -> anyhow::Result<Self> {
+        use std::num::NonZeroUsize;
+
+        use anyhow::Context;
+        use nix::sys::memfd::{MFdFlags, memfd_create};
+        use nix::sys::mman::{MapFlags, ProtFlags, mmap};
+
+        let size = N_SLOTS * BLCKSZ as usize;
+        let fd = memfd_create("walredo-ring", MFdFlags::MFD_CLOEXEC).context("memfd_create")?;
+        nix::unistd::ftruncate(&fd, size as i64).context("ftruncate")?;
+        // SAFETY: a new shared mapping of a file that we own
+        let ptr = unsafe {
+            mmap(
+                None,
+                NonZeroUsize::new(size).unwrap(),
+                ProtFlags::PROT_READ | ProtFlags::PROT_WRITE,
+                MapFlags::MAP_SHARED,
+                &fd,
+                0,
+            )
+        }
+        .context("mmap")?;
+
+        Ok(ShmemRing {
+            fd: Some(fd),
+            ptr: ptr.cast(),
+            // hand out the low slots first, so that only as many pages as
+            // there are concurrent requests get touched
+            slots: std::sync::Mutex::new(Slots {
+                free: (0..N_SLOTS as u32).rev().collect(),
+                state: [SlotState::Free; N_SLOTS],
+            }),
+            slots_available: tokio::sync::Semaphore::new(N_SLOTS),
+        })
+    }
+
+    #[cfg(not(target_os = "linux"))]
+    pub(crate) fn new() -> anyhow::Result<Self> {
+        anyhow::bail!("the walredo shared memory transport is only supported on Linux")
+    }
+
+    /// The fd to pass to the walredo process.
+    pub(crate) fn raw_fd(&self) -> RawFd {
+        self.fd
+            .as_ref()
+            .expect("fd is only closed after spawning")
+            .as_raw_fd()
+    }
+
+    /// Close the fd once the walredo process has inherited it; the mappings
+    /// stay.
+    pub(crate) fn close_fd(&mut self) {
+        self.fd = None;
+    }
+
+    /// Wait for a free slot.
+    pub(crate) async fn acquire(&self) -> Slot<'_> {
+        // The permit is given back when the slot is freed, see `free`
+        self.slots_available
+            .acquire()
+            .await
+            .expect("semaphore is never closed")
+            .forget();
+        let mut slots = self.slots.lock().unwrap();
+        let slotno = slots
+            .free
+            .pop()
+            .expect("a permit means there is a free slot");
+        slots.state[slotno as usize] = SlotState::Taken;
+        Slot { ring: self, slotno }
+    }
+
+    /// Called once the request that uses the slot has been written to the
+    /// walredo process's stdin.
+    pub(crate) fn sent(&self, slotno: u32) {
+        let mut slots = self.slots.lock().unwrap();
+        assert_eq!(slots.state[slotno as usize], SlotState::Taken);
+        slots.state[slotno as usize] = SlotState::Sent;
+    }
+
+    /// Called by whoever reads the response to the request that uses the slot
+    /// from the walredo process's stdout. Frees the slot if its request was
+    /// cancelled in the meantime.
+    pub(crate) fn answered(&self, slotno: u32) {
+        let mut slots = self.slots.lock().unwrap();
+        match slots.state[slotno as usize] {
+            SlotState::Sent => slots.state[slotno as usize] = SlotState::Answered,
+            SlotState::Orphaned => self.free(&mut slots, slotno),
+            state => panic!("response for walredo shared memory slot {slotno} in state {state:?}"),
+        }
+    }
+
+    fn free(&self, slots: &mut Slots, slotno: u32) {
+        slots.state[slotno as usize] = SlotState::Free;
+        slots.free.push(slotno);
+        self.slots_available.add_permits(1);
+    }
+
+    fn slot_ptr(&self, slotno: u32) -> *mut u8 {
+        assert!((slotno as usize) < N_SLOTS);
+        // SAFETY: in bounds of the mapping
+        unsafe { self.ptr.as_ptr().add(slotno as usize * BLCKSZ as usize) }
+    }
+}
+
+impl Slot<'_> {
+    pub(crate) fn write(&self, img: &[u8]) {
+        assert_eq!(img.len(), BLCKSZ as usize);
+        // SAFETY: we own the slot; the walredo process doesn't touch it until
+        // we send the message that refers to it.
+        unsafe {
+            std::ptr::copy_nonoverlapping(img.as_ptr(), self.ring.slot_ptr(self.slotno), img.len())
+        };
+    }
+
+    /// Read the result, after the walredo process has responded.
+    pub(crate) fn read(&self) -> Bytes {
+        let mut page = vec![0u8; BLCKSZ as usize];
+        assert_eq!(
+            self.ring.slots.lock().unwrap().state[self.slotno as usize],
+            SlotState::Answered
+        );
+        // SAFETY: the walredo process has responded, so it's done with the slot.
+        unsafe {
+            std::ptr::copy_nonoverlapping(
+                self.ring.slot_ptr(self.slotno),
+                page.as_mut_ptr(),
+                page.len(),
+            )
+        };
+        Bytes::from(page)
+    }
+}
+
+impl Drop for Slot<'_> {
+    fn drop(&mut self) {
+        let mut slots = self.ring.slots.lock().unwrap();
+        match slots.state[self.slotno as usize] {
+            SlotState::Taken | SlotState::Answered => self.ring.free(&mut slots, self.slotno),
+            // leave it to whoever reads the response, see `answered`
+            SlotState::Sent => slots.state[self.slotno as usize] = SlotState::Orphaned,
+            state => unreachable!("dropped walredo shared memory slot in state {state:?}"),
+        }
+    }
+}
+
+impl Drop for ShmemRing {
+    fn drop(&mut self) {
+        // SAFETY: the mapping was created in `new` with this size, and no
+        // `Slot` can outlive the ring.
+        let _ = unsafe { nix::sys::mman::munmap(self.ptr.cast(), N_SLOTS * BLCKSZ as usize) };
+    }
+}
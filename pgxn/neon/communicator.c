@@ -65,7 +65,12 @@
 #include "port/pg_iovec.h"
 #include "postmaster/interrupt.h"
 #include "replication/walsender.h"
+#include "storage/condition_variable.h"
 #include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/memutils.h"
 #include "utils/timeout.h"
 
 #include "bitmap.h"
@@ -172,16 +177,19 @@ typedef enum PrefetchStatus
 	PRFS_UNUSED = 0,			/* unused slot */
 	PRFS_REQUESTED,				/* request was written to the sendbuffer to
 								 * PS, but not necessarily flushed. all fields
-								 * except response valid */
+								 * except response valid; response is set if
+								 * prefetch_gather() received it early */
 	PRFS_RECEIVED,				/* all fields valid */
 	PRFS_TAG_REMAINS,			/* only buftag and my_ring_index are still
 								 * valid */
 } PrefetchStatus;
 
-/* must fit in uint8; bits 0x1 are used */
+/* must fit in uint8; bits 0x1, 0x2 and 0x4 are used */
 typedef enum {
 	PRFSF_NONE	= 0x0,
-	PRFSF_LFC	= 0x1  /* received prefetch result is stored in LFC */
+	PRFSF_LFC	= 0x1, /* received prefetch result is stored in LFC */
+	PRFSF_IN_TARGET	= 0x2, /* received page is stored in target, not response */
+	PRFSF_SHARED	= 0x4  /* request is published in the shared in-flight table */
 } PrefetchRequestFlags;
 
 typedef struct PrefetchRequest
@@ -194,6 +202,9 @@ typedef struct PrefetchRequest
 	NeonRequestId reqid;
 	NeonResponse *response;		/* may be null */
 	uint64		my_ring_index;
+	void	   *target;			/* buffer of a synchronous reader waiting for
+								 * this page, or NULL; see
+								 * prefetch_receive_target() */
 } PrefetchRequest;
 
 /* prefetch buffer lookup hash table */
@@ -268,6 +279,36 @@ typedef struct PrefetchState
 
 static PrefetchState *MyPState;
 
+/*
+ * Effective prefetch depth with neon.readahead_adaptive, see
+ * readahead_adapt(). 0 until the first adjustment.
+ */
+static int	readahead_depth = 0;
+
+/*
+ * GetPage requests in flight in all backends, see PrefetchShmemRequest().
+ * Only set up with neon.shared_prefetch_size > 0.
+ */
+#define SHARED_PREFETCH_PARTITIONS 16
+
+typedef struct SharedPrefetchEntry
+{
+	BufferTag	tag;			/* hash key */
+	NeonRequestId reqid;
+	int			owner;			/* MyProcNumber of the requesting backend */
+	neon_request_lsns request_lsns;
+} SharedPrefetchEntry;
+
+typedef struct SharedPrefetchControl
+{
+	/* signalled when a request of the partition completes */
+	ConditionVariable cv[SHARED_PREFETCH_PARTITIONS];
+} SharedPrefetchControl;
+
+static HTAB *shared_prefetch_hash;
+static LWLockPadded *shared_prefetch_locks;
+static SharedPrefetchControl *shared_prefetch_ctl;
+
 #define GetPrfSlotNoCheck(ring_index) ( \
 	&MyPState->prf_buffer[((ring_index) % readahead_buffer_size)] \
 )
@@ -296,13 +337,29 @@ static uint64 prefetch_register_bufferv(BufferTag tag, neon_request_lsns *frlsns
 										BlockNumber nblocks, const bits8 *mask,
 										bool is_prefetch);
 static bool prefetch_read(PrefetchRequest *slot);
-static void prefetch_do_request(PrefetchRequest *slot, neon_request_lsns *force_request_lsns);
+static void prefetch_receive_response(PrefetchRequest *slot, NeonResponse *response);
+static PrefetchRequest *prefetch_receive_target(NeonResponse *hdr, BlockNumber blkno,
+												int offset);
+static void prefetch_drop_targets(void);
+static void prefetch_do_request(PrefetchRequest *slot, neon_request_lsns *force_request_lsns,
+								int nblocks);
 static bool prefetch_wait_for(uint64 ring_index);
+static bool prefetch_gather(uint64 ring_index);
+static NeonResponse *prefetch_take_early_response(PrefetchRequest *slot);
 static void prefetch_cleanup_trailing_unused(void);
 static inline void prefetch_set_unused(uint64 ring_index);
 
 static bool neon_prefetch_response_usable(neon_request_lsns *request_lsns,
 										  PrefetchRequest *slot);
+static void readahead_adapt(void);
+static int	readahead_flush_batch(void);
+
+static void shared_prefetch_publish(PrefetchRequest *slot);
+static void shared_prefetch_unpublish(PrefetchRequest *slot);
+static bool shared_prefetch_lookup(BufferTag *tag, neon_request_lsns *lsns,
+								   NeonRequestId *reqid);
+static bool shared_prefetch_wait(BufferTag *tag, NeonRequestId reqid);
+static void shared_prefetch_on_exit(int code, Datum arg);
 static bool communicator_processinterrupts(void);
 
 void
@@ -371,6 +428,7 @@ compact_prefetch_buffers(void)
 		target_slot->reqid = source_slot->reqid;
 		target_slot->request_lsns = source_slot->request_lsns;
 		target_slot->my_ring_index = empty_ring_index;
+		target_slot->target = source_slot->target;
 
 		prfh_delete(MyPState->prf_hash, source_slot);
 		prfh_insert(MyPState->prf_hash, target_slot, &found);
@@ -388,6 +446,7 @@ compact_prefetch_buffers(void)
 		};
 		source_slot->response = NULL;
 		source_slot->my_ring_index = 0;
+		source_slot->target = NULL;
 		source_slot->request_lsns = (neon_request_lsns) {
 			InvalidXLogRecPtr, InvalidXLogRecPtr, InvalidXLogRecPtr
 		};
@@ -477,49 +536,23 @@ communicator_prefetch_pump_state(void)
 
 		slot = GetPrfSlot(MyPState->ring_receive);
 
-		old = MemoryContextSwitchTo(MyPState->errctx);
-		response = page_server->try_receive(slot->shard_no);
-		MemoryContextSwitchTo(old);
-
+		response = prefetch_take_early_response(slot);
 		if (response == NULL)
-			break;
-
-		check_getpage_response(slot, response);
-
-		/* The slot should still be valid */
-		if (slot->status != PRFS_REQUESTED ||
-			slot->response != NULL ||
-			slot->my_ring_index != MyPState->ring_receive)
 		{
-			neon_shard_log(slot->shard_no, PANIC,
-						   "Incorrect prefetch slot state after receive: status=%d response=%p my=" UINT64_FORMAT " receive=" UINT64_FORMAT "",
-						   slot->status, slot->response,
-						   slot->my_ring_index, MyPState->ring_receive);
+			old = MemoryContextSwitchTo(MyPState->errctx);
+			response = page_server->try_receive(slot->shard_no);
+			MemoryContextSwitchTo(old);
 		}
-		/* update prefetch state */
-		MyPState->n_responses_buffered += 1;
-		MyPState->n_requests_inflight -= 1;
-		MyPState->ring_receive += 1;
-		MyNeonCounters->getpage_prefetches_buffered =
-			MyPState->n_responses_buffered;
 
-		/* update slot state */
-		slot->status = PRFS_RECEIVED;
-		slot->response = response;
+		if (response == NULL)
+			break;
 
-		if (response->tag == T_NeonGetPageResponse && !(slot->flags & PRFSF_LFC) && lfc_store_prefetch_result)
-		{
-			/*
-			 * Store prefetched result in LFC (please read comments to lfc_prefetch
-			 * explaining why it can be done without holding shared buffer lock
-			 */
-			if (lfc_prefetch(BufTagGetNRelFileInfo(slot->buftag), slot->buftag.forkNum, slot->buftag.blockNum, ((NeonGetPageResponse*)response)->page, slot->request_lsns.not_modified_since))
-			{
-				slot->flags |= PRFSF_LFC;
-			}
-		}
+		prefetch_receive_response(slot, response);
 	}
 
+	/* Don't leave the pages we stored in LFC pending */
+	lfc_wait_async_writes();
+
 	END_PREFETCH_RECEIVE_WORK();
 
 	communicator_reconfigure_timeout_if_needed();
@@ -749,12 +782,249 @@ prefetch_wait_for(uint64 ring_index)
 		PrefetchRequest *slot = GetPrfSlot(ring_index);
 		result = slot->status == PRFS_RECEIVED;
 	}
+
+	/* Don't leave the pages we stored in LFC pending */
+	lfc_wait_async_writes();
+
 	END_PREFETCH_RECEIVE_WORK();
 
 	return result;
 ;
 }
 
+/*
+ * Wait event set of prefetch_gather(), and the shard connections it was
+ * built for.
+ */
+static WaitEventSet *gather_wes;
+static int	gather_wes_nshards;
+static shardno_t gather_wes_shards[MAX_SHARDS];
+static pgsocket gather_wes_socks[MAX_SHARDS];
+static TimestampTz gather_wes_connected_at[MAX_SHARDS];
+
+/*
+ * Find, for each shard with responses still due up to ring_index, the first
+ * slot that waits for a response from it. The responses of a connection
+ * arrive in the order of its requests, so that's the slot the next response
+ * from the shard belongs to.
+ */
+static int
+prefetch_gather_targets(uint64 ring_index, uint64 *targets)
+{
+	uint8		seen[(MAX_SHARDS + 7) / 8] = {0};
+	uint64		i = MyPState->ring_receive;
+	int			ntargets = 0;
+
+	while (i <= ring_index)
+	{
+		PrefetchRequest *slot = GetPrfSlot(i);
+		NeonRequestId reqid = slot->reqid;
+
+		Assert(slot->status == PRFS_REQUESTED);
+		if (slot->response == NULL && !BITMAP_ISSET(seen, slot->shard_no))
+		{
+			BITMAP_SET(seen, slot->shard_no);
+			targets[ntargets++] = i;
+		}
+
+		/* the rest of a batch is covered by the same response */
+		do
+			i++;
+		while (i <= ring_index && GetPrfSlot(i)->reqid == reqid);
+	}
+
+	return ntargets;
+}
+
+/*
+ * Wait until one of the target slots' shards has data to read.
+ *
+ * Returns false if the wait timed out, or a shard isn't connected anymore.
+ */
+static bool
+prefetch_gather_wait(uint64 *targets, int ntargets)
+{
+	WaitEvent	events[8];
+	bool		rebuild = (gather_wes == NULL || ntargets != gather_wes_nshards);
+	int			nevents;
+
+	for (int i = 0; i < ntargets; i++)
+	{
+		shardno_t	shard_no = GetPrfSlot(targets[i])->shard_no;
+		TimestampTz connected_at = 0;
+		pgsocket	sock = pageserver_socket(shard_no, &connected_at);
+
+		if (sock == PGINVALID_SOCKET)
+			return false;
+
+		if (!rebuild &&
+			(gather_wes_shards[i] != shard_no ||
+			 gather_wes_socks[i] != sock ||
+			 gather_wes_connected_at[i] != connected_at))
+			rebuild = true;
+	}
+
+	/*
+	 * A vectored read mostly waits for the same few shards as the previous
+	 * one, so the wait event set is usually reused.
+	 */
+	if (rebuild)
+	{
+		if (gather_wes)
+			FreeWaitEventSet(gather_wes);
+		gather_wes_nshards = 0;
+#if PG_MAJORVERSION_NUM >= 17
+		gather_wes = CreateWaitEventSet(NULL, 2 + ntargets);
+#else
+		gather_wes = CreateWaitEventSet(TopMemoryContext, 2 + ntargets);
+#endif
+		AddWaitEventToSet(gather_wes, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+		AddWaitEventToSet(gather_wes, WL_EXIT_ON_PM_DEATH, PGINVALID_SOCKET, NULL, NULL);
+		for (int i = 0; i < ntargets; i++)
+		{
+			gather_wes_shards[i] = GetPrfSlot(targets[i])->shard_no;
+			gather_wes_socks[i] = pageserver_socket(gather_wes_shards[i],
+													&gather_wes_connected_at[i]);
+			AddWaitEventToSet(gather_wes, WL_SOCKET_READABLE, gather_wes_socks[i], NULL, NULL);
+		}
+		gather_wes_nshards = ntargets;
+	}
+
+	nevents = WaitEventSetWait(gather_wes, pageserver_response_log_timeout,
+							   events, lengthof(events), WAIT_EVENT_NEON_PS_READ);
+	ResetLatch(MyLatch);
+	CHECK_FOR_INTERRUPTS();
+
+	return nevents > 0;
+}
+
+/*
+ * Receive the responses of all slots up to ring_index, from all the shards
+ * they were sent to at once.
+ *
+ * prefetch_wait_for() receives the responses in ring order, so while it
+ * waits for one shard, responses that other shards already sent pile up in
+ * their sockets. When a vectored read spans several shards, we instead wait
+ * on all their sockets, and take each response as soon as it arrives. A
+ * response that arrives before the slots ahead of it have been received is
+ * parked in its slot, which stays PRFS_REQUESTED, until its turn comes; see
+ * prefetch_take_early_response(). Such pages are not received directly into
+ * the reader's buffer.
+ *
+ * This needs the sockets of the backend's own connections, so with
+ * neon.pageserver_transport=communicator it leaves the receiving to
+ * prefetch_wait_for(). The forwarder process already receives from all
+ * shards at once. Protocol version 3 is needed to check that each response
+ * matches its request.
+ *
+ * Returns false if the connection was lost; the caller retries the requests
+ * as usual.
+ */
+static bool
+prefetch_gather(uint64 ring_index)
+{
+	uint64		targets[MAX_SHARDS];
+	bool		result = true;
+
+	if (page_server != &pageserver_direct_api || neon_protocol_version < 3)
+		return true;
+
+	if (MyPState->ring_flush <= ring_index &&
+		MyPState->ring_unused > MyPState->ring_flush)
+	{
+		if (!prefetch_flush_requests())
+			return false;
+		MyPState->ring_flush = MyPState->ring_unused;
+	}
+
+	START_PREFETCH_RECEIVE_WORK();
+
+	while (result && MyPState->ring_receive <= ring_index)
+	{
+		PrefetchRequest *slot = GetPrfSlot(MyPState->ring_receive);
+		NeonResponse *response;
+		bool		progress = false;
+		int			ntargets;
+
+		/* a response received early may be in turn now */
+		response = prefetch_take_early_response(slot);
+		if (response != NULL)
+		{
+			prefetch_receive_response(slot, response);
+			continue;
+		}
+
+		/* with only one shard left, there's nothing to gain */
+		ntargets = prefetch_gather_targets(ring_index, targets);
+		if (ntargets == 1)
+		{
+			result = prefetch_read(slot);
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+
+		for (int i = 0; i < ntargets; i++)
+		{
+			PrefetchRequest *target = GetPrfSlot(targets[i]);
+			MemoryContext old;
+
+			old = MemoryContextSwitchTo(MyPState->errctx);
+			response = page_server->try_receive(target->shard_no);
+			MemoryContextSwitchTo(old);
+
+			/* all in-flight requests are dropped if a connection is lost */
+			if (MyPState->ring_receive > targets[i])
+			{
+				result = false;
+				break;
+			}
+			if (response == NULL)
+				continue;
+
+			if (targets[i] == MyPState->ring_receive)
+				prefetch_receive_response(target, response);
+			else
+			{
+				target->response = response;
+				MyNeonCounters->getpage_gather_early_responses_total++;
+			}
+			progress = true;
+		}
+
+		/*
+		 * If no shard responds for a long time, fall back to waiting for the
+		 * next slot's response alone, which logs the wait and enforces
+		 * neon.pageserver_response_disconnect_timeout.
+		 */
+		if (result && !progress && !prefetch_gather_wait(targets, ntargets))
+		{
+			slot = GetPrfSlot(MyPState->ring_receive);
+			result = prefetch_read(slot);
+		}
+	}
+
+	/* Don't leave the pages we stored in LFC pending */
+	lfc_wait_async_writes();
+
+	END_PREFETCH_RECEIVE_WORK();
+
+	return result;
+}
+
+/*
+ * Take the response that prefetch_gather() received for the slot before its
+ * turn, if any.
+ */
+static NeonResponse *
+prefetch_take_early_response(PrefetchRequest *slot)
+{
+	NeonResponse *response = slot->response;
+
+	Assert(slot->status == PRFS_REQUESTED);
+	slot->response = NULL;
+	return response;
+}
+
 /*
  * Read the response of a prefetch request into its slot.
  *
@@ -776,12 +1046,10 @@ prefetch_read(PrefetchRequest *slot)
 	uint64		my_ring_index;
 
 	Assert(slot->status == PRFS_REQUESTED);
-	Assert(slot->response == NULL);
 	Assert(slot->my_ring_index == MyPState->ring_receive);
 	Assert(readpage_reentrant_guard || AmPrewarmWorker);
 
 	if (slot->status != PRFS_REQUESTED ||
-		slot->response != NULL ||
 		slot->my_ring_index != MyPState->ring_receive)
 	{
 		neon_shard_log(slot->shard_no, PANIC,
@@ -799,46 +1067,16 @@ prefetch_read(PrefetchRequest *slot)
 	shard_no = slot->shard_no;
 	my_ring_index = slot->my_ring_index;
 
-	old = MemoryContextSwitchTo(MyPState->errctx);
-	response = (NeonResponse *) page_server->receive(shard_no);
-	MemoryContextSwitchTo(old);
+	response = prefetch_take_early_response(slot);
+	if (response == NULL)
+	{
+		old = MemoryContextSwitchTo(MyPState->errctx);
+		response = (NeonResponse *) page_server->receive(shard_no);
+		MemoryContextSwitchTo(old);
+	}
 	if (response)
 	{
-		check_getpage_response(slot, response);
-
-		/* The slot should still be valid */
-		if (slot->status != PRFS_REQUESTED ||
-			slot->response != NULL ||
-			slot->my_ring_index != MyPState->ring_receive)
-		{
-			neon_shard_log(shard_no, PANIC,
-						   "Incorrect prefetch slot state after receive: status=%d response=%p my=" UINT64_FORMAT " receive=" UINT64_FORMAT "",
-						   slot->status, slot->response,
-						   slot->my_ring_index, MyPState->ring_receive);
-		}
-
-		/* update prefetch state */
-		MyPState->n_responses_buffered += 1;
-		MyPState->n_requests_inflight -= 1;
-		MyPState->ring_receive += 1;
-		MyNeonCounters->getpage_prefetches_buffered =
-			MyPState->n_responses_buffered;
-
-		/* update slot state */
-		slot->status = PRFS_RECEIVED;
-		slot->response = response;
-
-		if (response->tag == T_NeonGetPageResponse && !(slot->flags & PRFSF_LFC) && lfc_store_prefetch_result)
-		{
-			/*
-			 * Store prefetched result in LFC (please read comments to lfc_prefetch
-			 * explaining why it can be done without holding shared buffer lock
-			 */
-			if (lfc_prefetch(BufTagGetNRelFileInfo(buftag), buftag.forkNum, buftag.blockNum, ((NeonGetPageResponse*)response)->page, slot->request_lsns.not_modified_since))
-			{
-				slot->flags |= PRFSF_LFC;
-			}
-		}
+		prefetch_receive_response(slot, response);
 		return true;
 	}
 	else
@@ -857,6 +1095,182 @@ prefetch_read(PrefetchRequest *slot)
 }
 
 
+/*
+ * Zero-copy receive of GetPage responses.
+ *
+ * While communicator_read_at_lsnv() waits for a page, the destination buffer
+ * is recorded as the slot's target, and nm_unpack_response() copies the page
+ * from the libpq message straight into it. The response stored in the slot
+ * then only carries the header, and PRFSF_IN_TARGET is set on the slot.
+ *
+ * The target belongs to the reader that set it, so it's only valid while that
+ * reader waits: it either consumes the slot, or detaches the target with
+ * prefetch_drop_targets() if the read fails.
+ */
+static PrefetchRequest *
+prefetch_receive_target(NeonResponse *hdr, BlockNumber blkno, int offset)
+{
+	uint64		ring_index;
+	PrefetchRequest *slot;
+
+	/* we need the request id to match the response with its slot */
+	if (MyPState == NULL || neon_protocol_version < 3)
+		return NULL;
+
+	ring_index = MyPState->ring_receive + offset;
+	if (ring_index >= MyPState->ring_unused)
+		return NULL;
+
+	slot = GetPrfSlot(ring_index);
+	if (slot->target == NULL ||
+		slot->status != PRFS_REQUESTED ||
+		slot->reqid != hdr->reqid ||
+		slot->buftag.blockNum != blkno)
+		return NULL;
+
+	return slot;
+}
+
+/*
+ * Detach all receive targets, copying pages that were already received into
+ * a target back into a regular response.
+ */
+static void
+prefetch_drop_targets(void)
+{
+	for (uint64 ring_index = MyPState->ring_last;
+		 ring_index < MyPState->ring_unused;
+		 ring_index++)
+	{
+		PrefetchRequest *slot = GetPrfSlot(ring_index);
+
+		if (slot->target == NULL)
+			continue;
+
+		if (slot->flags & PRFSF_IN_TARGET)
+		{
+			NeonGetPageResponse *resp;
+
+			Assert(slot->status == PRFS_RECEIVED);
+			resp = MemoryContextAlloc(MyPState->bufctx, PS_GETPAGERESPONSE_SIZE);
+			memcpy(resp, slot->response, offsetof(NeonGetPageResponse, page));
+			memcpy(resp->page, slot->target, BLCKSZ);
+			pfree(slot->response);
+			slot->response = (NeonResponse *) resp;
+			slot->flags &= ~PRFSF_IN_TARGET;
+		}
+		slot->target = NULL;
+	}
+}
+
+static inline char *
+prefetch_slot_page(PrefetchRequest *slot)
+{
+	Assert(slot->response->tag == T_NeonGetPageResponse);
+
+	if (slot->flags & PRFSF_IN_TARGET)
+		return slot->target;
+	return ((NeonGetPageResponse *) slot->response)->page;
+}
+
+/*
+ * Store the response for the slot at ring_receive, and advance ring_receive.
+ */
+static void
+prefetch_set_received(PrefetchRequest *slot, NeonResponse *response)
+{
+	check_getpage_response(slot, response);
+
+	/* The slot should still be valid */
+	if (slot->status != PRFS_REQUESTED ||
+		slot->response != NULL ||
+		slot->my_ring_index != MyPState->ring_receive)
+	{
+		neon_shard_log(slot->shard_no, PANIC,
+					   "Incorrect prefetch slot state after receive: status=%d response=%p my=" UINT64_FORMAT " receive=" UINT64_FORMAT "",
+					   slot->status, slot->response,
+					   slot->my_ring_index, MyPState->ring_receive);
+	}
+
+	/* update prefetch state */
+	MyPState->n_responses_buffered += 1;
+	MyPState->n_requests_inflight -= 1;
+	MyPState->ring_receive += 1;
+	MyNeonCounters->getpage_prefetches_buffered =
+		MyPState->n_responses_buffered;
+
+	/* update slot state */
+	slot->status = PRFS_RECEIVED;
+	slot->response = response;
+
+	if (response->tag == T_NeonGetPageResponse && !(slot->flags & PRFSF_LFC) && lfc_store_prefetch_result)
+	{
+		/*
+		 * Store prefetched result in LFC (please read comments to lfc_prefetch
+		 * explaining why it can be done without holding shared buffer lock
+		 */
+		if (lfc_prefetch(BufTagGetNRelFileInfo(slot->buftag), slot->buftag.forkNum, slot->buftag.blockNum, prefetch_slot_page(slot), slot->request_lsns.not_modified_since))
+		{
+			slot->flags |= PRFSF_LFC;
+		}
+	}
+
+	/* the page is in the LFC now, if it could be stored there at all */
+	shared_prefetch_unpublish(slot);
+}
+
+/*
+ * Process a response received for the slot at ring_receive.
+ *
+ * A batch request covers that slot and the slots following it, which were
+ * all sent with the same request ID (see prefetch_do_request). The pages of a
+ * batch response are handed out to these slots, and if the request failed,
+ * each of them gets a copy of the error.
+ */
+static void
+prefetch_receive_response(PrefetchRequest *slot, NeonResponse *response)
+{
+	NeonRequestId reqid = slot->reqid;
+
+	if (response->tag == T_NeonGetPageBatchResponse)
+	{
+		NeonGetPageBatchResponse *batch = (NeonGetPageBatchResponse *) response;
+
+		for (int i = 0; i < batch->req.nblocks; i++)
+		{
+			if (MyPState->ring_receive == MyPState->ring_unused)
+				NEON_PANIC_CONNECTION_STATE(slot->shard_no, PANIC,
+											"Received getpage batch response for %u blocks, but only %d were requested",
+											batch->req.nblocks, i);
+			prefetch_set_received(GetPrfSlot(MyPState->ring_receive),
+								  (NeonResponse *) batch->pages[i]);
+		}
+		pfree(batch);
+		return;
+	}
+
+	prefetch_set_received(slot, response);
+
+	if (response->tag == T_NeonErrorResponse)
+	{
+		Size		size = sizeof(NeonErrorResponse) +
+			strlen(((NeonErrorResponse *) response)->message) + 1;
+
+		while (MyPState->ring_receive < MyPState->ring_unused)
+		{
+			PrefetchRequest *next = GetPrfSlot(MyPState->ring_receive);
+			NeonResponse *copy;
+
+			if (next->status != PRFS_REQUESTED || next->reqid != reqid)
+				break;
+
+			copy = MemoryContextAlloc(MyPState->errctx, size);
+			memcpy(copy, response, size);
+			prefetch_set_received(next, copy);
+		}
+	}
+}
+
 /*
  * Wait completion of previosly registered prefetch request.
  * Prefetch result should be placed in LFC by prefetch_wait_for.
@@ -911,9 +1325,24 @@ prefetch_on_ps_disconnect(void)
 		page_server->disconnect(slot->shard_no);
 
 		/* clean up the request */
-		slot->status = PRFS_TAG_REMAINS;
-		MyPState->n_requests_inflight -= 1;
-		MyPState->ring_receive += 1;
+		shared_prefetch_unpublish(slot);
+		if (slot->response != NULL)
+		{
+			/* received early by prefetch_gather(), but never used */
+			NeonResponse *response = prefetch_take_early_response(slot);
+
+			if (response->tag == T_NeonGetPageBatchResponse)
+			{
+				NeonGetPageBatchResponse *batch = (NeonGetPageBatchResponse *) response;
+
+				for (int i = 0; i < batch->req.nblocks; i++)
+					pfree(batch->pages[i]);
+			}
+			pfree(response);
+		}
+		slot->status = PRFS_TAG_REMAINS;
+		MyPState->n_requests_inflight -= 1;
+		MyPState->ring_receive += 1;
 
 		prefetch_set_unused(ring_index);
 		pgBufferUsage.prefetch.expired += 1;
@@ -992,12 +1421,19 @@ prefetch_set_unused(uint64 ring_index)
 /*
  * Send one prefetch request to the pageserver. To wait for the response, call
  * prefetch_wait_for().
+ *
+ * With nblocks > 1, a single batch request is sent for the slot and the
+ * nblocks - 1 slots following it, which the caller must have set up for the
+ * consecutive blocks. All of them get the same request LSNs and request ID.
  */
 static void
-prefetch_do_request(PrefetchRequest *slot, neon_request_lsns *force_request_lsns)
+prefetch_do_request(PrefetchRequest *slot, neon_request_lsns *force_request_lsns,
+					int nblocks)
 {
 	bool		found;
-	uint64		mySlotNo PG_USED_FOR_ASSERTS_ONLY = slot->my_ring_index;
+	uint64		mySlotNo = slot->my_ring_index;
+	NeonRequest *msg;
+	NeonGetPageBatchRequest batch_request;
 
 	NeonGetPageRequest request = {
 		.hdr.tag = T_NeonGetPageRequest,
@@ -1008,6 +1444,8 @@ prefetch_do_request(PrefetchRequest *slot, neon_request_lsns *force_request_lsns
 	};
 
 	Assert(mySlotNo == MyPState->ring_unused);
+	Assert(nblocks >= 1 && nblocks <= MAX_GETPAGE_BATCH_BLOCKS);
+	Assert(nblocks == 1 || (force_request_lsns && neon_protocol_version >= 4));
 
 	if (force_request_lsns)
 		slot->request_lsns = *force_request_lsns;
@@ -1021,24 +1459,50 @@ prefetch_do_request(PrefetchRequest *slot, neon_request_lsns *force_request_lsns
 	Assert(slot->response == NULL);
 	Assert(slot->my_ring_index == MyPState->ring_unused);
 
-	while (!page_server->send(slot->shard_no, (NeonRequest *) &request))
+	if (nblocks > 1)
+	{
+		batch_request.hdr = request.hdr;
+		batch_request.hdr.tag = T_NeonGetPageBatchRequest;
+		batch_request.rinfo = request.rinfo;
+		batch_request.forknum = request.forknum;
+		batch_request.blkno = request.blkno;
+		batch_request.nblocks = nblocks;
+		msg = (NeonRequest *) &batch_request;
+	}
+	else
+		msg = (NeonRequest *) &request;
+
+	while (!page_server->send(slot->shard_no, msg))
 	{
 		Assert(mySlotNo == MyPState->ring_unused);
 		/* loop */
 	}
-	slot->reqid = request.hdr.reqid;
 
-	/* update prefetch state */
-	MyPState->n_requests_inflight += 1;
-	MyPState->n_unused -= 1;
-	MyPState->ring_unused += 1;
+	for (int i = 0; i < nblocks; i++)
+	{
+		PrefetchRequest *bslot = GetPrfSlotNoCheck(mySlotNo + i);
+
+		Assert(bslot->my_ring_index == mySlotNo + i);
+		Assert(bslot->buftag.blockNum == slot->buftag.blockNum + i);
+		Assert(bslot->shard_no == slot->shard_no);
+
+		bslot->request_lsns = slot->request_lsns;
+		bslot->reqid = msg->reqid;
+
+		/* update prefetch state */
+		MyPState->n_requests_inflight += 1;
+		MyPState->n_unused -= 1;
+		MyPState->ring_unused += 1;
+
+		/* update slot state */
+		bslot->status = PRFS_REQUESTED;
+		prfh_insert(MyPState->prf_hash, bslot, &found);
+		Assert(!found);
+
+		shared_prefetch_publish(bslot);
+	}
 	BITMAP_SET(MyPState->shard_bitmap, slot->shard_no);
 	MyPState->max_shard_no = Max(slot->shard_no+1, MyPState->max_shard_no);
-
-	/* update slot state */
-	slot->status = PRFS_REQUESTED;
-	prfh_insert(MyPState->prf_hash, slot, &found);
-	Assert(!found);
 }
 
 /*
@@ -1097,7 +1561,7 @@ communicator_prefetch_lookupv(NRelFileInfo rinfo, ForkNumber forknum, BlockNumbe
 				continue;
 			}
 			Assert(slot->response->tag == T_NeonGetPageResponse); /* checked by check_getpage_response when response was assigned to the slot */
-			memcpy(buffers[i], ((NeonGetPageResponse*)slot->response)->page, BLCKSZ);
+			memcpy(buffers[i], prefetch_slot_page(slot), BLCKSZ);
 
 
 			/*
@@ -1145,6 +1609,49 @@ communicator_prefetch_register_bufferv(BufferTag tag, neon_request_lsns *frlsns,
 									   BlockNumber nblocks, const bits8 *mask)
 {
 	uint64		ring_index PG_USED_FOR_ASSERTS_ONLY;
+	bits8		shared_mask[PG_IOV_MAX / 8];
+
+	if (readahead_adaptive)
+	{
+		int			room;
+
+		readahead_adapt();
+		room = readahead_depth -
+			(MyPState->n_requests_inflight + MyPState->n_responses_buffered);
+		if (room <= 0)
+			return;
+		nblocks = Min(nblocks, room);
+	}
+
+	/* Don't prefetch pages that another backend already has in flight */
+	if (shared_prefetch_hash != NULL && nblocks <= PG_IOV_MAX)
+	{
+		BufferTag	blktag = tag;
+		bool		any_left = false;
+
+		if (PointerIsValid(mask))
+			memcpy(shared_mask, mask, sizeof(shared_mask));
+		else
+			memset(shared_mask, 0, sizeof(shared_mask));
+
+		for (int i = 0; i < nblocks; i++)
+		{
+			NeonRequestId reqid;
+
+			if (BITMAP_ISSET(shared_mask, i))
+				continue;
+
+			blktag.blockNum = tag.blockNum + i;
+			if (shared_prefetch_lookup(&blktag, frlsns ? &frlsns[i] : NULL, &reqid))
+				BITMAP_SET(shared_mask, i);
+			else
+				any_left = true;
+		}
+
+		if (!any_left)
+			return;
+		mask = shared_mask;
+	}
 
 	ring_index = prefetch_register_bufferv(tag, frlsns, nblocks, mask, true);
 
@@ -1152,6 +1659,66 @@ communicator_prefetch_register_bufferv(BufferTag tag, neon_request_lsns *frlsns,
 		   MyPState->ring_last <= ring_index);
 }
 
+static inline bool
+request_lsns_equal(const neon_request_lsns *a, const neon_request_lsns *b)
+{
+	return a->request_lsn == b->request_lsn &&
+		a->not_modified_since == b->not_modified_since &&
+		a->effective_request_lsn == b->effective_request_lsn;
+}
+
+/*
+ * Returns the number of blocks, starting at block i of the nblocks blocks at
+ * 'tag', that can be requested with a single batch request: blocks that are
+ * not in the prefetch buffers yet, live on the same shard, and are requested
+ * at the same LSNs. If frlsns is NULL, the LSNs of these blocks are looked up
+ * and returned in 'lsns', which must have room for MAX_GETPAGE_BATCH_BLOCKS
+ * entries.
+ */
+static int
+prefetch_batch_size(BufferTag tag, int i, BlockNumber nblocks, const bits8 *mask,
+					neon_request_lsns *frlsns, neon_request_lsns *lsns)
+{
+	PrefetchRequest hashkey;
+	shardno_t	shard_no;
+	int			n = 1;
+
+	memset(&hashkey.buftag, 0, sizeof(BufferTag));
+	hashkey.buftag = tag;
+	hashkey.buftag.blockNum = tag.blockNum + i;
+	shard_no = get_shard_number(&hashkey.buftag);
+
+	while (i + n < nblocks && n < MAX_GETPAGE_BATCH_BLOCKS)
+	{
+		if (PointerIsValid(mask) && BITMAP_ISSET(mask, i + n))
+			break;
+		if (frlsns && !request_lsns_equal(&frlsns[i + n], &frlsns[i]))
+			break;
+
+		hashkey.buftag.blockNum = tag.blockNum + i + n;
+		if (get_shard_number(&hashkey.buftag) != shard_no ||
+			prfh_lookup(MyPState->prf_hash, &hashkey) != NULL)
+			break;
+		n++;
+	}
+
+	if (frlsns == NULL)
+	{
+		neon_get_request_lsns(BufTagGetNRelFileInfo(tag), tag.forkNum,
+							  tag.blockNum + i, lsns, n);
+		for (int j = 1; j < n; j++)
+		{
+			if (!request_lsns_equal(&lsns[j], &lsns[0]))
+			{
+				n = j;
+				break;
+			}
+		}
+	}
+
+	return n;
+}
+
 /* Internal version. Returns the ring index of the last block (result of this function is used only
 *  when nblocks==1)
 */
@@ -1162,6 +1729,7 @@ prefetch_register_bufferv(BufferTag tag, neon_request_lsns *frlsns,
 {
 	uint64		last_ring_index;
 	PrefetchRequest hashkey;
+	neon_request_lsns batch_lsns[MAX_GETPAGE_BATCH_BLOCKS];
 #ifdef USE_ASSERT_CHECKING
 	bool		any_hits = false;
 #endif
@@ -1191,6 +1759,7 @@ Retry:
 		PrefetchRequest *slot = NULL;
 		PrfHashEntry *entry = NULL;
 		neon_request_lsns *lsns;
+		int			batch_size;
 
 		if (PointerIsValid(mask) && BITMAP_ISSET(mask, i))
 			continue;
@@ -1278,12 +1847,29 @@ Retry:
 		Assert(entry == NULL);
 		Assert(slot == NULL);
 
+		/*
+		 * With protocol version 4, the following blocks that need to be
+		 * requested as well are fetched with the same request, if possible.
+		 */
+		batch_size = 1;
+		if (neon_protocol_version >= 4)
+		{
+			batch_size = prefetch_batch_size(tag, i, nblocks, mask, frlsns, batch_lsns);
+			if (frlsns == NULL)
+				lsns = &batch_lsns[0];
+			if (!is_prefetch)
+			{
+				pgBufferUsage.prefetch.misses += batch_size - 1;
+				MyNeonCounters->getpage_prefetch_misses_total += batch_size - 1;
+			}
+		}
+
 		/* There should be no buffer overflow */
 		Assert(MyPState->ring_last + readahead_buffer_size >= MyPState->ring_unused);
 
 		/*
 		 * If the prefetch queue is full, we need to make room by clearing the
-		 * oldest slot. If the oldest slot holds a buffer that was already
+		 * oldest slots. If the oldest slot holds a buffer that was already
 		 * received, we can just throw it away; we fetched the page
 		 * unnecessarily in that case. If the oldest slot holds a request that
 		 * we haven't received a response for yet, we have to wait for the
@@ -1295,7 +1881,7 @@ Retry:
 		 * a prefetch request kind of goes against the principles of
 		 * prefetching)
 		 */
-		if (MyPState->ring_last + readahead_buffer_size == MyPState->ring_unused)
+		while (MyPState->ring_last + readahead_buffer_size < MyPState->ring_unused + batch_size)
 		{
 			uint64		cleanup_index = MyPState->ring_last;
 
@@ -1326,12 +1912,14 @@ Retry:
 						prefetch_set_unused(cleanup_index);
 						pgBufferUsage.prefetch.expired += 1;
 						MyNeonCounters->getpage_prefetch_discards_total += 1;
+						MyNeonCounters->getpage_prefetch_wasted_total += 1;
 						break;
 					case PRFS_RECEIVED:
 					case PRFS_TAG_REMAINS:
 						prefetch_set_unused(cleanup_index);
 						pgBufferUsage.prefetch.expired += 1;
 						MyNeonCounters->getpage_prefetch_discards_total += 1;
+						MyNeonCounters->getpage_prefetch_wasted_total += 1;
 						break;
 					default:
 						pg_unreachable();
@@ -1340,33 +1928,38 @@ Retry:
 		}
 
 		/*
-		 * The next buffer pointed to by `ring_unused` is now definitely empty, so
-		 * we can insert the new request to it.
+		 * The next batch_size buffers pointed to by `ring_unused` are now
+		 * definitely empty, so we can insert the new request to them.
 		 */
-		last_ring_index = MyPState->ring_unused;
-
-		Assert(MyPState->ring_last <= last_ring_index &&
-			   last_ring_index <= MyPState->ring_unused);
+		for (int j = 0; j < batch_size; j++)
+		{
+			last_ring_index = MyPState->ring_unused + j;
 
-		slot = GetPrfSlotNoCheck(last_ring_index);
+			Assert(MyPState->ring_last <= last_ring_index &&
+				   last_ring_index < MyPState->ring_last + readahead_buffer_size);
 
-		Assert(slot->status == PRFS_UNUSED);
+			slot = GetPrfSlotNoCheck(last_ring_index);
 
-		/*
-		 * We must update the slot data before insertion, because the hash
-		 * function reads the buffer tag from the slot.
-		 */
-		slot->buftag = hashkey.buftag;
-		slot->shard_no = get_shard_number(&tag);
-		slot->my_ring_index = last_ring_index;
-		slot->flags = 0;
+			Assert(slot->status == PRFS_UNUSED);
 
-		if (is_prefetch)
-			MyNeonCounters->getpage_prefetch_requests_total++;
-		else
-			MyNeonCounters->getpage_sync_requests_total++;
+			/*
+			 * We must update the slot data before insertion, because the hash
+			 * function reads the buffer tag from the slot.
+			 */
+			slot->buftag = hashkey.buftag;
+			slot->buftag.blockNum += j;
+			slot->shard_no = get_shard_number(&tag);
+			slot->my_ring_index = last_ring_index;
+			slot->flags = 0;
+
+			if (is_prefetch)
+				MyNeonCounters->getpage_prefetch_requests_total++;
+			else
+				MyNeonCounters->getpage_sync_requests_total++;
+		}
 
-		prefetch_do_request(slot, lsns);
+		prefetch_do_request(GetPrfSlotNoCheck(MyPState->ring_unused), lsns, batch_size);
+		i += batch_size - 1;
 	}
 
 	MyNeonCounters->pageserver_open_requests =
@@ -1381,7 +1974,7 @@ Retry:
 		   last_ring_index < MyPState->ring_unused);
 
 	if (flush_every_n_requests > 0 &&
-		MyPState->ring_unused - MyPState->ring_flush >= flush_every_n_requests)
+		MyPState->ring_unused - MyPState->ring_flush >= readahead_flush_batch())
 	{
 		if (!prefetch_flush_requests())
 		{
@@ -1538,6 +2131,20 @@ nm_pack_request(NeonRequest *msg)
 				pq_sendbyte(&s, msg_req->forknum);
 				pq_sendint32(&s, msg_req->blkno);
 
+				break;
+			}
+		case T_NeonGetPageBatchRequest:
+			{
+				NeonGetPageBatchRequest *msg_req = (NeonGetPageBatchRequest *) msg;
+
+				Assert(neon_protocol_version >= 4);
+				pq_sendint32(&s, NInfoGetSpcOid(msg_req->rinfo));
+				pq_sendint32(&s, NInfoGetDbOid(msg_req->rinfo));
+				pq_sendint32(&s, NInfoGetRelNumber(msg_req->rinfo));
+				pq_sendbyte(&s, msg_req->forknum);
+				pq_sendint32(&s, msg_req->blkno);
+				pq_sendint32(&s, msg_req->nblocks);
+
 				break;
 			}
 
@@ -1558,6 +2165,7 @@ nm_pack_request(NeonRequest *msg)
 		case T_NeonErrorResponse:
 		case T_NeonDbSizeResponse:
 		case T_NeonGetSlruSegmentResponse:
+		case T_NeonGetPageBatchResponse:
 		default:
 			neon_log(PANIC, "unexpected neon message tag 0x%02x", msg->tag);
 			break;
@@ -1623,23 +2231,94 @@ nm_unpack_response(StringInfo s)
 		case T_NeonGetPageResponse:
 			{
 				NeonGetPageResponse *msg_resp;
+				NeonGetPageRequest req = {0};
+				PrefetchRequest *target_slot = NULL;
 
-				msg_resp = MemoryContextAllocZero(MyPState->bufctx, PS_GETPAGERESPONSE_SIZE);
 				if (neon_protocol_version >= 3)
 				{
-					NInfoGetSpcOid(msg_resp->req.rinfo) = pq_getmsgint(s, 4);
-					NInfoGetDbOid(msg_resp->req.rinfo) = pq_getmsgint(s, 4);
-					NInfoGetRelNumber(msg_resp->req.rinfo) = pq_getmsgint(s, 4);
-					msg_resp->req.forknum = pq_getmsgbyte(s);
-					msg_resp->req.blkno = pq_getmsgint(s, 4);
+					NInfoGetSpcOid(req.rinfo) = pq_getmsgint(s, 4);
+					NInfoGetDbOid(req.rinfo) = pq_getmsgint(s, 4);
+					NInfoGetRelNumber(req.rinfo) = pq_getmsgint(s, 4);
+					req.forknum = pq_getmsgbyte(s);
+					req.blkno = pq_getmsgint(s, 4);
 				}
-				msg_resp->req.hdr = resp_hdr;
-				/* XXX:	should be varlena */
-				memcpy(msg_resp->page, pq_getmsgbytes(s, BLCKSZ), BLCKSZ);
+				req.hdr = resp_hdr;
+
+				target_slot = prefetch_receive_target(&resp_hdr, req.blkno, 0);
+				if (target_slot != NULL)
+				{
+					msg_resp = palloc0(offsetof(NeonGetPageResponse, page));
+					memcpy(target_slot->target, pq_getmsgbytes(s, BLCKSZ), BLCKSZ);
+				}
+				else
+				{
+					msg_resp = MemoryContextAllocZero(MyPState->bufctx, PS_GETPAGERESPONSE_SIZE);
+					/* XXX:	should be varlena */
+					memcpy(msg_resp->page, pq_getmsgbytes(s, BLCKSZ), BLCKSZ);
+				}
+				msg_resp->req = req;
 				pq_getmsgend(s);
 
 				Assert(msg_resp->req.hdr.tag == T_NeonGetPageResponse);
 
+				if (target_slot != NULL)
+				{
+					target_slot->flags |= PRFSF_IN_TARGET;
+					MyNeonCounters->getpage_copies_avoided_total++;
+				}
+
+				resp = (NeonResponse *) msg_resp;
+				break;
+			}
+
+		case T_NeonGetPageBatchResponse:
+			{
+				NeonGetPageBatchResponse *msg_resp;
+				NeonResponse page_hdr = resp_hdr;
+
+				msg_resp = palloc0(sizeof(NeonGetPageBatchResponse));
+				NInfoGetSpcOid(msg_resp->req.rinfo) = pq_getmsgint(s, 4);
+				NInfoGetDbOid(msg_resp->req.rinfo) = pq_getmsgint(s, 4);
+				NInfoGetRelNumber(msg_resp->req.rinfo) = pq_getmsgint(s, 4);
+				msg_resp->req.forknum = pq_getmsgbyte(s);
+				msg_resp->req.blkno = pq_getmsgint(s, 4);
+				msg_resp->req.nblocks = pq_getmsgint(s, 4);
+				msg_resp->req.hdr = resp_hdr;
+
+				/* check the size before allocating any pages */
+				if (msg_resp->req.nblocks == 0 ||
+					msg_resp->req.nblocks > MAX_GETPAGE_BATCH_BLOCKS ||
+					s->len - s->cursor != msg_resp->req.nblocks * BLCKSZ)
+					neon_log(ERROR, "invalid getpage batch response with %u blocks and %d bytes of data",
+							 msg_resp->req.nblocks, s->len - s->cursor);
+
+				page_hdr.tag = T_NeonGetPageResponse;
+				for (int i = 0; i < msg_resp->req.nblocks; i++)
+				{
+					NeonGetPageResponse *page_resp;
+					PrefetchRequest *target_slot;
+
+					target_slot = prefetch_receive_target(&resp_hdr, msg_resp->req.blkno + i, i);
+					if (target_slot != NULL)
+					{
+						page_resp = palloc0(offsetof(NeonGetPageResponse, page));
+						memcpy(target_slot->target, pq_getmsgbytes(s, BLCKSZ), BLCKSZ);
+						target_slot->flags |= PRFSF_IN_TARGET;
+						MyNeonCounters->getpage_copies_avoided_total++;
+					}
+					else
+					{
+						page_resp = MemoryContextAllocZero(MyPState->bufctx, PS_GETPAGERESPONSE_SIZE);
+						memcpy(page_resp->page, pq_getmsgbytes(s, BLCKSZ), BLCKSZ);
+					}
+					page_resp->req.hdr = page_hdr;
+					page_resp->req.rinfo = msg_resp->req.rinfo;
+					page_resp->req.forknum = msg_resp->req.forknum;
+					page_resp->req.blkno = msg_resp->req.blkno + i;
+					msg_resp->pages[i] = page_resp;
+				}
+				pq_getmsgend(s);
+
 				resp = (NeonResponse *) msg_resp;
 				break;
 			}
@@ -1710,6 +2389,7 @@ nm_unpack_response(StringInfo s)
 		case T_NeonGetPageRequest:
 		case T_NeonDbSizeRequest:
 		case T_NeonGetSlruSegmentRequest:
+		case T_NeonGetPageBatchRequest:
 		default:
 			neon_log(PANIC, "unexpected neon message tag 0x%02x", tag);
 			break;
@@ -1768,6 +2448,20 @@ nm_to_string(NeonMessage *msg)
 				appendStringInfoChar(&s, '}');
 				break;
 			}
+		case T_NeonGetPageBatchRequest:
+			{
+				NeonGetPageBatchRequest *msg_req = (NeonGetPageBatchRequest *) msg;
+
+				appendStringInfoString(&s, "{\"type\": \"NeonGetPageBatchRequest\"");
+				appendStringInfo(&s, ", \"rinfo\": \"%u/%u/%u\"", RelFileInfoFmt(msg_req->rinfo));
+				appendStringInfo(&s, ", \"forknum\": %d", msg_req->forknum);
+				appendStringInfo(&s, ", \"blkno\": %u", msg_req->blkno);
+				appendStringInfo(&s, ", \"nblocks\": %u", msg_req->nblocks);
+				appendStringInfo(&s, ", \"lsn\": \"%X/%X\"", LSN_FORMAT_ARGS(msg_req->hdr.lsn));
+				appendStringInfo(&s, ", \"not_modified_since\": \"%X/%X\"", LSN_FORMAT_ARGS(msg_req->hdr.not_modified_since));
+				appendStringInfoChar(&s, '}');
+				break;
+			}
 		case T_NeonDbSizeRequest:
 			{
 				NeonDbSizeRequest *msg_req = (NeonDbSizeRequest *) msg;
@@ -1825,6 +2519,18 @@ nm_to_string(NeonMessage *msg)
 				appendStringInfoChar(&s, '}');
 				break;
 			}
+		case T_NeonGetPageBatchResponse:
+			{
+				NeonGetPageBatchResponse *msg_resp = (NeonGetPageBatchResponse *) msg;
+
+				appendStringInfoString(&s, "{\"type\": \"NeonGetPageBatchResponse\"");
+				appendStringInfo(&s, ", \"rinfo\": %u/%u/%u", RelFileInfoFmt(msg_resp->req.rinfo));
+				appendStringInfo(&s, ", \"forknum\": %d", msg_resp->req.forknum);
+				appendStringInfo(&s, ", \"blkno\": %u", msg_resp->req.blkno);
+				appendStringInfo(&s, ", \"nblocks\": %u", msg_resp->req.nblocks);
+				appendStringInfoChar(&s, '}');
+				break;
+			}
 		case T_NeonErrorResponse:
 			{
 				NeonErrorResponse *msg_resp = (NeonErrorResponse *) msg;
@@ -1909,6 +2615,316 @@ communicator_init(void)
 
 	MyPState->prf_hash = prfh_create(MyPState->hashctx,
 									 readahead_buffer_size, NULL);
+
+	if (shared_prefetch_hash != NULL)
+		before_shmem_exit(shared_prefetch_on_exit, (Datum) 0);
+}
+
+/*
+ * Adaptive readahead
+ *
+ * With neon.readahead_adaptive, the number of pages a backend keeps
+ * prefetched, requested or received but not yet read, is capped by an
+ * effective depth that adapts to how well prefetching works, instead of
+ * always being readahead_buffer_size. After every READAHEAD_ADAPT_WINDOW
+ * prefetch requests, the counters of the window are checked:
+ *
+ * - If more than 1/8 of the prefetched pages had to be thrown away unread to
+ *   make room in the ring, we're reading too far ahead, and the depth is
+ *   reduced by a quarter. Prefetches lost to a disconnect or to an LSN
+ *   mismatch don't count, as reading less far ahead wouldn't avoid them.
+ * - Otherwise, if more than 1/8 of the reads still had to wait for the
+ *   pageserver, either because nothing was prefetched for them or because
+ *   the response hadn't arrived yet, the depth is increased by a quarter, up
+ *   to readahead_buffer_size.
+ *
+ * Prefetches beyond the effective depth are skipped. The output buffer is
+ * also flushed more often when the depth is low, so that the few requests
+ * we do make aren't held back waiting for a batch to fill up.
+ */
+#define READAHEAD_ADAPT_WINDOW		64
+#define READAHEAD_MIN_DEPTH			4
+/* getpage_hist buckets of reads that waited 100 us or more */
+#define READAHEAD_SLOW_WAIT_BUCKET	8
+
+typedef struct ReadaheadWindow
+{
+	uint64		prefetches;
+	uint64		wasted;
+	uint64		misses;
+	uint64		reads;
+	uint64		slow_reads;
+} ReadaheadWindow;
+
+static ReadaheadWindow readahead_window;
+
+static void
+readahead_window_snapshot(ReadaheadWindow *window)
+{
+	IOHistogram hist = &MyNeonCounters->getpage_hist;
+
+	window->prefetches = MyNeonCounters->getpage_prefetch_requests_total;
+	window->wasted = MyNeonCounters->getpage_prefetch_wasted_total;
+	window->misses = MyNeonCounters->getpage_prefetch_misses_total;
+	window->reads = hist->wait_us_count;
+	window->slow_reads = 0;
+	for (int i = READAHEAD_SLOW_WAIT_BUCKET; i < NUM_IO_WAIT_BUCKETS; i++)
+		window->slow_reads += hist->wait_us_bucket[i];
+}
+
+static void
+readahead_adapt(void)
+{
+	ReadaheadWindow now;
+	uint64		prefetches;
+	uint64		reads;
+
+	if (readahead_depth == 0 || readahead_depth > readahead_buffer_size)
+	{
+		readahead_depth = readahead_buffer_size;
+		readahead_window_snapshot(&readahead_window);
+		MyNeonCounters->getpage_prefetch_depth = readahead_depth;
+	}
+
+	if (MyNeonCounters->getpage_prefetch_requests_total - readahead_window.prefetches <
+		READAHEAD_ADAPT_WINDOW)
+		return;
+
+	readahead_window_snapshot(&now);
+	prefetches = now.prefetches - readahead_window.prefetches;
+	reads = now.reads - readahead_window.reads;
+
+	if ((now.wasted - readahead_window.wasted) * 8 > prefetches)
+		readahead_depth = Max(READAHEAD_MIN_DEPTH, readahead_depth - readahead_depth / 4);
+	else if ((now.misses - readahead_window.misses +
+			  now.slow_reads - readahead_window.slow_reads) * 8 > reads)
+		readahead_depth = Min(readahead_buffer_size,
+							  readahead_depth + Max(1, readahead_depth / 4));
+
+	readahead_window = now;
+	MyNeonCounters->getpage_prefetch_depth = readahead_depth;
+}
+
+/*
+ * Number of unflushed requests after which prefetch_register_bufferv()
+ * flushes the output buffer.
+ */
+static int
+readahead_flush_batch(void)
+{
+	if (!readahead_adaptive || readahead_depth == 0)
+		return flush_every_n_requests;
+	return Max(1, Min(flush_every_n_requests, readahead_depth / 8));
+}
+
+/*
+ * Shared in-flight prefetch table
+ *
+ * The prefetch queue is private to each backend, so when several backends
+ * read the same pages at about the same time, e.g. the workers of a parallel
+ * query or sessions behind a connection pool, each of them would send its own
+ * GetPage request for it. With neon.shared_prefetch_size > 0, each backend
+ * publishes the GetPage requests it has in flight in a shared hash table, keyed
+ * by buffer tag. Another backend that needs the same page waits for that
+ * request to complete instead of sending a duplicate, and then reads the page
+ * from the LFC, where the owner stores the responses it receives. Prefetches
+ * of pages that are in flight in another backend are skipped altogether.
+ *
+ * Responses can only be received by the backend that sent the request, so
+ * this relies on lfc_store_prefetch_result, and requests are only published
+ * when it's enabled. If the page didn't make it into the LFC, or the owner
+ * doesn't complete the request in time, the waiter falls back to sending its
+ * own request.
+ */
+#define SharedPrefetchPartition(hashcode) ((hashcode) % SHARED_PREFETCH_PARTITIONS)
+#define SharedPrefetchPartitionLock(hashcode) \
+	(&shared_prefetch_locks[SharedPrefetchPartition(hashcode)].lock)
+
+void
+PrefetchShmemRequest(void)
+{
+	if (shared_prefetch_size == 0)
+		return;
+
+	RequestAddinShmemSpace(sizeof(SharedPrefetchControl) +
+						   hash_estimate_size(shared_prefetch_size, sizeof(SharedPrefetchEntry)));
+	RequestNamedLWLockTranche("neon_shared_prefetch", SHARED_PREFETCH_PARTITIONS);
+}
+
+void
+PrefetchShmemInit(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	if (shared_prefetch_size == 0)
+		return;
+
+	shared_prefetch_ctl = (SharedPrefetchControl *)
+		ShmemInitStruct("neon_shared_prefetch", sizeof(SharedPrefetchControl), &found);
+	if (!found)
+	{
+		for (int i = 0; i < SHARED_PREFETCH_PARTITIONS; i++)
+			ConditionVariableInit(&shared_prefetch_ctl->cv[i]);
+	}
+	shared_prefetch_locks = GetNamedLWLockTranche("neon_shared_prefetch");
+
+	info.keysize = sizeof(BufferTag);
+	info.entrysize = sizeof(SharedPrefetchEntry);
+	info.num_partitions = SHARED_PREFETCH_PARTITIONS;
+	shared_prefetch_hash = ShmemInitHash("neon_shared_prefetch_hash",
+										 shared_prefetch_size, shared_prefetch_size,
+										 &info,
+										 HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+}
+
+/*
+ * Publish an in-flight GetPage request. If the table is full, or another
+ * backend already has the page in flight, the request is simply not shared.
+ */
+static void
+shared_prefetch_publish(PrefetchRequest *slot)
+{
+	SharedPrefetchEntry *entry;
+	uint32		hashcode;
+	bool		found;
+
+	if (shared_prefetch_hash == NULL || !lfc_store_prefetch_result)
+		return;
+
+	hashcode = get_hash_value(shared_prefetch_hash, &slot->buftag);
+	LWLockAcquire(SharedPrefetchPartitionLock(hashcode), LW_EXCLUSIVE);
+	entry = hash_search_with_hash_value(shared_prefetch_hash, &slot->buftag,
+										hashcode, HASH_ENTER_NULL, &found);
+	if (entry != NULL && !found)
+	{
+		entry->reqid = slot->reqid;
+		entry->owner = MyProcNumber;
+		entry->request_lsns = slot->request_lsns;
+		slot->flags |= PRFSF_SHARED;
+	}
+	LWLockRelease(SharedPrefetchPartitionLock(hashcode));
+}
+
+/*
+ * Remove a request published by shared_prefetch_publish(), and wake up the
+ * backends waiting for it.
+ */
+static void
+shared_prefetch_unpublish(PrefetchRequest *slot)
+{
+	SharedPrefetchEntry *entry;
+	uint32		hashcode;
+
+	if (!(slot->flags & PRFSF_SHARED))
+		return;
+
+	hashcode = get_hash_value(shared_prefetch_hash, &slot->buftag);
+	LWLockAcquire(SharedPrefetchPartitionLock(hashcode), LW_EXCLUSIVE);
+	entry = hash_search_with_hash_value(shared_prefetch_hash, &slot->buftag,
+										hashcode, HASH_FIND, NULL);
+	if (entry != NULL && entry->owner == MyProcNumber && entry->reqid == slot->reqid)
+		hash_search_with_hash_value(shared_prefetch_hash, &slot->buftag,
+									hashcode, HASH_REMOVE, NULL);
+	LWLockRelease(SharedPrefetchPartitionLock(hashcode));
+
+	slot->flags &= ~PRFSF_SHARED;
+	ConditionVariableBroadcast(&shared_prefetch_ctl->cv[SharedPrefetchPartition(hashcode)]);
+}
+
+/*
+ * Check if another backend has a GetPage request in flight for the page,
+ * whose response would satisfy a request with the given LSNs. With lsns ==
+ * NULL, any in-flight request matches.
+ */
+static bool
+shared_prefetch_lookup(BufferTag *tag, neon_request_lsns *lsns,
+					   NeonRequestId *reqid)
+{
+	SharedPrefetchEntry *entry;
+	uint32		hashcode;
+	bool		usable = false;
+
+	if (shared_prefetch_hash == NULL)
+		return false;
+
+	hashcode = get_hash_value(shared_prefetch_hash, tag);
+	LWLockAcquire(SharedPrefetchPartitionLock(hashcode), LW_SHARED);
+	entry = hash_search_with_hash_value(shared_prefetch_hash, tag,
+										hashcode, HASH_FIND, NULL);
+	if (entry != NULL && entry->owner != MyProcNumber)
+	{
+		/*
+		 * Unlike our own queue, the other backend may have computed its LSNs
+		 * after we did, so the response must be neither too old nor too new;
+		 * see neon_prefetch_response_usable().
+		 */
+		usable = lsns == NULL ||
+			(lsns->not_modified_since <= entry->request_lsns.effective_request_lsn &&
+			 lsns->effective_request_lsn >= entry->request_lsns.effective_request_lsn);
+		*reqid = entry->reqid;
+	}
+	LWLockRelease(SharedPrefetchPartitionLock(hashcode));
+
+	return usable;
+}
+
+/*
+ * Wait for another backend's request found by shared_prefetch_lookup() to
+ * complete. An idle owner still receives its responses every
+ * neon.readahead_getpage_pull_timeout, so if the request hasn't completed
+ * after a couple of those, we give up on it. Returns true if the request
+ * completed.
+ */
+static bool
+shared_prefetch_wait(BufferTag *tag, NeonRequestId reqid)
+{
+	uint32		hashcode = get_hash_value(shared_prefetch_hash, tag);
+	ConditionVariable *cv = &shared_prefetch_ctl->cv[SharedPrefetchPartition(hashcode)];
+	TimestampTz start = GetCurrentTimestamp();
+	long		max_wait_ms = 2 * Max(readahead_getpage_pull_timeout_ms, 1);
+	bool		done;
+
+	ConditionVariablePrepareToSleep(cv);
+	for (;;)
+	{
+		SharedPrefetchEntry *entry;
+		long		waited_ms;
+
+		LWLockAcquire(SharedPrefetchPartitionLock(hashcode), LW_SHARED);
+		entry = hash_search_with_hash_value(shared_prefetch_hash, tag,
+											hashcode, HASH_FIND, NULL);
+		done = entry == NULL || entry->reqid != reqid;
+		LWLockRelease(SharedPrefetchPartitionLock(hashcode));
+
+		if (done)
+			break;
+
+		waited_ms = TimestampDifferenceMilliseconds(start, GetCurrentTimestamp());
+		if (waited_ms >= max_wait_ms)
+			break;
+
+		ConditionVariableTimedSleep(cv, max_wait_ms - waited_ms, WAIT_EVENT_NEON_PS_READ);
+	}
+	ConditionVariableCancelSleep();
+
+	return done;
+}
+
+/*
+ * Remove the requests this backend still has published at exit; they will
+ * never complete.
+ */
+static void
+shared_prefetch_on_exit(int code, Datum arg)
+{
+	if (MyPState == NULL)
+		return;
+
+	for (uint64 ring_index = MyPState->ring_receive;
+		 ring_index < MyPState->ring_unused;
+		 ring_index++)
+		shared_prefetch_unpublish(GetPrfSlot(ring_index));
 }
 
 /*
@@ -2099,6 +3115,13 @@ communicator_read_at_lsnv(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber ba
 	PrfHashEntry *entry;
 	PrefetchRequest *slot;
 	PrefetchRequest hashkey;
+	bits8		shared_mask[PG_IOV_MAX / 8];
+	bits8		shared_pending[PG_IOV_MAX / 8];
+	NeonRequestId shared_reqids[PG_IOV_MAX];
+	int			n_shared = 0;
+	bool		any_request = true;
+	uint64		gather_until = 0;
+	int			n_gather = 0;
 
 	Assert(PointerIsValid(request_lsns));
 	Assert(nblocks >= 1);
@@ -2112,6 +3135,40 @@ communicator_read_at_lsnv(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber ba
 	hashkey.buftag.forkNum = forkNum;
 	hashkey.buftag.blockNum = base_blockno;
 
+	if (shared_prefetch_hash != NULL)
+	{
+		/*
+		 * Don't request the pages that another backend already has in
+		 * flight, we'll wait for those below.
+		 */
+		Assert(nblocks <= PG_IOV_MAX);
+		if (PointerIsValid(mask))
+			memcpy(shared_mask, mask, sizeof(shared_mask));
+		else
+			memset(shared_mask, 0, sizeof(shared_mask));
+		memset(shared_pending, 0, sizeof(shared_pending));
+		any_request = false;
+
+		for (int i = 0; i < nblocks; i++)
+		{
+			if (BITMAP_ISSET(shared_mask, i))
+				continue;
+
+			hashkey.buftag.blockNum = base_blockno + i;
+			if (prfh_lookup(MyPState->prf_hash, &hashkey) == NULL &&
+				shared_prefetch_lookup(&hashkey.buftag, &request_lsns[i], &shared_reqids[i]))
+			{
+				BITMAP_SET(shared_mask, i);
+				BITMAP_SET(shared_pending, i);
+				n_shared += 1;
+			}
+			else
+				any_request = true;
+		}
+		hashkey.buftag.blockNum = base_blockno;
+		mask = shared_mask;
+	}
+
 	/*
 	 * The redo process does not lock pages that it needs to replay but are
 	 * not in the shared buffers, so a concurrent process may request the page
@@ -2128,134 +3185,200 @@ communicator_read_at_lsnv(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber ba
 	 * weren't for the behaviour of the LwLsn cache that uses the highest
 	 * value of the LwLsn cache when the entry is not found.
 	 */
-	(void) prefetch_register_bufferv(hashkey.buftag, request_lsns, nblocks, mask, false);
+	if (any_request)
+		(void) prefetch_register_bufferv(hashkey.buftag, request_lsns, nblocks, mask, false);
 
-	for (int i = 0; i < nblocks; i++)
+	/*
+	 * Pages that another backend had in flight are read from the LFC once
+	 * its request completes. If that fails, we request them ourselves in the
+	 * loop below.
+	 */
+	for (int i = 0; n_shared > 0 && i < nblocks; i++)
 	{
-		void	   *buffer = buffers[i];
-		BlockNumber blockno = base_blockno + i;
-		neon_request_lsns *reqlsns = &request_lsns[i];
-		TimestampTz		start_ts, end_ts;
+		if (!BITMAP_ISSET(shared_pending, i))
+			continue;
+
+		/* see the comment on hot standby above */
+		if (RecoveryInProgress() && MyBackendType != B_STARTUP)
+			XLogWaitForReplayOf(request_lsns[i].request_lsn);
+
+		hashkey.buftag.blockNum = base_blockno + i;
+		if (shared_prefetch_wait(&hashkey.buftag, shared_reqids[i]) &&
+			lfc_read(rinfo, forkNum, base_blockno + i, buffers[i]))
+			MyNeonCounters->getpage_shared_prefetch_hits_total++;
+		else
+			BITMAP_CLR(shared_mask, i);
+	}
 
+	/*
+	 * Let the pages we're going to wait for be received directly into the
+	 * caller's buffers.
+	 */
+	for (int i = 0; i < nblocks; i++)
+	{
 		if (PointerIsValid(mask) && BITMAP_ISSET(mask, i))
 			continue;
 
-		start_ts = GetCurrentTimestamp();
+		hashkey.buftag.blockNum = base_blockno + i;
+		entry = prfh_lookup(MyPState->prf_hash, &hashkey);
 
-		if (RecoveryInProgress() && MyBackendType != B_STARTUP)
-			XLogWaitForReplayOf(reqlsns->request_lsn);
+		if (entry != NULL && entry->slot->status == PRFS_REQUESTED &&
+			neon_prefetch_response_usable(&request_lsns[i], entry->slot))
+		{
+			entry->slot->target = buffers[i];
+			gather_until = Max(gather_until, entry->slot->my_ring_index);
+			n_gather++;
+		}
+	}
 
+	PG_TRY();
+	{
 		/*
-		 * Try to find prefetched page in the list of received pages.
+		 * If the pages come from several shards, receive them in whatever
+		 * order the shards respond. If that fails, the loop below retries.
 		 */
-Retry:
-		hashkey.buftag.blockNum = blockno;
-		entry = prfh_lookup(MyPState->prf_hash, &hashkey);
+		if (n_gather > 1)
+			(void) prefetch_gather(gather_until);
 
-		if (entry != NULL)
+		for (int i = 0; i < nblocks; i++)
 		{
-			slot = entry->slot;
-			if (neon_prefetch_response_usable(reqlsns, slot))
-			{
-				ring_index = slot->my_ring_index;
-			}
-			else
+			void	   *buffer = buffers[i];
+			BlockNumber blockno = base_blockno + i;
+			neon_request_lsns *reqlsns = &request_lsns[i];
+			TimestampTz		start_ts, end_ts;
+
+			if (PointerIsValid(mask) && BITMAP_ISSET(mask, i))
+				continue;
+
+			start_ts = GetCurrentTimestamp();
+
+			if (RecoveryInProgress() && MyBackendType != B_STARTUP)
+				XLogWaitForReplayOf(reqlsns->request_lsn);
+
+			/*
+			 * Try to find prefetched page in the list of received pages.
+			 */
+Retry:
+			hashkey.buftag.blockNum = blockno;
+			entry = prfh_lookup(MyPState->prf_hash, &hashkey);
+
+			if (entry != NULL)
 			{
-				/*
-				 * Cannot use this prefetch, discard it
-				 *
-				 * We can't drop cache for not-yet-received requested items. It is
-				 * unlikely this happens, but it can happen if prefetch distance
-				 * is large enough and a backend didn't consume all prefetch
-				 * requests.
-				 */
-				if (slot->status == PRFS_REQUESTED)
+				slot = entry->slot;
+				if (neon_prefetch_response_usable(reqlsns, slot))
 				{
-					if (!prefetch_wait_for(slot->my_ring_index))
-						goto Retry;
+					ring_index = slot->my_ring_index;
+				}
+				else
+				{
+					/*
+					 * Cannot use this prefetch, discard it
+					 *
+					 * We can't drop cache for not-yet-received requested items. It is
+					 * unlikely this happens, but it can happen if prefetch distance
+					 * is large enough and a backend didn't consume all prefetch
+					 * requests.
+					 */
+					if (slot->status == PRFS_REQUESTED)
+					{
+						if (!prefetch_wait_for(slot->my_ring_index))
+							goto Retry;
+					}
+					/* drop caches */
+					prefetch_set_unused(slot->my_ring_index);
+					pgBufferUsage.prefetch.expired += 1;
+					MyNeonCounters->getpage_prefetch_discards_total++;
+					/* make it look like a prefetch cache miss */
+					entry = NULL;
 				}
-				/* drop caches */
-				prefetch_set_unused(slot->my_ring_index);
-				pgBufferUsage.prefetch.expired += 1;
-				MyNeonCounters->getpage_prefetch_discards_total++;
-				/* make it look like a prefetch cache miss */
-				entry = NULL;
 			}
-		}
 
-		do
-		{
-			if (entry == NULL)
-			{
-				ring_index = prefetch_register_bufferv(hashkey.buftag, reqlsns, 1, NULL, false);
-				Assert(ring_index != UINT64_MAX);
-				slot = GetPrfSlot(ring_index);
-			}
-			else
+			do
 			{
-				/*
-				 * Empty our reference to the prefetch buffer's hash entry. When
-				 * we wait for prefetches, the entry reference is invalidated by
-				 * potential updates to the hash, and when we reconnect to the
-				 * pageserver the prefetch we're waiting for may be dropped, in
-				 * which case we need to retry and take the branch above.
-				 */
-				entry = NULL;
-			}
+				if (entry == NULL)
+				{
+					ring_index = prefetch_register_bufferv(hashkey.buftag, reqlsns, 1, NULL, false);
+					Assert(ring_index != UINT64_MAX);
+					slot = GetPrfSlot(ring_index);
+				}
+				else
+				{
+					/*
+					 * Empty our reference to the prefetch buffer's hash entry. When
+					 * we wait for prefetches, the entry reference is invalidated by
+					 * potential updates to the hash, and when we reconnect to the
+					 * pageserver the prefetch we're waiting for may be dropped, in
+					 * which case we need to retry and take the branch above.
+					 */
+					entry = NULL;
+				}
 
-			Assert(slot->my_ring_index == ring_index);
-			Assert(MyPState->ring_last <= ring_index &&
-				   MyPState->ring_unused > ring_index);
-			Assert(slot->status != PRFS_UNUSED);
-			Assert(GetPrfSlot(ring_index) == slot);
+				Assert(slot->my_ring_index == ring_index);
+				Assert(MyPState->ring_last <= ring_index &&
+					   MyPState->ring_unused > ring_index);
+				Assert(slot->status != PRFS_UNUSED);
+				Assert(GetPrfSlot(ring_index) == slot);
 
-		} while (!prefetch_wait_for(ring_index));
+				/* receive the page directly into the caller's buffer */
+				if (slot->status == PRFS_REQUESTED)
+					slot->target = buffer;
+			} while (!prefetch_wait_for(ring_index));
 
-		Assert(slot->status == PRFS_RECEIVED);
-		Assert(memcmp(&hashkey.buftag, &slot->buftag, sizeof(BufferTag)) == 0);
-		Assert(hashkey.buftag.blockNum == base_blockno + i);
+			Assert(slot->status == PRFS_RECEIVED);
+			Assert(memcmp(&hashkey.buftag, &slot->buftag, sizeof(BufferTag)) == 0);
+			Assert(hashkey.buftag.blockNum == base_blockno + i);
 
-		/* We already checked that response match request when storing it in slot */
-		resp = slot->response;
+			/* We already checked that response match request when storing it in slot */
+			resp = slot->response;
 
-		switch (resp->tag)
-		{
-			case T_NeonGetPageResponse:
+			switch (resp->tag)
 			{
-				NeonGetPageResponse* getpage_resp = (NeonGetPageResponse *) resp;
-				memcpy(buffer, getpage_resp->page, BLCKSZ);
-
-				/*
-				 * With lfc_store_prefetch_result=true prefetch result is stored in LFC in prefetch_pump_state when response is received
-				 * from page server. But if lfc_store_prefetch_result=false then it is not yet stored in LFC and we have to do it here
-				 * under buffer lock.
-				 */
-				if (!lfc_store_prefetch_result)
-					lfc_write(rinfo, forkNum, blockno, buffer);
-				break;
+				case T_NeonGetPageResponse:
+				{
+					char	   *page = prefetch_slot_page(slot);
+
+					if (page != buffer)
+						memcpy(buffer, page, BLCKSZ);
+
+					/*
+					 * With lfc_store_prefetch_result=true prefetch result is stored in LFC in prefetch_pump_state when response is received
+					 * from page server. But if lfc_store_prefetch_result=false then it is not yet stored in LFC and we have to do it here
+					 * under buffer lock.
+					 */
+					if (!lfc_store_prefetch_result)
+						lfc_write(rinfo, forkNum, blockno, buffer);
+					break;
+				}
+				case T_NeonErrorResponse:
+					ereport(ERROR,
+							(errcode(ERRCODE_IO_ERROR),
+							 errmsg(NEON_TAG "[shard %d, reqid " UINT64_HEX_FORMAT "] could not read block %u in rel %u/%u/%u.%u from page server at lsn %X/%08X",
+									slot->shard_no, resp->reqid, blockno, RelFileInfoFmt(rinfo),
+									forkNum, LSN_FORMAT_ARGS(reqlsns->effective_request_lsn)),
+							 errdetail("page server returned error: %s",
+									   ((NeonErrorResponse *) resp)->message)));
+					break;
+				default:
+					NEON_PANIC_CONNECTION_STATE(slot->shard_no, PANIC,
+												"Expected GetPage (0x%02x) or Error (0x%02x) response to GetPageRequest, but got 0x%02x",
+												T_NeonGetPageResponse, T_NeonErrorResponse, resp->tag);
 			}
-			case T_NeonErrorResponse:
-				ereport(ERROR,
-						(errcode(ERRCODE_IO_ERROR),
-						 errmsg(NEON_TAG "[shard %d, reqid " UINT64_HEX_FORMAT "] could not read block %u in rel %u/%u/%u.%u from page server at lsn %X/%08X",
-								slot->shard_no, resp->reqid, blockno, RelFileInfoFmt(rinfo),
-								forkNum, LSN_FORMAT_ARGS(reqlsns->effective_request_lsn)),
-						 errdetail("page server returned error: %s",
-								   ((NeonErrorResponse *) resp)->message)));
-				break;
-			default:
-				NEON_PANIC_CONNECTION_STATE(slot->shard_no, PANIC,
-											"Expected GetPage (0x%02x) or Error (0x%02x) response to GetPageRequest, but got 0x%02x",
-											T_NeonGetPageResponse, T_NeonErrorResponse, resp->tag);
-		}
 
-		/* buffer was used, clean up for later reuse */
-		prefetch_set_unused(ring_index);
-		prefetch_cleanup_trailing_unused();
+			/* buffer was used, clean up for later reuse */
+			prefetch_set_unused(ring_index);
+			prefetch_cleanup_trailing_unused();
 
-		end_ts = GetCurrentTimestamp();
-		inc_getpage_wait(end_ts >= start_ts ? (end_ts - start_ts) : 0);
+			end_ts = GetCurrentTimestamp();
+			inc_getpage_wait(end_ts >= start_ts ? (end_ts - start_ts) : 0);
+		}
 	}
+	PG_CATCH();
+	{
+		/* the buffers are no longer ours to fill */
+		prefetch_drop_targets();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
 }
 
 /*
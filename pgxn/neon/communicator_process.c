@@ -3,10 +3,16 @@
  * communicator_process.c
  *	  Functions for starting up the communicator background worker process.
  *
- * Currently, the communicator process only functions as a metrics
- * exporter. It provides an HTTP endpoint for polling a limited set of
- * metrics. TODO: In the future, it will do much more, i.e. handle all
- * the communications with the pageservers.
+ * The communicator process functions as a metrics exporter. It provides an
+ * HTTP endpoint for polling a limited set of metrics. TODO: In the future, it
+ * will handle all the communications with the pageservers.
+ *
+ * With neon.pageserver_transport=communicator, a second worker, the
+ * forwarder, forwards the backends' GetPage, Nblocks and Exists requests to
+ * the pageservers over its own connections, see communicator_queue.c. That's
+ * a separate process because the communicator process is multi-threaded, and
+ * forwarding needs libpq, palloc and elog(ERROR), which are not safe to use
+ * there.
  *
  * Portions Copyright (c) 1996-2021, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -30,6 +36,7 @@
 #include "utils/timestamp.h"
 
 #include "communicator_process.h"
+#include "communicator_queue.h"
 #include "file_cache.h"
 #include "neon.h"
 #include "neon_perf_counters.h"
@@ -39,6 +46,7 @@
 
 static void pump_logging(struct LoggingReceiver *logging);
 PGDLLEXPORT void communicator_new_bgworker_main(Datum main_arg);
+PGDLLEXPORT void communicator_forwarder_main(Datum main_arg);
 
 /**** Initialization functions. These run in postmaster ****/
 
@@ -60,6 +68,22 @@ pg_init_communicator_process(void)
 	bgw.bgw_main_arg = (Datum) 0;
 
 	RegisterBackgroundWorker(&bgw);
+
+	if (pageserver_transport == PAGESERVER_TRANSPORT_COMMUNICATOR)
+	{
+		memset(&bgw, 0, sizeof(bgw));
+		bgw.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		bgw.bgw_start_time = BgWorkerStart_PostmasterStart;
+		snprintf(bgw.bgw_library_name, BGW_MAXLEN, "neon");
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN, "communicator_forwarder_main");
+		snprintf(bgw.bgw_name, BGW_MAXLEN, "Storage communicator forwarder");
+		snprintf(bgw.bgw_type, BGW_MAXLEN, "Storage communicator forwarder");
+		bgw.bgw_restart_time = 5;
+		bgw.bgw_notify_pid = 0;
+		bgw.bgw_main_arg = (Datum) 0;
+
+		RegisterBackgroundWorker(&bgw);
+	}
 }
 
 /**** Worker process functions. These run in the communicator worker process ****/
@@ -190,6 +214,53 @@ communicator_new_bgworker_main(Datum main_arg)
 	}
 }
 
+/*
+ * Entry point for the forwarder bgworker process, with
+ * neon.pageserver_transport=communicator
+ *
+ * This is a plain single-threaded process, so unlike in the communicator
+ * process, it's safe to use libpq, palloc and ereport here.
+ */
+void
+communicator_forwarder_main(Datum main_arg)
+{
+	/*
+	 * Backends need the forwarder until they have exited, so shut down last,
+	 * like the communicator process.
+	 */
+	am_walsender = true;
+	MarkPostmasterChildWalSender();
+
+	/* Establish signal handlers. */
+	pqsignal(SIGUSR1, procsignal_sigusr1_handler);
+	pqsignal(SIGUSR2, die);
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, die);
+
+	BackgroundWorkerUnblockSignals();
+
+	communicator_queue_worker_init();
+
+	for (;;)
+	{
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		/*
+		 * Send the queued requests and collect the responses, then wait
+		 * until a backend queues more, or a pageserver responds.
+		 */
+		communicator_queue_process();
+		communicator_queue_wait();
+	}
+}
+
 static void
 pump_logging(struct LoggingReceiver *logging)
 {
@@ -0,0 +1,1352 @@
+/*-------------------------------------------------------------------------
+ *
+ * communicator_queue.c
+ *	  Multiplexes the backends' page server requests over the connections of
+ *	  the communicator forwarder process.
+ *
+ * With neon.pageserver_transport=communicator, backends don't open their own
+ * page server connections for GetPage, Nblocks and Exists requests. Instead,
+ * a backend packs the request into a slot of its own channel in shared
+ * memory, and puts the slot on the submission queue. The forwarder process
+ * (see communicator_process.c), called "the communicator" below, takes the
+ * requests off the queue, and sends them over a single pipelined connection
+ * per shard. When a response arrives, the communicator
+ * copies the raw message into the request's slot and sets the backend's
+ * latch. The backend unpacks the response itself, so that GetPage responses
+ * can still be unpacked straight into the destination buffer.
+ *
+ * This file implements both sides: the page_server_api that backends use,
+ * and the forwarding loop of the forwarder process.
+ *
+ * The responses to a backend's requests on a shard are received in the
+ * order the requests were sent, like on a direct connection, so the
+ * prefetch ring in communicator.c doesn't need to know which transport is
+ * in use. Requests of other types (DbSize and SLRU segment requests, whose
+ * responses don't fit in a slot, and batched GetPage requests) are sent over
+ * the backend's own connection. The backend remembers which route each
+ * request took, so that it can return the responses in the right order.
+ *
+ * The submission queue is a lock-free ring: backends claim a position with
+ * an atomic increment, and publish the submission through the position's
+ * sequence number. Only the communicator consumes from it, so taking a
+ * submission off the ring needs no atomic read-modify-write operations.
+ *
+ * A slot goes from FREE to SUBMITTED when the backend queues a request, to
+ * FORWARDED when the communicator takes it off the queue, to DONE or FAILED
+ * when the communicator has received the response or lost the connection,
+ * and back to FREE once the backend has consumed the response. A backend
+ * can't take a request back from the communicator once it has been
+ * submitted, so if the backend abandons it, e.g. because the query was
+ * canceled, it only marks the slot as orphaned in its local state, and
+ * reuses the slot once the communicator is done with it.
+ *
+ * Portions Copyright (c) 1996-2021, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <signal.h>
+
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/s_lock.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include "communicator_queue.h"
+#include "neon.h"
+#include "neon_perf_counters.h"
+#include "pagestore_client.h"
+
+#define CQ_MAX_REQUEST_SIZE		64
+#define CQ_MAX_RESPONSE_SIZE	(BLCKSZ + 128)
+
+/* How often a waiting backend checks that the communicator is still there */
+#define CQ_ALIVE_CHECK_INTERVAL_MS	1000
+
+/*
+ * How long a backend waits for the communicator to start, or to be restarted
+ * after a crash, before failing the request. The postmaster restarts it 5
+ * seconds after it exits.
+ */
+#define CQ_STARTUP_TIMEOUT_MS		10000
+#define CQ_STARTUP_CHECK_INTERVAL_MS	100
+
+typedef enum
+{
+	CQ_SLOT_FREE,
+	CQ_SLOT_SUBMITTED,
+	CQ_SLOT_FORWARDED,
+	CQ_SLOT_DONE,
+	CQ_SLOT_FAILED,
+} CommunicatorSlotState;
+
+typedef struct
+{
+	pg_atomic_uint32 state;		/* CommunicatorSlotState */
+	shardno_t	shard_no;
+	uint16		request_len;
+	uint32		response_len;
+	char		request[CQ_MAX_REQUEST_SIZE];
+	char		response[CQ_MAX_RESPONSE_SIZE];
+} CommunicatorSlot;
+
+typedef struct
+{
+	uint32		procno;
+	uint32		slotno;
+} CommunicatorSubmission;
+
+/*
+ * A position in the submission ring. 'seq' equals the position when it's
+ * free for a backend to fill, position + 1 once the submission has been
+ * published, and position + nslots when the communicator has taken it, which
+ * frees it for the next lap.
+ */
+typedef struct
+{
+	pg_atomic_uint64 seq;
+	CommunicatorSubmission sub;
+} CommunicatorQueueEntry;
+
+/*
+ * Each slot is on the submission queue at most once, so a queue with room
+ * for all slots can't overflow.
+ */
+typedef struct
+{
+	Latch	   *communicator_latch; /* NULL if the communicator isn't running */
+	pid_t		communicator_pid;	/* 0 if the communicator isn't running */
+	int			protocol_version;	/* of the communicator's connections */
+	uint32		nslots;
+
+	/* claimed by backends */
+	pg_atomic_uint64 submit_tail pg_attribute_aligned(PG_CACHE_LINE_SIZE);
+
+	/* next submission for the communicator, only accessed by it */
+	uint64		submit_head pg_attribute_aligned(PG_CACHE_LINE_SIZE);
+
+	/* followed by the submission queue, and the slots of all channels */
+} CommunicatorQueueShared;
+
+static CommunicatorQueueShared *cq_shared;
+static CommunicatorQueueEntry *cq_submissions;
+static CommunicatorSlot *cq_slots;
+
+static inline CommunicatorSlot *
+cq_slot(uint32 procno, uint32 slotno)
+{
+	return &cq_slots[(Size) procno * communicator_queue_depth + slotno];
+}
+
+static inline bool
+cq_in_flight(uint32 state)
+{
+	return state == CQ_SLOT_SUBMITTED || state == CQ_SLOT_FORWARDED;
+}
+
+/**** Backend side ****/
+
+typedef enum
+{
+	CQ_ROUTE_QUEUE,				/* in a slot, forwarded by the communicator */
+	CQ_ROUTE_STASHED,			/* completed, response copied to local memory */
+	CQ_ROUTE_DIRECT,			/* sent over the backend's own connection */
+} CQRoute;
+
+typedef struct
+{
+	shardno_t	shard_no;
+	CQRoute		route;
+	int			slotno;			/* CQ_ROUTE_QUEUE */
+	char	   *data;			/* CQ_ROUTE_STASHED, NULL if failed */
+	int			len;
+} CQPendingRequest;
+
+static CommunicatorSlot *my_slots;
+static bool *my_slot_orphaned;
+
+/* Requests in flight, oldest first, in a ring of power-of-two size */
+static CQPendingRequest *cq_pending;
+static uint32 cq_pending_size;
+static uint32 cq_pending_head;
+static uint32 cq_npending;
+
+#define CQ_PENDING(i) (&cq_pending[(cq_pending_head + (i)) & (cq_pending_size - 1)])
+
+/* Have we submitted requests since we last woke up the communicator? */
+static bool cq_needs_wakeup;
+static bool cq_direct_unflushed[MAX_SHARDS + 1];
+
+static void
+cq_attach(void)
+{
+	if (my_slots != NULL)
+		return;
+
+	if (cq_shared == NULL)
+		neon_log(ERROR, "communicator queue is not initialized");
+
+	my_slots = cq_slot(MyProcNumber, 0);
+	my_slot_orphaned = MemoryContextAllocZero(TopMemoryContext,
+											  communicator_queue_depth * sizeof(bool));
+
+	/*
+	 * A backend that previously used this PGPROC entry may have exited with
+	 * requests still in flight.
+	 */
+	for (int i = 0; i < communicator_queue_depth; i++)
+	{
+		if (pg_atomic_read_u32(&my_slots[i].state) != CQ_SLOT_FREE)
+			my_slot_orphaned[i] = true;
+	}
+
+	cq_pending_size = 64;
+	cq_pending = MemoryContextAlloc(TopMemoryContext,
+									cq_pending_size * sizeof(CQPendingRequest));
+}
+
+static CQPendingRequest *
+cq_pending_push(shardno_t shard_no, CQRoute route)
+{
+	CQPendingRequest *entry;
+
+	if (cq_npending == cq_pending_size)
+	{
+		CQPendingRequest *grown;
+
+		grown = MemoryContextAlloc(TopMemoryContext,
+								   2 * cq_pending_size * sizeof(CQPendingRequest));
+		for (uint32 i = 0; i < cq_npending; i++)
+			grown[i] = *CQ_PENDING(i);
+		pfree(cq_pending);
+		cq_pending = grown;
+		cq_pending_size *= 2;
+		cq_pending_head = 0;
+	}
+
+	entry = CQ_PENDING(cq_npending);
+	cq_npending++;
+
+	entry->shard_no = shard_no;
+	entry->route = route;
+	entry->slotno = -1;
+	entry->data = NULL;
+	entry->len = 0;
+	return entry;
+}
+
+/* Find the oldest request in flight on the shard */
+static int
+cq_pending_find(shardno_t shard_no)
+{
+	for (uint32 i = 0; i < cq_npending; i++)
+	{
+		if (CQ_PENDING(i)->shard_no == shard_no)
+			return i;
+	}
+	return -1;
+}
+
+static void
+cq_pending_remove(int idx)
+{
+	/* Usually this is the oldest entry, so shift the older ones forward */
+	for (int i = idx; i > 0; i--)
+		*CQ_PENDING(i) = *CQ_PENDING(i - 1);
+	cq_pending_head = (cq_pending_head + 1) & (cq_pending_size - 1);
+	cq_npending--;
+}
+
+static void
+cq_wakeup_communicator(void)
+{
+	Latch	   *latch;
+
+	if (!cq_needs_wakeup)
+		return;
+
+	/*
+	 * If the communicator isn't running, it will process the queue when it
+	 * starts up, unless the backend gives up on the requests first.
+	 */
+	latch = cq_shared->communicator_latch;
+	if (latch != NULL)
+		SetLatch(latch);
+	cq_needs_wakeup = false;
+}
+
+/*
+ * Is the communicator running? It clears communicator_pid when it exits, so
+ * this only needs to look further if it was killed without a chance to.
+ */
+static bool
+cq_communicator_alive(void)
+{
+	pid_t		pid = cq_shared->communicator_pid;
+
+	return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/*
+ * Wait for the communicator to be running. Errors out if it doesn't come up
+ * in CQ_STARTUP_TIMEOUT_MS.
+ */
+static void
+cq_wait_for_communicator(shardno_t shard_no)
+{
+	TimestampTz start = 0;
+
+	while (!cq_communicator_alive())
+	{
+		if (start == 0)
+			start = GetCurrentTimestamp();
+		else if (TimestampDifferenceExceeds(start, GetCurrentTimestamp(),
+											CQ_STARTUP_TIMEOUT_MS))
+			neon_shard_log(shard_no, ERROR, "communicator forwarder process is not running");
+
+		(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 CQ_STARTUP_CHECK_INTERVAL_MS, WAIT_EVENT_NEON_PS_STARTING);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Wait for the communicator to complete a request. If the communicator is
+ * not running, gives up and returns CQ_SLOT_FAILED, leaving the slot in
+ * flight. The caller must then release the slot with cq_release_slot().
+ */
+static uint32
+cq_wait_for_slot(CommunicatorSlot *slot)
+{
+	uint32		state;
+
+	while (cq_in_flight(state = pg_atomic_read_u32(&slot->state)))
+	{
+		if (!cq_communicator_alive())
+			return CQ_SLOT_FAILED;
+
+		cq_wakeup_communicator();
+
+		(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 CQ_ALIVE_CHECK_INTERVAL_MS, WAIT_EVENT_NEON_PS_READ);
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* Read the response only after seeing the state change */
+	pg_read_barrier();
+	return state;
+}
+
+/*
+ * Let go of a slot whose request we no longer care about.
+ */
+static void
+cq_release_slot(int slotno)
+{
+	if (cq_in_flight(pg_atomic_read_u32(&my_slots[slotno].state)))
+		my_slot_orphaned[slotno] = true;
+	else
+		pg_atomic_write_u32(&my_slots[slotno].state, CQ_SLOT_FREE);
+}
+
+/*
+ * Wait for a queued request to complete, and move its response to local
+ * memory, so that its slot can be reused.
+ */
+static void
+cq_stash(int slotno)
+{
+	CommunicatorSlot *slot = &my_slots[slotno];
+	uint32		state;
+
+	state = cq_wait_for_slot(slot);
+
+	/*
+	 * Interrupts processed while waiting may have consumed the response
+	 * already, so look the request up only now.
+	 */
+	for (uint32 i = 0; i < cq_npending; i++)
+	{
+		CQPendingRequest *entry = CQ_PENDING(i);
+
+		if (entry->route == CQ_ROUTE_QUEUE && entry->slotno == slotno)
+		{
+			if (state == CQ_SLOT_DONE)
+			{
+				entry->data = MemoryContextAlloc(TopMemoryContext, slot->response_len);
+				memcpy(entry->data, slot->response, slot->response_len);
+				entry->len = slot->response_len;
+			}
+			entry->route = CQ_ROUTE_STASHED;
+			entry->slotno = -1;
+
+			cq_release_slot(slotno);
+			break;
+		}
+	}
+}
+
+/*
+ * Find a free slot for a new request on the shard.
+ */
+static int
+cq_acquire_slot(shardno_t shard_no)
+{
+	for (;;)
+	{
+		int			oldest = -1;
+
+		for (int i = 0; i < communicator_queue_depth; i++)
+		{
+			uint32		state = pg_atomic_read_u32(&my_slots[i].state);
+
+			if (my_slot_orphaned[i])
+			{
+				if (cq_in_flight(state))
+					continue;
+				my_slot_orphaned[i] = false;
+				pg_atomic_write_u32(&my_slots[i].state, CQ_SLOT_FREE);
+				return i;
+			}
+			if (state == CQ_SLOT_FREE)
+				return i;
+		}
+
+		/*
+		 * All slots are in use. Wait for our oldest queued request to
+		 * complete, and make room by moving its response to local memory.
+		 */
+		for (uint32 i = 0; i < cq_npending; i++)
+		{
+			if (CQ_PENDING(i)->route == CQ_ROUTE_QUEUE)
+			{
+				oldest = CQ_PENDING(i)->slotno;
+				break;
+			}
+		}
+
+		if (oldest >= 0)
+			cq_stash(oldest);
+		else
+		{
+			/*
+			 * Only orphaned requests are in flight, wait for any of them. If
+			 * the communicator has died, its successor fails them when it
+			 * starts up.
+			 */
+			cq_wait_for_communicator(shard_no);
+			cq_wakeup_communicator();
+			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+							 CQ_ALIVE_CHECK_INTERVAL_MS, WAIT_EVENT_NEON_PS_READ);
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+}
+
+static void
+cq_submit(int slotno)
+{
+	CommunicatorQueueEntry *entry;
+	SpinDelayStatus delay;
+	uint64		pos;
+
+	pg_atomic_write_u32(&my_slots[slotno].state, CQ_SLOT_SUBMITTED);
+
+	pos = pg_atomic_fetch_add_u64(&cq_shared->submit_tail, 1);
+	entry = &cq_submissions[pos % cq_shared->nslots];
+
+	/*
+	 * The submission that was in this position one lap earlier has already
+	 * been taken by the communicator, or is being taken right now: there
+	 * can't be more submissions in the queue than there are slots.
+	 */
+	init_local_spin_delay(&delay);
+	while (pg_atomic_read_u64(&entry->seq) != pos)
+		perform_spin_delay(&delay);
+	finish_spin_delay(&delay);
+
+	entry->sub.procno = MyProcNumber;
+	entry->sub.slotno = slotno;
+
+	/* Publish the request, and the submission */
+	pg_write_barrier();
+	pg_atomic_write_u64(&entry->seq, pos + 1);
+
+	cq_needs_wakeup = true;
+}
+
+static void
+cq_disconnect(shardno_t shard_no)
+{
+	if (my_slots != NULL)
+	{
+		for (uint32 i = 0; i < cq_npending;)
+		{
+			CQPendingRequest *entry = CQ_PENDING(i);
+
+			if (entry->shard_no != shard_no)
+			{
+				i++;
+				continue;
+			}
+
+			if (entry->route == CQ_ROUTE_QUEUE)
+				cq_release_slot(entry->slotno);
+			else if (entry->route == CQ_ROUTE_STASHED && entry->data != NULL)
+				pfree(entry->data);
+			cq_pending_remove(i);
+		}
+	}
+
+	cq_direct_unflushed[shard_no] = false;
+	if (shard_no != CQ_STAND_IN_SHARD)
+		pageserver_direct_api.disconnect(shard_no);
+}
+
+/*
+ * The equivalent of losing the connection to the shard: any prefetch
+ * requests in flight are thrown away, like pageserver_disconnect() does.
+ */
+static void
+cq_connection_lost(shardno_t shard_no)
+{
+	prefetch_on_ps_disconnect();
+	cq_disconnect(shard_no);
+}
+
+/*
+ * Send a request over the backend's own connection.
+ */
+static bool
+cq_send_direct(shardno_t shard_no, NeonRequest *request)
+{
+	if (shard_no == CQ_STAND_IN_SHARD)
+		neon_log(ERROR, "cannot send request with tag %d to the stand-in server",
+				 messageTag(request));
+	if (!pageserver_direct_api.send(shard_no, request))
+		return false;
+	(void) cq_pending_push(shard_no, CQ_ROUTE_DIRECT);
+	cq_direct_unflushed[shard_no] = true;
+	return true;
+}
+
+static bool
+cq_send(shardno_t shard_no, NeonRequest *request)
+{
+	CQPendingRequest *entry;
+	CommunicatorSlot *slot;
+	StringInfoData req_buff;
+	int			slotno;
+
+	cq_attach();
+
+	/*
+	 * neon.protocol_version can be set per session. The communicator
+	 * forwards the requests as they are, so it can only take requests packed
+	 * for the protocol version of its own connections.
+	 */
+	if (neon_protocol_version != cq_shared->protocol_version)
+		return cq_send_direct(shard_no, request);
+
+	switch (messageTag(request))
+	{
+		case T_NeonExistsRequest:
+		case T_NeonNblocksRequest:
+		case T_NeonGetPageRequest:
+			break;
+		default:
+			return cq_send_direct(shard_no, request);
+	}
+
+	/*
+	 * While the communicator is not running, e.g. before it has started, or
+	 * while it's being restarted, wait for it rather than fall back to the
+	 * backend's own connection: with many backends, that would open as many
+	 * connections as the communicator is there to avoid.
+	 */
+	cq_wait_for_communicator(shard_no);
+	slotno = cq_acquire_slot(shard_no);
+	slot = &my_slots[slotno];
+
+	MyNeonCounters->pageserver_requests_sent_total++;
+
+	request->reqid = pageserver_next_request_id();
+	req_buff = nm_pack_request(request);
+	if (req_buff.len > CQ_MAX_REQUEST_SIZE)
+		neon_shard_log(shard_no, ERROR, "request of %d bytes does not fit in the communicator queue",
+					   req_buff.len);
+	memcpy(slot->request, req_buff.data, req_buff.len);
+	slot->request_len = req_buff.len;
+	slot->shard_no = shard_no;
+	pfree(req_buff.data);
+
+	entry = cq_pending_push(shard_no, CQ_ROUTE_QUEUE);
+	entry->slotno = slotno;
+	cq_submit(slotno);
+
+	return true;
+}
+
+static bool
+cq_flush(shardno_t shard_no)
+{
+	if (cq_direct_unflushed[shard_no])
+	{
+		cq_direct_unflushed[shard_no] = false;
+		if (!pageserver_direct_api.flush(shard_no))
+			return false;
+	}
+
+	if (cq_needs_wakeup)
+	{
+		MyNeonCounters->pageserver_send_flushes_total++;
+		cq_wakeup_communicator();
+	}
+	return true;
+}
+
+static NeonResponse *
+cq_unpack(shardno_t shard_no, char *data, int len)
+{
+	StringInfoData resp_buff;
+
+	resp_buff.data = data;
+	resp_buff.len = len;
+	resp_buff.maxlen = len;
+	resp_buff.cursor = 0;
+
+	return nm_unpack_response(&resp_buff);
+}
+
+static NeonResponse *
+cq_receive_internal(shardno_t shard_no, bool wait)
+{
+	CQPendingRequest entry;
+	NeonResponse *resp = NULL;
+	CommunicatorSlot *slot;
+	int			idx;
+
+	idx = cq_pending_find(shard_no);
+	if (idx < 0)
+	{
+		if (wait)
+			neon_shard_log(shard_no, LOG, "pageserver_receive: no request in flight");
+		return NULL;
+	}
+	entry = *CQ_PENDING(idx);
+
+	switch (entry.route)
+	{
+		case CQ_ROUTE_DIRECT:
+			if (wait)
+				resp = pageserver_direct_api.receive(shard_no);
+			else
+				resp = pageserver_direct_api.try_receive(shard_no);
+
+			/*
+			 * Interrupts processed while receiving can consume responses on
+			 * other shards, so look the entry up again.
+			 */
+			if (resp != NULL)
+				cq_pending_remove(cq_pending_find(shard_no));
+			else if (wait)
+			{
+				/*
+				 * The connection was lost. The direct transport has normally
+				 * thrown away our requests already, but make sure.
+				 */
+				cq_disconnect(shard_no);
+			}
+			return resp;
+
+		case CQ_ROUTE_STASHED:
+			cq_pending_remove(idx);
+			if (entry.data == NULL)
+				break;
+			PG_TRY();
+			{
+				resp = cq_unpack(shard_no, entry.data, entry.len);
+			}
+			PG_CATCH();
+			{
+				pfree(entry.data);
+				neon_shard_log(shard_no, LOG, "pageserver_receive: disconnect due to failure while parsing response");
+				cq_connection_lost(shard_no);
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			pfree(entry.data);
+			return resp;
+
+		case CQ_ROUTE_QUEUE:
+			slot = &my_slots[entry.slotno];
+			if (!wait && cq_in_flight(pg_atomic_read_u32(&slot->state)))
+			{
+				cq_wakeup_communicator();
+				return NULL;
+			}
+
+			/*
+			 * If we're interrupted while waiting, the request stays in flight,
+			 * and the caller disconnects to get rid of it.
+			 */
+			if (cq_wait_for_slot(slot) == CQ_SLOT_FAILED)
+			{
+				cq_pending_remove(cq_pending_find(shard_no));
+				cq_release_slot(entry.slotno);
+				break;
+			}
+
+			PG_TRY();
+			{
+				resp = cq_unpack(shard_no, slot->response, slot->response_len);
+			}
+			PG_CATCH();
+			{
+				neon_shard_log(shard_no, LOG, "pageserver_receive: disconnect due to failure while parsing response");
+				cq_connection_lost(shard_no);
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+
+			cq_pending_remove(cq_pending_find(shard_no));
+			cq_release_slot(entry.slotno);
+			return resp;
+	}
+
+	/* The communicator lost the connection, or couldn't establish it */
+	neon_shard_log(shard_no, LOG, "pageserver_receive: communicator could not complete the request");
+	cq_connection_lost(shard_no);
+	return NULL;
+}
+
+static NeonResponse *
+cq_receive(shardno_t shard_no)
+{
+	return cq_receive_internal(shard_no, true);
+}
+
+static NeonResponse *
+cq_try_receive(shardno_t shard_no)
+{
+	return cq_receive_internal(shard_no, false);
+}
+
+page_server_api communicator_queue_api =
+{
+	.send = cq_send,
+	.flush = cq_flush,
+	.receive = cq_receive,
+	.try_receive = cq_try_receive,
+	.disconnect = cq_disconnect
+};
+
+/*
+ * For neon_test_utils, which can only look up functions in this module.
+ * Returns NULL if the communicator transport is not in use.
+ */
+page_server_api *
+communicator_queue_get_api(void)
+{
+	return cq_shared != NULL ? &communicator_queue_api : NULL;
+}
+
+/**** Forwarder process side ****/
+
+typedef struct
+{
+	CommunicatorSubmission sub;
+	TimestampTz sent_at;
+} CQInflightRequest;
+
+/* The communicator's state of each shard */
+typedef struct
+{
+	/*
+	 * Requests not yet answered, oldest first, in a ring of nslots. Those
+	 * from 'sent' on are waiting for the connection to be established.
+	 */
+	CQInflightRequest *inflight;
+	uint64		head;
+	uint64		sent;
+	uint64		tail;
+
+	bool		unflushed;
+	TimestampTz connected_at;	/* the connection the requests were sent on */
+
+	/* the socket registered in cq_wes, and whether it's readable */
+	pgsocket	wes_sock;
+	uint32		wes_events;
+	TimestampTz wes_connected_at;
+	bool		readable;
+} CQShard;
+
+static CQShard cq_shards[MAX_SHARDS];
+static int	cq_nshards;			/* shards [0, cq_nshards) have been used */
+static WaitEventSet *cq_wes;
+
+/* The submission being forwarded, to fail it if we error out */
+static CommunicatorSubmission cq_current;
+static bool cq_current_valid;
+
+static void
+cq_complete(CommunicatorSubmission sub, CommunicatorSlotState state,
+			const char *data, int len)
+{
+	CommunicatorSlot *slot = cq_slot(sub.procno, sub.slotno);
+
+	if (state == CQ_SLOT_DONE)
+	{
+		memcpy(slot->response, data, len);
+		slot->response_len = len;
+	}
+
+	/* The backend must see the response before the state change */
+	pg_write_barrier();
+	pg_atomic_write_u32(&slot->state, state);
+
+	SetLatch(&GetPGProcByNumber(sub.procno)->procLatch);
+}
+
+static void
+cq_fail_shard(shardno_t shard_no)
+{
+	CQShard    *shard = &cq_shards[shard_no];
+
+	while (shard->head != shard->tail)
+		cq_complete(shard->inflight[shard->head++ % cq_shared->nslots].sub,
+					CQ_SLOT_FAILED, NULL, 0);
+	shard->sent = shard->tail;
+	shard->unflushed = false;
+}
+
+/*
+ * Send the requests that are waiting for the shard's connection, connecting
+ * first if needed. Doesn't wait for the pageserver: if the connection is not
+ * established yet, the requests keep waiting, and communicator_queue_wait()
+ * waits for the connection along with everything else.
+ */
+static void
+cq_send_queued(shardno_t shard_no)
+{
+	CQShard    *shard = &cq_shards[shard_no];
+	TimestampTz connected_at = 0;
+
+	if (shard->sent == shard->tail)
+		return;
+
+	switch (pageserver_connect_nowait(shard_no))
+	{
+		case PS_CONNECT_DONE:
+			break;
+		case PS_CONNECT_IN_PROGRESS:
+			return;
+		case PS_CONNECT_FAILED:
+			cq_fail_shard(shard_no);
+			return;
+	}
+
+	/*
+	 * If we had to reconnect, the requests sent on the old connection will
+	 * never be answered.
+	 */
+	(void) pageserver_socket(shard_no, &connected_at);
+	if (connected_at != shard->connected_at)
+	{
+		while (shard->head != shard->sent)
+			cq_complete(shard->inflight[shard->head++ % cq_shared->nslots].sub,
+						CQ_SLOT_FAILED, NULL, 0);
+		shard->connected_at = connected_at;
+	}
+
+	while (shard->sent != shard->tail)
+	{
+		CommunicatorSubmission sub = shard->inflight[shard->sent % cq_shared->nslots].sub;
+		CommunicatorSlot *slot = cq_slot(sub.procno, sub.slotno);
+
+		if (!pageserver_send_packed(shard_no, slot->request, slot->request_len))
+		{
+			cq_fail_shard(shard_no);
+			return;
+		}
+		shard->sent++;
+		shard->unflushed = true;
+	}
+}
+
+/*
+ * Answer a request sent to CQ_STAND_IN_SHARD. From protocol version 3 on,
+ * a response starts with the request's header and echoes its fields, so the
+ * response is the request with the response tag, followed by an empty result.
+ */
+static void
+cq_stand_in_respond(CommunicatorSubmission sub)
+{
+	CommunicatorSlot *slot = cq_slot(sub.procno, sub.slotno);
+	char		response[CQ_MAX_RESPONSE_SIZE];
+	int			len = slot->request_len;
+
+	if (neon_protocol_version < 3)
+	{
+		cq_complete(sub, CQ_SLOT_FAILED, NULL, 0);
+		return;
+	}
+
+	memcpy(response, slot->request, len);
+	switch ((NeonMessageTag) slot->request[0])
+	{
+		case T_NeonExistsRequest:
+			response[0] = T_NeonExistsResponse;
+			response[len++] = 0;
+			break;
+		case T_NeonNblocksRequest:
+			response[0] = T_NeonNblocksResponse;
+			memset(&response[len], 0, sizeof(uint32));
+			len += sizeof(uint32);
+			break;
+		case T_NeonGetPageRequest:
+			response[0] = T_NeonGetPageResponse;
+			memset(&response[len], 0, BLCKSZ);
+			len += BLCKSZ;
+			break;
+		default:
+			cq_complete(sub, CQ_SLOT_FAILED, NULL, 0);
+			return;
+	}
+
+	cq_complete(sub, CQ_SLOT_DONE, response, len);
+}
+
+static bool
+cq_dequeue(CommunicatorSubmission *out)
+{
+	uint64		pos = cq_shared->submit_head;
+	CommunicatorQueueEntry *entry = &cq_submissions[pos % cq_shared->nslots];
+
+	if (pg_atomic_read_u64(&entry->seq) != pos + 1)
+		return false;
+	pg_read_barrier();
+
+	*out = entry->sub;
+
+	/* Hand the position over to the backend that fills it on the next lap */
+	pg_memory_barrier();
+	pg_atomic_write_u64(&entry->seq, pos + cq_shared->nslots);
+	cq_shared->submit_head = pos + 1;
+	return true;
+}
+
+static void
+cq_forward(CommunicatorSubmission sub)
+{
+	CommunicatorSlot *slot = cq_slot(sub.procno, sub.slotno);
+	uint32		expected = CQ_SLOT_SUBMITTED;
+	shardno_t	shard_no;
+	CQShard    *shard;
+	CQInflightRequest *req;
+
+	/*
+	 * If a previous incarnation of the communicator died while taking this
+	 * submission off the queue, it has been failed already, and the slot may
+	 * even have been reused. The request in the slot is then forwarded once,
+	 * by whichever submission is seen first.
+	 */
+	if (!pg_atomic_compare_exchange_u32(&slot->state, &expected, CQ_SLOT_FORWARDED))
+		return;
+
+	shard_no = slot->shard_no;
+	if (shard_no == CQ_STAND_IN_SHARD)
+	{
+		cq_stand_in_respond(sub);
+		return;
+	}
+
+	if (shard_no >= MAX_SHARDS)
+	{
+		cq_complete(sub, CQ_SLOT_FAILED, NULL, 0);
+		return;
+	}
+
+	shard = &cq_shards[shard_no];
+	if (shard->inflight == NULL)
+	{
+		shard->inflight = MemoryContextAlloc(TopMemoryContext,
+											 cq_shared->nslots * sizeof(CQInflightRequest));
+		shard->wes_sock = PGINVALID_SOCKET;
+		cq_nshards = Max(cq_nshards, shard_no + 1);
+	}
+
+	req = &shard->inflight[shard->tail++ % cq_shared->nslots];
+	req->sub = sub;
+	req->sent_at = GetCurrentTimestamp();
+}
+
+static void
+cq_collect(shardno_t shard_no)
+{
+	CQShard    *shard = &cq_shards[shard_no];
+
+	for (;;)
+	{
+		CQInflightRequest *req;
+		char	   *buf;
+		int			rc;
+
+		rc = pageserver_try_receive_packed(shard_no, &buf);
+		if (rc == 0)
+			break;
+		if (rc < 0)
+		{
+			cq_fail_shard(shard_no);
+			break;
+		}
+
+		if (shard->head == shard->sent)
+		{
+			neon_shard_log(shard_no, LOG, "unexpected response from pageserver with no request in flight");
+			PQfreemem(buf);
+			pageserver_direct_api.disconnect(shard_no);
+			break;
+		}
+
+		req = &shard->inflight[shard->head++ % cq_shared->nslots];
+		if (rc > CQ_MAX_RESPONSE_SIZE)
+		{
+			neon_shard_log(shard_no, LOG, "response of %d bytes does not fit in the communicator queue", rc);
+			cq_complete(req->sub, CQ_SLOT_FAILED, NULL, 0);
+		}
+		else
+			cq_complete(req->sub, CQ_SLOT_DONE, buf, rc);
+		PQfreemem(buf);
+	}
+}
+
+/*
+ * Tell the backends that nobody is forwarding their requests anymore.
+ */
+static void
+cq_worker_shmem_exit(int code, Datum arg)
+{
+	cq_shared->communicator_latch = NULL;
+	cq_shared->communicator_pid = 0;
+}
+
+/*
+ * Set up the queue in the forwarder process, before it starts forwarding
+ * requests.
+ */
+void
+communicator_queue_worker_init(void)
+{
+	bool	   *wakeup;
+
+	if (cq_shared == NULL)
+		return;
+
+	wakeup = palloc0(NUM_NEON_PERF_COUNTER_SLOTS * sizeof(bool));
+
+	/*
+	 * Fail the requests that a previous incarnation of this process took off
+	 * the queue but didn't answer. The ones still in the queue are forwarded
+	 * as usual.
+	 */
+	for (uint32 i = 0; i < cq_shared->nslots; i++)
+	{
+		uint32		expected = CQ_SLOT_FORWARDED;
+
+		if (pg_atomic_compare_exchange_u32(&cq_slots[i].state, &expected, CQ_SLOT_FAILED))
+			wakeup[i / communicator_queue_depth] = true;
+	}
+
+	cq_shared->protocol_version = neon_protocol_version;
+	pg_write_barrier();
+	cq_shared->communicator_latch = MyLatch;
+	cq_shared->communicator_pid = MyProcPid;
+
+	for (int procno = 0; procno < NUM_NEON_PERF_COUNTER_SLOTS; procno++)
+	{
+		if (wakeup[procno])
+			SetLatch(&GetPGProcByNumber(procno)->procLatch);
+	}
+	pfree(wakeup);
+
+	before_shmem_exit(cq_worker_shmem_exit, 0);
+}
+
+/*
+ * Forward newly submitted requests, and hand out the responses that have
+ * arrived. Doesn't block.
+ */
+void
+communicator_queue_process(void)
+{
+	if (cq_shared == NULL)
+		return;
+
+	PG_TRY();
+	{
+		TimestampTz now;
+
+		/* Forward the new requests */
+		while ((cq_current_valid = cq_dequeue(&cq_current)))
+			cq_forward(cq_current);
+
+		for (shardno_t shard_no = 0; shard_no < cq_nshards; shard_no++)
+		{
+			CQShard    *shard = &cq_shards[shard_no];
+
+			cq_send_queued(shard_no);
+			if (shard->unflushed)
+			{
+				shard->unflushed = false;
+				if (!pageserver_flush_packed(shard_no))
+					cq_fail_shard(shard_no);
+			}
+		}
+
+		/* Collect the responses */
+		now = GetCurrentTimestamp();
+		for (shardno_t shard_no = 0; shard_no < cq_nshards; shard_no++)
+		{
+			CQShard    *shard = &cq_shards[shard_no];
+
+			/*
+			 * While the shard is still connecting, its socket becoming
+			 * readable only means that the connection attempt can proceed.
+			 */
+			if (shard->head != shard->sent ||
+				(shard->readable && shard->sent == shard->tail))
+				cq_collect(shard_no);
+			shard->readable = false;
+
+			/*
+			 * Like the backends do with their own connections, give up on a
+			 * connection that hasn't answered for a long time. That includes
+			 * a connection that takes that long to establish.
+			 */
+			if (shard->head != shard->tail &&
+				TimestampDifferenceExceeds(shard->inflight[shard->head % cq_shared->nslots].sent_at,
+										   now, pageserver_response_disconnect_timeout))
+			{
+				neon_shard_log(shard_no, LOG, "no response from pageserver for %d ms, disconnecting",
+							   pageserver_response_disconnect_timeout);
+				pageserver_direct_api.disconnect(shard_no);
+				cq_fail_shard(shard_no);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		/*
+		 * Don't let one bad request take down the communicator. The state of
+		 * the connections is unknown, so drop them, and fail all requests
+		 * that were in flight.
+		 */
+		EmitErrorReport();
+		FlushErrorState();
+
+		if (cq_current_valid)
+		{
+			cq_complete(cq_current, CQ_SLOT_FAILED, NULL, 0);
+			cq_current_valid = false;
+		}
+		for (shardno_t shard_no = 0; shard_no < cq_nshards; shard_no++)
+		{
+			pageserver_direct_api.disconnect(shard_no);
+			cq_fail_shard(shard_no);
+		}
+	}
+	PG_END_TRY();
+}
+
+/*
+ * Which socket to wait on for the shard, and for what: the connection's
+ * socket for responses, or while connecting, whatever the connection attempt
+ * is waiting for. Also lowers *deadline to when to retry a failed attempt.
+ */
+static pgsocket
+cq_shard_socket(shardno_t shard_no, uint32 *events, TimestampTz *connected_at,
+				TimestampTz *deadline)
+{
+	CQShard    *shard = &cq_shards[shard_no];
+	TimestampTz retry_at = 0;
+	pgsocket	sock;
+
+	*events = WL_SOCKET_READABLE;
+	*connected_at = 0;
+	sock = pageserver_socket(shard_no, connected_at);
+	if (sock != PGINVALID_SOCKET || shard->sent == shard->tail)
+		return sock;
+
+	sock = pageserver_connect_wait(shard_no, events, &retry_at);
+	if (sock == PGINVALID_SOCKET && (*deadline == 0 || retry_at < *deadline))
+		*deadline = retry_at;
+	return sock;
+}
+
+/*
+ * Sleep until a backend submits requests, a response arrives, a connection
+ * attempt can proceed, or the oldest request in flight times out.
+ */
+void
+communicator_queue_wait(void)
+{
+	WaitEvent	events[8];
+	bool		rebuild = (cq_wes == NULL);
+	TimestampTz now = GetCurrentTimestamp();
+	TimestampTz deadline = 0;
+	long		timeout = -1;
+	int			nevents;
+
+	for (shardno_t shard_no = 0; shard_no < cq_nshards; shard_no++)
+	{
+		CQShard    *shard = &cq_shards[shard_no];
+		TimestampTz connected_at;
+		uint32		sock_events;
+		pgsocket	sock;
+
+		sock = cq_shard_socket(shard_no, &sock_events, &connected_at, &deadline);
+		if (sock != shard->wes_sock || sock_events != shard->wes_events ||
+			connected_at != shard->wes_connected_at)
+			rebuild = true;
+
+		if (shard->head != shard->tail)
+		{
+			TimestampTz response_deadline;
+
+			response_deadline = TimestampTzPlusMilliseconds(shard->inflight[shard->head % cq_shared->nslots].sent_at,
+															pageserver_response_disconnect_timeout);
+			if (deadline == 0 || response_deadline < deadline)
+				deadline = response_deadline;
+		}
+	}
+	if (deadline != 0)
+		timeout = Max(TimestampDifferenceMilliseconds(now, deadline), 0);
+
+	/*
+	 * The sockets change only when a shard is (re)connected, so the wait
+	 * event set is rebuilt rarely. Comparing the connection time too catches
+	 * a new connection that happens to get the same socket number.
+	 */
+	if (rebuild)
+	{
+		if (cq_wes)
+			FreeWaitEventSet(cq_wes);
+#if PG_MAJORVERSION_NUM >= 17
+		cq_wes = CreateWaitEventSet(NULL, 2 + cq_nshards);
+#else
+		cq_wes = CreateWaitEventSet(TopMemoryContext, 2 + cq_nshards);
+#endif
+		AddWaitEventToSet(cq_wes, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+		AddWaitEventToSet(cq_wes, WL_EXIT_ON_PM_DEATH, PGINVALID_SOCKET, NULL, NULL);
+
+		for (shardno_t shard_no = 0; shard_no < cq_nshards; shard_no++)
+		{
+			CQShard    *shard = &cq_shards[shard_no];
+
+			shard->wes_sock = cq_shard_socket(shard_no, &shard->wes_events,
+											  &shard->wes_connected_at, &deadline);
+			if (shard->wes_sock != PGINVALID_SOCKET)
+				AddWaitEventToSet(cq_wes, shard->wes_events, shard->wes_sock, NULL,
+								  &cq_shards[shard_no]);
+		}
+	}
+
+	nevents = WaitEventSetWait(cq_wes, timeout, events, lengthof(events),
+							   PG_WAIT_EXTENSION);
+	for (int i = 0; i < nevents; i++)
+	{
+		if (events[i].events & WL_SOCKET_READABLE)
+			((CQShard *) events[i].user_data)->readable = true;
+	}
+
+	/*
+	 * While connecting, the socket may change on every step, and a new one
+	 * can get the same number as the old. Start from scratch next time.
+	 */
+	for (shardno_t shard_no = 0; shard_no < cq_nshards; shard_no++)
+	{
+		if (cq_shards[shard_no].wes_connected_at == 0 &&
+			cq_shards[shard_no].wes_sock != PGINVALID_SOCKET)
+		{
+			FreeWaitEventSet(cq_wes);
+			cq_wes = NULL;
+			break;
+		}
+	}
+}
+
+/**** Shared memory ****/
+
+static Size
+CommunicatorQueueShmemSize(void)
+{
+	Size		nslots = mul_size(NUM_NEON_PERF_COUNTER_SLOTS, communicator_queue_depth);
+
+	return add_size(MAXALIGN(sizeof(CommunicatorQueueShared)),
+					add_size(MAXALIGN(mul_size(nslots, sizeof(CommunicatorQueueEntry))),
+							 mul_size(nslots, sizeof(CommunicatorSlot))));
+}
+
+void
+CommunicatorQueueShmemRequest(void)
+{
+	if (pageserver_transport != PAGESERVER_TRANSPORT_COMMUNICATOR)
+		return;
+
+#if PG_MAJORVERSION_NUM < 15
+	/* See NeonPerfCountersShmemRequest() */
+	Assert(MaxBackends == 0);
+	InitializeMaxBackends();
+	RequestAddinShmemSpace(CommunicatorQueueShmemSize());
+	MaxBackends = 0;
+#else
+	RequestAddinShmemSpace(CommunicatorQueueShmemSize());
+#endif
+}
+
+void
+CommunicatorQueueShmemInit(void)
+{
+	Size		nslots;
+	bool		found;
+
+	if (pageserver_transport != PAGESERVER_TRANSPORT_COMMUNICATOR)
+		return;
+
+	nslots = mul_size(NUM_NEON_PERF_COUNTER_SLOTS, communicator_queue_depth);
+	cq_shared = ShmemInitStruct("neon communicator queue",
+								CommunicatorQueueShmemSize(),
+								&found);
+	cq_submissions = (CommunicatorQueueEntry *)
+		((char *) cq_shared + MAXALIGN(sizeof(CommunicatorQueueShared)));
+	cq_slots = (CommunicatorSlot *)
+		((char *) cq_submissions + MAXALIGN(nslots * sizeof(CommunicatorQueueEntry)));
+
+	if (!found)
+	{
+		cq_shared->communicator_latch = NULL;
+		cq_shared->communicator_pid = 0;
+		cq_shared->protocol_version = neon_protocol_version;
+		cq_shared->nslots = nslots;
+		pg_atomic_init_u64(&cq_shared->submit_tail, 0);
+		cq_shared->submit_head = 0;
+		for (Size i = 0; i < nslots; i++)
+		{
+			pg_atomic_init_u64(&cq_submissions[i].seq, i);
+			pg_atomic_init_u32(&cq_slots[i].state, CQ_SLOT_FREE);
+		}
+	}
+}
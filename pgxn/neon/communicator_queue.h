@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * communicator_queue.h
+ *	  Shared memory request queue between backends and the communicator
+ *	  forwarder process
+ *
+ *
+ * Portions Copyright (c) 1996-2021, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef COMMUNICATOR_QUEUE_H
+#define COMMUNICATOR_QUEUE_H
+
+#include "pagestore_client.h"
+
+/*
+ * Requests sent to this shard are answered by the forwarder process
+ * itself, with an empty result, instead of a pageserver. Used to benchmark
+ * the queue.
+ */
+#define CQ_STAND_IN_SHARD		MAX_SHARDS
+
+/* page_server implementation for neon.pageserver_transport=communicator */
+extern page_server_api communicator_queue_api;
+extern page_server_api *communicator_queue_get_api(void);
+
+/* Called in the forwarder process, see communicator_process.c */
+extern void communicator_queue_worker_init(void);
+extern void communicator_queue_process(void);
+extern void communicator_queue_wait(void);
+
+#endif							/* COMMUNICATOR_QUEUE_H */
@@ -14,15 +14,22 @@
 #include <sys/file.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 #include "neon_pgversioncompat.h"
 
 #include "access/parallel.h"
+#include "access/xact.h"
 #include "access/xlog.h"
+#include "catalog/pg_control.h"
+#include "common/controldata_utils.h"
 #include "funcapi.h"
 #include "miscadmin.h"
 #include "common/hashfn.h"
 #include "pgstat.h"
+#include "port/pg_crc32c.h"
 #include "port/pg_iovec.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/interrupt.h"
@@ -34,6 +41,7 @@
 #include "storage/lwlock.h"
 #include "storage/pg_shmem.h"
 #include "storage/procsignal.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/dynahash.h"
@@ -44,6 +52,7 @@
 #endif
 
 #include "hll.h"
+#include "mrc.h"
 #include "bitmap.h"
 #include "file_cache.h"
 #include "neon.h"
@@ -60,14 +69,68 @@
 /*
  * Local file cache is used to temporary store relations pages in local file system.
  * All blocks of all relations are stored inside one file and addressed using shared hash map.
- * Currently LRU eviction policy based on L2 list is used as replacement algorithm.
- * As far as manipulation of L2-list requires global critical section, we are not using partitioned hash.
- * Also we are using exclusive lock even for read operation because LRU requires relinking element in L2 list.
- * If this lock become a bottleneck, we can consider other eviction strategies, for example clock algorithm.
+ * The replacement algorithm is selected with neon.file_cache_eviction_policy:
+ * LRU based on L2 list (the default), or CLOCK, see below.
  *
  * Cache is always reconstructed at node startup, so we do not need to save mapping somewhere and worry about
  * its consistency.
-
+ *
+ * ## Partitions
+ *
+ * The chunk hash table and the replacement state are split into
+ * neon.file_cache_partitions independent partitions. A chunk is assigned to
+ * a partition by the hash of its tag, and each partition has its own lock,
+ * hash table, LRU list, holes list and share of the cache size limit, so
+ * accesses to chunks in different partitions never contend with each other.
+ * With the default of one partition, this is the classic single-lock LFC.
+ *
+ * Chunks stay in their LRU list also while they are pinned for I/O. That way,
+ * a reader which finds all the blocks it needs AVAILABLE only needs the
+ * partition lock in shared mode: it pins the chunk with an atomic increment of
+ * 'access_count' and sets its 'usage' flag instead of relinking it. Eviction
+ * scans the LRU list from the head, skipping pinned chunks and giving the
+ * chunks with the usage flag set a second chance by moving them to the tail.
+ * Writers, and readers that need to wait for a block that is being loaded,
+ * still take the partition lock in exclusive mode, and move the chunk to the
+ * tail of the LRU list directly.
+ *
+ * ## CLOCK
+ *
+ * With the CLOCK policy, each partition has two clock rings, in the style of
+ * CLOCK-Pro (without tracking of non-resident chunks): the LRU list is used
+ * as the cold ring, and the 'hot' list as the hot ring. The heads of the
+ * lists are the clock hands. Accesses never relink chunks: a read hit
+ * increments the chunk's usage count (up to LFC_CLOCK_MAX_USAGE) with an
+ * atomic, so readers never need the exclusive lock.
+ *
+ * New chunks are inserted into the cold ring with zero usage. To find a
+ * victim, the cold hand evicts the first unpinned chunk with zero usage, and
+ * promotes the chunks that were hit since they were inserted to the hot ring.
+ * When the hot ring grows beyond LFC_CLOCK_HOT_PERCENT of the partition, the
+ * hot hand sweeps it, decrementing usage counts and demoting chunks whose
+ * usage drops to zero back to the cold ring. Writes don't count as
+ * references, so the chunks populated by a large seqscan or by prewarm stay
+ * cold and only replace each other, instead of flushing the working set.
+ *
+ * Global state (the generation, the cache size limit, the nominal size of the
+ * file, prewarm state) is protected by 'lfc_lock'. Fields that are read on
+ * the hot path without it, i.e. the generation and limit, may only be changed
+ * while also holding all the partition locks; see lfc_lock_all(). The lock
+ * order is 'lfc_lock' first, then partition locks in increasing order.
+ *
+ * ## I/O engines
+ *
+ * Blocks are read from and written to the cache file outside the locks, with
+ * the engine selected by neon.file_cache_io_engine. The 'sync' engine uses
+ * plain preadv/pwritev calls. The 'io_uring' engine (available if the
+ * extension was built with liburing) sets up a small io_uring instance in
+ * each backend, and uses it for two things: lfc_readv_select() submits the
+ * reads of all the chunks it needs at once and waits for them together, and
+ * lfc_prefetch() returns without waiting for its write. The blocks written by
+ * lfc_prefetch() stay PENDING until the backend reaps the completion, which
+ * happens at its next LFC operation and, at the latest, when the communicator
+ * has finished receiving a batch of responses; see lfc_wait_async_writes().
+ * A backend that can't set up the ring falls back to the 'sync' engine.
  *
  * ## Holes
  *
@@ -80,12 +143,33 @@
  * shrink, but the disk space it uses does.
  *
  * Each hole is tracked by a dummy FileCacheEntry, which are kept in the
- * 'holes' linked list. They are entered into the chunk hash table, with a
- * special key where the blockNumber is used to store the 'offset' of the
- * hole, and all other fields are zero. Holes are never looked up in the hash
- * table, we only enter them there to have a FileCacheEntry that we can keep
- * in the linked list. If the soft limit is raised again, we reuse the holes
- * before extending the nominal size of the file.
+ * 'holes' linked list of the partition that released the chunk. They are
+ * entered into that partition's chunk hash table, with a special key where
+ * the blockNumber is used to store the 'offset' of the hole, and all other
+ * fields are zero. Holes are never looked up in the hash table, we only enter
+ * them there to have a FileCacheEntry that we can keep in the linked list. If
+ * the soft limit is raised again, we reuse the holes before extending the
+ * nominal size of the file.
+ *
+ * ## Persistence across restarts
+ *
+ * Normally the file is truncated at server startup. With
+ * neon.file_cache_persist, the postmaster writes an index of the chunks and
+ * their available blocks next to the file when it exits after a clean
+ * shutdown, and the next postmaster rebuilds the hash tables from it instead
+ * of truncating the file.
+ *
+ * The cached pages are the latest versions as of the end of WAL at shutdown.
+ * They're still the latest versions if the server starts from a checkpoint
+ * between the shutdown checkpoint and that end of WAL, i.e. if nothing was
+ * written to the timeline in the meantime, by this compute or any other. The
+ * index also records the system identifier, tenant and timeline, and is
+ * discarded if any of that doesn't match. The index file is removed as soon
+ * as it's read, so that it's never used after a crash.
+ *
+ * If the index can't be used, the cache starts empty as usual, and the
+ * regular prewarm fetches the pages from the pageserver. After a successful
+ * restore, prewarm skips the pages that are already in the cache.
  */
 
 /* Local file storage allocation chunk.
@@ -100,6 +184,46 @@
 
 #define MB					((uint64)1024*1024)
 
+#define MAX_LFC_PARTITIONS	128
+
+/* Replacement policies */
+typedef enum
+{
+	LFC_EVICTION_LRU,
+	LFC_EVICTION_CLOCK
+} LfcEvictionPolicy;
+
+static const struct config_enum_entry lfc_eviction_policies[] = {
+	{"lru", LFC_EVICTION_LRU, false},
+	{"clock", LFC_EVICTION_CLOCK, false},
+	{NULL, 0, false}
+};
+
+/* Maximal usage count of a chunk with the CLOCK policy */
+#define LFC_CLOCK_MAX_USAGE	3
+
+/* Share of a partition's chunks that can be in the hot ring of CLOCK */
+#define LFC_CLOCK_HOT_PERCENT	75
+
+/* I/O engines */
+typedef enum
+{
+	LFC_IO_SYNC,
+	LFC_IO_URING
+} LfcIoEngine;
+
+static const struct config_enum_entry lfc_io_engines[] = {
+	{"sync", LFC_IO_SYNC, false},
+	{"io_uring", LFC_IO_URING, false},
+	{NULL, 0, false}
+};
+
+/* Size of the per-backend io_uring instance */
+#define LFC_URING_DEPTH			64
+
+/* Maximal number of asynchronous prefetch writes in flight per backend */
+#define LFC_MAX_ASYNC_WRITES	32
+
 #define SIZE_MB_TO_CHUNKS(size) ((uint32)((size) * MB / BLCKSZ >> lfc_chunk_size_log))
 #define BLOCK_TO_CHUNK_OFF(blkno) ((blkno) & (lfc_blocks_per_chunk-1))
 
@@ -125,7 +249,8 @@ typedef struct FileCacheEntry
 	BufferTag	key;
 	uint32		hash;
 	uint32		offset;
-	uint32		access_count;
+	pg_atomic_uint32 access_count;	/* number of backends that pinned the chunk */
+	pg_atomic_uint32 usage;		/* recent accesses, see lfc_pin_entry() */
 	dlist_node	list_node;		/* LRU/holes list node */
 	uint32		state[FLEXIBLE_ARRAY_MEMBER]; /* two bits per block */
 } FileCacheEntry;
@@ -139,32 +264,68 @@ typedef struct FileCacheEntry
 
 #define MAX_PREWARM_WORKERS 8
 
+/* Number of recent foreground misses that prewarm workers look at */
+#define PREWARM_PROMOTE_SIZE 64
+
+/* How often prewarm workers check the foreground getpage latency, in ms */
+#define PREWARM_THROTTLE_INTERVAL 100
+
 typedef struct PrewarmWorkerState
 {
 	uint32		prewarmed_pages;
 	uint32		skipped_pages;
+	int			procno;			/* slot in neon_per_backend_counters */
 	TimestampTz completed;
 } PrewarmWorkerState;
 
+/*
+ * Work queue of the prewarm workers, in the DSM segment after the prewarmed
+ * FileCacheState. The chunks are claimed in the order of the state, which
+ * is hottest first, except that chunks with recent foreground misses, see
+ * 'prewarm_promote', are claimed out of turn.
+ */
+typedef struct PrewarmQueue
+{
+	pg_atomic_uint32 next_chunk;	/* next chunk in the order of the state */
+	pg_atomic_uint32 claimed[FLEXIBLE_ARRAY_MEMBER];	/* bitmap of claimed chunks */
+} PrewarmQueue;
+
+#define PREWARM_QUEUE_SIZE(n_chunks) \
+	(offsetof(PrewarmQueue, claimed) + ((n_chunks) + 31) / 32 * sizeof(pg_atomic_uint32))
+#define PREWARM_QUEUE(fcs) ((PrewarmQueue *) ((char *) (fcs) + MAXALIGN(VARSIZE(fcs))))
+
+/*
+ * Per-partition state, protected by the partition lock. The counters that
+ * can be updated by readers holding the lock in shared mode are atomics.
+ */
+typedef struct FileCachePartition
+{
+	uint32		limit;			/* this partition's share of the limit */
+	uint32		used;			/* number of used chunks */
+	uint32		used_pages;		/* number of used pages */
+	uint64		evicted_pages;	/* number of evicted pages */
+	uint64		evictions;		/* number of evicted chunks */
+	uint64		sweep_steps;	/* chunks examined to find victims */
+	pg_atomic_uint32 pinned;	/* number of pinned chunks */
+	pg_atomic_uint64 hits;
+	pg_atomic_uint64 misses;
+	pg_atomic_uint64 writes;	/* number of writes issued */
+	pg_atomic_uint64 time_read;	/* time spent reading (us) */
+	pg_atomic_uint64 time_write;	/* time spent writing (us) */
+	dlist_head	lru;			/* double linked list for LRU replacement
+								 * algorithm, cold ring of CLOCK */
+	dlist_head	hot;			/* hot ring of CLOCK */
+	uint32		n_hot;			/* number of chunks in the hot ring */
+	dlist_head	holes;			/* double linked list of punched holes */
+} FileCachePartition;
+
 typedef struct FileCacheControl
 {
 	uint64		generation;		/* generation is needed to handle correct hash
 								 * reenabling */
-	uint32		size;			/* size of cache file in chunks */
-	uint32		used;			/* number of used chunks */
-	uint32		used_pages;		/* number of used pages */
-	uint32		pinned;			/* number of pinned chunks */
+	pg_atomic_uint32 size;		/* size of cache file in chunks */
 	uint32		limit;			/* shared copy of lfc_size_limit */
-	uint64		hits;
-	uint64		misses;
-	uint64		writes;			/* number of writes issued */
-	uint64		time_read;		/* time spent reading (us) */
-	uint64		time_write;		/* time spent writing (us) */
 	uint64		resizes;        /* number of LFC resizes   */
-	uint64		evicted_pages;	/* number of evicted pages */
-	dlist_head	lru;			/* double linked list for LRU replacement
-								 * algorithm */
-	dlist_head  holes;          /* double linked list of punched holes */
 
 	ConditionVariable cv[N_COND_VARS]; /* turnstile of condition variables */
 
@@ -172,11 +333,11 @@ typedef struct FileCacheControl
 	 * Estimation of working set size.
 	 *
 	 * This is not guarded by the lock. No locking is needed because all the
-	 * writes to the "registers" are simple 64-bit stores, to update a
+	 * writes to the "registers" are simple 32-bit stores, to update a
 	 * timestamp. We assume that:
 	 *
-	 * - 64-bit stores are atomic. We could enforce that by using
-	 *   pg_atomic_uint64 instead of TimestampTz as the datatype in hll.h, but
+	 * - 32-bit stores are atomic. We could enforce that by using
+	 *   pg_atomic_uint32 instead of uint32 as the datatype in hll.h, but
 	 *   for now we just rely on it implicitly.
 	 *
 	 * - Even if they're not, and there is a race between two stores, it
@@ -192,6 +353,9 @@ typedef struct FileCacheControl
 	 */
 	HyperLogLogState wss_estimation;
 
+	/* Estimation of the hit ratio at other cache sizes, see mrc.h */
+	MissRatioCurveState mrc_estimation;
+
 	/* Prewarmer state */
 	PrewarmWorkerState prewarm_workers[MAX_PREWARM_WORKERS];
 	size_t n_prewarm_workers;
@@ -201,27 +365,147 @@ typedef struct FileCacheControl
 	bool   prewarm_active;
 	bool   prewarm_canceled;
 	dsm_handle prewarm_lfc_state_handle;
+	TimestampTz prewarm_started;
+
+	/*
+	 * Ring of the tags of recent foreground reads that missed a whole chunk
+	 * while prewarm is active, protected by the spinlock.
+	 */
+	slock_t		prewarm_promote_mutex;
+	uint64		prewarm_promote_head;
+	BufferTag	prewarm_promote[PREWARM_PROMOTE_SIZE];
+
+	FileCachePartition partitions[FLEXIBLE_ARRAY_MEMBER];
 } FileCacheControl;
 
+#define FILE_CACHE_CONTROL_SIZE(n_partitions) \
+	(offsetof(FileCacheControl, partitions) + (n_partitions) * sizeof(FileCachePartition))
+
+/* Sums of the per-partition counters */
+typedef struct FileCacheTotals
+{
+	uint32		used;
+	uint32		used_pages;
+	uint32		pinned;
+	uint32		hot;
+	uint64		evicted_pages;
+	uint64		evictions;
+	uint64		sweep_steps;
+	uint64		hits;
+	uint64		misses;
+	uint64		writes;
+} FileCacheTotals;
+
+/*
+ * An I/O request on the cache file. This is the common header of the chunk
+ * reads of lfc_readv_select() and the asynchronous writes of lfc_prefetch(),
+ * and what the io_uring completions point to.
+ */
+typedef struct LfcIoOp
+{
+	bool		is_write;
+	bool		done;
+	ssize_t		result;			/* bytes transferred, or -errno */
+	instr_time	start;			/* submission time */
+	uint64		latency_us;		/* time from submission to completion */
+} LfcIoOp;
+
+/* Read of the blocks of one chunk in lfc_readv_select() */
+typedef struct LfcChunkRead
+{
+	LfcIoOp		op;
+	int			partno;
+	FileCacheEntry *entry;		/* pinned chunk */
+	uint64		generation;
+	off_t		file_offset;	/* offset of the first block to read */
+	struct iovec *iov;
+	int			iovcnt;
+	int			buf_offset;		/* index of iov[0] in the caller's buffers */
+	int			hits;
+	int			misses;
+	uint8		chunk_mask[(PG_IOV_MAX + 7) / 8];	/* available blocks, by iov */
+} LfcChunkRead;
+
+#ifdef HAVE_LIBURING
+/* Write of a prefetched page, see lfc_prefetch() */
+typedef struct LfcAsyncWrite
+{
+	LfcIoOp		op;
+	bool		in_use;
+	int			partno;
+	FileCacheEntry *entry;		/* pinned chunk */
+	uint64		generation;
+	uint32		hash;
+	int			chunk_offs;
+} LfcAsyncWrite;
+#endif
+
 #define FILE_CACHE_STATE_MAGIC 0xfcfcfcfc
 
+#define LFC_INDEX_MAGIC		0xfcfc1dec
+#define LFC_INDEX_SUFFIX	".index"
+
+/* Header of the index file written at shutdown, see lfc_persist_at_exit() */
+typedef struct LfcIndexHeader
+{
+	uint32		magic;
+	uint32		blcksz;
+	uint32		chunk_size_log;
+	uint32		n_entries;
+	uint64		system_identifier;
+	XLogRecPtr	checkpoint_lsn;	/* location of the shutdown checkpoint */
+	XLogRecPtr	end_lsn;		/* end of WAL at shutdown */
+	char		tenant[64];
+	char		timeline[64];
+	pg_crc32c	crc;			/* of the header up to here, and the entries */
+} LfcIndexHeader;
+
+typedef struct LfcIndexEntry
+{
+	BufferTag	key;
+	uint32		offset;
+	uint32		available[MAX_BLOCKS_PER_CHUNK / 32];	/* bitmap of AVAILABLE blocks */
+} LfcIndexEntry;
+
 #define FILE_CACHE_STATE_BITMAP(fcs)	((uint8*)&(fcs)->chunks[(fcs)->n_chunks])
 #define FILE_CACHE_STATE_SIZE_FOR_CHUNKS(n_chunks)	(sizeof(FileCacheState) + (n_chunks)*sizeof(BufferTag) + (((n_chunks) * lfc_blocks_per_chunk)+7)/8)
 #define FILE_CACHE_STATE_SIZE(fcs)		(sizeof(FileCacheState) + (fcs->n_chunks)*sizeof(BufferTag) + (((fcs->n_chunks) << fcs->chunk_size_log)+7)/8)
 
-static HTAB *lfc_hash;
+static HTAB *lfc_hash[MAX_LFC_PARTITIONS];
 static int	lfc_desc = -1;
 static LWLockId lfc_lock;
+static LWLockPadded *lfc_partition_locks;
+static int	lfc_n_partitions = 1;
+static int	lfc_eviction_policy = LFC_EVICTION_LRU;
+static int	lfc_io_engine = LFC_IO_SYNC;
 static int	lfc_max_size;
 static int	lfc_size_limit;
 static int	lfc_prewarm_limit;
 static int	lfc_prewarm_batch;
+static int	lfc_prewarm_yield_latency;
 static int	lfc_chunk_size_log = MAX_BLOCKS_PER_CHUNK_LOG;
 static int	lfc_blocks_per_chunk = MAX_BLOCKS_PER_CHUNK;
 static char *lfc_path;
 static uint64 lfc_generation;
 static FileCacheControl *lfc_ctl;
 static bool lfc_do_prewarm;
+static bool lfc_persist;
+
+#ifdef HAVE_LIBURING
+typedef enum
+{
+	LFC_RING_NONE,				/* not set up yet */
+	LFC_RING_READY,
+	LFC_RING_FAILED				/* couldn't be set up, use the sync engine */
+} LfcRingState;
+
+static struct io_uring lfc_ring;
+static LfcRingState lfc_ring_state = LFC_RING_NONE;
+static int	lfc_ring_inflight;	/* submitted I/Os that haven't completed */
+static LfcAsyncWrite lfc_async_writes[LFC_MAX_ASYNC_WRITES];
+static PGAlignedBlock lfc_async_write_bufs[LFC_MAX_ASYNC_WRITES];
+static int	lfc_n_async_writes;	/* lfc_async_writes in use */
+#endif
 
 bool lfc_store_prefetch_result;
 bool lfc_prewarm_update_ws_estimation;
@@ -230,7 +514,225 @@ bool AmPrewarmWorker;
 
 #define LFC_ENABLED() (lfc_ctl->limit != 0)
 
+#define LFC_PARTITION_LOCK(partno) (&lfc_partition_locks[(partno)].lock)
+
 PGDLLEXPORT void lfc_prewarm_main(Datum main_arg);
+static void lfc_prewarm_promote(BufferTag *tag);
+
+static inline uint32
+lfc_tag_hash(BufferTag *tag)
+{
+	/* all partitions use the same hash function */
+	return get_hash_value(lfc_hash[0], tag);
+}
+
+/*
+ * Map a chunk hash to its partition. The low bits of the hash select the
+ * bucket in the partition's hash table, so mix them before taking the modulo
+ * to not leave most of the buckets of every partition unused.
+ */
+static inline int
+lfc_partition_of(uint32 hash)
+{
+	return murmurhash32(hash) % lfc_n_partitions;
+}
+
+/* Share of 'total' chunks given to a partition */
+static inline uint32
+lfc_partition_share(uint32 total, int partno)
+{
+	return total / lfc_n_partitions + ((uint32) partno < total % lfc_n_partitions ? 1 : 0);
+}
+
+/*
+ * Acquire 'lfc_lock' and all partition locks. This is needed to change the
+ * fields that are read on the hot path without holding 'lfc_lock'.
+ */
+static void
+lfc_lock_all(LWLockMode mode)
+{
+	LWLockAcquire(lfc_lock, mode);
+	for (int i = 0; i < lfc_n_partitions; i++)
+		LWLockAcquire(LFC_PARTITION_LOCK(i), mode);
+}
+
+static void
+lfc_unlock_all(void)
+{
+	for (int i = lfc_n_partitions - 1; i >= 0; i--)
+		LWLockRelease(LFC_PARTITION_LOCK(i));
+	LWLockRelease(lfc_lock);
+}
+
+/*
+ * Sum the per-partition counters. No locks are taken, so the result is only
+ * approximate while the cache is in use.
+ */
+static void
+lfc_get_totals(FileCacheTotals *totals)
+{
+	memset(totals, 0, sizeof(*totals));
+	for (int i = 0; i < lfc_n_partitions; i++)
+	{
+		FileCachePartition *part = &lfc_ctl->partitions[i];
+
+		totals->used += part->used;
+		totals->used_pages += part->used_pages;
+		totals->pinned += pg_atomic_read_u32(&part->pinned);
+		totals->hot += part->n_hot;
+		totals->evicted_pages += part->evicted_pages;
+		totals->evictions += part->evictions;
+		totals->sweep_steps += part->sweep_steps;
+		totals->hits += pg_atomic_read_u64(&part->hits);
+		totals->misses += pg_atomic_read_u64(&part->misses);
+		totals->writes += pg_atomic_read_u64(&part->writes);
+	}
+}
+
+/*
+ * Pin the chunk for the duration of an I/O operation and register the access
+ * for the replacement policy.
+ *
+ * With the LRU policy, any access makes the chunk the most recently used one.
+ * With the partition lock held in shared mode we cannot relink the entry, so
+ * we just set its usage flag instead. With the CLOCK policy, only reads count
+ * as references: populating the cache with pages that were just fetched from
+ * the pageserver, as a seqscan or prewarm does, leaves the usage count of the
+ * chunk at zero, so such chunks are the first to be evicted.
+ */
+static inline void
+lfc_pin_entry(FileCachePartition *part, FileCacheEntry *entry, LWLockMode mode, bool is_read)
+{
+	if (pg_atomic_fetch_add_u32(&entry->access_count, 1) == 0)
+		pg_atomic_fetch_add_u32(&part->pinned, 1);
+
+	if (lfc_eviction_policy == LFC_EVICTION_CLOCK)
+	{
+		if (is_read)
+		{
+			uint32		usage = pg_atomic_read_u32(&entry->usage);
+
+			while (usage < LFC_CLOCK_MAX_USAGE &&
+				   !pg_atomic_compare_exchange_u32(&entry->usage, &usage, usage + 1))
+				;
+		}
+	}
+	else if (mode == LW_EXCLUSIVE)
+	{
+		dlist_delete(&entry->list_node);
+		dlist_push_tail(&part->lru, &entry->list_node);
+	}
+	else
+		pg_atomic_write_u32(&entry->usage, 1);
+}
+
+/* Unpin the chunk. The partition lock must be held in any mode. */
+static inline void
+lfc_unpin_entry(FileCachePartition *part, FileCacheEntry *entry)
+{
+	CriticalAssert(pg_atomic_read_u32(&entry->access_count) > 0);
+	if (pg_atomic_sub_fetch_u32(&entry->access_count, 1) == 0)
+		pg_atomic_fetch_sub_u32(&part->pinned, 1);
+}
+
+/*
+ * Choose a chunk to evict with the CLOCK policy, see lfc_choose_victim().
+ */
+static FileCacheEntry *
+lfc_clock_choose_victim(FileCachePartition *part)
+{
+	uint32		hot_target = part->limit * LFC_CLOCK_HOT_PERCENT / 100;
+	uint32		max_scan = part->used * (LFC_CLOCK_MAX_USAGE + 2);
+
+	for (uint32 i = 0; i < max_scan; i++)
+	{
+		FileCacheEntry *entry;
+		uint32		usage;
+
+		part->sweep_steps += 1;
+		if (part->n_hot > hot_target || dlist_is_empty(&part->lru))
+		{
+			if (dlist_is_empty(&part->hot))
+				break;
+
+			/*
+			 * Advance the hot hand: decrement the usage count, and demote
+			 * the chunk to the cold ring if it drops to zero.
+			 */
+			entry = dlist_head_element(FileCacheEntry, list_node, &part->hot);
+			dlist_delete(&entry->list_node);
+			usage = pg_atomic_read_u32(&entry->usage);
+			while (usage > 0 &&
+				   !pg_atomic_compare_exchange_u32(&entry->usage, &usage, usage - 1))
+				;
+			if (usage <= 1 && pg_atomic_read_u32(&entry->access_count) == 0)
+			{
+				dlist_push_tail(&part->lru, &entry->list_node);
+				part->n_hot -= 1;
+			}
+			else
+				dlist_push_tail(&part->hot, &entry->list_node);
+			continue;
+		}
+
+		/*
+		 * Advance the cold hand: a chunk that was referenced since it was
+		 * inserted is promoted to the hot ring, an unreferenced one is
+		 * evicted.
+		 */
+		entry = dlist_head_element(FileCacheEntry, list_node, &part->lru);
+		dlist_delete(&entry->list_node);
+		if (pg_atomic_read_u32(&entry->access_count) != 0)
+			dlist_push_tail(&part->lru, &entry->list_node);
+		else if (pg_atomic_read_u32(&entry->usage) != 0)
+		{
+			dlist_push_tail(&part->hot, &entry->list_node);
+			part->n_hot += 1;
+		}
+		else
+		{
+			part->evictions += 1;
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Choose a chunk to evict from the partition and unlink it from its list.
+ * Must be called with the partition lock held in exclusive mode. Returns
+ * NULL if no chunk can be evicted because all chunks are pinned.
+ *
+ * With the LRU policy, we scan the LRU list from the head, skipping pinned
+ * chunks and giving chunks that were accessed by readers since the last scan
+ * a second chance. Every chunk is visited at most twice.
+ */
+static FileCacheEntry *
+lfc_choose_victim(FileCachePartition *part)
+{
+	uint32		max_scan = part->used * 2;
+
+	if (lfc_eviction_policy == LFC_EVICTION_CLOCK)
+		return lfc_clock_choose_victim(part);
+
+	for (uint32 i = 0; i < max_scan && !dlist_is_empty(&part->lru); i++)
+	{
+		FileCacheEntry *entry = dlist_head_element(FileCacheEntry, list_node, &part->lru);
+
+		part->sweep_steps += 1;
+		if (pg_atomic_read_u32(&entry->access_count) != 0 ||
+			pg_atomic_exchange_u32(&entry->usage, 0) != 0)
+		{
+			dlist_delete(&entry->list_node);
+			dlist_push_tail(&part->lru, &entry->list_node);
+			continue;
+		}
+		dlist_delete(&entry->list_node);
+		part->evictions += 1;
+		return entry;
+	}
+	return NULL;
+}
 
 /*
  * Close LFC file if opened.
@@ -262,20 +764,28 @@ lfc_switch_off(void)
 		HASH_SEQ_STATUS status;
 		FileCacheEntry *entry;
 
-		/* Invalidate hash */
-		hash_seq_init(&status, lfc_hash);
-		while ((entry = hash_seq_search(&status)) != NULL)
+		for (int i = 0; i < lfc_n_partitions; i++)
 		{
-			hash_search_with_hash_value(lfc_hash, &entry->key, entry->hash, HASH_REMOVE, NULL);
+			FileCachePartition *part = &lfc_ctl->partitions[i];
+
+			/* Invalidate hash */
+			hash_seq_init(&status, lfc_hash[i]);
+			while ((entry = hash_seq_search(&status)) != NULL)
+			{
+				hash_search_with_hash_value(lfc_hash[i], &entry->key, entry->hash, HASH_REMOVE, NULL);
+			}
+			pg_atomic_write_u32(&part->pinned, 0);
+			part->limit = 0;
+			part->used = 0;
+			part->used_pages = 0;
+			part->n_hot = 0;
+			dlist_init(&part->lru);
+			dlist_init(&part->hot);
+			dlist_init(&part->holes);
 		}
 		lfc_ctl->generation += 1;
-		lfc_ctl->size = 0;
-		lfc_ctl->pinned = 0;
-		lfc_ctl->used = 0;
-		lfc_ctl->used_pages = 0;
+		pg_atomic_write_u32(&lfc_ctl->size, 0);
 		lfc_ctl->limit = 0;
-		dlist_init(&lfc_ctl->lru);
-		dlist_init(&lfc_ctl->holes);
 
 		/*
 		 * We need to use unlink to to avoid races in LFC write, because it is not
@@ -289,55 +799,686 @@ lfc_switch_off(void)
 		else
 			close(fd);
 
-		/* Wakeup waiting backends */
-		for (int i = 0; i < N_COND_VARS; i++)
-			ConditionVariableBroadcast(&lfc_ctl->cv[i]);
+		/* Wakeup waiting backends */
+		for (int i = 0; i < N_COND_VARS; i++)
+			ConditionVariableBroadcast(&lfc_ctl->cv[i]);
+	}
+	lfc_close_file();
+}
+
+static void
+lfc_disable(char const *op)
+{
+	elog(WARNING, "LFC: failed to %s local file cache at %s: %m, disabling local file cache", op, lfc_path);
+
+	lfc_lock_all(LW_EXCLUSIVE);
+	lfc_switch_off();
+	lfc_unlock_all();
+}
+
+/*
+ * This check is done without obtaining lfc_lock, so it is unreliable
+ */
+static bool
+lfc_maybe_disabled(void)
+{
+	return !lfc_ctl || !LFC_ENABLED();
+}
+
+/*
+ * Open LFC file if not opened yet or generation is changed.
+ * Should be called under LFC lock or a partition lock.
+ */
+static bool
+lfc_ensure_opened(void)
+{
+	if (lfc_generation != lfc_ctl->generation)
+	{
+		lfc_close_file();
+		lfc_generation = lfc_ctl->generation;
+	}
+	/* Open cache file if not done yet */
+	if (lfc_desc < 0)
+	{
+		lfc_desc = BasicOpenFile(lfc_path, O_RDWR);
+
+		if (lfc_desc < 0)
+		{
+			lfc_disable("open");
+			return false;
+		}
+	}
+	return true;
+}
+
+static void lfc_prefetch_done(int partno, FileCacheEntry *entry, uint64 generation,
+							  uint32 hash, int chunk_offs, ssize_t rc,
+							  uint64 time_spent_us);
+
+#ifdef HAVE_LIBURING
+
+/*
+ * Make sure that the blocks written asynchronously by this backend don't
+ * stay PENDING when it exits, or goes idle after an error.
+ */
+static void
+lfc_uring_at_exit(int code, Datum arg)
+{
+	lfc_wait_async_writes();
+}
+
+static void
+lfc_uring_xact_callback(XactEvent event, void *arg)
+{
+	lfc_wait_async_writes();
+}
+
+/*
+ * Returns true if I/O should be done with the io_uring instance of this
+ * backend, setting it up on first use.
+ */
+static bool
+lfc_uring_ready(void)
+{
+	int			rc;
+
+	if (lfc_io_engine != LFC_IO_URING)
+		return false;
+	if (lfc_ring_state != LFC_RING_NONE)
+		return lfc_ring_state == LFC_RING_READY;
+
+	rc = io_uring_queue_init(LFC_URING_DEPTH, &lfc_ring, 0);
+	if (rc < 0)
+	{
+		errno = -rc;
+		elog(LOG, "LFC: failed to set up io_uring, using synchronous I/O: %m");
+		lfc_ring_state = LFC_RING_FAILED;
+		return false;
+	}
+	lfc_ring_state = LFC_RING_READY;
+	before_shmem_exit(lfc_uring_at_exit, 0);
+	RegisterXactCallback(lfc_uring_xact_callback, NULL);
+	return true;
+}
+
+/*
+ * The ring is broken. Stop using it, and disable the LFC like after any other
+ * I/O error, which also invalidates the chunks pinned for the outstanding
+ * I/Os.
+ *
+ * The I/Os that the kernel has already taken from the ring point into the
+ * callers' buffers and iovecs, so wait for them to complete before
+ * returning. The ones that were never submitted are discarded along with the
+ * ring. If we can't even wait, tearing down the ring cancels the rest.
+ */
+static void
+lfc_uring_fail(int rc)
+{
+	int			n_submitted = lfc_ring_inflight - io_uring_sq_ready(&lfc_ring);
+
+	while (n_submitted > 0)
+	{
+		struct io_uring_cqe *cqe;
+		int			wait_rc = io_uring_wait_cqe(&lfc_ring, &cqe);
+
+		if (wait_rc == -EINTR)
+			continue;
+		if (wait_rc < 0)
+			break;
+		io_uring_cqe_seen(&lfc_ring, cqe);
+		n_submitted -= 1;
+	}
+	io_uring_queue_exit(&lfc_ring);
+
+	lfc_ring_state = LFC_RING_FAILED;
+	lfc_ring_inflight = 0;
+	lfc_n_async_writes = 0;
+	errno = -rc;
+	lfc_disable("use io_uring for");
+}
+
+/*
+ * Submit all the prepared requests. Returns false if the ring is broken.
+ */
+static bool
+lfc_uring_submit(void)
+{
+	while (io_uring_sq_ready(&lfc_ring) > 0)
+	{
+		int			rc = io_uring_submit(&lfc_ring);
+
+		if (rc < 0 && rc != -EINTR)
+		{
+			lfc_uring_fail(rc);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+lfc_uring_complete(struct io_uring_cqe *cqe)
+{
+	LfcIoOp    *op = (LfcIoOp *) io_uring_cqe_get_data(cqe);
+	instr_time	now;
+
+	op->result = cqe->res;
+	io_uring_cqe_seen(&lfc_ring, cqe);
+	lfc_ring_inflight -= 1;
+
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, op->start);
+	op->latency_us = INSTR_TIME_GET_MICROSEC(now);
+	op->done = true;
+
+	if (op->is_write)
+	{
+		LfcAsyncWrite *aw = (LfcAsyncWrite *) op;
+
+		aw->in_use = false;
+		lfc_n_async_writes -= 1;
+		lfc_prefetch_done(aw->partno, aw->entry, aw->generation, aw->hash,
+						  aw->chunk_offs, aw->op.result, aw->op.latency_us);
+	}
+}
+
+/*
+ * Process the completed requests of the ring. If 'wait' is true, wait for at
+ * least one request to complete, if there are any in flight. Returns false if
+ * the ring is broken.
+ *
+ * Must not be called while holding any LFC locks, as completing a prefetch
+ * write needs to take the partition lock.
+ */
+static bool
+lfc_uring_process_completions(bool wait)
+{
+	struct io_uring_cqe *cqe;
+	int			rc;
+
+	while (lfc_ring_inflight > 0)
+	{
+		if (wait)
+			rc = io_uring_wait_cqe(&lfc_ring, &cqe);
+		else
+			rc = io_uring_peek_cqe(&lfc_ring, &cqe);
+
+		if (rc == -EINTR)
+			continue;
+		if (rc == -EAGAIN)
+			break;				/* nothing completed yet */
+		if (rc < 0)
+		{
+			lfc_uring_fail(rc);
+			return false;
+		}
+		lfc_uring_complete(cqe);
+		wait = false;
+	}
+	return true;
+}
+
+/*
+ * Get a free slot for an asynchronous write, waiting for earlier writes to
+ * complete if all slots are in use. Returns NULL if the ring is broken.
+ */
+static LfcAsyncWrite *
+lfc_uring_get_write_slot(void)
+{
+	if (!lfc_uring_process_completions(false))
+		return NULL;
+	while (lfc_n_async_writes >= LFC_MAX_ASYNC_WRITES)
+	{
+		if (!lfc_uring_process_completions(true))
+			return NULL;
+	}
+	for (int i = 0; i < LFC_MAX_ASYNC_WRITES; i++)
+	{
+		if (!lfc_async_writes[i].in_use)
+			return &lfc_async_writes[i];
+	}
+	pg_unreachable();
+}
+
+#endif							/* HAVE_LIBURING */
+
+/*
+ * Wait for the asynchronous writes of prefetched pages issued by this backend
+ * to complete, making the pages available to other backends. This is called
+ * by the communicator after receiving a batch of responses, and before any LFC
+ * operation that might have to wait for a PENDING block.
+ */
+void
+lfc_wait_async_writes(void)
+{
+#ifdef HAVE_LIBURING
+	if (lfc_n_async_writes == 0)
+		return;
+
+	pgstat_report_wait_start(WAIT_EVENT_NEON_LFC_WRITE);
+	while (lfc_n_async_writes > 0)
+	{
+		if (!lfc_uring_process_completions(true))
+			break;
+	}
+	pgstat_report_wait_end();
+#endif
+}
+
+/*
+ * Read the available blocks of the chunks pinned by lfc_readv_select(). With
+ * io_uring, the reads of all the chunks are submitted together. Returns false
+ * if there was an I/O error, after disabling the LFC.
+ */
+static bool
+lfc_read_chunks(LfcChunkRead *reads, int n_reads)
+{
+#ifdef HAVE_LIBURING
+	if (n_reads > 1 && lfc_uring_ready())
+	{
+		bool		submitted = false;
+
+		for (int i = 0; i < n_reads; i++)
+		{
+			LfcChunkRead *rd = &reads[i];
+			struct io_uring_sqe *sqe;
+
+			if (rd->hits == 0)
+				continue;
+
+			/* If we run out of SQEs, the rest is read synchronously below */
+			sqe = io_uring_get_sqe(&lfc_ring);
+			if (sqe == NULL)
+				break;
+
+			io_uring_prep_readv(sqe, lfc_desc, rd->iov, rd->iovcnt, rd->file_offset);
+			io_uring_sqe_set_data(sqe, &rd->op);
+			INSTR_TIME_SET_CURRENT(rd->op.start);
+			lfc_ring_inflight += 1;
+			submitted = true;
+		}
+
+		if (submitted)
+		{
+			if (!lfc_uring_submit())
+				return false;
+
+			pgstat_report_wait_start(WAIT_EVENT_NEON_LFC_READ);
+			for (int i = 0; i < n_reads; i++)
+			{
+				LfcChunkRead *rd = &reads[i];
+
+				if (rd->hits == 0 || INSTR_TIME_IS_ZERO(rd->op.start))
+					continue;
+				while (!rd->op.done)
+				{
+					if (!lfc_uring_process_completions(true))
+					{
+						pgstat_report_wait_end();
+						return false;
+					}
+				}
+			}
+			pgstat_report_wait_end();
+		}
+	}
+#endif
+
+	for (int i = 0; i < n_reads; i++)
+	{
+		LfcChunkRead *rd = &reads[i];
+		instr_time	io_start,
+					io_end;
+
+		if (rd->hits == 0 || rd->op.done)
+			continue;
+
+		pgstat_report_wait_start(WAIT_EVENT_NEON_LFC_READ);
+		INSTR_TIME_SET_CURRENT(io_start);
+		rd->op.result = preadv(lfc_desc, rd->iov, rd->iovcnt, rd->file_offset);
+		if (rd->op.result < 0)
+			rd->op.result = -errno;
+		INSTR_TIME_SET_CURRENT(io_end);
+		pgstat_report_wait_end();
+
+		INSTR_TIME_SUBTRACT(io_end, io_start);
+		rd->op.latency_us = INSTR_TIME_GET_MICROSEC(io_end);
+		rd->op.done = true;
+	}
+
+	for (int i = 0; i < n_reads; i++)
+	{
+		LfcChunkRead *rd = &reads[i];
+
+		if (rd->hits != 0 && rd->op.result != BLCKSZ * rd->iovcnt)
+		{
+			if (rd->op.result < 0)
+				errno = -rd->op.result;
+			lfc_disable("read");
+			return false;
+		}
+	}
+	return true;
+}
+
+static char *
+lfc_index_path(void)
+{
+	return psprintf("%s" LFC_INDEX_SUFFIX, lfc_path);
+}
+
+static pg_crc32c
+lfc_index_crc(LfcIndexHeader *hdr, LfcIndexEntry *entries)
+{
+	pg_crc32c	crc;
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, hdr, offsetof(LfcIndexHeader, crc));
+	COMP_CRC32C(crc, entries, (size_t) hdr->n_entries * sizeof(LfcIndexEntry));
+	FIN_CRC32C(crc);
+	return crc;
+}
+
+/*
+ * Set the cache size limit at startup, from neon.file_cache_size_limit.
+ */
+static void
+lfc_init_limit(void)
+{
+	lfc_ctl->limit = SIZE_MB_TO_CHUNKS(lfc_size_limit);
+	for (int i = 0; i < lfc_n_partitions; i++)
+		lfc_ctl->partitions[i].limit = lfc_partition_share(lfc_ctl->limit, i);
+}
+
+/*
+ * on_shmem_exit callback of the postmaster: write the index of the cache, if
+ * the server was shut down cleanly. All other processes have exited by now,
+ * so the shared state can be read without locks.
+ */
+static void
+lfc_persist_at_exit(int code, Datum arg)
+{
+	ControlFileData *control;
+	bool		crc_ok;
+	LfcIndexHeader hdr;
+	LfcIndexEntry *entries;
+	FileCacheTotals totals;
+	uint32		n_entries = 0;
+	char	   *path;
+	char	   *tmppath;
+	int			fd;
+
+	/* Don't try to persist anything after a crash */
+	if (code != 0 || lfc_ctl == NULL || !LFC_ENABLED())
+		return;
+
+	control = get_controlfile(DataDir, &crc_ok);
+	if (!crc_ok || control->state != DB_SHUTDOWNED)
+	{
+		elog(LOG, "LFC: not persisting local file cache, the server was not shut down cleanly");
+		return;
+	}
+
+	/* The pages must be on disk before the index that refers to them */
+	fd = BasicOpenFile(lfc_path, O_RDWR);
+	if (fd < 0 || pg_fsync(fd) != 0)
+	{
+		elog(LOG, "LFC: failed to sync local file cache %s: %m", lfc_path);
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+	close(fd);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = LFC_INDEX_MAGIC;
+	hdr.blcksz = BLCKSZ;
+	hdr.chunk_size_log = lfc_chunk_size_log;
+	hdr.system_identifier = control->system_identifier;
+	hdr.checkpoint_lsn = control->checkPoint;
+	hdr.end_lsn = GetXLogInsertRecPtr();
+	strlcpy(hdr.tenant, neon_tenant ? neon_tenant : "", sizeof(hdr.tenant));
+	strlcpy(hdr.timeline, neon_timeline ? neon_timeline : "", sizeof(hdr.timeline));
+
+	lfc_get_totals(&totals);
+	entries = palloc0(Max(totals.used, 1) * sizeof(LfcIndexEntry));
+
+	/*
+	 * Write the chunks in the order of their lists, least recently used
+	 * first, so that restoring them in the same order keeps the order.
+	 */
+	for (int p = 0; p < lfc_n_partitions; p++)
+	{
+		FileCachePartition *part = &lfc_ctl->partitions[p];
+		dlist_head *lists[2] = {&part->lru, &part->hot};
+
+		for (int l = 0; l < lengthof(lists); l++)
+		{
+			dlist_iter	iter;
+
+			dlist_foreach(iter, lists[l])
+			{
+				FileCacheEntry *entry = dlist_container(FileCacheEntry, list_node, iter.cur);
+				LfcIndexEntry *ientry;
+				bool		any_available = false;
+
+				if (n_entries == totals.used)
+					break;
+				ientry = &entries[n_entries];
+				for (int i = 0; i < lfc_blocks_per_chunk; i++)
+				{
+					if (GET_STATE(entry, i) == AVAILABLE)
+					{
+						ientry->available[i / 32] |= (uint32) 1 << (i % 32);
+						any_available = true;
+					}
+				}
+				if (!any_available)
+					continue;
+				ientry->key = entry->key;
+				ientry->offset = entry->offset;
+				n_entries++;
+			}
+		}
 	}
-	lfc_close_file();
-}
-
-static void
-lfc_disable(char const *op)
-{
-	elog(WARNING, "LFC: failed to %s local file cache at %s: %m, disabling local file cache", op, lfc_path);
+	hdr.n_entries = n_entries;
+	hdr.crc = lfc_index_crc(&hdr, entries);
+
+	path = lfc_index_path();
+	tmppath = psprintf("%s.tmp", path);
+	fd = BasicOpenFile(tmppath, O_RDWR | O_CREAT | O_TRUNC);
+	if (fd < 0 ||
+		write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		write(fd, entries, n_entries * sizeof(LfcIndexEntry)) != n_entries * sizeof(LfcIndexEntry) ||
+		pg_fsync(fd) != 0)
+	{
+		elog(LOG, "LFC: failed to write local file cache index %s: %m", tmppath);
+		if (fd >= 0)
+			close(fd);
+		unlink(tmppath);
+		return;
+	}
+	close(fd);
 
-	LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
-	lfc_switch_off();
-	LWLockRelease(lfc_lock);
+	if (durable_rename(tmppath, path, LOG) == 0)
+		elog(LOG, "LFC: persisted index of %u chunks, valid up to %X/%X",
+			 n_entries, LSN_FORMAT_ARGS(hdr.end_lsn));
 }
 
 /*
- * This check is done without obtaining lfc_lock, so it is unreliable
+ * Rebuild the hash tables from the index written at the last shutdown, if
+ * the cached pages are still the latest versions. Called by the postmaster
+ * at startup, after the partitions have been initialized. Returns false if
+ * the cache must start empty.
  */
 static bool
-lfc_maybe_disabled(void)
+lfc_restore_index(uint32 n_chunks)
 {
-	return !lfc_ctl || !LFC_ENABLED();
-}
+	char	   *path = lfc_index_path();
+	LfcIndexHeader hdr;
+	LfcIndexEntry *entries;
+	ControlFileData *control;
+	bool		crc_ok;
+	XLogRecPtr	redo;
+	uint8	   *offset_used;
+	uint32		n_holes[MAX_LFC_PARTITIONS] = {0};
+	uint32		size = 0;
+	uint32		n_restored = 0;
+	uint64		n_pages = 0;
+	int			fd;
+	int			hole_partno = 0;
 
-/*
- * Open LFC file if not opened yet or generation is changed.
- * Should be called under LFC lock.
- */
-static bool
-lfc_ensure_opened(void)
-{
-	if (lfc_generation != lfc_ctl->generation)
+	fd = BasicOpenFile(path, O_RDONLY);
+	if (fd < 0)
 	{
-		lfc_close_file();
-		lfc_generation = lfc_ctl->generation;
+		if (errno != ENOENT)
+			elog(LOG, "LFC: could not open local file cache index %s: %m", path);
+		return false;
 	}
-	/* Open cache file if not done yet */
-	if (lfc_desc < 0)
+
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		hdr.magic != LFC_INDEX_MAGIC ||
+		hdr.blcksz != BLCKSZ ||
+		hdr.chunk_size_log != lfc_chunk_size_log ||
+		hdr.n_entries >= MaxAllocSize / sizeof(LfcIndexEntry))
 	{
-		lfc_desc = BasicOpenFile(lfc_path, O_RDWR);
+		elog(LOG, "LFC: ignoring invalid or incompatible local file cache index %s", path);
+		close(fd);
+		unlink(path);
+		return false;
+	}
+	entries = palloc(Max(hdr.n_entries, 1) * sizeof(LfcIndexEntry));
+	if (read(fd, entries, hdr.n_entries * sizeof(LfcIndexEntry)) != hdr.n_entries * sizeof(LfcIndexEntry) ||
+		lfc_index_crc(&hdr, entries) != hdr.crc)
+	{
+		elog(LOG, "LFC: ignoring corrupted local file cache index %s", path);
+		close(fd);
+		unlink(path);
+		pfree(entries);
+		return false;
+	}
+	close(fd);
+
+	/* The index is only valid for the next startup, whatever happens below */
+	unlink(path);
+
+	control = get_controlfile(DataDir, &crc_ok);
+	redo = control->checkPointCopy.redo;
+	if (!crc_ok ||
+		control->system_identifier != hdr.system_identifier ||
+		strcmp(hdr.tenant, neon_tenant ? neon_tenant : "") != 0 ||
+		strcmp(hdr.timeline, neon_timeline ? neon_timeline : "") != 0 ||
+		redo < hdr.checkpoint_lsn || redo > hdr.end_lsn)
+	{
+		elog(LOG, "LFC: local file cache valid from %X/%X to %X/%X can't be reused when starting from %X/%X",
+			 LSN_FORMAT_ARGS(hdr.checkpoint_lsn), LSN_FORMAT_ARGS(hdr.end_lsn),
+			 LSN_FORMAT_ARGS(redo));
+		pfree(entries);
+		return false;
+	}
 
-		if (lfc_desc < 0)
+	fd = BasicOpenFile(lfc_path, O_RDWR);
+	if (fd < 0)
+	{
+		elog(LOG, "LFC: failed to open local file cache %s: %m", lfc_path);
+		pfree(entries);
+		return false;
+	}
+	close(fd);
+
+	lfc_init_limit();
+
+	offset_used = palloc0((n_chunks + 7) / 8);
+	for (uint32 n = 0; n < hdr.n_entries; n++)
+	{
+		LfcIndexEntry *ientry = &entries[n];
+		FileCacheEntry *entry;
+		FileCachePartition *part;
+		uint32		hash;
+		int			partno;
+		bool		found;
+		uint32		available = 0;
+
+		/* skip the chunks that don't fit in the cache anymore */
+		if (ientry->offset >= n_chunks || BITMAP_ISSET(offset_used, ientry->offset))
+			continue;
+		hash = lfc_tag_hash(&ientry->key);
+		partno = lfc_partition_of(hash);
+		part = &lfc_ctl->partitions[partno];
+		if (part->used >= part->limit)
+			continue;
+
+		entry = hash_search_with_hash_value(lfc_hash[partno], &ientry->key, hash, HASH_ENTER, &found);
+		if (found)
+			continue;
+		entry->hash = hash;
+		entry->offset = ientry->offset;
+		pg_atomic_init_u32(&entry->access_count, 0);
+		pg_atomic_init_u32(&entry->usage, 0);
+		for (int i = 0; i < lfc_blocks_per_chunk; i++)
 		{
-			lfc_disable("open");
-			return false;
+			if (ientry->available[i / 32] & ((uint32) 1 << (i % 32)))
+			{
+				SET_STATE(entry, i, AVAILABLE);
+				available++;
+			}
+			else
+				SET_STATE(entry, i, UNAVAILABLE);
+		}
+		dlist_push_tail(&part->lru, &entry->list_node);
+		part->used += 1;
+		part->used_pages += available;
+
+		BITMAP_SET(offset_used, ientry->offset);
+		size = Max(size, ientry->offset + 1);
+		n_restored++;
+		n_pages += available;
+	}
+
+	/*
+	 * The chunks in between that weren't restored become holes, in the
+	 * partitions that have room for them in their hash tables. If none has,
+	 * the chunk is left unused until the next restart.
+	 */
+	for (uint32 offset = 0; offset < size; offset++)
+	{
+		if (BITMAP_ISSET(offset_used, offset))
+			continue;
+
+		for (int i = 0; i < lfc_n_partitions; i++)
+		{
+			int			partno = (hole_partno + i) % lfc_n_partitions;
+			FileCachePartition *part = &lfc_ctl->partitions[partno];
+			FileCacheEntry *hole;
+			BufferTag	holetag;
+			uint32		hash;
+			bool		found;
+
+			if (part->used + n_holes[partno] >= lfc_partition_share(n_chunks, partno))
+				continue;
+
+			memset(&holetag, 0, sizeof(holetag));
+			holetag.blockNum = offset;
+			hash = get_hash_value(lfc_hash[partno], &holetag);
+			hole = hash_search_with_hash_value(lfc_hash[partno], &holetag, hash, HASH_ENTER, &found);
+			CriticalAssert(!found);
+			hole->hash = hash;
+			hole->offset = offset;
+			pg_atomic_init_u32(&hole->access_count, 0);
+			pg_atomic_init_u32(&hole->usage, 0);
+			dlist_push_tail(&part->holes, &hole->list_node);
+			n_holes[partno] += 1;
+			hole_partno = partno + 1;
+			break;
 		}
 	}
+	pg_atomic_write_u32(&lfc_ctl->size, size);
+
+	elog(LOG, "LFC: restored %u chunks with " UINT64_FORMAT " pages from the last shutdown at %X/%X",
+		 n_restored, n_pages, LSN_FORMAT_ARGS(hdr.end_lsn));
+
+	pfree(offset_used);
+	pfree(entries);
 	return true;
 }
 
@@ -350,42 +1491,68 @@ LfcShmemInit(void)
 	if (lfc_max_size <= 0)
 		return;
 
-	lfc_ctl = (FileCacheControl *) ShmemInitStruct("lfc", sizeof(FileCacheControl), &found);
+	lfc_ctl = (FileCacheControl *) ShmemInitStruct("lfc", FILE_CACHE_CONTROL_SIZE(lfc_n_partitions), &found);
 	if (!found)
 	{
 		int			fd;
 		uint32		n_chunks = SIZE_MB_TO_CHUNKS(lfc_max_size);
 
 		lfc_lock = (LWLockId) GetNamedLWLockTranche("lfc_lock");
+		lfc_partition_locks = GetNamedLWLockTranche("lfc_partition_lock");
 		info.keysize = sizeof(BufferTag);
 		info.entrysize = FILE_CACHE_ENRTY_SIZE;
 
-		/*
-		 * n_chunks+1 because we add new element to hash table before eviction
-		 * of victim
-		 */
-		lfc_hash = ShmemInitHash("lfc_hash",
-								 n_chunks + 1, n_chunks + 1,
-								 &info,
-								 HASH_ELEM | HASH_BLOBS);
-		memset(lfc_ctl, 0, sizeof(FileCacheControl));
-		dlist_init(&lfc_ctl->lru);
-		dlist_init(&lfc_ctl->holes);
+		memset(lfc_ctl, 0, FILE_CACHE_CONTROL_SIZE(lfc_n_partitions));
+		pg_atomic_init_u32(&lfc_ctl->size, 0);
+
+		for (int i = 0; i < lfc_n_partitions; i++)
+		{
+			FileCachePartition *part = &lfc_ctl->partitions[i];
+			uint32		max_entries = lfc_partition_share(n_chunks, i) + 1;
+			char		name[32];
+
+			/*
+			 * +1 because we add new element to hash table before eviction
+			 * of victim
+			 */
+			snprintf(name, sizeof(name), "lfc_hash_%d", i);
+			lfc_hash[i] = ShmemInitHash(name,
+										max_entries, max_entries,
+										&info,
+										HASH_ELEM | HASH_BLOBS);
+			pg_atomic_init_u32(&part->pinned, 0);
+			pg_atomic_init_u64(&part->hits, 0);
+			pg_atomic_init_u64(&part->misses, 0);
+			pg_atomic_init_u64(&part->writes, 0);
+			pg_atomic_init_u64(&part->time_read, 0);
+			pg_atomic_init_u64(&part->time_write, 0);
+			dlist_init(&part->lru);
+			dlist_init(&part->hot);
+			dlist_init(&part->holes);
+		}
 
 		/* Initialize hyper-log-log structure for estimating working set size */
 		initSHLL(&lfc_ctl->wss_estimation);
+		initMRC(&lfc_ctl->mrc_estimation);
+		SpinLockInit(&lfc_ctl->prewarm_promote_mutex);
 
-		/* Recreate file cache on restart */
-		fd = BasicOpenFile(lfc_path, O_RDWR | O_CREAT | O_TRUNC);
-		if (fd < 0)
-		{
-			elog(WARNING, "LFC: failed to create local file cache %s: %m", lfc_path);
-			lfc_ctl->limit = 0;
-		}
-		else
+		if (lfc_persist && !IsUnderPostmaster)
+			on_shmem_exit(lfc_persist_at_exit, (Datum) 0);
+
+		/* Recreate file cache on restart, unless it can be reused */
+		if (!lfc_persist || !lfc_restore_index(n_chunks))
 		{
-			close(fd);
-			lfc_ctl->limit = SIZE_MB_TO_CHUNKS(lfc_size_limit);
+			fd = BasicOpenFile(lfc_path, O_RDWR | O_CREAT | O_TRUNC);
+			if (fd < 0)
+			{
+				elog(WARNING, "LFC: failed to create local file cache %s: %m", lfc_path);
+				lfc_ctl->limit = 0;
+			}
+			else
+			{
+				close(fd);
+				lfc_init_limit();
+			}
 		}
 
 		/* Initialize turnstile of condition variables */
@@ -400,8 +1567,15 @@ LfcShmemRequest(void)
 {
 	if (lfc_max_size > 0)
 	{
-		RequestAddinShmemSpace(sizeof(FileCacheControl) + hash_estimate_size(SIZE_MB_TO_CHUNKS(lfc_max_size) + 1, FILE_CACHE_ENRTY_SIZE));
+		uint32		n_chunks = SIZE_MB_TO_CHUNKS(lfc_max_size);
+		Size		size = FILE_CACHE_CONTROL_SIZE(lfc_n_partitions);
+
+		for (int i = 0; i < lfc_n_partitions; i++)
+			size = add_size(size, hash_estimate_size(lfc_partition_share(n_chunks, i) + 1, FILE_CACHE_ENRTY_SIZE));
+
+		RequestAddinShmemSpace(size);
 		RequestNamedLWLockTranche("lfc_lock", 1);
+		RequestNamedLWLockTranche("lfc_partition_lock", lfc_n_partitions);
 	}
 }
 
@@ -455,12 +1629,12 @@ lfc_change_limit_hook(int newval, void *extra)
 	if (!lfc_ctl || !is_normal_backend())
 		return;
 
-	LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+	lfc_lock_all(LW_EXCLUSIVE);
 
 	/* Open LFC file only if LFC was enabled or we are going to reenable it */
 	if (newval == 0 && !LFC_ENABLED())
 	{
-		LWLockRelease(lfc_lock);
+		lfc_unlock_all();
 		/* File should be reopened if LFC is reenabled */
 		lfc_close_file();
 		return;
@@ -468,7 +1642,7 @@ lfc_change_limit_hook(int newval, void *extra)
 
 	if (!lfc_ensure_opened())
 	{
-		LWLockRelease(lfc_lock);
+		lfc_unlock_all();
 		return;
 	}
 
@@ -477,44 +1651,57 @@ lfc_change_limit_hook(int newval, void *extra)
 		lfc_ctl->resizes += 1;
 	}
 
-	while (new_size < lfc_ctl->used && !dlist_is_empty(&lfc_ctl->lru))
+	for (int partno = 0; partno < lfc_n_partitions; partno++)
 	{
-		/*
-		 * Shrink cache by throwing away least recently accessed chunks and
-		 * returning their space to file system
-		 */
-		FileCacheEntry *victim = dlist_container(FileCacheEntry, list_node, dlist_pop_head_node(&lfc_ctl->lru));
-		FileCacheEntry *hole;
-		uint32		offset = victim->offset;
-		uint32		hash;
-		bool		found;
-		BufferTag	holetag;
+		FileCachePartition *part = &lfc_ctl->partitions[partno];
+		uint32		new_part_size = lfc_partition_share(new_size, partno);
 
-		CriticalAssert(victim->access_count == 0);
+		while (new_part_size < part->used)
+		{
+			/*
+			 * Shrink cache by throwing away least recently accessed chunks and
+			 * returning their space to file system
+			 */
+			FileCacheEntry *victim = lfc_choose_victim(part);
+			FileCacheEntry *hole;
+			uint32		offset;
+			uint32		hash;
+			bool		found;
+			BufferTag	holetag;
+
+			/* All remaining chunks are pinned */
+			if (victim == NULL)
+				break;
+
+			offset = victim->offset;
 #ifdef FALLOC_FL_PUNCH_HOLE
-		if (fallocate(lfc_desc, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) victim->offset * lfc_blocks_per_chunk * BLCKSZ, lfc_blocks_per_chunk * BLCKSZ) < 0)
-			neon_log(LOG, "Failed to punch hole in file: %m");
+			if (fallocate(lfc_desc, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) victim->offset * lfc_blocks_per_chunk * BLCKSZ, lfc_blocks_per_chunk * BLCKSZ) < 0)
+				neon_log(LOG, "Failed to punch hole in file: %m");
 #endif
-		/* We remove the old entry, and re-enter a hole to the hash table */
-		for (int i = 0; i < lfc_blocks_per_chunk; i++)
-		{
-			bool is_page_cached = GET_STATE(victim, i) == AVAILABLE;
-			lfc_ctl->used_pages -= is_page_cached;
-			lfc_ctl->evicted_pages += is_page_cached;
+			/* We remove the old entry, and re-enter a hole to the hash table */
+			for (int i = 0; i < lfc_blocks_per_chunk; i++)
+			{
+				bool is_page_cached = GET_STATE(victim, i) == AVAILABLE;
+				part->used_pages -= is_page_cached;
+				part->evicted_pages += is_page_cached;
+			}
+			hash_search_with_hash_value(lfc_hash[partno], &victim->key, victim->hash, HASH_REMOVE, NULL);
+
+			memset(&holetag, 0, sizeof(holetag));
+			holetag.blockNum = offset;
+			hash = get_hash_value(lfc_hash[partno], &holetag);
+			hole = hash_search_with_hash_value(lfc_hash[partno], &holetag, hash, HASH_ENTER, &found);
+			hole->hash = hash;
+			hole->offset = offset;
+			pg_atomic_init_u32(&hole->access_count, 0);
+			pg_atomic_init_u32(&hole->usage, 0);
+			CriticalAssert(!found);
+			dlist_push_tail(&part->holes, &hole->list_node);
+
+			part->used -= 1;
 		}
-		hash_search_with_hash_value(lfc_hash, &victim->key, victim->hash, HASH_REMOVE, NULL);
-
-		memset(&holetag, 0, sizeof(holetag));
-		holetag.blockNum = offset;
-		hash = get_hash_value(lfc_hash, &holetag);
-		hole = hash_search_with_hash_value(lfc_hash, &holetag, hash, HASH_ENTER, &found);
-		hole->hash = hash;
-		hole->offset = offset;
-		hole->access_count = 0;
-		CriticalAssert(!found);
-		dlist_push_tail(&lfc_ctl->holes, &hole->list_node);
-
-		lfc_ctl->used -= 1;
+		if (new_size != 0)
+			part->limit = new_part_size;
 	}
 	if (new_size == 0)
 		lfc_switch_off();
@@ -523,7 +1710,7 @@ lfc_change_limit_hook(int newval, void *extra)
 
 	neon_log(DEBUG1, "set local file cache limit to %d", new_size);
 
-	LWLockRelease(lfc_lock);
+	lfc_unlock_all();
 }
 
 void
@@ -559,6 +1746,17 @@ lfc_init(void)
 							NULL,
 							NULL);
 
+	DefineCustomBoolVariable("neon.file_cache_persist",
+							"Keep the local file cache across clean restarts of the compute",
+							NULL,
+							&lfc_persist,
+							false,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
 	DefineCustomIntVariable("neon.max_file_cache_size",
 							"Maximal size of Neon local file cache",
 							NULL,
@@ -609,6 +1807,48 @@ lfc_init(void)
 							lfc_change_chunk_size,
 							NULL);
 
+	DefineCustomIntVariable("neon.file_cache_partitions",
+							"Number of independently locked partitions of Neon local file cache",
+							NULL,
+							&lfc_n_partitions,
+							1,
+							1,
+							MAX_LFC_PARTITIONS,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomEnumVariable("neon.file_cache_eviction_policy",
+							 "Replacement policy of Neon local file cache",
+							 NULL,
+							 &lfc_eviction_policy,
+							 LFC_EVICTION_LRU,
+							 lfc_eviction_policies,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomEnumVariable("neon.file_cache_io_engine",
+							 "I/O engine used to access Neon local file cache",
+							 NULL,
+							 &lfc_io_engine,
+							 LFC_IO_SYNC,
+							 lfc_io_engines,
+							 PGC_SIGHUP,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+#ifndef HAVE_LIBURING
+	if (lfc_io_engine == LFC_IO_URING)
+		elog(WARNING, "LFC: neon was built without io_uring support, using synchronous I/O for local file cache");
+#endif
+
 	DefineCustomIntVariable("neon.file_cache_prewarm_limit",
 							"Maximal number of prewarmed chunks",
 							NULL,
@@ -634,6 +1874,19 @@ lfc_init(void)
 							NULL,
 							NULL,
 							NULL);
+
+	DefineCustomIntVariable("neon.file_cache_prewarm_yield_latency",
+							"Average foreground getpage latency above which prewarm slows down",
+							"Zero disables throttling of prewarm.",
+							&lfc_prewarm_yield_latency,
+							10,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
 }
 
 /*
@@ -649,16 +1902,22 @@ lfc_get_state(size_t max_entries)
 	if (lfc_maybe_disabled() || max_entries == 0)	/* fast exit if file cache is disabled */
 		return NULL;
 
-	LWLockAcquire(lfc_lock, LW_SHARED);
+	lfc_lock_all(LW_SHARED);
 
 	if (LFC_ENABLED())
 	{
-		dlist_iter iter;
+		dlist_node *cursors[MAX_LFC_PARTITIONS];
+		bool		cursor_in_hot[MAX_LFC_PARTITIONS];
+		FileCacheTotals totals;
 		size_t i = 0;
 		uint8* bitmap;
 		size_t n_pages = 0;
-		size_t n_entries = Min(max_entries, lfc_ctl->used - lfc_ctl->pinned);
-		size_t state_size = FILE_CACHE_STATE_SIZE_FOR_CHUNKS(n_entries);
+		size_t n_entries;
+		size_t state_size;
+
+		lfc_get_totals(&totals);
+		n_entries = Min(max_entries, totals.used);
+		state_size = FILE_CACHE_STATE_SIZE_FOR_CHUNKS(n_entries);
 		fcs = (FileCacheState*)palloc0(state_size);
 		SET_VARSIZE(fcs, state_size);
 		fcs->magic = FILE_CACHE_STATE_MAGIC;
@@ -666,30 +1925,69 @@ lfc_get_state(size_t max_entries)
 		fcs->n_chunks = n_entries;
 		bitmap = FILE_CACHE_STATE_BITMAP(fcs);
 
-		dlist_reverse_foreach(iter, &lfc_ctl->lru)
+		/*
+		 * Walk the lists of all partitions from the most recently used end,
+		 * the hot ring of CLOCK before the LRU list, taking one chunk from
+		 * each partition in turn, so that the hottest chunks come first also
+		 * when the state is truncated.
+		 */
+		for (int p = 0; p < lfc_n_partitions; p++)
+		{
+			FileCachePartition *part = &lfc_ctl->partitions[p];
+
+			cursor_in_hot[p] = !dlist_is_empty(&part->hot);
+			if (cursor_in_hot[p])
+				cursors[p] = dlist_tail_node(&part->hot);
+			else
+				cursors[p] = dlist_is_empty(&part->lru) ? NULL : dlist_tail_node(&part->lru);
+		}
+		while (i < n_entries)
 		{
-			FileCacheEntry *entry = dlist_container(FileCacheEntry, list_node, iter.cur);
-			fcs->chunks[i] = entry->key;
-			for (int j = 0; j < lfc_blocks_per_chunk; j++)
+			bool		progress = false;
+
+			for (int p = 0; p < lfc_n_partitions && i < n_entries; p++)
 			{
-				if (GET_STATE(entry, j) != UNAVAILABLE)
+				FileCachePartition *part = &lfc_ctl->partitions[p];
+				dlist_head *list = cursor_in_hot[p] ? &part->hot : &part->lru;
+				FileCacheEntry *entry;
+
+				if (cursors[p] == NULL)
+					continue;
+				entry = dlist_container(FileCacheEntry, list_node, cursors[p]);
+				if (dlist_has_prev(list, cursors[p]))
+					cursors[p] = dlist_prev_node(list, cursors[p]);
+				else if (cursor_in_hot[p] && !dlist_is_empty(&part->lru))
 				{
-					/* Validate the buffer tag before including it */
-					BufferTag test_tag = entry->key;
-					test_tag.blockNum += j;
+					cursor_in_hot[p] = false;
+					cursors[p] = dlist_tail_node(&part->lru);
+				}
+				else
+					cursors[p] = NULL;
+				progress = true;
 
-					if (BufferTagIsValid(&test_tag))
-					{
-						BITMAP_SET(bitmap, i*lfc_blocks_per_chunk + j);
-						n_pages += 1;
-					}
-					else
+				fcs->chunks[i] = entry->key;
+				for (int j = 0; j < lfc_blocks_per_chunk; j++)
+				{
+					if (GET_STATE(entry, j) != UNAVAILABLE)
 					{
-						elog(ERROR, "LFC: Skipping invalid buffer tag during cache state capture: blockNum=%u", test_tag.blockNum);
+						/* Validate the buffer tag before including it */
+						BufferTag test_tag = entry->key;
+						test_tag.blockNum += j;
+
+						if (BufferTagIsValid(&test_tag))
+						{
+							BITMAP_SET(bitmap, i*lfc_blocks_per_chunk + j);
+							n_pages += 1;
+						}
+						else
+						{
+							elog(ERROR, "LFC: Skipping invalid buffer tag during cache state capture: blockNum=%u", test_tag.blockNum);
+						}
 					}
 				}
+				i++;
 			}
-			if (++i == n_entries)
+			if (!progress)
 				break;
 		}
 		Assert(i == n_entries);
@@ -698,7 +1996,7 @@ lfc_get_state(size_t max_entries)
 		elog(LOG, "LFC: save state of %d chunks %d pages (validated)", (int)n_entries, (int)n_pages);
 	}
 
-	LWLockRelease(lfc_lock);
+	lfc_unlock_all();
 
 	return fcs;
 }
@@ -716,6 +2014,7 @@ lfc_prewarm(FileCacheState* fcs, uint32 n_workers)
 	size_t fcs_size;
 	uint32_t max_prefetch_pages;
 	dsm_segment *seg;
+	PrewarmQueue *queue;
 	BackgroundWorkerHandle* bgw_handle[MAX_PREWARM_WORKERS];
 
 
@@ -767,7 +2066,7 @@ lfc_prewarm(FileCacheState* fcs, uint32 n_workers)
 	LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
 
 	/* Do not prewarm more entries than LFC limit */
-	if (lfc_ctl->limit <= lfc_ctl->size)
+	if (lfc_ctl->limit <= pg_atomic_read_u32(&lfc_ctl->size))
 	{
 		elog(LOG, "LFC: skip prewarm because LFC is already filled");
 		LWLockRelease(lfc_lock);
@@ -785,14 +2084,21 @@ lfc_prewarm(FileCacheState* fcs, uint32 n_workers)
 	lfc_ctl->prewarm_canceled = false;
 	lfc_ctl->prewarm_batch = prewarm_batch;
 	memset(lfc_ctl->prewarm_workers, 0, n_workers*sizeof(PrewarmWorkerState));
+	for (uint32 i = 0; i < n_workers; i++)
+		lfc_ctl->prewarm_workers[i].procno = -1;
 
 	LWLockRelease(lfc_lock);
 
 	/* Calculate total number of pages to be prewarmed */
 	lfc_ctl->total_prewarm_pages = fcs->n_pages;
+	lfc_ctl->prewarm_started = GetCurrentTimestamp();
 
-	seg = dsm_create(fcs_size, 0);
+	seg = dsm_create(MAXALIGN(fcs_size) + PREWARM_QUEUE_SIZE(n_entries), 0);
 	memcpy(dsm_segment_address(seg), fcs, fcs_size);
+	queue = PREWARM_QUEUE(dsm_segment_address(seg));
+	pg_atomic_init_u32(&queue->next_chunk, 0);
+	for (size_t i = 0; i < (n_entries + 31) / 32; i++)
+		pg_atomic_init_u32(&queue->claimed[i], 0);
 	lfc_ctl->prewarm_lfc_state_handle = dsm_segment_handle(seg);
 
 	/* Spawn background workers */
@@ -861,20 +2167,137 @@ lfc_prewarm(FileCacheState* fcs, uint32 n_workers)
 	LWLockRelease(lfc_lock);
 }
 
+/*
+ * Called on a foreground read that missed a whole chunk while prewarm is
+ * active. If the chunk is still waiting to be prewarmed, a prewarm worker
+ * claims it next, so that the rest of the chunk, which is likely to be read
+ * soon, is loaded ahead of its turn.
+ */
+static void
+lfc_prewarm_promote(BufferTag *tag)
+{
+	SpinLockAcquire(&lfc_ctl->prewarm_promote_mutex);
+	lfc_ctl->prewarm_promote[lfc_ctl->prewarm_promote_head % PREWARM_PROMOTE_SIZE] = *tag;
+	lfc_ctl->prewarm_promote_head++;
+	SpinLockRelease(&lfc_ctl->prewarm_promote_mutex);
+}
+
+typedef struct PrewarmChunkEntry
+{
+	BufferTag	key;
+	uint32		chunk;
+} PrewarmChunkEntry;
+
+static bool
+lfc_prewarm_claim(PrewarmQueue *queue, uint32 chunk)
+{
+	uint32		bit = (uint32) 1 << (chunk % 32);
+
+	return (pg_atomic_fetch_or_u32(&queue->claimed[chunk / 32], bit) & bit) == 0;
+}
+
+/*
+ * Claim the next chunk for a prewarm worker: a chunk that a foreground read
+ * missed recently, or else the next unclaimed one in the order of the state.
+ */
+static bool
+lfc_prewarm_next_chunk(FileCacheState *fcs, size_t n_entries, HTAB *chunks,
+					   uint64 *promote_tail, uint32 *chunk)
+{
+	PrewarmQueue *queue = PREWARM_QUEUE(fcs);
+	BufferTag	promoted[PREWARM_PROMOTE_SIZE];
+	int			n_promoted = 0;
+
+	SpinLockAcquire(&lfc_ctl->prewarm_promote_mutex);
+	if (lfc_ctl->prewarm_promote_head - *promote_tail > PREWARM_PROMOTE_SIZE)
+		*promote_tail = lfc_ctl->prewarm_promote_head - PREWARM_PROMOTE_SIZE;
+	while (*promote_tail < lfc_ctl->prewarm_promote_head)
+		promoted[n_promoted++] = lfc_ctl->prewarm_promote[(*promote_tail)++ % PREWARM_PROMOTE_SIZE];
+	SpinLockRelease(&lfc_ctl->prewarm_promote_mutex);
+
+	/* Most recent misses first */
+	for (int i = n_promoted - 1; i >= 0; i--)
+	{
+		PrewarmChunkEntry *entry;
+
+		promoted[i].blockNum &= ~(BlockNumber) ((1 << fcs->chunk_size_log) - 1);
+		entry = hash_search(chunks, &promoted[i], HASH_FIND, NULL);
+		if (entry != NULL && lfc_prewarm_claim(queue, entry->chunk))
+		{
+			*chunk = entry->chunk;
+			return true;
+		}
+	}
+
+	for (;;)
+	{
+		uint32		next = pg_atomic_fetch_add_u32(&queue->next_chunk, 1);
+
+		if (next >= n_entries)
+			return false;
+		if (lfc_prewarm_claim(queue, next))
+		{
+			*chunk = next;
+			return true;
+		}
+	}
+}
+
+/*
+ * Average latency of the getpage requests of the foreground backends, i.e.
+ * all but the prewarm workers, since the previous call.
+ */
+static uint64
+lfc_foreground_getpage_latency(uint64 *prev_count, uint64 *prev_sum)
+{
+	uint64		count = 0;
+	uint64		sum = 0;
+	uint64		latency = 0;
+
+	for (int procno = 0; procno < NUM_NEON_PERF_COUNTER_SLOTS; procno++)
+	{
+		bool		is_prewarm_worker = false;
+
+		for (size_t i = 0; i < lfc_ctl->n_prewarm_workers; i++)
+		{
+			if (lfc_ctl->prewarm_workers[i].procno == procno)
+				is_prewarm_worker = true;
+		}
+		if (is_prewarm_worker)
+			continue;
+		count += neon_per_backend_counters_shared[procno].getpage_hist.wait_us_count;
+		sum += neon_per_backend_counters_shared[procno].getpage_hist.wait_us_sum;
+	}
+	/* the counters of an exited backend are reset by the next one */
+	if (count > *prev_count && sum >= *prev_sum)
+		latency = (sum - *prev_sum) / (count - *prev_count);
+	*prev_count = count;
+	*prev_sum = sum;
+	return latency;
+}
+
 void
 lfc_prewarm_main(Datum main_arg)
 {
-	size_t snd_idx = 0, rcv_idx = 0;
-	size_t n_sent = 0, n_received = 0;
+	size_t n_entries;
 	size_t fcs_chunk_size_log;
-	size_t max_prefetch_pages;
 	size_t prewarm_batch;
-	size_t n_workers;
+	size_t depth;
+	size_t n_sent = 0, n_received = 0;
 	dsm_segment *seg;
 	FileCacheState* fcs;
 	uint8* bitmap;
 	BufferTag tag;
+	BufferTag *inflight;
 	PrewarmWorkerState* ws;
+	HTAB *chunks;
+	HASHCTL info;
+	uint32 chunk = 0;
+	uint32 chunk_blocks;
+	uint32 blk;
+	uint64 promote_tail;
+	uint64 fg_count = 0, fg_sum = 0;
+	TimestampTz next_check;
 	uint32 worker_id = DatumGetInt32(main_arg);
 
 	AmPrewarmWorker = true;
@@ -891,10 +2314,32 @@ lfc_prewarm_main(Datum main_arg)
 	fcs = (FileCacheState*) dsm_segment_address(seg);
 	prewarm_batch = lfc_ctl->prewarm_batch;
 	fcs_chunk_size_log = fcs->chunk_size_log;
-	n_workers = lfc_ctl->n_prewarm_workers;
-	max_prefetch_pages = lfc_ctl->n_prewarm_entries << fcs_chunk_size_log;
+	n_entries = lfc_ctl->n_prewarm_entries;
 	ws = &lfc_ctl->prewarm_workers[worker_id];
+	ws->procno = MyProcNumber;
 	bitmap = FILE_CACHE_STATE_BITMAP(fcs);
+	chunk_blocks = 1 << fcs_chunk_size_log;
+	blk = chunk_blocks;			/* no chunk claimed yet */
+
+	/* Map the chunk tags to their position in the state, for promotion */
+	info.keysize = sizeof(BufferTag);
+	info.entrysize = sizeof(PrewarmChunkEntry);
+	chunks = hash_create("LFC prewarm chunks", n_entries, &info, HASH_ELEM | HASH_BLOBS);
+	for (uint32 i = 0; i < n_entries; i++)
+	{
+		PrewarmChunkEntry *entry = hash_search(chunks, &fcs->chunks[i], HASH_ENTER, NULL);
+
+		entry->chunk = i;
+	}
+	SpinLockAcquire(&lfc_ctl->prewarm_promote_mutex);
+	promote_tail = lfc_ctl->prewarm_promote_head;
+	SpinLockRelease(&lfc_ctl->prewarm_promote_mutex);
+
+	/* Ring of the tags of the prefetch requests in flight */
+	inflight = palloc(prewarm_batch * sizeof(BufferTag));
+	depth = prewarm_batch;
+	(void) lfc_foreground_getpage_latency(&fg_count, &fg_sum);
+	next_check = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), PREWARM_THROTTLE_INTERVAL);
 
 	/* enable prefetch in LFC */
 	lfc_store_prefetch_result = true;
@@ -903,68 +2348,78 @@ lfc_prewarm_main(Datum main_arg)
 	elog(LOG, "LFC: worker %d start prewarming", worker_id);
 	while (!lfc_ctl->prewarm_canceled)
 	{
-		if (snd_idx < max_prefetch_pages)
+		/* Keep up to 'depth' prefetch requests in flight */
+		while (n_sent - n_received < depth)
 		{
-			if ((snd_idx >> fcs_chunk_size_log) % n_workers != worker_id)
+			size_t		idx;
+
+			if (blk == chunk_blocks)
 			{
-				/* If there are multiple workers, split chunks between them */
-				snd_idx += 1 << fcs_chunk_size_log;
+				if (!lfc_prewarm_next_chunk(fcs, n_entries, chunks, &promote_tail, &chunk))
+					break;
+				blk = 0;
 			}
-			else
-			{
-				if (BITMAP_ISSET(bitmap, snd_idx))
-				{
-					tag = fcs->chunks[snd_idx >> fcs_chunk_size_log];
-					tag.blockNum += snd_idx & ((1 << fcs_chunk_size_log) - 1);
+			idx = ((size_t) chunk << fcs_chunk_size_log) + blk;
+			blk += 1;
+			if (!BITMAP_ISSET(bitmap, idx))
+				continue;
 
-					if (!BufferTagIsValid(&tag)) {
-						elog(ERROR, "LFC: Invalid buffer tag: %u", tag.blockNum);
-					}
+			tag = fcs->chunks[chunk];
+			tag.blockNum += idx & (chunk_blocks - 1);
 
-					if (!lfc_cache_contains(BufTagGetNRelFileInfo(tag), tag.forkNum, tag.blockNum))
-					{
-						(void)communicator_prefetch_register_bufferv(tag, NULL, 1, NULL);
-						n_sent += 1;
-					}
-					else
-					{
-						ws->skipped_pages += 1;
-						BITMAP_CLR(bitmap, snd_idx);
-					}
-				}
-				snd_idx += 1;
+			if (!BufferTagIsValid(&tag)) {
+				elog(ERROR, "LFC: Invalid buffer tag: %u", tag.blockNum);
 			}
+
+			if (!lfc_cache_contains(BufTagGetNRelFileInfo(tag), tag.forkNum, tag.blockNum))
+			{
+				(void)communicator_prefetch_register_bufferv(tag, NULL, 1, NULL);
+				inflight[n_sent % prewarm_batch] = tag;
+				n_sent += 1;
+			}
+			else
+			{
+				ws->skipped_pages += 1;
+			}
+		}
+		if (n_received == n_sent)
+			break;
+
+		tag = inflight[n_received % prewarm_batch];
+		if (communicator_prefetch_receive(tag))
+		{
+			ws->prewarmed_pages += 1;
+		}
+		else
+		{
+			ws->skipped_pages += 1;
 		}
-		if (n_sent >= n_received + prewarm_batch || snd_idx == max_prefetch_pages)
+		n_received += 1;
+
+		/*
+		 * Yield to the foreground backends: halve the number of requests in
+		 * flight while their getpage latency is above the threshold, and stop
+		 * for a while if it stays there with a single request in flight.
+		 * Grow back one request at a time when the latency is normal again.
+		 */
+		if (lfc_prewarm_yield_latency > 0 && GetCurrentTimestamp() >= next_check)
 		{
-			if (n_received == n_sent && snd_idx == max_prefetch_pages)
-			{
-				break;
-			}
-			if ((rcv_idx >> fcs_chunk_size_log) % n_workers != worker_id)
-			{
-				/* Skip chunks processed by other workers */
-				rcv_idx += 1 << fcs_chunk_size_log;
-				continue;
-			}
+			uint64		latency = lfc_foreground_getpage_latency(&fg_count, &fg_sum);
 
-			/* Locate next block to prefetch */
-			while (!BITMAP_ISSET(bitmap, rcv_idx))
-			{
-				rcv_idx += 1;
-			}
-			tag = fcs->chunks[rcv_idx >> fcs_chunk_size_log];
-			tag.blockNum += rcv_idx & ((1 << fcs_chunk_size_log) - 1);
-			if (communicator_prefetch_receive(tag))
-			{
-				ws->prewarmed_pages += 1;
-			}
-			else
+			if (latency > (uint64) lfc_prewarm_yield_latency * 1000)
 			{
-				ws->skipped_pages += 1;
+				if (depth == 1 && n_sent == n_received)
+				{
+					(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+									 PREWARM_THROTTLE_INTERVAL, PG_WAIT_EXTENSION);
+					ResetLatch(MyLatch);
+					CHECK_FOR_INTERRUPTS();
+				}
+				depth = Max(depth / 2, 1);
 			}
-			rcv_idx += 1;
-			n_received += 1;
+			else if (depth < prewarm_batch)
+				depth += 1;
+			next_check = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), PREWARM_THROTTLE_INTERVAL);
 		}
 	}
 	/* No need to perform prefetch cleanup here because prewarm worker will be terminated and
@@ -990,28 +2445,34 @@ lfc_invalidate(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber nblocks)
 
 	CriticalAssert(BufTagGetRelNumber(&tag) != InvalidRelFileNumber);
 
-	LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
-	if (LFC_ENABLED())
+	for (BlockNumber blkno = 0; blkno < nblocks; blkno += lfc_blocks_per_chunk)
 	{
-		for (BlockNumber blkno = 0; blkno < nblocks; blkno += lfc_blocks_per_chunk)
+		int			partno;
+
+		tag.blockNum = blkno;
+		hash = lfc_tag_hash(&tag);
+		partno = lfc_partition_of(hash);
+
+		LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
+		if (!LFC_ENABLED())
+		{
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
+			break;
+		}
+		entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_FIND, NULL);
+		if (entry != NULL)
 		{
-			tag.blockNum = blkno;
-			hash = get_hash_value(lfc_hash, &tag);
-			entry = hash_search_with_hash_value(lfc_hash, &tag, hash, HASH_FIND, NULL);
-			if (entry != NULL)
+			for (int i = 0; i < lfc_blocks_per_chunk; i++)
 			{
-				for (int i = 0; i < lfc_blocks_per_chunk; i++)
+				if (GET_STATE(entry, i) == AVAILABLE)
 				{
-					if (GET_STATE(entry, i) == AVAILABLE)
-					{
-						lfc_ctl->used_pages -= 1;
-						SET_STATE(entry, i, UNAVAILABLE);
-					}
+					lfc_ctl->partitions[partno].used_pages -= 1;
+					SET_STATE(entry, i, UNAVAILABLE);
 				}
 			}
 		}
+		LWLockRelease(LFC_PARTITION_LOCK(partno));
 	}
-	LWLockRelease(lfc_lock);
 }
 
 /*
@@ -1026,6 +2487,7 @@ lfc_cache_contains(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno)
 	int			chunk_offs = BLOCK_TO_CHUNK_OFF(blkno);
 	bool		found = false;
 	uint32		hash;
+	int			partno;
 
 	if (lfc_maybe_disabled())	/* fast exit if file cache is disabled */
 		return false;
@@ -1035,15 +2497,16 @@ lfc_cache_contains(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno)
 	tag.blockNum = blkno - chunk_offs;
 
 	CriticalAssert(BufTagGetRelNumber(&tag) != InvalidRelFileNumber);
-	hash = get_hash_value(lfc_hash, &tag);
+	hash = lfc_tag_hash(&tag);
+	partno = lfc_partition_of(hash);
 
-	LWLockAcquire(lfc_lock, LW_SHARED);
+	LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_SHARED);
 	if (LFC_ENABLED())
 	{
-		entry = hash_search_with_hash_value(lfc_hash, &tag, hash, HASH_FIND, NULL);
+		entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_FIND, NULL);
 		found = entry != NULL && GET_STATE(entry, chunk_offs) != UNAVAILABLE;
 	}
-	LWLockRelease(lfc_lock);
+	LWLockRelease(LFC_PARTITION_LOCK(partno));
 	return found;
 }
 
@@ -1060,6 +2523,7 @@ lfc_cache_containsv(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 	uint32		chunk_offs;
 	int			found = 0;
 	uint32		hash;
+	int			partno;
 	int			i = 0;
 
 	if (lfc_maybe_disabled())	/* fast exit if file cache is disabled */
@@ -1072,19 +2536,20 @@ lfc_cache_containsv(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 
 	chunk_offs = BLOCK_TO_CHUNK_OFF(blkno);
 	tag.blockNum = blkno - chunk_offs;
-	hash = get_hash_value(lfc_hash, &tag);
+	hash = lfc_tag_hash(&tag);
+	partno = lfc_partition_of(hash);
 
-	LWLockAcquire(lfc_lock, LW_SHARED);
+	LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_SHARED);
 
 	if (!LFC_ENABLED())
 	{
-		LWLockRelease(lfc_lock);
+		LWLockRelease(LFC_PARTITION_LOCK(partno));
 		return 0;
 	}
 	while (true)
 	{
 		int		this_chunk = Min(nblocks - i, lfc_blocks_per_chunk - chunk_offs);
-		entry = hash_search_with_hash_value(lfc_hash, &tag, hash, HASH_FIND, NULL);
+		entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_FIND, NULL);
 
 		if (entry != NULL)
 		{
@@ -1109,15 +2574,24 @@ lfc_cache_containsv(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			break;
 
 		/*
-		 * Prepare for the next iteration. We don't unlock here, as that'd
-		 * probably be more expensive than the gains it'd get us.
+		 * Prepare for the next iteration. We don't unlock here if the next
+		 * chunk is in the same partition, as that'd probably be more
+		 * expensive than the gains it'd get us.
 		 */
 		chunk_offs = BLOCK_TO_CHUNK_OFF(blkno + i);
 		tag.blockNum = (blkno + i) - chunk_offs;
-		hash = get_hash_value(lfc_hash, &tag);
+		hash = lfc_tag_hash(&tag);
+		if (lfc_partition_of(hash) != partno)
+		{
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
+			partno = lfc_partition_of(hash);
+			LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_SHARED);
+			if (!LFC_ENABLED())
+				break;
+		}
 	}
 
-	LWLockRelease(lfc_lock);
+	LWLockRelease(LFC_PARTITION_LOCK(partno));
 
 #ifdef USE_ASSERT_CHECKING
 	{
@@ -1155,6 +2629,8 @@ static PGAlignedBlock voidblock = {0};
  * If the mask argument is supplied, we'll only try to read those pages which
  * don't have their bits set on entry. At exit, pages which were successfully
  * read from LFC will have their bits set.
+ *
+ * At most PG_IOV_MAX pages can be read at a time.
  */
 int
 lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
@@ -1162,60 +2638,73 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 {
 	BufferTag	tag;
 	FileCacheEntry *entry;
-	ssize_t		rc;
 	uint32		hash;
-	uint64		generation;
-	uint32		entry_offset;
+	struct iovec iov[PG_IOV_MAX];
+	LfcChunkRead reads[PG_IOV_MAX];
+	int			n_reads = 0;
 	int			blocks_read = 0;
 	int			buf_offset = 0;
+	bool		disabled = false;
+	bool		failed = false;
 
 	if (lfc_maybe_disabled())	/* fast exit if file cache is disabled */
 		return -1;
 
+	Assert(nblocks <= PG_IOV_MAX);
+
+	/* We might need to wait for a block that we're writing ourselves */
+	lfc_wait_async_writes();
+
 	CopyNRelFileInfoToBufTag(tag, rinfo);
 	tag.forkNum = forkNum;
 
 	CriticalAssert(BufTagGetRelNumber(&tag) != InvalidRelFileNumber);
 
-	/* Update working set size estimate for the blocks */
+	/* Update working set size and miss ratio estimates for the blocks */
 	for (int i = 0; i < nblocks; i++)
 	{
+		uint32		tag_hash;
+
 		tag.blockNum = blkno + i;
-		addSHLL(&lfc_ctl->wss_estimation, hash_bytes((uint8_t const*)&tag, sizeof(tag)));
+		tag_hash = hash_bytes((uint8_t const*)&tag, sizeof(tag));
+		addSHLL(&lfc_ctl->wss_estimation, tag_hash);
+		addMRC(&lfc_ctl->mrc_estimation, tag_hash, true);
 	}
 
 	/*
 	 * For every chunk that has blocks we're interested in, we
 	 * 1. get the chunk header
-	 * 2. Check if the chunk actually has the blocks we're interested in
-	 * 3. Read the blocks we're looking for (in one preadv), assuming they exist
-	 * 4. Update the statistics for the read call.
+	 * 2. Check if the chunk actually has the blocks we're interested in, and
+	 *    pin it.
+	 * Then we
+	 * 3. Read the blocks we're looking for, assuming they exist. That's one
+	 *    preadv per chunk, or a single io_uring submission for all of them.
+	 * 4. Update the statistics for the read call, and unpin the chunks.
 	 *
-	 * If there is an error, we do an early return.
+	 * If there is an error, we return -1.
 	 */
 	while (nblocks > 0)
 	{
-		struct iovec iov[PG_IOV_MAX];
-		uint8	chunk_mask[MAX_BLOCKS_PER_CHUNK / 8] = {0};
+		LfcChunkRead *rd = &reads[n_reads];
 		int		chunk_offs = BLOCK_TO_CHUNK_OFF(blkno);
 		int		blocks_in_chunk = Min(nblocks, lfc_blocks_per_chunk - chunk_offs);
-		int		iteration_hits = 0;
-		int		iteration_misses = 0;
-		uint64	io_time_us = 0;
 		int		n_blocks_to_read = 0;
 		int		iov_last_used = 0;
 		int		first_block_in_chunk_read = -1;
+		int		partno;
+		FileCachePartition *part;
+		LWLockMode lockmode;
 		ConditionVariable* cv;
 
 		Assert(blocks_in_chunk > 0);
 
 		for (int i = 0; i < blocks_in_chunk; i++)
 		{
-			iov[i].iov_len = BLCKSZ;
+			iov[buf_offset + i].iov_len = BLCKSZ;
 			/* mask not set = we must do work */
 			if (!BITMAP_ISSET(mask, buf_offset + i))
 			{
-				iov[i].iov_base = buffers[buf_offset + i];
+				iov[buf_offset + i].iov_base = buffers[buf_offset + i];
 				n_blocks_to_read++;
 				iov_last_used = i + 1;
 
@@ -1228,7 +2717,7 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			else
 			{
 				/* don't scribble on pages we weren't requested to write to */
-				iov[i].iov_base = SCRIBBLEPAGE;
+				iov[buf_offset + i].iov_base = SCRIBBLEPAGE;
 			}
 		}
 
@@ -1248,26 +2737,71 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 		Assert(iov_last_used - first_block_in_chunk_read >= n_blocks_to_read);
 
 		tag.blockNum = blkno - chunk_offs;
-		hash = get_hash_value(lfc_hash, &tag);
+		hash = lfc_tag_hash(&tag);
+		partno = lfc_partition_of(hash);
+		part = &lfc_ctl->partitions[partno];
 		cv = &lfc_ctl->cv[hash % N_COND_VARS];
 
-		LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+		/*
+		 * First try with the lock in shared mode. That's enough if none of
+		 * the blocks we need are being loaded by some other backend.
+		 */
+		lockmode = LW_SHARED;
+		LWLockAcquire(LFC_PARTITION_LOCK(partno), lockmode);
 
-		/* We can return the blocks we've read before LFC got disabled;
-		 * assuming we read any. */
 		if (!LFC_ENABLED() || !lfc_ensure_opened())
 		{
-			LWLockRelease(lfc_lock);
-			return blocks_read;
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
+			disabled = true;
+			break;
 		}
 
-		entry = hash_search_with_hash_value(lfc_hash, &tag, hash, HASH_FIND, NULL);
+		entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_FIND, NULL);
+		if (entry != NULL)
+		{
+			for (int i = first_block_in_chunk_read; i < iov_last_used; i++)
+			{
+				FileCacheBlockState state;
+
+				if (BITMAP_ISSET(mask, buf_offset + i))
+					continue;
+
+				state = GET_STATE(entry, chunk_offs + i);
+				if (state == PENDING || state == REQUESTED)
+				{
+					/* We'll have to wait, which requires the exclusive lock */
+					lockmode = LW_EXCLUSIVE;
+					break;
+				}
+			}
+			if (lockmode == LW_EXCLUSIVE)
+			{
+				LWLockRelease(LFC_PARTITION_LOCK(partno));
+				LWLockAcquire(LFC_PARTITION_LOCK(partno), lockmode);
+
+				if (!LFC_ENABLED() || !lfc_ensure_opened())
+				{
+					LWLockRelease(LFC_PARTITION_LOCK(partno));
+					disabled = true;
+					break;
+				}
+				entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_FIND, NULL);
+			}
+		}
 		if (entry == NULL)
 		{
 			/* Pages are not cached */
-			lfc_ctl->misses += blocks_in_chunk;
+			pg_atomic_fetch_add_u64(&part->misses, blocks_in_chunk);
 			pgBufferUsage.file_cache.misses += blocks_in_chunk;
-			LWLockRelease(lfc_lock);
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
+
+			if (lfc_ctl->prewarm_active && !AmPrewarmWorker)
+			{
+				BufferTag	missed = tag;
+
+				missed.blockNum = blkno;
+				lfc_prewarm_promote(&missed);
+			}
 
 			buf_offset += blocks_in_chunk;
 			nblocks -= blocks_in_chunk;
@@ -1276,14 +2810,19 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			continue;
 		}
 
-		/* Unlink entry from LRU list to pin it for the duration of IO operation */
-		if (entry->access_count++ == 0)
-		{
-			lfc_ctl->pinned += 1;
-			dlist_delete(&entry->list_node);
-		}
-		generation = lfc_ctl->generation;
-		entry_offset = entry->offset;
+		/* Pin entry for the duration of IO operation */
+		lfc_pin_entry(part, entry, lockmode, true);
+
+		memset(rd, 0, sizeof(LfcChunkRead));
+		rd->partno = partno;
+		rd->entry = entry;
+		rd->generation = lfc_ctl->generation;
+		/* chunk offset (# of pages) into the LFC file, plus offset of first IOV */
+		rd->file_offset = ((off_t) entry->offset * lfc_blocks_per_chunk +
+						   chunk_offs + first_block_in_chunk_read) * BLCKSZ;
+		rd->iov = &iov[buf_offset + first_block_in_chunk_read];
+		rd->iovcnt = iov_last_used - first_block_in_chunk_read;
+		rd->buf_offset = buf_offset + first_block_in_chunk_read;
 
 		for (int i = first_block_in_chunk_read; i < iov_last_used; i++)
 		{
@@ -1294,10 +2833,12 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			if (BITMAP_ISSET(mask, buf_offset + i))
 				continue;
 
-			while (lfc_ctl->generation == generation)
+			/* In shared mode, we checked above that there is nothing to wait for */
+			while (lfc_ctl->generation == rd->generation)
 			{
 				state = GET_STATE(entry, chunk_offs + i);
 				if (state == PENDING) {
+					Assert(lockmode == LW_EXCLUSIVE);
 					SET_STATE(entry, chunk_offs + i, REQUESTED);
 				} else if (state != REQUESTED) {
 					break;
@@ -1307,9 +2848,9 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 					ConditionVariablePrepareToSleep(cv);
 					sleeping = true;
 				}
-				LWLockRelease(lfc_lock);
+				LWLockRelease(LFC_PARTITION_LOCK(partno));
 				ConditionVariableTimedSleep(cv, CV_WAIT_TIMEOUT, WAIT_EVENT_NEON_LFC_CV_WAIT);
-				LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+				LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
 			}
 			if (sleeping)
 			{
@@ -1317,89 +2858,78 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			}
 			if (state == AVAILABLE)
 			{
-				BITMAP_SET(chunk_mask, i);
-				iteration_hits++;
+				BITMAP_SET(rd->chunk_mask, i - first_block_in_chunk_read);
+				rd->hits++;
 			}
 			else
-				iteration_misses++;
+				rd->misses++;
 		}
-		LWLockRelease(lfc_lock);
-
-		Assert(iteration_hits + iteration_misses > 0);
+		LWLockRelease(LFC_PARTITION_LOCK(partno));
 
-		if (iteration_hits != 0)
-		{
-			/* chunk offset (#
-			   of pages) into the LFC file */
-			off_t	first_read_offset = (off_t) entry_offset * lfc_blocks_per_chunk;
-			int		nwrite = iov_last_used - first_block_in_chunk_read;
-			/* offset of first IOV */
-			first_read_offset += chunk_offs + first_block_in_chunk_read;
+		Assert(rd->hits + rd->misses > 0);
+		n_reads++;
 
-			pgstat_report_wait_start(WAIT_EVENT_NEON_LFC_READ);
+		buf_offset += blocks_in_chunk;
+		nblocks -= blocks_in_chunk;
+		blkno += blocks_in_chunk;
+	}
 
-			/* Read only the blocks we're interested in, limiting */
-			rc = preadv(lfc_desc, &iov[first_block_in_chunk_read],
-						nwrite, first_read_offset * BLCKSZ);
-			pgstat_report_wait_end();
+	if (!disabled && !lfc_read_chunks(reads, n_reads))
+		failed = true;
 
-			if (rc != (BLCKSZ * nwrite))
-			{
-				lfc_disable("read");
-				return -1;
-			}
-		}
+	/*
+	 * Unpin the entries. Nothing here needs the exclusive lock, we only need
+	 * to hold the lock to be sure that the entry was not removed while LFC
+	 * was disabled.
+	 */
+	for (int j = 0; j < n_reads; j++)
+	{
+		LfcChunkRead *rd = &reads[j];
+		FileCachePartition *part = &lfc_ctl->partitions[rd->partno];
 
-		/* Place entry to the head of LRU list */
-		LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+		LWLockAcquire(LFC_PARTITION_LOCK(rd->partno), LW_SHARED);
 
-		if (lfc_ctl->generation == generation)
+		if (lfc_ctl->generation == rd->generation)
 		{
 			CriticalAssert(LFC_ENABLED());
-			lfc_ctl->hits += iteration_hits;
-			lfc_ctl->misses += iteration_misses;
-			pgBufferUsage.file_cache.hits += iteration_hits;
-			pgBufferUsage.file_cache.misses += iteration_misses;
 
-			if (iteration_hits)
+			if (!disabled && !failed)
 			{
-				lfc_ctl->time_read += io_time_us;
-				inc_page_cache_read_wait(io_time_us);
-				/*
-				 * We successfully read the pages we know were valid when we
-				 * started reading; now mark those pages as read
-				 */
-				for (int i = first_block_in_chunk_read; i < iov_last_used; i++)
+				pg_atomic_fetch_add_u64(&part->hits, rd->hits);
+				pg_atomic_fetch_add_u64(&part->misses, rd->misses);
+				pgBufferUsage.file_cache.hits += rd->hits;
+				pgBufferUsage.file_cache.misses += rd->misses;
+
+				if (rd->hits)
 				{
-					if (BITMAP_ISSET(chunk_mask, i))
-						BITMAP_SET(mask, buf_offset + i);
+					pg_atomic_fetch_add_u64(&part->time_read, rd->op.latency_us);
+					inc_page_cache_read_wait(rd->op.latency_us);
+					/*
+					 * We successfully read the pages we know were valid when
+					 * we started reading; now mark those pages as read
+					 */
+					for (int i = 0; i < rd->iovcnt; i++)
+					{
+						if (BITMAP_ISSET(rd->chunk_mask, i))
+							BITMAP_SET(mask, rd->buf_offset + i);
+					}
+					blocks_read += rd->hits;
 				}
 			}
 
-			CriticalAssert(entry->access_count > 0);
-			if (--entry->access_count == 0)
-			{
-				lfc_ctl->pinned -= 1;
-				dlist_push_tail(&lfc_ctl->lru, &entry->list_node);
-			}
+			lfc_unpin_entry(part, rd->entry);
 		}
 		else
 		{
 			/* generation mismatch, assume error condition */
 			lfc_close_file();
-			LWLockRelease(lfc_lock);
-			return -1;
+			failed = true;
 		}
 
-		LWLockRelease(lfc_lock);
-
-		buf_offset += blocks_in_chunk;
-		nblocks -= blocks_in_chunk;
-		blkno += blocks_in_chunk;
-		blocks_read += iteration_hits;
+		LWLockRelease(LFC_PARTITION_LOCK(rd->partno));
 	}
 
-	return blocks_read;
+	return failed ? -1 : blocks_read;
 }
 
 /*
@@ -1407,41 +2937,44 @@ lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
  * Returns false if there are no unpinned entries and chunk can not be added.
  */
 static bool
-lfc_init_new_entry(FileCacheEntry* entry, uint32 hash)
+lfc_init_new_entry(int partno, FileCacheEntry* entry, uint32 hash)
 {
+	FileCachePartition *part = &lfc_ctl->partitions[partno];
+	FileCacheEntry *victim = NULL;
+
 	/*-----------
 	 * If the chunk wasn't already in the LFC then we have these
 	 * options, in order of preference:
 	 *
-	 * Unless there is no space available, we can:
+	 * Unless there is no space available in the partition, we can:
 	 *  1. Use an entry from the `holes` list, and
 	 *  2. Create a new entry.
 	 * We can always, regardless of space in the LFC:
 	 *  3. evict an entry from LRU, and
 	 *  4. ignore the write operation (the least favorite option)
 	 */
-	if (lfc_ctl->used < lfc_ctl->limit)
+	if (part->used < part->limit)
 	{
-		if (!dlist_is_empty(&lfc_ctl->holes))
+		if (!dlist_is_empty(&part->holes))
 		{
 			/* We can reuse a hole that was left behind when the LFC was shrunk previously */
 			FileCacheEntry *hole = dlist_container(FileCacheEntry, list_node,
-												   dlist_pop_head_node(&lfc_ctl->holes));
+												   dlist_pop_head_node(&part->holes));
 			uint32 offset = hole->offset;
 			bool hole_found;
 
-			hash_search_with_hash_value(lfc_hash, &hole->key,
+			hash_search_with_hash_value(lfc_hash[partno], &hole->key,
 										hole->hash, HASH_REMOVE, &hole_found);
 			CriticalAssert(hole_found);
 
-			lfc_ctl->used += 1;
+			part->used += 1;
 			entry->offset = offset;			/* reuse the hole */
 		}
 		else
 		{
-			lfc_ctl->used += 1;
-			entry->offset = lfc_ctl->size++;/* allocate new chunk at end
-											 * of file */
+			part->used += 1;
+			/* allocate new chunk at end of file */
+			entry->offset = pg_atomic_fetch_add_u32(&lfc_ctl->size, 1);
 		}
 	}
 	/*
@@ -1455,37 +2988,36 @@ lfc_init_new_entry(FileCacheEntry* entry, uint32 hash)
 	 * While prewarming LFC we do not want to replace existed entries,
 	 * so we just stop prewarm is LFC cache is full.
 	 */
-	else if (!dlist_is_empty(&lfc_ctl->lru) && !lfc_do_prewarm)
+	else if (!lfc_do_prewarm && (victim = lfc_choose_victim(part)) != NULL)
 	{
 		/* Cache overflow: evict least recently used chunk */
-		FileCacheEntry *victim = dlist_container(FileCacheEntry, list_node,
-												 dlist_pop_head_node(&lfc_ctl->lru));
-
 		for (int i = 0; i < lfc_blocks_per_chunk; i++)
 		{
 			bool is_page_cached = GET_STATE(victim, i) == AVAILABLE;
-			lfc_ctl->used_pages -= is_page_cached;
-			lfc_ctl->evicted_pages += is_page_cached;
+			part->used_pages -= is_page_cached;
+			part->evicted_pages += is_page_cached;
 		}
 
-		CriticalAssert(victim->access_count == 0);
+		CriticalAssert(pg_atomic_read_u32(&victim->access_count) == 0);
 		entry->offset = victim->offset; /* grab victim's chunk */
-		hash_search_with_hash_value(lfc_hash, &victim->key,
+		hash_search_with_hash_value(lfc_hash[partno], &victim->key,
 									victim->hash, HASH_REMOVE, NULL);
 		neon_log(DEBUG2, "Swap file cache page");
 	}
 	else
 	{
 		/* Can't add this chunk - we don't have the space for it */
-		hash_search_with_hash_value(lfc_hash, &entry->key, hash,
+		hash_search_with_hash_value(lfc_hash[partno], &entry->key, hash,
 									HASH_REMOVE, NULL);
 		lfc_ctl->prewarm_canceled = true; /* cancel prewarm if LFC limit is reached */
 		return false;
 	}
 
-	entry->access_count = 1;
+	pg_atomic_init_u32(&entry->access_count, 1);
+	pg_atomic_init_u32(&entry->usage, 0);
 	entry->hash = hash;
-	lfc_ctl->pinned += 1;
+	pg_atomic_fetch_add_u32(&part->pinned, 1);
+	dlist_push_tail(&part->lru, &entry->list_node);
 
 	for (int i = 0; i < lfc_blocks_per_chunk; i++)
 		SET_STATE(entry, i, UNAVAILABLE);
@@ -1515,6 +3047,9 @@ lfc_init_new_entry(FileCacheEntry* entry, uint32 hash)
  *    If there is some backend waiting to write new image of the page (4) then now it will be able to
  *    do it,overwriting old (prefetched) page image. As far as this write will be completed before
  *    shared buffer can be reassigned, not other backend can see old page image.
+ *
+ * With the io_uring engine, we return right after submitting the write, and step 5 is done by
+ * lfc_prefetch_done() when this backend reaps the completion.
 */
 bool
 lfc_prefetch(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
@@ -1527,16 +3062,27 @@ lfc_prefetch(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
 	uint32		hash;
 	uint64		generation;
 	uint32		entry_offset;
+	off_t		file_offset;
 	instr_time io_start, io_end;
-	ConditionVariable* cv;
 	FileCacheBlockState state;
 	XLogRecPtr lwlsn;
+	int			partno;
+	FileCachePartition *part;
+#ifdef HAVE_LIBURING
+	LfcAsyncWrite *aw = NULL;
+#endif
 
 	int		chunk_offs = BLOCK_TO_CHUNK_OFF(blkno);
 
 	if (lfc_maybe_disabled())	/* fast exit if file cache is disabled */
 		return false;
 
+#ifdef HAVE_LIBURING
+	/* Reserve a slot for the write before we mark the block as PENDING */
+	if (lfc_uring_ready())
+		aw = lfc_uring_get_write_slot();
+#endif
+
 	CopyNRelFileInfoToBufTag(tag, rinfo);
 	CriticalAssert(BufTagGetRelNumber(&tag) != InvalidRelFileNumber);
 	tag.forkNum = forknum;
@@ -1549,14 +3095,15 @@ lfc_prefetch(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
 	}
 
 	tag.blockNum = blkno - chunk_offs;
-	hash = get_hash_value(lfc_hash, &tag);
-	cv = &lfc_ctl->cv[hash % N_COND_VARS];
+	hash = lfc_tag_hash(&tag);
+	partno = lfc_partition_of(hash);
+	part = &lfc_ctl->partitions[partno];
 
-	LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+	LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
 
 	if (!LFC_ENABLED() || !lfc_ensure_opened())
 	{
-		LWLockRelease(lfc_lock);
+		LWLockRelease(LFC_PARTITION_LOCK(partno));
 		return false;
 	}
 
@@ -1566,38 +3113,31 @@ lfc_prefetch(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
 	{
 		elog(DEBUG1, "Skip LFC write for %u because LwLSN=%X/%X is greater than not_nodified_since LSN %X/%X",
 			 blkno, LSN_FORMAT_ARGS(lwlsn), LSN_FORMAT_ARGS(lsn));
-		LWLockRelease(lfc_lock);
+		LWLockRelease(LFC_PARTITION_LOCK(partno));
 		return false;
 	}
 
-	entry = hash_search_with_hash_value(lfc_hash, &tag, hash, HASH_ENTER, &found);
+	entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_ENTER, &found);
 	if (found)
 	{
 		state = GET_STATE(entry, chunk_offs);
 		if (state != UNAVAILABLE) {
 			/* Do not rewrite existed LFC entry */
-			LWLockRelease(lfc_lock);
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
 			return false;
 		}
-		/*
-		 * Unlink entry from LRU list to pin it for the duration of IO
-		 * operation
-		 */
-		if (entry->access_count++ == 0)
-		{
-			lfc_ctl->pinned += 1;
-			dlist_delete(&entry->list_node);
-		}
+		/* Pin entry for the duration of IO operation */
+		lfc_pin_entry(part, entry, LW_EXCLUSIVE, false);
 	}
 	else
 	{
-		if (!lfc_init_new_entry(entry, hash))
+		if (!lfc_init_new_entry(partno, entry, hash))
 		{
 			/*
 			 * We can't process this chunk due to lack of space in LFC,
 			 * so skip to the next one
 			 */
-			LWLockRelease(lfc_lock);
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
 			return false;
 		}
 	}
@@ -1607,68 +3147,146 @@ lfc_prefetch(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
 
 	SET_STATE(entry, chunk_offs, PENDING);
 
-	LWLockRelease(lfc_lock);
+	LWLockRelease(LFC_PARTITION_LOCK(partno));
+
+	file_offset = ((off_t) entry_offset * lfc_blocks_per_chunk + chunk_offs) * BLCKSZ;
+
+#ifdef HAVE_LIBURING
+	if (aw != NULL)
+	{
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&lfc_ring);
+
+		/*
+		 * The caller's buffer can go away as soon as we return, so write
+		 * from a copy of it. The write is completed by
+		 * lfc_uring_complete(), which calls lfc_prefetch_done().
+		 */
+		if (sqe != NULL)
+		{
+			char	   *copy = lfc_async_write_bufs[aw - lfc_async_writes].data;
+
+			memcpy(copy, buffer, BLCKSZ);
+			io_uring_prep_write(sqe, lfc_desc, copy, BLCKSZ, file_offset);
+			io_uring_sqe_set_data(sqe, &aw->op);
+
+			memset(&aw->op, 0, sizeof(LfcIoOp));
+			aw->op.is_write = true;
+			INSTR_TIME_SET_CURRENT(aw->op.start);
+			aw->in_use = true;
+			aw->partno = partno;
+			aw->entry = entry;
+			aw->generation = generation;
+			aw->hash = hash;
+			aw->chunk_offs = chunk_offs;
+			lfc_n_async_writes += 1;
+			lfc_ring_inflight += 1;
+
+			/* If this fails, the LFC was disabled */
+			(void) lfc_uring_submit();
+			return true;
+		}
+	}
+#endif
 
 	pgstat_report_wait_start(WAIT_EVENT_NEON_LFC_WRITE);
 	INSTR_TIME_SET_CURRENT(io_start);
-	rc = pwrite(lfc_desc, buffer, BLCKSZ,
-				((off_t) entry_offset * lfc_blocks_per_chunk + chunk_offs) * BLCKSZ);
+	rc = pwrite(lfc_desc, buffer, BLCKSZ, file_offset);
 	INSTR_TIME_SET_CURRENT(io_end);
 	pgstat_report_wait_end();
 
+	INSTR_TIME_SUBTRACT(io_end, io_start);
+	lfc_prefetch_done(partno, entry, generation, hash, chunk_offs,
+					  rc < 0 ? -errno : rc, INSTR_TIME_GET_MICROSEC(io_end));
+	return true;
+}
+
+/*
+ * Complete the write of a prefetched page started by lfc_prefetch(): make the
+ * block available, and wake up the backends waiting for it. 'rc' is the
+ * result of the write, the number of bytes written or -errno.
+ */
+static void
+lfc_prefetch_done(int partno, FileCacheEntry *entry, uint64 generation,
+				  uint32 hash, int chunk_offs, ssize_t rc, uint64 time_spent_us)
+{
+	FileCachePartition *part = &lfc_ctl->partitions[partno];
+	ConditionVariable *cv = &lfc_ctl->cv[hash % N_COND_VARS];
+	FileCacheBlockState state;
+
 	if (rc != BLCKSZ)
 	{
+		if (rc < 0)
+			errno = -rc;
 		lfc_disable("write");
+		return;
 	}
-	else
-	{
-		LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
 
-		if (lfc_ctl->generation == generation)
-		{
-			uint64	time_spent_us;
-			CriticalAssert(LFC_ENABLED());
-			/* Place entry to the head of LRU list */
-			CriticalAssert(entry->access_count > 0);
+	LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
 
-			lfc_ctl->writes += 1;
-			INSTR_TIME_SUBTRACT(io_start, io_end);
-			time_spent_us = INSTR_TIME_GET_MICROSEC(io_start);
-			lfc_ctl->time_write += time_spent_us;
-			inc_page_cache_write_wait(time_spent_us);
+	if (lfc_ctl->generation == generation)
+	{
+		CriticalAssert(LFC_ENABLED());
 
-			if (--entry->access_count == 0)
-			{
-				lfc_ctl->pinned -= 1;
-				dlist_push_tail(&lfc_ctl->lru, &entry->list_node);
-			}
+		pg_atomic_fetch_add_u64(&part->writes, 1);
+		pg_atomic_fetch_add_u64(&part->time_write, time_spent_us);
+		inc_page_cache_write_wait(time_spent_us);
 
-			state = GET_STATE(entry, chunk_offs);
-			if (state == REQUESTED) {
-				ConditionVariableBroadcast(cv);
-			}
-			if (state != AVAILABLE)
-			{
-				lfc_ctl->used_pages += 1;
-				SET_STATE(entry, chunk_offs, AVAILABLE);
-			}
+		lfc_unpin_entry(part, entry);
+
+		state = GET_STATE(entry, chunk_offs);
+		if (state == REQUESTED) {
+			ConditionVariableBroadcast(cv);
 		}
-		else
+		if (state != AVAILABLE)
 		{
-			lfc_close_file();
+			part->used_pages += 1;
+			SET_STATE(entry, chunk_offs, AVAILABLE);
 		}
-		LWLockRelease(lfc_lock);
 	}
-	return true;
+	else
+	{
+		lfc_close_file();
+	}
+	LWLockRelease(LFC_PARTITION_LOCK(partno));
 }
 
 /*
  * Put page in local file cache.
  * If cache is full then evict some other page.
  */
+static void lfc_writev_internal(NRelFileInfo rinfo, ForkNumber forkNum,
+								BlockNumber blkno, const void *const *buffers,
+								const XLogRecPtr *lsns, BlockNumber nblocks);
+
 void
 lfc_writev(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 		   const void *const *buffers, BlockNumber nblocks)
+{
+	lfc_writev_internal(rinfo, forkNum, blkno, buffers, NULL, nblocks);
+}
+
+/*
+ * Like lfc_writev(), but for pages whose write was deferred: a block is
+ * skipped if its last-written LSN has advanced past lsns[i], because then
+ * another backend may already have written a newer version of it.
+ *
+ * The check is made under the partition lock, and a backend that writes a
+ * newer version advances the last-written LSN before it writes the page to
+ * the LFC, so it either makes us skip the block, or waits for our write and
+ * overwrites it.
+ */
+void
+lfc_writev_unmodified(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
+					  const void *const *buffers, const XLogRecPtr *lsns,
+					  BlockNumber nblocks)
+{
+	lfc_writev_internal(rinfo, forkNum, blkno, buffers, lsns, nblocks);
+}
+
+static void
+lfc_writev_internal(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
+					const void *const *buffers, const XLogRecPtr *lsns,
+					BlockNumber nblocks)
 {
 	BufferTag	tag;
 	FileCacheEntry *entry;
@@ -1682,76 +3300,86 @@ lfc_writev(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 	if (lfc_maybe_disabled())	/* fast exit if file cache is disabled */
 		return;
 
+	/* We might need to wait for a block that we're writing ourselves */
+	lfc_wait_async_writes();
+
 	CopyNRelFileInfoToBufTag(tag, rinfo);
 	CriticalAssert(BufTagGetRelNumber(&tag) != InvalidRelFileNumber);
 	tag.forkNum = forkNum;
 
-	/* Update working set size estimate for the blocks */
+	/* Update working set size and miss ratio estimates for the blocks */
 	for (int i = 0; i < nblocks; i++)
 	{
-		tag.blockNum = blkno + i;
-		addSHLL(&lfc_ctl->wss_estimation, hash_bytes((uint8_t const*)&tag, sizeof(tag)));
-	}
-
-	LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+		uint32		tag_hash;
 
-	if (!LFC_ENABLED() || !lfc_ensure_opened())
-	{
-		LWLockRelease(lfc_lock);
-		return;
+		tag.blockNum = blkno + i;
+		tag_hash = hash_bytes((uint8_t const*)&tag, sizeof(tag));
+		addSHLL(&lfc_ctl->wss_estimation, tag_hash);
+		addMRC(&lfc_ctl->mrc_estimation, tag_hash, false);
 	}
-	generation = lfc_ctl->generation;
 
 	/*
 	 * For every chunk that has blocks we're interested in, we
 	 * 1. get the chunk header
-	 * 2. Check if the chunk actually has the blocks we're interested in
-	 * 3. Read the blocks we're looking for (in one preadv), assuming they exist
-	 * 4. Update the statistics for the read call.
+	 * 2. Mark the blocks we write as pending, skipping the ones that were
+	 *    modified since (only with lsns)
+	 * 3. Write the blocks, in one pwritev per run of consecutive blocks
+	 * 4. Update the statistics for the write call.
 	 *
 	 * If there is an error, we do an early return.
 	 */
 	while (nblocks > 0)
 	{
 		struct iovec iov[PG_IOV_MAX];
+		bool		skip[PG_IOV_MAX];
 		int		chunk_offs = BLOCK_TO_CHUNK_OFF(blkno);
 		int		blocks_in_chunk = Min(nblocks, lfc_blocks_per_chunk - chunk_offs);
+		int		blocks_written = 0;
 		instr_time io_start, io_end;
+		int		partno;
+		FileCachePartition *part;
 		ConditionVariable* cv;
 
 		Assert(blocks_in_chunk > 0);
+		blocks_in_chunk = Min(blocks_in_chunk, PG_IOV_MAX);
 
 		for (int i = 0; i < blocks_in_chunk; i++)
 		{
 			iov[i].iov_base = unconstify(void *, buffers[buf_offset + i]);
 			iov[i].iov_len = BLCKSZ;
+			skip[i] = false;
 		}
 
 		tag.blockNum = blkno - chunk_offs;
-		hash = get_hash_value(lfc_hash, &tag);
+		hash = lfc_tag_hash(&tag);
+		partno = lfc_partition_of(hash);
+		part = &lfc_ctl->partitions[partno];
 		cv = &lfc_ctl->cv[hash % N_COND_VARS];
 
-		entry = hash_search_with_hash_value(lfc_hash, &tag, hash, HASH_ENTER, &found);
+		LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
+
+		if (!LFC_ENABLED() || !lfc_ensure_opened())
+		{
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
+			return;
+		}
+		generation = lfc_ctl->generation;
+
+		entry = hash_search_with_hash_value(lfc_hash[partno], &tag, hash, HASH_ENTER, &found);
 		if (found)
 		{
-			/*
-			 * Unlink entry from LRU list to pin it for the duration of IO
-			 * operation
-			 */
-			if (entry->access_count++ == 0)
-			{
-				lfc_ctl->pinned += 1;
-				dlist_delete(&entry->list_node);
-			}
+			/* Pin entry for the duration of IO operation */
+			lfc_pin_entry(part, entry, LW_EXCLUSIVE, false);
 		}
 		else
 		{
-			if (!lfc_init_new_entry(entry, hash))
+			if (!lfc_init_new_entry(partno, entry, hash))
 			{
 				/*
 				 * We can't process this chunk due to lack of space in LFC,
 				 * so skip to the next one
 				 */
+				LWLockRelease(LFC_PARTITION_LOCK(partno));
 				blkno += blocks_in_chunk;
 				buf_offset += blocks_in_chunk;
 				nblocks -= blocks_in_chunk;
@@ -1767,6 +3395,13 @@ lfc_writev(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			bool sleeping = false;
 			while (lfc_ctl->generation == generation)
 			{
+				/* checked again after every sleep, see lfc_writev_unmodified */
+				if (lsns != NULL &&
+					neon_get_lwlsn(rinfo, forkNum, blkno + i) > lsns[buf_offset + i])
+				{
+					skip[i] = true;
+					break;
+				}
 				state = GET_STATE(entry, chunk_offs + i);
 				if (state == PENDING) {
 					SET_STATE(entry, chunk_offs + i, REQUESTED);
@@ -1781,62 +3416,81 @@ lfc_writev(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 					ConditionVariablePrepareToSleep(cv);
 					sleeping = true;
 				}
-				LWLockRelease(lfc_lock);
+				LWLockRelease(LFC_PARTITION_LOCK(partno));
 				ConditionVariableTimedSleep(cv, CV_WAIT_TIMEOUT, WAIT_EVENT_NEON_LFC_CV_WAIT);
-				LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+				LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
 			}
 			if (sleeping)
 			{
 				ConditionVariableCancelSleep();
 			}
 		}
-		LWLockRelease(lfc_lock);
+		LWLockRelease(LFC_PARTITION_LOCK(partno));
 
 		pgstat_report_wait_start(WAIT_EVENT_NEON_LFC_WRITE);
 		INSTR_TIME_SET_CURRENT(io_start);
-		rc = pwritev(lfc_desc, iov, blocks_in_chunk,
-					 ((off_t) entry_offset * lfc_blocks_per_chunk + chunk_offs) * BLCKSZ);
+		rc = 0;
+		for (int i = 0; i < blocks_in_chunk;)
+		{
+			int			run = 0;
+
+			if (skip[i])
+			{
+				i++;
+				continue;
+			}
+			while (i + run < blocks_in_chunk && !skip[i + run])
+				run++;
+
+			rc = pwritev(lfc_desc, &iov[i], run,
+						 ((off_t) entry_offset * lfc_blocks_per_chunk + chunk_offs + i) * BLCKSZ);
+			if (rc != BLCKSZ * run)
+			{
+				rc = -1;
+				break;
+			}
+			blocks_written += run;
+			i += run;
+		}
 		INSTR_TIME_SET_CURRENT(io_end);
 		pgstat_report_wait_end();
 
-		if (rc != BLCKSZ * blocks_in_chunk)
+		if (rc < 0)
 		{
 			lfc_disable("write");
 			return;
 		}
 		else
 		{
-			LWLockAcquire(lfc_lock, LW_EXCLUSIVE);
+			LWLockAcquire(LFC_PARTITION_LOCK(partno), LW_EXCLUSIVE);
 
 			if (lfc_ctl->generation == generation)
 			{
 				uint64	time_spent_us;
 				CriticalAssert(LFC_ENABLED());
-				/* Place entry to the head of LRU list */
-				CriticalAssert(entry->access_count > 0);
 
-				lfc_ctl->writes += blocks_in_chunk;
-				INSTR_TIME_SUBTRACT(io_start, io_end);
-				time_spent_us = INSTR_TIME_GET_MICROSEC(io_start);
-				lfc_ctl->time_write += time_spent_us;
+				pg_atomic_fetch_add_u64(&part->writes, blocks_written);
+				INSTR_TIME_SUBTRACT(io_end, io_start);
+				time_spent_us = INSTR_TIME_GET_MICROSEC(io_end);
+				pg_atomic_fetch_add_u64(&part->time_write, time_spent_us);
 				inc_page_cache_write_wait(time_spent_us);
 
-				if (--entry->access_count == 0)
-				{
-					lfc_ctl->pinned -= 1;
-					dlist_push_tail(&lfc_ctl->lru, &entry->list_node);
-				}
+				lfc_unpin_entry(part, entry);
 
 				for (int i = 0; i < blocks_in_chunk; i++)
 				{
-					FileCacheBlockState state = GET_STATE(entry, chunk_offs + i);
+					FileCacheBlockState state;
+
+					if (skip[i])
+						continue;
+					state = GET_STATE(entry, chunk_offs + i);
 					if (state == REQUESTED)
 					{
 						ConditionVariableBroadcast(cv);
 					}
 					if (state != AVAILABLE)
 					{
-						lfc_ctl->used_pages += 1;
+						part->used_pages += 1;
 						SET_STATE(entry, chunk_offs + i, AVAILABLE);
 					}
 				}
@@ -1845,14 +3499,15 @@ lfc_writev(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 			{
 				/* stop iteration if LFC was disabled */
 				lfc_close_file();
+				LWLockRelease(LFC_PARTITION_LOCK(partno));
 				break;
 			}
+			LWLockRelease(LFC_PARTITION_LOCK(partno));
 		}
 		blkno += blocks_in_chunk;
 		buf_offset += blocks_in_chunk;
 		nblocks -= blocks_in_chunk;
 	}
-	LWLockRelease(lfc_lock);
 }
 
 /*
@@ -1865,31 +3520,47 @@ LfcStatsEntry *
 lfc_get_stats(size_t *num_entries)
 {
 	LfcStatsEntry *entries;
+	FileCacheTotals totals;
 	size_t		n = 0;
 
-#define MAX_ENTRIES 10
+#define MAX_ENTRIES 15
 	entries = palloc(sizeof(LfcStatsEntry) * MAX_ENTRIES);
 
+	if (lfc_ctl)
+		lfc_get_totals(&totals);
+
 	entries[n++] = (LfcStatsEntry) {"file_cache_chunk_size_pages", lfc_ctl == NULL,
 									lfc_ctl ? lfc_blocks_per_chunk : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_misses", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->misses : 0};
+									lfc_ctl ? totals.misses : 0};
 	entries[n++] = (LfcStatsEntry) {"file_cache_hits", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->hits : 0 };
+									lfc_ctl ? totals.hits : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_used", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->used : 0 };
+									lfc_ctl ? totals.used : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_writes", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->writes : 0 };
+									lfc_ctl ? totals.writes : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_size", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->size : 0 };
+									lfc_ctl ? pg_atomic_read_u32(&lfc_ctl->size) : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_used_pages", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->used_pages : 0 };
+									lfc_ctl ? totals.used_pages : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_evicted_pages", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->evicted_pages : 0 };
+									lfc_ctl ? totals.evicted_pages : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_limit", lfc_ctl == NULL,
 									lfc_ctl ? lfc_ctl->limit : 0 };
 	entries[n++] = (LfcStatsEntry) {"file_cache_chunks_pinned", lfc_ctl == NULL,
-									lfc_ctl ? lfc_ctl->pinned : 0 };
+									lfc_ctl ? totals.pinned : 0 };
+	entries[n++] = (LfcStatsEntry) {"file_cache_partitions", lfc_ctl == NULL,
+									lfc_ctl ? lfc_n_partitions : 0 };
+	entries[n++] = (LfcStatsEntry) {"file_cache_hit_ratio_permille",
+									lfc_ctl == NULL || totals.hits + totals.misses == 0,
+									lfc_ctl && totals.hits + totals.misses != 0 ?
+									totals.hits * 1000 / (totals.hits + totals.misses) : 0 };
+	entries[n++] = (LfcStatsEntry) {"file_cache_evictions", lfc_ctl == NULL,
+									lfc_ctl ? totals.evictions : 0 };
+	entries[n++] = (LfcStatsEntry) {"file_cache_sweep_steps", lfc_ctl == NULL,
+									lfc_ctl ? totals.sweep_steps : 0 };
+	entries[n++] = (LfcStatsEntry) {"file_cache_hot_chunks", lfc_ctl == NULL,
+									lfc_ctl ? totals.hot : 0 };
 	Assert(n <= MAX_ENTRIES);
 #undef MAX_ENTRIES
 
@@ -1917,30 +3588,33 @@ lfc_local_cache_pages(size_t *num_entries)
 		return NULL;
 	}
 
-	LWLockAcquire(lfc_lock, LW_SHARED);
+	lfc_lock_all(LW_SHARED);
 	if (!LFC_ENABLED())
 	{
-		LWLockRelease(lfc_lock);
+		lfc_unlock_all();
 		*num_entries = 0;
 		return NULL;
 	}
 
 	/* Count the pages first */
 	n_pages = 0;
-	hash_seq_init(&status, lfc_hash);
-	while ((entry = hash_seq_search(&status)) != NULL)
+	for (int p = 0; p < lfc_n_partitions; p++)
 	{
-		/* Skip hole tags */
-		if (NInfoGetRelNumber(BufTagGetNRelFileInfo(entry->key)) != 0)
+		hash_seq_init(&status, lfc_hash[p]);
+		while ((entry = hash_seq_search(&status)) != NULL)
 		{
-			for (int i = 0; i < lfc_blocks_per_chunk; i++)
-				n_pages += GET_STATE(entry, i) == AVAILABLE;
+			/* Skip hole tags */
+			if (NInfoGetRelNumber(BufTagGetNRelFileInfo(entry->key)) != 0)
+			{
+				for (int i = 0; i < lfc_blocks_per_chunk; i++)
+					n_pages += GET_STATE(entry, i) == AVAILABLE;
+			}
 		}
 	}
 
 	if (n_pages == 0)
 	{
-		LWLockRelease(lfc_lock);
+		lfc_unlock_all();
 		*num_entries = 0;
 		return NULL;
 	}
@@ -1954,29 +3628,32 @@ lfc_local_cache_pages(size_t *num_entries)
 	 * in the result structure.
 	 */
 	n = 0;
-	hash_seq_init(&status, lfc_hash);
-	while ((entry = hash_seq_search(&status)) != NULL)
+	for (int p = 0; p < lfc_n_partitions; p++)
 	{
-		for (int i = 0; i < lfc_blocks_per_chunk; i++)
+		hash_seq_init(&status, lfc_hash[p]);
+		while ((entry = hash_seq_search(&status)) != NULL)
 		{
-			if (NInfoGetRelNumber(BufTagGetNRelFileInfo(entry->key)) != 0)
+			for (int i = 0; i < lfc_blocks_per_chunk; i++)
 			{
-				if (GET_STATE(entry, i) == AVAILABLE)
+				if (NInfoGetRelNumber(BufTagGetNRelFileInfo(entry->key)) != 0)
 				{
-					result[n].pageoffs = entry->offset * lfc_blocks_per_chunk + i;
-					result[n].relfilenode = NInfoGetRelNumber(BufTagGetNRelFileInfo(entry->key));
-					result[n].reltablespace = NInfoGetSpcOid(BufTagGetNRelFileInfo(entry->key));
-					result[n].reldatabase = NInfoGetDbOid(BufTagGetNRelFileInfo(entry->key));
-					result[n].forknum = entry->key.forkNum;
-					result[n].blocknum = entry->key.blockNum + i;
-					result[n].accesscount = entry->access_count;
-					n += 1;
+					if (GET_STATE(entry, i) == AVAILABLE)
+					{
+						result[n].pageoffs = entry->offset * lfc_blocks_per_chunk + i;
+						result[n].relfilenode = NInfoGetRelNumber(BufTagGetNRelFileInfo(entry->key));
+						result[n].reltablespace = NInfoGetSpcOid(BufTagGetNRelFileInfo(entry->key));
+						result[n].reldatabase = NInfoGetDbOid(BufTagGetNRelFileInfo(entry->key));
+						result[n].forknum = entry->key.forkNum;
+						result[n].blocknum = entry->key.blockNum + i;
+						result[n].accesscount = pg_atomic_read_u32(&entry->access_count);
+						n += 1;
+					}
 				}
 			}
 		}
 	}
 	Assert(n_pages == n);
-	LWLockRelease(lfc_lock);
+	lfc_unlock_all();
 
 	*num_entries = n_pages;
 	return result;
@@ -2000,6 +3677,21 @@ lfc_approximate_working_set_size_seconds(time_t duration, bool reset)
 	return dc;
 }
 
+/*
+ * Internal implementation of the neon_lfc_miss_ratio_curve view. Fills in
+ * the estimated hit ratio for caches of 2^i pages, for i < MRC_N_BUCKETS.
+ * Returns false if the LFC is disabled.
+ */
+bool
+lfc_get_miss_ratio_curve(double *hit_ratios)
+{
+	if (lfc_size_limit == 0)
+		return false;
+
+	estimateMRC(&lfc_ctl->mrc_estimation, hit_ratios);
+	return true;
+}
+
 /*
  * Get metrics, for the built-in metrics exporter that's part of the communicator
  * process.
@@ -2013,14 +3705,18 @@ callback_get_lfc_metrics_unsafe(void)
 {
 	struct LfcMetrics result = {
 		.lfc_cache_size_limit = (int64) lfc_size_limit * 1024 * 1024,
-		.lfc_hits = lfc_ctl ? lfc_ctl->hits : 0,
-		.lfc_misses = lfc_ctl ? lfc_ctl->misses : 0,
-		.lfc_used = lfc_ctl ? lfc_ctl->used : 0,
-		.lfc_writes = lfc_ctl ? lfc_ctl->writes : 0,
 	};
 
 	if (lfc_ctl)
 	{
+		FileCacheTotals totals;
+
+		lfc_get_totals(&totals);
+		result.lfc_hits = totals.hits;
+		result.lfc_misses = totals.misses;
+		result.lfc_used = totals.used;
+		result.lfc_writes = totals.writes;
+
 		for (int minutes = 1; minutes <= 60; minutes++)
 		{
 			result.lfc_approximate_working_set_size_windows[minutes - 1] =
@@ -2061,21 +3757,37 @@ prewarm_local_cache(PG_FUNCTION_ARGS)
 
 PG_FUNCTION_INFO_V1(get_prewarm_info);
 
+/*
+ * Progress of the last prewarm. The throughput and the estimated remaining
+ * time are computed over the pages prewarmed or skipped since the prewarm
+ * started. The columns after active_workers are only returned if the
+ * extension's declaration of the function has them.
+ */
 Datum
 get_prewarm_info(PG_FUNCTION_ARGS)
 {
-	Datum		values[4];
-	bool		nulls[4];
+	Datum		values[6];
+	bool		nulls[6];
 	TupleDesc	tupdesc;
 	uint32 prewarmed_pages = 0;
 	uint32 skipped_pages = 0;
 	uint32 active_workers = 0;
 	uint32 total_pages;
 	size_t n_workers;
+	TimestampTz started;
+	TimestampTz finished = 0;
+	bool		all_completed = true;
+	long		secs;
+	int			usecs;
+	double		elapsed;
+	double		pages_per_second = 0;
 
 	if (lfc_size_limit == 0)
 		PG_RETURN_NULL();
 
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
 	LWLockAcquire(lfc_lock, LW_SHARED);
 	if (!lfc_ctl || lfc_ctl->n_prewarm_workers == 0)
 	{
@@ -2084,21 +3796,25 @@ get_prewarm_info(PG_FUNCTION_ARGS)
 	}
 	n_workers = lfc_ctl->n_prewarm_workers;
 	total_pages = lfc_ctl->total_prewarm_pages;
+	started = lfc_ctl->prewarm_started;
 	for (size_t i = 0; i < n_workers; i++)
 	{
 		PrewarmWorkerState* ws = &lfc_ctl->prewarm_workers[i];
 		prewarmed_pages += ws->prewarmed_pages;
 		skipped_pages += ws->skipped_pages;
 		active_workers += ws->completed != 0;
+		if (ws->completed == 0)
+			all_completed = false;
+		finished = Max(finished, ws->completed);
 	}
 	LWLockRelease(lfc_lock);
 
-	tupdesc = CreateTemplateTupleDesc(4);
-	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "total_pages", INT4OID, -1, 0);
-	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "prewarmed_pages", INT4OID, -1, 0);
-	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "skipped_pages", INT4OID, -1, 0);
-	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "active_workers", INT4OID, -1, 0);
-	tupdesc = BlessTupleDesc(tupdesc);
+	if (!all_completed)
+		finished = GetCurrentTimestamp();
+	TimestampDifference(started, finished, &secs, &usecs);
+	elapsed = secs + usecs / 1000000.0;
+	if (elapsed > 0)
+		pages_per_second = (prewarmed_pages + skipped_pages) / elapsed;
 
 	MemSet(nulls, 0, sizeof(nulls));
 
@@ -2106,6 +3822,14 @@ get_prewarm_info(PG_FUNCTION_ARGS)
 	values[1] = Int32GetDatum(prewarmed_pages);
 	values[2] = Int32GetDatum(skipped_pages);
 	values[3] = Int32GetDatum(active_workers);
+	values[4] = Float8GetDatum(pages_per_second);
+	if (all_completed || prewarmed_pages + skipped_pages >= total_pages)
+		values[5] = Float8GetDatum(0);
+	else if (pages_per_second > 0)
+		values[5] = Float8GetDatum((total_pages - prewarmed_pages - skipped_pages) / pages_per_second);
+	else
+		nulls[5] = true;
 
+	tupdesc = BlessTupleDesc(tupdesc);
 	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
 }
@@ -32,6 +32,9 @@ extern void lfc_invalidate(NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber n
 extern void lfc_writev(NRelFileInfo rinfo, ForkNumber forkNum,
 					   BlockNumber blkno, const void *const *buffers,
 					   BlockNumber nblocks);
+extern void lfc_writev_unmodified(NRelFileInfo rinfo, ForkNumber forkNum,
+								  BlockNumber blkno, const void *const *buffers,
+								  const XLogRecPtr *lsns, BlockNumber nblocks);
 /* returns number of blocks read, with one bit set in *read for each  */
 extern int lfc_readv_select(NRelFileInfo rinfo, ForkNumber forkNum,
 							BlockNumber blkno, void **buffers,
@@ -44,6 +47,7 @@ extern int lfc_cache_containsv(NRelFileInfo rinfo, ForkNumber forkNum,
 extern void lfc_init(void);
 extern bool lfc_prefetch(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
 						 const void* buffer, XLogRecPtr lsn);
+extern void lfc_wait_async_writes(void);
 extern FileCacheState* lfc_get_state(size_t max_entries);
 extern void lfc_prewarm(FileCacheState* fcs, uint32 n_workers);
 
@@ -68,6 +72,7 @@ typedef struct
 extern LocalCachePagesRec *lfc_local_cache_pages(size_t *num_entries);
 
 extern int32 lfc_approximate_working_set_size_seconds(time_t duration, bool reset);
+extern bool lfc_get_miss_ratio_curve(double *hit_ratios);
 
 
 static inline bool
@@ -47,11 +47,11 @@
  */
 
 #include <math.h>
+#include <time.h>
 
 #include "postgres.h"
 #include "funcapi.h"
 #include "port/pg_bitutils.h"
-#include "utils/timestamp.h"
 #include "hll.h"
 
 
@@ -93,6 +93,22 @@ rho(uint32 x, uint8 b)
 	return j;
 }
 
+/*
+ * Current time for the registers, in seconds. 0 means "never", which the
+ * clock doesn't return.
+ */
+static inline uint32
+hll_now(void)
+{
+#ifdef CLOCK_REALTIME_COARSE
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+		return (uint32) ts.tv_sec;
+#endif
+	return (uint32) time(NULL);
+}
+
 /*
  * Initialize HyperLogLog track state
  */
@@ -116,31 +132,40 @@ addSHLL(HyperLogLogState *cState, uint32 hash)
 {
 	uint8		count;
 	uint32		index;
+	uint32		now = hll_now();
 
-	TimestampTz	now = GetCurrentTimestamp();
 	/* Use the first "k" (registerWidth) bits as a zero based index */
 	index = hash >> HLL_C_BITS;
 
 	/* Compute the rank of the remaining 32 - "k" (registerWidth) bits */
 	count = rho(hash << HLL_BIT_WIDTH, HLL_C_BITS) - 1;
 	Assert(count <= HLL_C_BITS);
-	cState->regs[index][count] = now;
+
+	/*
+	 * The register is shared by all backends. Don't dirty its cache line if
+	 * it was already updated in this second, which is the common case for
+	 * the low counts.
+	 */
+	if (cState->regs[index][count] != now)
+		cState->regs[index][count] = now;
 }
 
-static uint8
-getMaximum(const TimestampTz* reg, TimestampTz since)
+/*
+ * Returns the number of bits for a register: the highest bucket updated at
+ * or after 'since'.
+ *
+ * The loop has no branches or early exit, so that the compiler can vectorize
+ * it.
+ */
+static inline uint8
+getMaximum(const uint32 *reg, uint32 since)
 {
-	uint8 max = 0;
+	uint32		mask = 0;
 
-	for (size_t i = 0; i < HLL_C_BITS + 1; i++)
-	{
-		if (reg[i] >= since)
-		{
-			max = i + 1;
-		}
-	}
+	for (int i = 0; i < HLL_C_BITS + 1; i++)
+		mask |= (uint32) (reg[i] >= since) << i;
 
-	return max;
+	return mask == 0 ? 0 : pg_leftmost_one_pos32(mask) + 1;
 }
 
 
@@ -152,15 +177,17 @@ estimateSHLL(HyperLogLogState *cState, time_t duration)
 {
 	double		result;
 	double		sum = 0.0;
-	size_t		i;
-	uint8       R[HLL_N_REGISTERS];
+	int			zero_count = 0;
 	/* 0 indicates uninitialized timestamp, so if we need to cover the whole range than starts with 1 */
-	TimestampTz since = duration == (time_t)-1 ? 1 : GetCurrentTimestamp() - duration * USECS_PER_SEC;
+	uint32		now = hll_now();
+	uint32		since = (duration == (time_t) -1 || duration >= now) ? 1 : now - (uint32) duration;
 
-	for (i = 0; i < HLL_N_REGISTERS; i++)
+	for (int i = 0; i < HLL_N_REGISTERS; i++)
 	{
-		R[i] = getMaximum(cState->regs[i], since);
-		sum += 1.0 / pow(2.0, R[i]);
+		uint8		r = getMaximum(cState->regs[i], since);
+
+		sum += ldexp(1.0, -r);
+		zero_count += r == 0;
 	}
 
 	/* result set to "raw" HyperLogLog estimate (E in the HyperLogLog paper) */
@@ -169,13 +196,6 @@ estimateSHLL(HyperLogLogState *cState, time_t duration)
 	if (result <= (5.0 / 2.0) * HLL_N_REGISTERS)
 	{
 		/* Small range correction */
-		int			zero_count = 0;
-
-		for (i = 0; i < HLL_N_REGISTERS; i++)
-		{
-			zero_count += R[i] == 0;
-		}
-
 		if (zero_count != 0)
 			result = HLL_N_REGISTERS * log((double) HLL_N_REGISTERS /
 										   zero_count);
@@ -188,4 +208,3 @@ estimateSHLL(HyperLogLogState *cState, time_t duration)
 
 	return result;
 }
-
@@ -69,14 +69,15 @@
  * modified timestamp >= the query timestamp. This value is the number of bits
  * for this register in the normal HLL calculation.
  *
- * The memory usage is 2^B * (C + 1) * sizeof(TimetampTz), or 184kiB.
- * Usage could be halved if we decide to reduce the required time dimension
- * precision; as 32 bits in second precision should be enough for statistics.
- * However, that is not yet implemented.
+ * The registers hold the time in seconds since the Unix epoch, which is
+ * plenty of precision for working set statistics. It's read from the
+ * kernel's coarse clock, which is only updated once per tick and is much
+ * cheaper to read than GetCurrentTimestamp(), as it's done on every LFC
+ * access. The memory usage is 2^B * (C + 1) * sizeof(uint32), or 92kiB.
  */
 typedef struct HyperLogLogState
 {
-	TimestampTz regs[HLL_N_REGISTERS][HLL_C_BITS + 1];
+	uint32		regs[HLL_N_REGISTERS][HLL_C_BITS + 1];
 } HyperLogLogState;
 
 extern void   initSHLL(HyperLogLogState *cState);
@@ -35,6 +35,7 @@
 #include "utils/guc.h"
 #include "utils/memutils.h"
 
+#include "communicator_queue.h"
 #include "neon.h"
 #include "neon_perf_counters.h"
 #include "neon_utils.h"
@@ -64,6 +65,12 @@ static const struct config_enum_entry neon_compute_modes[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry pageserver_transports[] = {
+	{"direct", PAGESERVER_TRANSPORT_DIRECT, false},
+	{"communicator", PAGESERVER_TRANSPORT_COMMUNICATOR, false},
+	{NULL, 0, false}
+};
+
 /* GUCs */
 char	   *neon_timeline;
 char	   *neon_tenant;
@@ -75,7 +82,12 @@ char	   *pageserver_connstring;
 char	   *neon_auth_token;
 
 int			readahead_buffer_size = 128;
+bool		readahead_adaptive = false;
+int			shared_prefetch_size = 0;
+int			stride_prefetch_distance = 0;
 int			flush_every_n_requests = 8;
+int			pageserver_transport = PAGESERVER_TRANSPORT_DIRECT;
+int			communicator_queue_depth = 16;
 
 int         neon_protocol_version = 3;
 
@@ -84,9 +96,9 @@ static int	max_reconnect_attempts = 60;
 static int	stripe_size;
 static int	max_sockets;
 
-static int pageserver_response_log_timeout = 10000;
+int			pageserver_response_log_timeout = 10000;
 /* 2.5 minutes. A bit higher than highest default TCP retransmission timeout */
-static int pageserver_response_disconnect_timeout = 150000;
+int			pageserver_response_disconnect_timeout = 150000;
 
 static int	conf_refresh_reconnect_attempt_threshold = 16;
 // Hadron: timeout for refresh errors (1 minute)
@@ -158,6 +170,12 @@ typedef struct
 	PSConnectionState state;
 	PGconn		   *conn;
 
+	/* PQconnectPoll() state to act on next, in conn_startup */
+	PostgresPollingStatusType poll_result;
+
+	/* what a non-blocking connection attempt is waiting for on the socket */
+	uint32			connect_wait_events;
+
 	/* request / response counters for debugging */
 	uint64			nrequests_sent;
 	uint64			nresponses_received;
@@ -424,17 +442,39 @@ CLEANUP_AND_DISCONNECT(PageServer *shard)
 	shard->state = PS_Disconnected;
 }
 
+/*
+ * In a non-blocking connection attempt, check whether the connection's socket
+ * is ready for 'event'. If not, remember to wait for it.
+ */
+static bool
+pageserver_connect_ready(PageServer *shard, uint32 event)
+{
+	int			rc;
+
+	rc = WaitLatchOrSocket(NULL, event | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						   PQsocket(shard->conn), 0, WAIT_EVENT_NEON_PS_STARTING);
+	if (rc & event)
+		return true;
+
+	shard->connect_wait_events = event;
+	return false;
+}
+
 /*
  * Connect to a pageserver, or continue to try to connect if we're yet to
  * complete the connection (e.g. due to receiving an earlier cancellation
  * during connection start).
  * Returns true if successfully connected; false if the connection failed.
  *
+ * If 'in_progress' is not NULL, doesn't wait for the pageserver, or for the
+ * reconnect backoff: instead, returns false and sets *in_progress when it
+ * would have to, and the caller calls this again later to continue.
+ *
  * Throws errors in unrecoverable situations, or when this backend's query
  * is canceled.
  */
 static bool
-pageserver_connect(shardno_t shard_no, int elevel)
+pageserver_connect(shardno_t shard_no, int elevel, bool *in_progress)
 {
 	PageServer *shard = &page_servers[shard_no];
 	char		connstr[MAX_PAGESERVER_CONNSTRING_SIZE];
@@ -477,6 +517,13 @@ pageserver_connect(shardno_t shard_no, int elevel)
 		if (shard->delay_us == 0)
 			shard->delay_us = MIN_RECONNECT_INTERVAL_USEC;
 
+		if (in_progress != NULL && us_since_last_attempt < shard->delay_us)
+		{
+			shard->connect_wait_events = 0;
+			*in_progress = true;
+			return false;
+		}
+
 		/*
 		 * If we did other tasks between reconnect attempts, then we won't
 		 * need to wait as long as a full delay.
@@ -576,6 +623,7 @@ pageserver_connect(shardno_t shard_no, int elevel)
 			return false;
 		}
 		shard->state = PS_Connecting_Startup;
+		shard->poll_result = PGRES_POLLING_WRITING;
 	}
 	/* FALLTHROUGH */
 	case PS_Connecting_Startup:
@@ -583,12 +631,11 @@ pageserver_connect(shardno_t shard_no, int elevel)
 		char	   *pagestream_query;
 		int			ps_send_query_ret;
 		bool		connected = false;
-		int poll_result = PGRES_POLLING_WRITING;
 		neon_shard_log(shard_no, DEBUG5, "Connection state: Connecting_Startup");
 
 		do
 		{
-			switch (poll_result)
+			switch (shard->poll_result)
 			{
 			default: /* unknown/unused states are handled as a failed connection */
 			case PGRES_POLLING_FAILED:
@@ -616,6 +663,16 @@ pageserver_connect(shardno_t shard_no, int elevel)
 					return false;
 				}
 			case PGRES_POLLING_READING:
+				if (in_progress != NULL)
+				{
+					if (!pageserver_connect_ready(shard, WL_SOCKET_READABLE))
+					{
+						*in_progress = true;
+						return false;
+					}
+					break;
+				}
+
 				/* Sleep until there's something to do */
 				while (true)
 				{
@@ -638,6 +695,16 @@ pageserver_connect(shardno_t shard_no, int elevel)
 
 				break;
 			case PGRES_POLLING_WRITING:
+				if (in_progress != NULL)
+				{
+					if (!pageserver_connect_ready(shard, WL_SOCKET_WRITEABLE))
+					{
+						*in_progress = true;
+						return false;
+					}
+					break;
+				}
+
 				/* Sleep until there's something to do */
 				while (true)
 				{
@@ -664,8 +731,8 @@ pageserver_connect(shardno_t shard_no, int elevel)
 				connected = true;
 				break;
 			}
-			poll_result = PQconnectPoll(shard->conn);
-			elog(DEBUG5, "PQconnectPoll=>%d", poll_result);
+			shard->poll_result = PQconnectPoll(shard->conn);
+			elog(DEBUG5, "PQconnectPoll=>%d", shard->poll_result);
 		}
 		while (!connected);
 
@@ -686,6 +753,9 @@ pageserver_connect(shardno_t shard_no, int elevel)
 
 		switch (neon_protocol_version)
 		{
+		case 4:
+			pagestream_query = psprintf("pagestream_v4 %s %s", neon_tenant, neon_timeline);
+			break;
 		case 3:
 			pagestream_query = psprintf("pagestream_v3 %s %s", neon_tenant, neon_timeline);
 			break;
@@ -743,12 +813,24 @@ pageserver_connect(shardno_t shard_no, int elevel)
 		{
 			WaitEvent	event;
 
-			/* Sleep until there's something to do */
-			(void) WaitEventSetWait(shard->wes_read, -1L, &event, 1,
-									WAIT_EVENT_NEON_PS_CONFIGURING);
-			ResetLatch(MyLatch);
+			if (in_progress != NULL)
+			{
+				if (!pageserver_connect_ready(shard, WL_SOCKET_READABLE))
+				{
+					*in_progress = true;
+					return false;
+				}
+				event.events = WL_SOCKET_READABLE;
+			}
+			else
+			{
+				/* Sleep until there's something to do */
+				(void) WaitEventSetWait(shard->wes_read, -1L, &event, 1,
+										WAIT_EVENT_NEON_PS_CONFIGURING);
+				ResetLatch(MyLatch);
 
-			CHECK_FOR_INTERRUPTS();
+				CHECK_FOR_INTERRUPTS();
+			}
 
 			/* Data available in socket? */
 			if (event.events & WL_SOCKET_READABLE)
@@ -1162,7 +1244,7 @@ pageserver_send(shardno_t shard_no, NeonRequest *request)
 	 */
 	if (shard->state != PS_Connected)
 	{
-		while (!pageserver_connect(shard_no, shard->n_reconnect_attempts < max_reconnect_attempts ? LOG : ERROR))
+		while (!pageserver_connect(shard_no, shard->n_reconnect_attempts < max_reconnect_attempts ? LOG : ERROR, NULL))
 		{
 			shard->n_reconnect_attempts += 1;
 			if (shard->n_reconnect_attempts > conf_refresh_reconnect_attempt_threshold
@@ -1423,7 +1505,179 @@ pageserver_flush(shardno_t shard_no)
 	return true;
 }
 
-page_server_api api =
+/*
+ * Functions for the communicator forwarder process, which forwards the
+ * requests that backends have queued in shared memory (see
+ * communicator_queue.c). The requests arrive already packed, and the
+ * responses are handed back as raw messages for the backends to unpack.
+ */
+
+NeonRequestId
+pageserver_next_request_id(void)
+{
+	return GENERATE_REQUEST_ID();
+}
+
+/*
+ * Returns the socket of the shard's connection, or PGINVALID_SOCKET if it's
+ * not connected. *connected_at identifies the connection: it changes when
+ * the shard is reconnected, even if the new socket has the same number.
+ */
+pgsocket
+pageserver_socket(shardno_t shard_no, TimestampTz *connected_at)
+{
+	PageServer *shard = &page_servers[shard_no];
+
+	if (shard->state != PS_Connected)
+		return PGINVALID_SOCKET;
+
+	*connected_at = shard->last_connect_time;
+	return PQsocket(shard->conn);
+}
+
+/*
+ * Connect to the shard, or continue connecting, without blocking.
+ *
+ * Unlike pageserver_send(), this makes only one connection attempt, and
+ * never waits for the pageserver: the forwarder serves all backends, and must
+ * not get stuck on one shard. Returns PS_CONNECT_IN_PROGRESS if the attempt
+ * needs to wait, see pageserver_connect_wait().
+ */
+PSConnectResult
+pageserver_connect_nowait(shardno_t shard_no)
+{
+	PageServer *shard = &page_servers[shard_no];
+	bool		in_progress = false;
+
+	if (shard->state == PS_Connected && PQstatus(shard->conn) == CONNECTION_BAD)
+	{
+		neon_shard_log(shard_no, LOG, "pageserver_send disconnect bad connection");
+		pageserver_disconnect_shard(shard_no);
+	}
+
+	if (shard->state == PS_Connected ||
+		pageserver_connect(shard_no, LOG, &in_progress))
+		return PS_CONNECT_DONE;
+
+	return in_progress ? PS_CONNECT_IN_PROGRESS : PS_CONNECT_FAILED;
+}
+
+/*
+ * What a connection attempt left in progress by pageserver_connect_nowait()
+ * waits for. Returns the socket, and sets *events to wait for on it, or
+ * returns PGINVALID_SOCKET and sets *retry_at to when to try again after a
+ * failed attempt.
+ */
+pgsocket
+pageserver_connect_wait(shardno_t shard_no, uint32 *events, TimestampTz *retry_at)
+{
+	PageServer *shard = &page_servers[shard_no];
+
+	if (shard->state == PS_Disconnected)
+	{
+		*retry_at = shard->last_reconnect_time + shard->delay_us;
+		return PGINVALID_SOCKET;
+	}
+
+	*events = shard->connect_wait_events;
+	return PQsocket(shard->conn);
+}
+
+/*
+ * Send a packed request. The shard must have been connected with
+ * pageserver_connect_nowait().
+ *
+ * Returns false if the request could not be sent. Any requests that were in
+ * flight on the shard's connection are lost in that case.
+ */
+bool
+pageserver_send_packed(shardno_t shard_no, const char *data, int len)
+{
+	PageServer *shard = &page_servers[shard_no];
+
+	if (shard->state != PS_Connected)
+		return false;
+
+	shard->nrequests_sent++;
+	if (PQputCopyData(shard->conn, data, len) <= 0)
+	{
+		char	   *msg = pchomp(PQerrorMessage(shard->conn));
+
+		pageserver_disconnect_shard(shard_no);
+		neon_shard_log(shard_no, LOG, "pageserver_send disconnected: failed to send page request: %s", msg);
+		pfree(msg);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+pageserver_flush_packed(shardno_t shard_no)
+{
+	PageServer *shard = &page_servers[shard_no];
+
+	if (shard->state != PS_Connected)
+		return false;
+
+	if (PQflush(shard->conn))
+	{
+		char	   *msg = pchomp(PQerrorMessage(shard->conn));
+
+		pageserver_disconnect_shard(shard_no);
+		neon_shard_log(shard_no, LOG, "pageserver_flush disconnect because failed to flush page requests: %s", msg);
+		pfree(msg);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Get the next raw response from the shard's connection, without blocking.
+ *
+ * Returns the length of the message stored in *buffer, which must be freed
+ * with PQfreemem(), 0 if no complete message has arrived yet, or -1 if the
+ * connection was lost.
+ */
+int
+pageserver_try_receive_packed(shardno_t shard_no, char **buffer)
+{
+	PageServer *shard = &page_servers[shard_no];
+	int			rc;
+
+	if (shard->state != PS_Connected)
+		return -1;
+
+	rc = PQgetCopyData(shard->conn, buffer, 1 /* async */ );
+	if (rc == 0)
+	{
+		if (!PQconsumeInput(shard->conn))
+			rc = -1;
+		else
+			rc = PQgetCopyData(shard->conn, buffer, 1 /* async */ );
+	}
+
+	if (rc > 0)
+	{
+		shard->nresponses_received++;
+		return rc;
+	}
+	else if (rc == 0)
+		return 0;
+	else
+	{
+		char	   *msg = pchomp(PQerrorMessage(shard->conn));
+
+		neon_shard_log(shard_no, LOG, "pageserver_receive disconnect: could not read COPY data: %s", msg);
+		pfree(msg);
+		pageserver_disconnect_shard(shard_no);
+		hadron_request_configuration_refresh();
+		return -1;
+	}
+}
+
+page_server_api pageserver_direct_api =
 {
 	.send = pageserver_send,
 	.flush = pageserver_flush,
@@ -1567,6 +1821,65 @@ pg_init_libpagestore(void)
 							PGC_USERSET,
 							0,	/* no flags required */
 							NULL, (GucIntAssignHook) &readahead_buffer_resize, NULL);
+	DefineCustomIntVariable("neon.shared_prefetch_size",
+							"number of in-flight getpage requests shared between backends",
+							"Backends publish the getpage requests they have in "
+							"flight, so that other backends needing the same page "
+							"wait for it to arrive in the local file cache instead "
+							"of requesting it again. 0 disables sharing.",
+							&shared_prefetch_size,
+							0, 0, INT_MAX,
+							PGC_POSTMASTER,
+							0,	/* no flags required */
+							NULL, NULL, NULL);
+	DefineCustomBoolVariable("neon.readahead_adaptive",
+							 "adapt the readahead depth to how well prefetching works",
+							 "Prefetch fewer pages when prefetched pages are "
+							 "discarded unused, and more when reads still have to "
+							 "wait for the page server, up to "
+							 "neon.readahead_buffer_size.",
+							 &readahead_adaptive,
+							 false,
+							 PGC_USERSET,
+							 0,	/* no flags required */
+							 NULL, NULL, NULL);
+	DefineCustomIntVariable("neon.stride_prefetch_distance",
+							"number of blocks to prefetch for detected access strides",
+							"When consecutive reads of a relation fork follow a "
+							"forward or backward stride, prefetch up to this many "
+							"of the blocks the stride predicts. This helps reads "
+							"that PostgreSQL doesn't prefetch itself, like index "
+							"scans over a correlated index. 0 disables stride "
+							"detection.",
+							&stride_prefetch_distance,
+							0, 0, 1024,
+							PGC_USERSET,
+							0,	/* no flags required */
+							NULL, NULL, NULL);
+	DefineCustomEnumVariable("neon.pageserver_transport",
+							 "how backends send their requests to the page server",
+							 "With \"direct\", each backend has its own connection "
+							 "to each shard. With \"communicator\", backends queue "
+							 "GetPage, Nblocks and Exists requests in shared memory, "
+							 "and a communicator worker process sends them over one "
+							 "pipelined connection per shard. Other requests "
+							 "still use the backend's own connection.",
+							 &pageserver_transport,
+							 PAGESERVER_TRANSPORT_DIRECT,
+							 pageserver_transports,
+							 PGC_POSTMASTER,
+							 0,	/* no flags required */
+							 NULL, NULL, NULL);
+	DefineCustomIntVariable("neon.communicator_queue_depth",
+							"number of requests each backend can have queued for the communicator forwarder process",
+							"Only used with neon.pageserver_transport=communicator. "
+							"A backend that has this many requests in flight waits "
+							"for the oldest one to complete before queueing more.",
+							&communicator_queue_depth,
+							16, 1, 1024,
+							PGC_POSTMASTER,
+							0,	/* no flags required */
+							NULL, NULL, NULL);
 	DefineCustomIntVariable("neon.readahead_getpage_pull_timeout",
 							"readahead response pull timeout",
 							"Time between active tries to pull data from the "
@@ -1583,7 +1896,7 @@ pg_init_libpagestore(void)
 							&neon_protocol_version,
 							3,	/* use protocol version 3 */
 							2,	/* min */
-							3,	/* max */
+							4,	/* max, adds batched getpage requests */
 							PGC_SU_BACKEND,
 							0,	/* no flags required */
 							NULL, NULL, NULL);
@@ -1633,7 +1946,10 @@ pg_init_libpagestore(void)
 		neon_log(ERROR, "libpagestore already loaded");
 
 	neon_log(PageStoreTrace, "libpagestore already loaded");
-	page_server = &api;
+	if (pageserver_transport == PAGESERVER_TRANSPORT_COMMUNICATOR)
+		page_server = &communicator_queue_api;
+	else
+		page_server = &pageserver_direct_api;
 
 	/*
 	 * Retrieve the auth token to use when connecting to pageserver and
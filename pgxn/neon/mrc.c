@@ -0,0 +1,188 @@
+/*-------------------------------------------------------------------------
+ *
+ * mrc.c
+ *	  Miss ratio curve estimator, from sampled reuse distances
+ *
+ * See mrc.h for a description of the algorithm.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "port/pg_bitutils.h"
+#include "storage/spin.h"
+
+#include "mrc.h"
+
+#define MRC_SAMPLE_MASK		((1 << MRC_SAMPLE_SHIFT) - 1)
+
+static inline void
+tree_add(MissRatioCurveState *state, uint32 slot, int32 delta)
+{
+	for (uint32 i = slot + 1; i <= MRC_WINDOW; i += i & -i)
+		state->tree[i] += delta;
+}
+
+/* Number of marks in slots 0..slot-1 */
+static inline uint32
+tree_sum(MissRatioCurveState *state, uint32 slot)
+{
+	uint32		sum = 0;
+
+	for (uint32 i = slot; i > 0; i -= i & -i)
+		sum += state->tree[i];
+	return sum;
+}
+
+static inline uint32
+table_start(uint32 key)
+{
+	return (key * 0x9E3779B1) >> (32 - MRC_TABLE_BITS);
+}
+
+static MrcTableEntry *
+table_find(MissRatioCurveState *state, uint32 key)
+{
+	for (uint32 i = table_start(key);; i = (i + 1) & (MRC_TABLE_SIZE - 1))
+	{
+		MrcTableEntry *entry = &state->table[i];
+
+		if (entry->key == key || entry->key == 0)
+			return entry;
+	}
+}
+
+/*
+ * Remove an entry, moving back the entries after it that would otherwise
+ * become unreachable. The table is never more than half full, so the runs
+ * are short.
+ */
+static void
+table_remove(MissRatioCurveState *state, MrcTableEntry *entry)
+{
+	uint32		hole = entry - state->table;
+	uint32		i = hole;
+
+	for (;;)
+	{
+		uint32		start;
+
+		i = (i + 1) & (MRC_TABLE_SIZE - 1);
+		if (state->table[i].key == 0)
+			break;
+		start = table_start(state->table[i].key);
+
+		/* can the entry at i be moved to the hole? */
+		if (((i - start) & (MRC_TABLE_SIZE - 1)) >= ((i - hole) & (MRC_TABLE_SIZE - 1)))
+		{
+			state->table[hole] = state->table[i];
+			hole = i;
+		}
+	}
+	state->table[hole].key = 0;
+}
+
+void
+initMRC(MissRatioCurveState *state)
+{
+	SpinLockInit(&state->mutex);
+	state->clock = 0;
+	state->n_tracked = 0;
+	state->reads = 0;
+	memset(state->hits, 0, sizeof(state->hits));
+	memset(state->tree, 0, sizeof(state->tree));
+	memset(state->slot_key, 0, sizeof(state->slot_key));
+	memset(state->table, 0, sizeof(state->table));
+}
+
+/*
+ * Records a reference to a page, from a caller-supplied hash of its tag.
+ * Only reads are counted in the curve, but writes make the page recently
+ * used all the same.
+ */
+void
+addMRC(MissRatioCurveState *state, uint32 hash, bool is_read)
+{
+	uint32		key;
+	uint32		slot;
+	MrcTableEntry *entry;
+
+	if ((hash & MRC_SAMPLE_MASK) != 0)
+		return;
+	key = (hash >> MRC_SAMPLE_SHIFT) + 1;
+
+	SpinLockAcquire(&state->mutex);
+
+	slot = state->clock % MRC_WINDOW;
+
+	/* forget the page referenced MRC_WINDOW references ago, if any */
+	if (state->slot_key[slot] != 0)
+	{
+		table_remove(state, table_find(state, state->slot_key[slot]));
+		tree_add(state, slot, -1);
+		state->slot_key[slot] = 0;
+		state->n_tracked--;
+	}
+
+	entry = table_find(state, key);
+	if (entry->key != 0)
+	{
+		uint32		prev = entry->slot;
+		uint64		distance;
+
+		if (prev < slot)
+			distance = tree_sum(state, slot) - tree_sum(state, prev + 1);
+		else
+			distance = state->n_tracked - tree_sum(state, prev + 1) + tree_sum(state, slot);
+
+		tree_add(state, prev, -1);
+		state->slot_key[prev] = 0;
+		state->n_tracked--;
+
+		if (is_read)
+		{
+			distance <<= MRC_SAMPLE_SHIFT;
+			state->hits[distance == 0 ? 0 : pg_leftmost_one_pos64(distance) + 1]++;
+		}
+	}
+	entry->key = key;
+	entry->slot = slot;
+	tree_add(state, slot, 1);
+	state->slot_key[slot] = key;
+	state->n_tracked++;
+	state->clock++;
+
+	if (is_read && ++state->reads >= MRC_WINDOW)
+	{
+		/* age the counts */
+		state->reads /= 2;
+		for (int i = 0; i < MRC_N_BUCKETS; i++)
+			state->hits[i] /= 2;
+	}
+
+	SpinLockRelease(&state->mutex);
+}
+
+/*
+ * Estimates the hit ratio of an LRU cache of 2^i pages, for each i <
+ * MRC_N_BUCKETS. Returns all zeros if there haven't been any reads yet.
+ */
+void
+estimateMRC(MissRatioCurveState *state, double *hit_ratios)
+{
+	uint64		hits[MRC_N_BUCKETS];
+	uint64		reads;
+	uint64		cumulative = 0;
+
+	SpinLockAcquire(&state->mutex);
+	memcpy(hits, state->hits, sizeof(hits));
+	reads = state->reads;
+	SpinLockRelease(&state->mutex);
+
+	for (int i = 0; i < MRC_N_BUCKETS; i++)
+	{
+		cumulative += hits[i];
+		hit_ratios[i] = reads == 0 ? 0.0 : (double) cumulative / reads;
+	}
+}
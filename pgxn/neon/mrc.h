@@ -0,0 +1,79 @@
+/*-------------------------------------------------------------------------
+ *
+ * mrc.h
+ *	  Miss ratio curve estimator, from sampled reuse distances
+ *
+ * Implements the fixed-rate variant of SHARDS, from "Efficient MRC
+ * Construction with SHARDS" by Waldspurger et al, FAST '15.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MRC_H
+#define MRC_H
+
+#include "storage/s_lock.h"
+
+/*
+ * Only pages whose hash has the low MRC_SAMPLE_SHIFT bits clear are
+ * tracked, i.e. one in 64. The spatial sampling keeps all the references
+ * to a sampled page, so the reuse distances measured among the sampled
+ * pages, scaled up by the sampling rate, estimate the reuse distances among
+ * all pages.
+ */
+#define MRC_SAMPLE_SHIFT	6
+
+/*
+ * The sampled pages are tracked for the last MRC_WINDOW sampled references,
+ * so the curve covers caches of up to MRC_WINDOW << MRC_SAMPLE_SHIFT pages,
+ * or 32GB.
+ */
+#define MRC_WINDOW_BITS		16
+#define MRC_WINDOW			(1 << MRC_WINDOW_BITS)
+#define MRC_TABLE_BITS		(MRC_WINDOW_BITS + 1)
+#define MRC_TABLE_SIZE		(1 << MRC_TABLE_BITS)
+
+/* Bucket i counts the reads with a scaled reuse distance < 2^i pages */
+#define MRC_N_BUCKETS		(MRC_WINDOW_BITS + MRC_SAMPLE_SHIFT + 1)
+
+/*
+ * The reuse distance of a reference is the number of distinct pages
+ * referenced since the previous reference to the same page. An LRU cache of
+ * C pages has the page iff the distance is less than C, so the histogram of
+ * distances gives the hit ratio for any cache size.
+ *
+ * Every reference to a sampled page gets the next "clock" value. A page's
+ * last reference is marked at its clock slot in a Fenwick tree, so the
+ * distance is the number of marks after the slot of the previous reference.
+ * Pages not referenced within the last MRC_WINDOW clock values are
+ * forgotten, and count as misses.
+ *
+ * The counts are halved every MRC_WINDOW sampled reads, so that the curve
+ * follows changes in the workload.
+ *
+ * Everything is protected by the spinlock, which is only taken for the
+ * sampled references. The memory usage is about 1.5MB.
+ */
+typedef struct MrcTableEntry
+{
+	uint32		key;			/* 0 if unused */
+	uint32		slot;			/* clock slot of the last reference */
+} MrcTableEntry;
+
+typedef struct MissRatioCurveState
+{
+	slock_t		mutex;
+	uint64		clock;
+	uint32		n_tracked;		/* number of marks in the tree */
+	uint64		reads;			/* sampled reads */
+	uint64		hits[MRC_N_BUCKETS];
+	uint32		tree[MRC_WINDOW + 1];	/* Fenwick tree, 1-based */
+	uint32		slot_key[MRC_WINDOW];	/* 0 if the slot isn't marked */
+	MrcTableEntry table[MRC_TABLE_SIZE];
+} MissRatioCurveState;
+
+extern void initMRC(MissRatioCurveState *state);
+extern void addMRC(MissRatioCurveState *state, uint32 hash, bool is_read);
+extern void estimateMRC(MissRatioCurveState *state, double *hit_ratios);
+
+#endif
@@ -0,0 +1,35 @@
+\echo Use "ALTER EXTENSION neon UPDATE TO '1.7'" to load this file. \quit
+
+-- Approximate working set size over a few standard windows, in pages. These
+-- don't reset the estimator, unlike approximate_working_set_size(true).
+CREATE VIEW neon_lfc_working_set AS
+  SELECT W.window_seconds,
+         approximate_working_set_size_seconds(W.window_seconds) AS approximate_working_set_size
+  FROM unnest(ARRAY[60, 300, 900, 3600]) AS W (window_seconds);
+
+CREATE FUNCTION get_lfc_miss_ratio_curve()
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'neon_get_lfc_miss_ratio_curve'
+LANGUAGE C PARALLEL SAFE;
+
+-- Estimated LFC hit ratio if the cache had the given size, from sampled
+-- reuse distances of the pages read through the LFC. The estimate assumes
+-- LRU replacement of pages, while the LFC replaces whole chunks, so it's
+-- most accurate for cache sizes well above the chunk size.
+CREATE VIEW neon_lfc_miss_ratio_curve AS
+  SELECT P.cache_size_mb, P.estimated_hit_ratio
+  FROM get_lfc_miss_ratio_curve() AS P (
+    cache_size_mb bigint,
+    estimated_hit_ratio float8
+  );
+
+GRANT SELECT ON neon_lfc_working_set TO pg_monitor;
+GRANT SELECT ON neon_lfc_miss_ratio_curve TO pg_monitor;
+
+DROP FUNCTION IF EXISTS get_prewarm_info(out total_pages integer, out prewarmed_pages integer, out skipped_pages integer, out active_workers integer);
+
+CREATE FUNCTION get_prewarm_info(out total_pages integer, out prewarmed_pages integer, out skipped_pages integer, out active_workers integer, out pages_per_second float8, out eta_seconds float8)
+RETURNS record
+AS 'MODULE_PATHNAME', 'get_prewarm_info'
+LANGUAGE C STRICT
+PARALLEL SAFE;
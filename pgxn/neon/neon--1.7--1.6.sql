@@ -0,0 +1,13 @@
+DROP FUNCTION IF EXISTS get_prewarm_info(out total_pages integer, out prewarmed_pages integer, out skipped_pages integer, out active_workers integer, out pages_per_second float8, out eta_seconds float8);
+
+CREATE FUNCTION get_prewarm_info(out total_pages integer, out prewarmed_pages integer, out skipped_pages integer, out active_workers integer)
+RETURNS record
+AS 'MODULE_PATHNAME', 'get_prewarm_info'
+LANGUAGE C STRICT
+PARALLEL SAFE;
+
+DROP VIEW IF EXISTS neon_lfc_miss_ratio_curve CASCADE;
+
+DROP FUNCTION IF EXISTS get_lfc_miss_ratio_curve() CASCADE;
+
+DROP VIEW IF EXISTS neon_lfc_working_set CASCADE;
@@ -39,6 +39,7 @@
 #include "neon_lwlsncache.h"
 #include "neon_perf_counters.h"
 #include "logical_replication_monitor.h"
+#include "mrc.h"
 #include "unstable_extensions.h"
 #include "walsender_hooks.h"
 #if PG_MAJORVERSION_NUM >= 16
@@ -669,6 +670,7 @@ PG_FUNCTION_INFO_V1(approximate_working_set_size_seconds);
 PG_FUNCTION_INFO_V1(approximate_working_set_size);
 PG_FUNCTION_INFO_V1(neon_get_lfc_stats);
 PG_FUNCTION_INFO_V1(local_cache_pages);
+PG_FUNCTION_INFO_V1(neon_get_lfc_miss_ratio_curve);
 
 Datum
 pg_cluster_size(PG_FUNCTION_ARGS)
@@ -813,6 +815,41 @@ local_cache_pages(PG_FUNCTION_ARGS)
 #undef NUM_LOCALCACHE_PAGES_COLS
 }
 
+/*
+ * Estimated LFC hit ratio for cache sizes that are powers of two, from 1MB
+ * up to what the estimator covers.
+ */
+Datum
+neon_get_lfc_miss_ratio_curve(PG_FUNCTION_ARGS)
+{
+#define NUM_MISS_RATIO_CURVE_COLS	2
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	double		hit_ratios[MRC_N_BUCKETS];
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	if (!lfc_get_miss_ratio_curve(hit_ratios))
+		PG_RETURN_VOID();
+
+	for (int i = 0; i < MRC_N_BUCKETS; i++)
+	{
+		uint64		size_bytes = ((uint64) 1 << i) * BLCKSZ;
+		Datum		values[NUM_MISS_RATIO_CURVE_COLS];
+		bool		nulls[NUM_MISS_RATIO_CURVE_COLS] = {false, false};
+
+		if (size_bytes < 1024 * 1024)
+			continue;
+
+		values[0] = Int64GetDatum((int64) (size_bytes / (1024 * 1024)));
+		values[1] = Float8GetDatum(hit_ratios[i]);
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+
+	PG_RETURN_VOID();
+
+#undef NUM_MISS_RATIO_CURVE_COLS
+}
+
 /*
  * Initialization stage 2: make requests for the amount of shared memory we
  * will need.
@@ -833,6 +870,8 @@ neon_shmem_request_hook(void)
 	RelsizeCacheShmemRequest();
 	WalproposerShmemRequest();
 	LwLsnCacheShmemRequest();
+	PrefetchShmemRequest();
+	CommunicatorQueueShmemRequest();
 }
 
 
@@ -858,6 +897,8 @@ neon_shmem_startup_hook(void)
 	RelsizeCacheShmemInit();
 	WalproposerShmemInit();
 	LwLsnCacheShmemInit();
+	PrefetchShmemInit();
+	CommunicatorQueueShmemInit();
 
 #if PG_MAJORVERSION_NUM >= 17
 	WAIT_EVENT_NEON_LFC_MAINTENANCE = WaitEventExtensionNew("Neon/FileCache_Maintenance");
@@ -77,6 +77,8 @@ extern void RelsizeCacheShmemRequest(void);
 extern void WalproposerShmemRequest(void);
 extern void LwLsnCacheShmemRequest(void);
 extern void NeonPerfCountersShmemRequest(void);
+extern void PrefetchShmemRequest(void);
+extern void CommunicatorQueueShmemRequest(void);
 
 extern void LfcShmemInit(void);
 extern void PagestoreShmemInit(void);
@@ -84,6 +86,8 @@ extern void RelsizeCacheShmemInit(void);
 extern void WalproposerShmemInit(void);
 extern void LwLsnCacheShmemInit(void);
 extern void NeonPerfCountersShmemInit(void);
+extern void PrefetchShmemInit(void);
+extern void CommunicatorQueueShmemInit(void);
 
 
 #endif							/* NEON_H */
@@ -9,44 +9,57 @@
 #include "storage/ipc.h"
 #include "storage/shmem.h"
 #include "storage/buf_internals.h"
+#include "storage/s_lock.h"
 #include "utils/guc.h"
-#include "utils/hsearch.h"
+#include "common/hashfn.h"
+#include "port/atomics.h"
 
 
 
+/*
+ * Cache of last written LSN for each relation page.
+ * Also to provide request LSN for smgrnblocks, smgrexists there is pseudokey=InvalidBlockId which stores LSN of last
+ * relation metadata update.
+ *
+ * The cache is a set-associative table: each page maps to one set of
+ * LWLSN_WAYS entries, chosen by the hash of its buffer tag. Size of the cache
+ * is limited by GUC variable lastWrittenLsnCacheSize ("lsn_cache_size").
+ * When a set is full, the entry with the lowest LSN in the set is replaced.
+ * That approximates LRU without a global list, and it is also the entry
+ * whose eviction raises maxLastWrittenLsn the least.
+ *
+ * Each set is protected by a change counter, which is odd while the set is
+ * being modified. Writers make the counter odd with compare-and-swap, so
+ * writers of different sets never contend. Readers don't lock at all: they
+ * read the entries between two reads of the counter, and retry if it changed.
+ */
+#define LWLSN_WAYS	8
+
 typedef struct LastWrittenLsnCacheEntry
 {
 	BufferTag	key;
-	XLogRecPtr	lsn;
-	/* double linked list for LRU replacement algorithm */
-	dlist_node	lru_node;
+	XLogRecPtr	lsn;			/* InvalidXLogRecPtr if the entry is unused */
 } LastWrittenLsnCacheEntry;
 
+typedef struct LastWrittenLsnCacheSet
+{
+	pg_atomic_uint32 changecount;
+	LastWrittenLsnCacheEntry entries[LWLSN_WAYS];
+} LastWrittenLsnCacheSet;
+
 typedef struct LwLsnCacheCtl {
 	int lastWrittenLsnCacheSize;
+	uint32		nsets;
 	/*
-	* Maximal last written LSN for pages not present in lastWrittenLsnCache
+	* Maximal last written LSN for pages not present in the cache. When an
+	* entry is replaced, this is advanced before the entry is overwritten,
+	* so that readers that miss the entry see an LSN that covers it.
 	*/
-	XLogRecPtr  maxLastWrittenLsn;
+	pg_atomic_uint64 maxLastWrittenLsn;
 
-	/*
-	* Double linked list to implement LRU replacement policy for last written LSN cache.
-	* Access to this list as well as to last written LSN cache is protected by 'LastWrittenLsnLock'.
-	*/
-	dlist_head lastWrittenLsnLRU;
+	LastWrittenLsnCacheSet sets[FLEXIBLE_ARRAY_MEMBER];
 } LwLsnCacheCtl;
 
-
-/*
- * Cache of last written LSN for each relation page.
- * Also to provide request LSN for smgrnblocks, smgrexists there is pseudokey=InvalidBlockId which stores LSN of last
- * relation metadata update.
- * Size of the cache is limited by GUC variable lastWrittenLsnCacheSize ("lsn_cache_size"),
- * pages are replaced using LRU algorithm, based on L2-list.
- * Access to this cache is protected by 'LastWrittenLsnLock'.
- */
-static HTAB *lastWrittenLsnCache;
-
 LwLsnCacheCtl* LwLsnCache;
 
 static int lwlsn_cache_size = (128 * 1024); 
@@ -65,11 +78,6 @@ lwlc_register_gucs(void)
 							NULL, NULL, NULL);
 }
 
-static XLogRecPtr SetLastWrittenLSNForBlockRangeInternal(XLogRecPtr lsn,
-														 NRelFileInfo rlocator,
-														 ForkNumber forknum,
-														 BlockNumber from,
-														 BlockNumber n_blocks);
 
 /* All the necessary hooks are defined here */
 
@@ -107,38 +115,213 @@ init_lwlsncache(void)
 }
 
 
-void
-LwLsnCacheShmemRequest(void)
+static uint32
+lwlc_num_sets(void)
 {
-	Size requested_size = sizeof(LwLsnCacheCtl);
+	return Max((lwlsn_cache_size + LWLSN_WAYS - 1) / LWLSN_WAYS, 1);
+}
 
-	requested_size += hash_estimate_size(lwlsn_cache_size, sizeof(LastWrittenLsnCacheEntry));
+static Size
+lwlc_shmem_size(void)
+{
+	return add_size(offsetof(LwLsnCacheCtl, sets),
+					mul_size(lwlc_num_sets(), sizeof(LastWrittenLsnCacheSet)));
+}
 
-	RequestAddinShmemSpace(requested_size);
+void
+LwLsnCacheShmemRequest(void)
+{
+	RequestAddinShmemSpace(lwlc_shmem_size());
 }
 
 void
 LwLsnCacheShmemInit(void)
 {
-	static HASHCTL info;
 	bool found;
-	if (lwlsn_cache_size > 0)
+
+	LwLsnCache = ShmemInitStruct("neon/LwLsnCacheCtl", lwlc_shmem_size(), &found);
+	if (found)
+		return;
+
+	LwLsnCache->nsets = lwlc_num_sets();
+	LwLsnCache->lastWrittenLsnCacheSize = LwLsnCache->nsets * LWLSN_WAYS;
+	for (uint32 i = 0; i < LwLsnCache->nsets; i++)
+	{
+		LastWrittenLsnCacheSet *set = &LwLsnCache->sets[i];
+
+		pg_atomic_init_u32(&set->changecount, 0);
+		MemSet(set->entries, 0, sizeof(set->entries));
+	}
+	pg_atomic_init_u64(&LwLsnCache->maxLastWrittenLsn, GetRedoRecPtr());
+}
+
+static inline LastWrittenLsnCacheSet *
+lwlc_set_for(const BufferTag *key)
+{
+	uint32		hash = hash_bytes((const unsigned char *) key, sizeof(BufferTag));
+
+	return &LwLsnCache->sets[hash % LwLsnCache->nsets];
+}
+
+/*
+ * Lock a set for modification, by making its change counter odd.
+ */
+static void
+lwlc_lock_set(LastWrittenLsnCacheSet *set)
+{
+	SpinDelayStatus delay;
+
+	init_local_spin_delay(&delay);
+	for (;;)
 	{
-		info.keysize = sizeof(BufferTag);
-		info.entrysize = sizeof(LastWrittenLsnCacheEntry);
-		lastWrittenLsnCache = ShmemInitHash("last_written_lsn_cache",
-			lwlsn_cache_size, lwlsn_cache_size,
-										&info,
-										HASH_ELEM | HASH_BLOBS);
-		LwLsnCache = ShmemInitStruct("neon/LwLsnCacheCtl", sizeof(LwLsnCacheCtl), &found);
-		// Now set the size in the struct
-		LwLsnCache->lastWrittenLsnCacheSize = lwlsn_cache_size;
-		if (found) {
-			return;
+		uint32		count = pg_atomic_read_u32(&set->changecount);
+
+		if ((count & 1) == 0 &&
+			pg_atomic_compare_exchange_u32(&set->changecount, &count, count + 1))
+			break;
+		perform_spin_delay(&delay);
+	}
+	finish_spin_delay(&delay);
+}
+
+static void
+lwlc_unlock_set(LastWrittenLsnCacheSet *set)
+{
+	/* pg_atomic_fetch_add_u32() is a full barrier */
+	pg_atomic_fetch_add_u32(&set->changecount, 1);
+}
+
+/*
+ * Look up a page in the cache without locking. Returns InvalidXLogRecPtr if
+ * the page is not cached.
+ */
+static XLogRecPtr
+lwlc_lookup(const BufferTag *key)
+{
+	LastWrittenLsnCacheSet *set = lwlc_set_for(key);
+	SpinDelayStatus delay;
+	XLogRecPtr	lsn;
+
+	init_local_spin_delay(&delay);
+	for (;;)
+	{
+		uint32		before = pg_atomic_read_u32(&set->changecount);
+
+		if ((before & 1) == 0)
+		{
+			pg_read_barrier();
+
+			lsn = InvalidXLogRecPtr;
+			for (int i = 0; i < LWLSN_WAYS; i++)
+			{
+				if (memcmp(&set->entries[i].key, key, sizeof(BufferTag)) == 0)
+				{
+					lsn = set->entries[i].lsn;
+					break;
+				}
+			}
+
+			pg_read_barrier();
+			if (pg_atomic_read_u32(&set->changecount) == before)
+				break;
 		}
+		perform_spin_delay(&delay);
 	}
-	dlist_init(&LwLsnCache->lastWrittenLsnLRU);
-    LwLsnCache->maxLastWrittenLsn = GetRedoRecPtr();
+	finish_spin_delay(&delay);
+
+	return lsn;
+}
+
+/*
+ * Advance maxLastWrittenLsn to 'lsn', if it is behind. Returns the new value.
+ */
+static XLogRecPtr
+lwlc_advance_max(XLogRecPtr lsn)
+{
+	uint64		cur = pg_atomic_read_u64(&LwLsnCache->maxLastWrittenLsn);
+
+	while (lsn > cur)
+	{
+		if (pg_atomic_compare_exchange_u64(&LwLsnCache->maxLastWrittenLsn, &cur, lsn))
+			return lsn;
+	}
+	return cur;
+}
+
+/*
+ * Raise the cached LSN of a page to 'lsn', inserting the page if it is not
+ * cached yet. Returns the resulting LSN of the page.
+ *
+ * If 'lsn' is InvalidXLogRecPtr, maxLastWrittenLsn is used. It is read only
+ * after locking the set, so that it covers any entry for the page that was
+ * replaced since the caller looked it up.
+ */
+static XLogRecPtr
+lwlc_update(const BufferTag *key, XLogRecPtr lsn)
+{
+	LastWrittenLsnCacheSet *set = lwlc_set_for(key);
+	LastWrittenLsnCacheEntry *victim = NULL;
+
+	lwlc_lock_set(set);
+
+	if (lsn == InvalidXLogRecPtr)
+		lsn = pg_atomic_read_u64(&LwLsnCache->maxLastWrittenLsn);
+
+	for (int i = 0; i < LWLSN_WAYS; i++)
+	{
+		LastWrittenLsnCacheEntry *entry = &set->entries[i];
+
+		if (entry->lsn != InvalidXLogRecPtr &&
+			memcmp(&entry->key, key, sizeof(BufferTag)) == 0)
+		{
+			if (lsn > entry->lsn)
+				entry->lsn = lsn;
+			else
+				lsn = entry->lsn;
+			lwlc_unlock_set(set);
+			return lsn;
+		}
+		if (victim == NULL || entry->lsn < victim->lsn)
+			victim = entry;
+	}
+
+	/* Adjust max LSN for not cached relations/chunks if needed */
+	if (victim->lsn != InvalidXLogRecPtr)
+		lwlc_advance_max(victim->lsn);
+
+	victim->key = *key;
+	victim->lsn = lsn;
+
+	lwlc_unlock_set(set);
+
+	return lsn;
+}
+
+/*
+ * Maximum of all cached LSNs and maxLastWrittenLsn.
+ * If cache is large enough, iterating through all entries may be rather expensive.
+ * But it is used only by neon_dbsize which is not performance critical.
+ */
+static XLogRecPtr
+lwlc_max_lsn(void)
+{
+	XLogRecPtr	lsn = InvalidXLogRecPtr;
+
+	for (uint32 i = 0; i < LwLsnCache->nsets; i++)
+	{
+		LastWrittenLsnCacheSet *set = &LwLsnCache->sets[i];
+
+		lwlc_lock_set(set);
+		for (int j = 0; j < LWLSN_WAYS; j++)
+			lsn = Max(lsn, set->entries[j].lsn);
+		lwlc_unlock_set(set);
+	}
+
+	/*
+	 * Read the global maximum last, so that it covers the entries that were
+	 * replaced while we were scanning.
+	 */
+	return Max(lsn, pg_atomic_read_u64(&LwLsnCache->maxLastWrittenLsn));
 }
 
 /*
@@ -146,22 +329,14 @@ LwLsnCacheShmemInit(void)
  * It returns an upper bound for the last written LSN of a given page,
  * either from a cached last written LSN or a global maximum last written LSN.
  * If rnode is InvalidOid then we calculate maximum among all cached LSN and maxLastWrittenLsn.
- * If cache is large enough, iterating through all hash items may be rather expensive.
- * But neon_get_lwlsn(InvalidOid) is used only by neon_dbsize which is not performance critical.
  */
 XLogRecPtr
 neon_get_lwlsn(NRelFileInfo rlocator, ForkNumber forknum, BlockNumber blkno)
 {
 	XLogRecPtr lsn;
-	LastWrittenLsnCacheEntry* entry;
 
 	Assert(LwLsnCache->lastWrittenLsnCacheSize != 0);
 
-	LWLockAcquire(LastWrittenLsnLock, LW_SHARED);
-
-	/* Maximal last written LSN among all non-cached pages */
-	lsn = LwLsnCache->maxLastWrittenLsn;
-
 	if (NInfoGetRelNumber(rlocator) != InvalidOid)
 	{
 		BufferTag key;
@@ -169,14 +344,10 @@ neon_get_lwlsn(NRelFileInfo rlocator, ForkNumber forknum, BlockNumber blkno)
 		Oid dbOid = NInfoGetDbOid(rlocator);
 		Oid relNumber = NInfoGetRelNumber(rlocator);
 		BufTagInit(key,  relNumber, forknum, blkno, spcOid, dbOid);
-		
-		entry = hash_search(lastWrittenLsnCache, &key, HASH_FIND, NULL);
-		if (entry != NULL)
-			lsn = entry->lsn;
-		else
+
+		lsn = lwlc_lookup(&key);
+		if (lsn == InvalidXLogRecPtr)
 		{
-			LWLockRelease(LastWrittenLsnLock);
-			LWLockAcquire(LastWrittenLsnLock, LW_EXCLUSIVE);
 			/*
 			 * In case of statements CREATE TABLE AS SELECT... or INSERT FROM SELECT... we are fetching data from source table
 			 * and storing it in destination table. It cause problems with prefetch last-written-lsn is known for the pages of
@@ -188,29 +359,17 @@ neon_get_lwlsn(NRelFileInfo rlocator, ForkNumber forknum, BlockNumber blkno)
 			 * less likely the LSN for this page will get evicted from the LwLsnCache
 			 * before the page is read.
 			 */
-			 lsn = SetLastWrittenLSNForBlockRangeInternal(lsn, rlocator, forknum, blkno, 1);
+			lsn = lwlc_update(&key, InvalidXLogRecPtr);
 		}
 	}
 	else
-	{
-		HASH_SEQ_STATUS seq;
-		/* Find maximum of all cached LSNs */
-		hash_seq_init(&seq, lastWrittenLsnCache);
-		while ((entry = (LastWrittenLsnCacheEntry *) hash_seq_search(&seq)) != NULL)
-		{
-			if (entry->lsn > lsn)
-				lsn = entry->lsn;
-		}
-	}
-	LWLockRelease(LastWrittenLsnLock);
+		lsn = lwlc_max_lsn();
 
 	return lsn;
 }
 
 static void neon_set_max_lwlsn(XLogRecPtr lsn) {
-	LWLockAcquire(LastWrittenLsnLock, LW_EXCLUSIVE);
-	LwLsnCache->maxLastWrittenLsn = lsn;
-	LWLockRelease(LastWrittenLsnLock);
+	pg_atomic_write_u64(&LwLsnCache->maxLastWrittenLsn, lsn);
 }
 
 /*
@@ -218,26 +377,20 @@ static void neon_set_max_lwlsn(XLogRecPtr lsn) {
  * It returns an upper bound for the last written LSN of a given page,
  * either from a cached last written LSN or a global maximum last written LSN.
  * If rnode is InvalidOid then we calculate maximum among all cached LSN and maxLastWrittenLsn.
- * If cache is large enough, iterating through all hash items may be rather expensive.
- * But GetLastWrittenLSN(InvalidOid) is used only by neon_dbsize which is not performance critical.
  */
 void
 neon_get_lwlsn_v(NRelFileInfo relfilenode, ForkNumber forknum,
 				   BlockNumber blkno, int nblocks, XLogRecPtr *lsns)
 {
-	LastWrittenLsnCacheEntry* entry;
 	XLogRecPtr lsn;
 
 	Assert(LwLsnCache->lastWrittenLsnCacheSize != 0);
 	Assert(nblocks > 0);
 	Assert(PointerIsValid(lsns));
 
-	LWLockAcquire(LastWrittenLsnLock, LW_SHARED);
-
 	if (NInfoGetRelNumber(relfilenode) != InvalidOid)
 	{
 		BufferTag key;
-		bool missed_keys = false;
 		Oid spcOid = NInfoGetSpcOid(relfilenode);
 		Oid dbOid = NInfoGetDbOid(relfilenode);
 		Oid relNumber = NInfoGetRelNumber(relfilenode);
@@ -245,64 +398,28 @@ neon_get_lwlsn_v(NRelFileInfo relfilenode, ForkNumber forknum,
 
 		for (int i = 0; i < nblocks; i++)
 		{
-			/* Maximal last written LSN among all non-cached pages */
 			key.blockNum = blkno + i;
 
-			entry = hash_search(lastWrittenLsnCache, &key, HASH_FIND, NULL);
-			if (entry != NULL)
+			lsn = lwlc_lookup(&key);
+			if (lsn == InvalidXLogRecPtr)
 			{
- 				lsns[i] = entry->lsn;
-			}
-			else
-			{
-				/* Mark this block's LSN as missing - we'll update the LwLSN for missing blocks in bulk later */
-				lsns[i] = InvalidXLogRecPtr;
-				missed_keys = true;
-			}
-		}
-
-		/*
-		 * If we had any missing LwLSN entries, we add the missing ones now.
-		 * By doing the insertions in one batch, we decrease lock contention.
-		 */
-		if (missed_keys)
-		{
-			LWLockRelease(LastWrittenLsnLock);
-			LWLockAcquire(LastWrittenLsnLock, LW_EXCLUSIVE);
-
-			lsn = LwLsnCache->maxLastWrittenLsn;
-
-			for (int i = 0; i < nblocks; i++)
-			{
-				if (lsns[i] == InvalidXLogRecPtr)
-				{
-					lsns[i] = lsn;
-					SetLastWrittenLSNForBlockRangeInternal(lsn, relfilenode, forknum, blkno + i, 1);
-				}
+				/* See neon_get_lwlsn() for why missing pages are inserted */
+				lsn = lwlc_update(&key, InvalidXLogRecPtr);
 			}
+			lsns[i] = lsn;
 		}
 	}
 	else
 	{
-		HASH_SEQ_STATUS seq;
-		lsn = LwLsnCache->maxLastWrittenLsn;
-		/* Find maximum of all cached LSNs */
-		hash_seq_init(&seq, lastWrittenLsnCache);
-		while ((entry = (LastWrittenLsnCacheEntry *) hash_seq_search(&seq)) != NULL)
-		{
-			if (entry->lsn > lsn)
-				lsn = entry->lsn;
-		}
+		lsn = lwlc_max_lsn();
 
 		for (int i = 0; i < nblocks; i++)
 			lsns[i] = lsn;
 	}
-	LWLockRelease(LastWrittenLsnLock);
 }
 
 /*
  * Guts for SetLastWrittenLSNForBlockRange.
- * Caller must ensure LastWrittenLsnLock is held in exclusive mode.
  */
 static XLogRecPtr
 SetLastWrittenLSNForBlockRangeInternal(XLogRecPtr lsn,
@@ -312,17 +429,11 @@ SetLastWrittenLSNForBlockRangeInternal(XLogRecPtr lsn,
 									   BlockNumber n_blocks)
 {
 	if (NInfoGetRelNumber(rlocator) == InvalidOid)
-	{
-		if (lsn > LwLsnCache->maxLastWrittenLsn)
-		LwLsnCache->maxLastWrittenLsn = lsn;
-		else
-			lsn = LwLsnCache->maxLastWrittenLsn;
-	}
+		lsn = lwlc_advance_max(lsn);
 	else
 	{
-		LastWrittenLsnCacheEntry* entry;
 		BufferTag key;
-		bool found;
+		XLogRecPtr max = InvalidXLogRecPtr;
 		BlockNumber i;
 
 		Oid spcOid = NInfoGetSpcOid(rlocator);
@@ -332,41 +443,17 @@ SetLastWrittenLSNForBlockRangeInternal(XLogRecPtr lsn,
 		for (i = 0; i < n_blocks; i++)
 		{
 			key.blockNum = from + i;
-			entry = hash_search(lastWrittenLsnCache, &key, HASH_ENTER, &found);
-			if (found)
-			{
-				if (lsn > entry->lsn)
-					entry->lsn = lsn;
-				else
-					lsn = entry->lsn;
-				/* Unlink from LRU list */
-				dlist_delete(&entry->lru_node);
-			}
-			else
-			{
-				entry->lsn = lsn;
-				if (hash_get_num_entries(lastWrittenLsnCache) > LwLsnCache->lastWrittenLsnCacheSize)
-				{
-					/* Replace least recently used entry */
-					LastWrittenLsnCacheEntry* victim = dlist_container(LastWrittenLsnCacheEntry, lru_node, dlist_pop_head_node(&LwLsnCache->lastWrittenLsnLRU));
-					/* Adjust max LSN for not cached relations/chunks if needed */
-					if (victim->lsn > LwLsnCache->maxLastWrittenLsn)
-					LwLsnCache->maxLastWrittenLsn = victim->lsn;
-
-					hash_search(lastWrittenLsnCache, victim, HASH_REMOVE, NULL);
-				}
-			}
-			/* Link to the end of LRU list */
-			dlist_push_tail(&LwLsnCache->lastWrittenLsnLRU, &entry->lru_node);
+			max = Max(max, lwlc_update(&key, lsn));
 		}
+		lsn = max;
 	}
 	return lsn;
 }
 
 /*
  * SetLastWrittenLSNForBlockRange -- Set maximal LSN of written page range.
- * We maintain cache of last written LSNs with limited size and LRU replacement
- * policy. Keeping last written LSN for each page allows to use old LSN when
+ * We maintain cache of last written LSNs with limited size and approximate
+ * LRU replacement policy. Keeping last written LSN for each page allows to use old LSN when
  * requesting pages of unchanged or appended relations. Also it is critical for
  * efficient work of prefetch in case massive update operations (like vacuum or remove).
  *
@@ -380,19 +467,15 @@ neon_set_lwlsn_block_range(XLogRecPtr lsn, NRelFileInfo rlocator, ForkNumber for
 		return lsn;
 
 	Assert(lsn >= WalSegMinSize);
-	LWLockAcquire(LastWrittenLsnLock, LW_EXCLUSIVE);
-	lsn = SetLastWrittenLSNForBlockRangeInternal(lsn, rlocator, forknum, from, n_blocks);
-	LWLockRelease(LastWrittenLsnLock);
-
-	return lsn;
+	return SetLastWrittenLSNForBlockRangeInternal(lsn, rlocator, forknum, from, n_blocks);
 }
 
 /*
  * neon_set_lwlsn_block_v -- Set maximal LSN of pages to their respective
  * LSNs.
  *
- * We maintain cache of last written LSNs with limited size and LRU replacement
- * policy. Keeping last written LSN for each page allows to use old LSN when
+ * We maintain cache of last written LSNs with limited size and approximate
+ * LRU replacement policy. Keeping last written LSN for each page allows to use old LSN when
  * requesting pages of unchanged or appended relations. Also it is critical for
  * efficient work of prefetch in case massive update operations (like vacuum or remove).
  *
@@ -404,9 +487,7 @@ neon_set_lwlsn_block_v(const XLogRecPtr *lsns, NRelFileInfo relfilenode,
 						   ForkNumber forknum, BlockNumber blockno,
 						   int nblocks)
 {
-	LastWrittenLsnCacheEntry* entry;
 	BufferTag	key;
-	bool		found;
 	XLogRecPtr	max = InvalidXLogRecPtr;
 	Oid spcOid = NInfoGetSpcOid(relfilenode);
 	Oid dbOid = NInfoGetDbOid(relfilenode);
@@ -418,8 +499,6 @@ neon_set_lwlsn_block_v(const XLogRecPtr *lsns, NRelFileInfo relfilenode,
 
 	BufTagInit(key,  relNumber, forknum, blockno, spcOid, dbOid);
 
-	LWLockAcquire(LastWrittenLsnLock, LW_EXCLUSIVE);
-
 	for (int i = 0; i < nblocks; i++)
 	{
 		XLogRecPtr	lsn = lsns[i];
@@ -429,37 +508,9 @@ neon_set_lwlsn_block_v(const XLogRecPtr *lsns, NRelFileInfo relfilenode,
 
 		Assert(lsn >= WalSegMinSize);
 		key.blockNum = blockno + i;
-		entry = hash_search(lastWrittenLsnCache, &key, HASH_ENTER, &found);
-		if (found)
-		{
-			if (lsn > entry->lsn)
-				entry->lsn = lsn;
-			else
-				lsn = entry->lsn;
-			/* Unlink from LRU list */
-			dlist_delete(&entry->lru_node);
-		}
-		else
-		{
-			entry->lsn = lsn;
-			if (hash_get_num_entries(lastWrittenLsnCache) > LwLsnCache->lastWrittenLsnCacheSize)
-			{
-				/* Replace least recently used entry */
-				LastWrittenLsnCacheEntry* victim = dlist_container(LastWrittenLsnCacheEntry, lru_node, dlist_pop_head_node(&LwLsnCache->lastWrittenLsnLRU));
-				/* Adjust max LSN for not cached relations/chunks if needed */
-				if (victim->lsn > LwLsnCache->maxLastWrittenLsn)
-					LwLsnCache->maxLastWrittenLsn = victim->lsn;
-
-				hash_search(lastWrittenLsnCache, victim, HASH_REMOVE, NULL);
-			}
-		}
-		/* Link to the end of LRU list */
-		dlist_push_tail(&LwLsnCache->lastWrittenLsnLRU, &entry->lru_node);
-		max = Max(max, lsn);
+		max = Max(max, lwlc_update(&key, lsn));
 	}
 
-	LWLockRelease(LastWrittenLsnLock);
-
 	return max;
 }
 
@@ -490,4 +541,3 @@ neon_set_lwlsn_db(XLogRecPtr lsn)
 	NRelFileInfo dummyNode = {InvalidOid, InvalidOid, InvalidOid};
 	return neon_set_lwlsn_block(lsn, dummyNode, MAIN_FORKNUM, 0);
 }
-
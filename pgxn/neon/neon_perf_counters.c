@@ -250,7 +250,7 @@ qt_histogram_to_metrics(QTHistogram histogram,
 static metric_t *
 neon_perf_counters_to_metrics(neon_per_backend_counters *counters)
 {
-#define NUM_METRICS ((2 + NUM_IO_WAIT_BUCKETS) * 3 + (2 + NUM_QT_BUCKETS) + 12)
+#define NUM_METRICS ((2 + NUM_IO_WAIT_BUCKETS) * 3 + (2 + NUM_QT_BUCKETS) + 25)
 	metric_t   *metrics = palloc((NUM_METRICS + 1) * sizeof(metric_t));
 	int			i = 0;
 
@@ -272,13 +272,26 @@ neon_perf_counters_to_metrics(neon_per_backend_counters *counters)
 	APPEND_METRIC(compute_getpage_max_inflight_stuck_time_ms);
 	APPEND_METRIC(getpage_prefetch_misses_total);
 	APPEND_METRIC(getpage_prefetch_discards_total);
+	APPEND_METRIC(getpage_prefetch_wasted_total);
+	APPEND_METRIC(getpage_copies_avoided_total);
+	APPEND_METRIC(getpage_shared_prefetch_hits_total);
+	APPEND_METRIC(getpage_gather_early_responses_total);
+	APPEND_METRIC(getpage_stride_prefetches_total);
+	APPEND_METRIC(getpage_stride_prefetch_hits_total);
+	APPEND_METRIC(getpage_stride_prefetch_waste_total);
 	APPEND_METRIC(pageserver_requests_sent_total);
 	APPEND_METRIC(pageserver_disconnects_total);
 	APPEND_METRIC(pageserver_send_flushes_total);
 	APPEND_METRIC(pageserver_open_requests);
 	APPEND_METRIC(getpage_prefetches_buffered);
+	APPEND_METRIC(getpage_prefetch_depth);
 
 	APPEND_METRIC(file_cache_hits_total);
+	APPEND_METRIC(relsize_cache_hits_total);
+	APPEND_METRIC(relsize_cache_misses_total);
+	APPEND_METRIC(relsize_cache_contention_total);
+	APPEND_METRIC(backpressure_throttling_us_total);
+	APPEND_METRIC(backpressure_admissions_total);
 
 	i += io_histogram_to_metrics(&counters->file_cache_read_hist, &metrics[i],
 								 "file_cache_read_wait_seconds_count",
@@ -410,12 +423,25 @@ neon_get_perf_counters(PG_FUNCTION_ARGS)
 		totals.getpage_sync_requests_total += counters->getpage_sync_requests_total;
 		totals.getpage_prefetch_misses_total += counters->getpage_prefetch_misses_total;
 		totals.getpage_prefetch_discards_total += counters->getpage_prefetch_discards_total;
+		totals.getpage_prefetch_wasted_total += counters->getpage_prefetch_wasted_total;
+		totals.getpage_copies_avoided_total += counters->getpage_copies_avoided_total;
+		totals.getpage_shared_prefetch_hits_total += counters->getpage_shared_prefetch_hits_total;
+		totals.getpage_gather_early_responses_total += counters->getpage_gather_early_responses_total;
+		totals.getpage_stride_prefetches_total += counters->getpage_stride_prefetches_total;
+		totals.getpage_stride_prefetch_hits_total += counters->getpage_stride_prefetch_hits_total;
+		totals.getpage_stride_prefetch_waste_total += counters->getpage_stride_prefetch_waste_total;
 		totals.pageserver_requests_sent_total += counters->pageserver_requests_sent_total;
 		totals.pageserver_disconnects_total += counters->pageserver_disconnects_total;
 		totals.pageserver_send_flushes_total += counters->pageserver_send_flushes_total;
 		totals.pageserver_open_requests += counters->pageserver_open_requests;
 		totals.getpage_prefetches_buffered += counters->getpage_prefetches_buffered;
+		totals.getpage_prefetch_depth += counters->getpage_prefetch_depth;
 		totals.file_cache_hits_total += counters->file_cache_hits_total;
+		totals.relsize_cache_hits_total += counters->relsize_cache_hits_total;
+		totals.relsize_cache_misses_total += counters->relsize_cache_misses_total;
+		totals.relsize_cache_contention_total += counters->relsize_cache_contention_total;
+		totals.backpressure_throttling_us_total += counters->backpressure_throttling_us_total;
+		totals.backpressure_admissions_total += counters->backpressure_admissions_total;
 		totals.compute_getpage_stuck_requests_total += counters->compute_getpage_stuck_requests_total;
 		totals.compute_getpage_max_inflight_stuck_time_ms = Max(
 			totals.compute_getpage_max_inflight_stuck_time_ms,
@@ -105,6 +105,44 @@ typedef struct
 	 */
 	uint64		getpage_prefetch_discards_total;
 
+	/*
+	 * Number of prefetched pages that were thrown away unread to make room
+	 * in the readahead ring, because we prefetched further ahead than the
+	 * reads got. Unlike getpage_prefetch_discards_total, this doesn't count
+	 * prefetches lost to a disconnect or that didn't satisfy the read's LSN.
+	 */
+	uint64		getpage_prefetch_wasted_total;
+
+	/*
+	 * Number of GetPage responses that were decoded directly into the
+	 * destination buffer of a synchronous read, skipping the copy through
+	 * the prefetch response buffer.
+	 */
+	uint64		getpage_copies_avoided_total;
+
+	/*
+	 * Number of pages that were read from the LFC after waiting for another
+	 * backend's in-flight GetPage request, instead of requesting them again.
+	 */
+	uint64		getpage_shared_prefetch_hits_total;
+
+	/*
+	 * Number of GetPage responses that a vectored read spanning several
+	 * shards received from one shard while the response it needed next was
+	 * still due from another.
+	 */
+	uint64		getpage_gather_early_responses_total;
+
+	/*
+	 * Number of blocks prefetched because the stride detector predicted them
+	 * from the preceding reads of the same relation fork, and how many of
+	 * those predicted blocks were then read, or abandoned when the pattern
+	 * broke.
+	 */
+	uint64		getpage_stride_prefetches_total;
+	uint64		getpage_stride_prefetch_hits_total;
+	uint64		getpage_stride_prefetch_waste_total;
+
 	/*
 	 * Total number of requests send to pageserver. (prefetch_requests_total
 	 * and sync_request_total count only GetPage requests, this counts all
@@ -136,6 +174,12 @@ typedef struct
 	 */
 	uint64		getpage_prefetches_buffered;
 
+	/*
+	 * Current effective readahead depth of this backend, with
+	 * neon.readahead_adaptive.
+	 */
+	uint64		getpage_prefetch_depth;
+
 	/*
 	 * Number of requests satisfied from the LFC.
 	 *
@@ -146,6 +190,28 @@ typedef struct
 	 */
 	uint64		file_cache_hits_total;
 
+	/*
+	 * Relation size cache lookups that found or didn't find the relation,
+	 * and the number of times a lookup or update of the cache had to wait
+	 * for a concurrent update of the same cache set.
+	 */
+	uint64		relsize_cache_hits_total;
+	uint64		relsize_cache_misses_total;
+	uint64		relsize_cache_contention_total;
+
+	/*
+	 * Time this backend has spent throttled by backpressure, in
+	 * microseconds.
+	 */
+	uint64		backpressure_throttling_us_total;
+
+	/*
+	 * Number of times this backend was let through backpressure while the lag
+	 * was still above the limit, on a share of the headroom that pageserver
+	 * feedback freed up.
+	 */
+	uint64		backpressure_admissions_total;
+
 	/* LFC I/O time buckets */
 	IOHistogramData file_cache_read_hist;
 	IOHistogramData file_cache_write_hist;
@@ -15,6 +15,7 @@
 
 #include "access/slru.h"
 #include "access/xlogdefs.h"
+#include "datatype/timestamp.h"
 #include RELFILEINFO_HDR
 #include "lib/stringinfo.h"
 #include "storage/block.h"
@@ -31,6 +32,7 @@ typedef enum
 	T_NeonGetPageRequest,
 	T_NeonDbSizeRequest,
 	T_NeonGetSlruSegmentRequest,
+	T_NeonGetPageBatchRequest,	/* protocol version 4 and above */
 	/* future tags above this line */
 	T_NeonTestRequest = 99, /* only in cfg(feature = "testing") */
 
@@ -41,6 +43,7 @@ typedef enum
 	T_NeonErrorResponse,
 	T_NeonDbSizeResponse,
 	T_NeonGetSlruSegmentResponse,
+	T_NeonGetPageBatchResponse, /* protocol version 4 and above */
 	/* future tags above this line */
 	T_NeonTestResponse = 199, /* only in cfg(feature = "testing") */
 } NeonMessageTag;
@@ -90,6 +93,10 @@ typedef enum {
  * as well as other fields from requests, which allows to verify that we receive response for our request.
  * We copy fields from request to response to make checking more reliable: request ID is formed from process ID
  * and local counter, so in principle there can be duplicated requests IDs if process PID is reused.
+ *
+ * V4 adds NeonGetPageBatchRequest, which requests a range of consecutive
+ * blocks at the same LSNs with a single message, and is answered with a
+ * single NeonGetPageBatchResponse.
  */
 typedef NeonMessage NeonRequest;
 
@@ -128,6 +135,22 @@ typedef struct
 	int			segno;
 } NeonGetSlruSegmentRequest;
 
+/*
+ * Maximum number of blocks in a NeonGetPageBatchRequest.
+ *
+ * Keep in sync with MAX_GETPAGE_BATCH_BLOCKS in pagestream_api.rs
+ */
+#define MAX_GETPAGE_BATCH_BLOCKS 32
+
+typedef struct
+{
+	NeonRequest hdr;
+	NRelFileInfo rinfo;
+	ForkNumber	forknum;
+	BlockNumber blkno;			/* first block */
+	BlockNumber nblocks;
+} NeonGetPageBatchRequest;
+
 
 /* supertype of all the Neon*Response structs below */
 typedef NeonMessage NeonResponse;
@@ -152,6 +175,17 @@ typedef struct
 
 #define PS_GETPAGERESPONSE_SIZE (MAXALIGN(offsetof(NeonGetPageResponse, page) + BLCKSZ))
 
+/*
+ * The pages of a batch response are unpacked into separately allocated
+ * NeonGetPageResponses, so that each of them can be handed out and freed on
+ * its own, like the response to a single NeonGetPageRequest.
+ */
+typedef struct
+{
+	NeonGetPageBatchRequest req;
+	NeonGetPageResponse *pages[MAX_GETPAGE_BATCH_BLOCKS];
+} NeonGetPageBatchResponse;
+
 typedef struct
 {
 	NeonDbSizeRequest req;
@@ -235,10 +269,42 @@ typedef struct
 extern void prefetch_on_ps_disconnect(void);
 
 extern page_server_api *page_server;
+extern page_server_api pageserver_direct_api;
+
+typedef enum
+{
+	PAGESERVER_TRANSPORT_DIRECT,
+	PAGESERVER_TRANSPORT_COMMUNICATOR,
+} PageserverTransport;
+
+typedef enum
+{
+	PS_CONNECT_DONE,
+	PS_CONNECT_IN_PROGRESS,
+	PS_CONNECT_FAILED,
+} PSConnectResult;
+
+extern pgsocket pageserver_socket(shardno_t shard_no, TimestampTz *connected_at);
+
+/* Used by the communicator forwarder process to forward queued requests */
+extern NeonRequestId pageserver_next_request_id(void);
+extern PSConnectResult pageserver_connect_nowait(shardno_t shard_no);
+extern pgsocket pageserver_connect_wait(shardno_t shard_no, uint32 *events,
+										TimestampTz *retry_at);
+extern bool pageserver_send_packed(shardno_t shard_no, const char *data, int len);
+extern bool pageserver_flush_packed(shardno_t shard_no);
+extern int	pageserver_try_receive_packed(shardno_t shard_no, char **buffer);
 
 extern char *pageserver_connstring;
 extern int	flush_every_n_requests;
 extern int	readahead_buffer_size;
+extern bool readahead_adaptive;
+extern int	shared_prefetch_size;
+extern int	stride_prefetch_distance;
+extern int	pageserver_transport;
+extern int	communicator_queue_depth;
+extern int	pageserver_response_log_timeout;
+extern int	pageserver_response_disconnect_timeout;
 extern char *neon_timeline;
 extern char *neon_tenant;
 extern int32 max_cluster_size;
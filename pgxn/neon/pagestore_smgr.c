@@ -103,6 +103,7 @@ static bool neon_redo_read_buffer_filter(XLogReaderState *record, uint8 block_id
 static bool (*old_redo_read_buffer_filter) (XLogReaderState *record, uint8 block_id) = NULL;
 
 static BlockNumber neon_nblocks(SMgrRelation reln, ForkNumber forknum);
+static void neon_flush_pending_extends(void);
 
 /*
  * Wrapper around log_newpage() that makes a temporary copy of the block and
@@ -868,6 +869,8 @@ neon_create(SMgrRelation reln, ForkNumber forkNum, bool isRedo)
 static void
 neon_unlink(NRelFileInfoBackend rinfo, ForkNumber forkNum, bool isRedo)
 {
+	neon_flush_pending_extends();
+
 	/*
 	 * Might or might not exist locally, depending on whether it's an unlogged
 	 * or permanent relation (or if debug_compare_local is set). Try to
@@ -880,6 +883,109 @@ neon_unlink(NRelFileInfoBackend rinfo, ForkNumber forkNum, bool isRedo)
 	}
 }
 
+/*
+ * Zero pages added by neon_extend() whose LFC write has been deferred, to
+ * write a run of consecutive extensions with one lfc_writev call.
+ *
+ * A block is only deferred if the LFC didn't hold it when the run was
+ * started: truncation leaves the old pages of a relation in the LFC, and
+ * the extension must overwrite them before anyone can read the new page
+ * from there. The last-written LSN is still updated right away, so readers
+ * that don't find the page in the LFC get it from the pageserver, and
+ * lfc_writev_unmodified() skips the blocks that were written again since.
+ *
+ * The run is written out when it's full, and before this backend reads,
+ * writes, prefetches, zero-extends, truncates, unlinks or syncs a neon
+ * relation. neon_nblocks() and neon_exists() don't flush it: they don't
+ * look at the pages in the LFC, and they are called in between the extends
+ * of a bulk extension, which would otherwise never get to defer more than
+ * one block.
+ */
+typedef struct
+{
+	NRelFileInfo rinfo;
+	ForkNumber	forknum;
+	BlockNumber blkno;			/* first deferred block */
+	int			nblocks;		/* number of deferred blocks */
+	int			capacity;		/* blocks known to be absent from the LFC */
+	XLogRecPtr	lsns[PG_IOV_MAX];	/* last-written LSN of each block */
+} PendingExtends;
+
+static PendingExtends pending_extends;
+static const PGAlignedBlock zero_page = {0};
+
+static void
+neon_flush_pending_extends(void)
+{
+	const void *buffers[PG_IOV_MAX];
+	int			nblocks = pending_extends.nblocks;
+
+	if (nblocks == 0)
+		return;
+
+	/* reset first, so that an error doesn't make us retry forever */
+	pending_extends.nblocks = 0;
+
+	for (int i = 0; i < nblocks; i++)
+		buffers[i] = zero_page.data;
+
+	lfc_writev_unmodified(pending_extends.rinfo, pending_extends.forknum,
+						  pending_extends.blkno, buffers,
+						  pending_extends.lsns, nblocks);
+}
+
+/*
+ * Try to defer the LFC write of a page added by neon_extend(). Returns false
+ * if the page must be written to the LFC now.
+ */
+static bool
+neon_defer_extend(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber blkno,
+				  const void *buffer, XLogRecPtr lsn)
+{
+	PendingExtends *pending = &pending_extends;
+
+	if (!PageIsNew((Page) buffer) || memcmp(buffer, zero_page.data, BLCKSZ) != 0)
+	{
+		neon_flush_pending_extends();
+		return false;
+	}
+
+	if (pending->nblocks > 0 &&
+		!(RelFileInfoEquals(pending->rinfo, rinfo) &&
+		  pending->forknum == forknum &&
+		  pending->blkno + pending->nblocks == blkno))
+		neon_flush_pending_extends();
+
+	if (pending->nblocks == 0)
+	{
+		bits8		lfc_present[PG_IOV_MAX / 8] = {0};
+		int			nblocks = (int) Min((BlockNumber) PG_IOV_MAX, MaxBlockNumber - blkno + 1);
+		int			capacity = 0;
+
+		if (lfc_cache_containsv(rinfo, forknum, blkno, nblocks, lfc_present) != 0)
+		{
+			while (capacity < nblocks && !BITMAP_ISSET(lfc_present, capacity))
+				capacity++;
+		}
+		else
+			capacity = nblocks;
+
+		if (capacity == 0)
+			return false;
+
+		pending->rinfo = rinfo;
+		pending->forknum = forknum;
+		pending->blkno = blkno;
+		pending->capacity = capacity;
+	}
+
+	pending->lsns[pending->nblocks++] = lsn;
+	if (pending->nblocks == pending->capacity)
+		neon_flush_pending_extends();
+
+	return true;
+}
+
 /*
  *	neon_extend() -- Add a block to the specified relation.
  *
@@ -964,14 +1070,6 @@ neon_extend(SMgrRelation reln, ForkNumber forkNum, BlockNumber blkno,
 		 forkNum, blkno,
 		 (uint32) (lsn >> 32), (uint32) lsn);
 
-	lfc_write(InfoFromSMgrRel(reln), forkNum, blkno, buffer);
-
-	if (debug_compare_local)
-	{
-		if (IS_LOCAL_REL(reln))
-			mdextend(reln, forkNum, blkno, buffer, skipFsync);
-	}
-
 	/*
 	 * smgr_extend is often called with an all-zeroes page, so
 	 * lsn==InvalidXLogRecPtr. An smgr_write() call will come for the buffer
@@ -984,6 +1082,16 @@ neon_extend(SMgrRelation reln, ForkNumber forkNum, BlockNumber blkno,
 		lsn = GetXLogInsertRecPtr();
 		neon_set_lwlsn_block(lsn, InfoFromSMgrRel(reln), forkNum, blkno);
 	}
+
+	if (!neon_defer_extend(InfoFromSMgrRel(reln), forkNum, blkno, buffer, lsn))
+		lfc_write(InfoFromSMgrRel(reln), forkNum, blkno, buffer);
+
+	if (debug_compare_local)
+	{
+		if (IS_LOCAL_REL(reln))
+			mdextend(reln, forkNum, blkno, buffer, skipFsync);
+	}
+
 	neon_set_lwlsn_relation(lsn, InfoFromSMgrRel(reln), forkNum);
 }
 
@@ -993,9 +1101,12 @@ neon_zeroextend(SMgrRelation reln, ForkNumber forkNum, BlockNumber blocknum,
 				int nblocks, bool skipFsync)
 {
 	const PGIOAlignedBlock buffer = {0};
+	const void *buffers[XLR_MAX_BLOCK_ID];
 	int			remblocks = nblocks;
 	XLogRecPtr	lsn = 0;
 
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:
@@ -1058,6 +1169,10 @@ neon_zeroextend(SMgrRelation reln, ForkNumber forkNum, BlockNumber blocknum,
 	/* ensure we have enough xlog buffers to log max-sized records */
 	XLogEnsureRecordSpace(Min(remblocks, (XLR_MAX_BLOCK_ID - 1)), 0);
 
+	/* every block of a batch is written to the LFC from the same zero page */
+	for (int i = 0; i < XLR_MAX_BLOCK_ID; i++)
+		buffers[i] = buffer.data;
+
 	/*
 	 * Iterate over all the pages. They are collected into batches of
 	 * XLR_MAX_BLOCK_ID pages, and a single WAL-record is written for each
@@ -1075,12 +1190,10 @@ neon_zeroextend(SMgrRelation reln, ForkNumber forkNum, BlockNumber blocknum,
 
 		lsn = XLogInsert(RM_XLOG_ID, XLOG_FPI);
 
-		for (int i = 0; i < count; i++)
-		{
-			lfc_write(InfoFromSMgrRel(reln), forkNum, blocknum + i, buffer.data);
-			neon_set_lwlsn_block(lsn, InfoFromSMgrRel(reln), forkNum,
-									  blocknum + i);
-		}
+		/* one pwritev per LFC chunk, as count <= XLR_MAX_BLOCK_ID <= PG_IOV_MAX */
+		lfc_writev(InfoFromSMgrRel(reln), forkNum, blocknum, buffers, count);
+		neon_set_lwlsn_block_range(lsn, InfoFromSMgrRel(reln), forkNum,
+								   blocknum, count);
 
 		blocknum += count;
 		remblocks -= count;
@@ -1135,6 +1248,8 @@ neon_prefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 {
 	BufferTag	tag;
 
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:					/* probably shouldn't happen, but ignore it */
@@ -1190,6 +1305,8 @@ neon_prefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum)
 {
 	BufferTag	tag;
 
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:					/* probably shouldn't happen, but ignore it */
@@ -1220,6 +1337,246 @@ neon_prefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum)
 }
 #endif /* PG_MAJORVERSION_NUM < 17 */
 
+/*
+ * Stride detection
+ *
+ * PostgreSQL only calls smgrprefetch() from the access paths that know which
+ * blocks they will need next, like sequential and bitmap heap scans. Other
+ * reads, e.g. the heap fetches of an index scan over a well-correlated index,
+ * or a backward scan, arrive one block at a time and each of them waits for a
+ * full round-trip to the pageserver. To help those, we remember the last
+ * reads of a few relation forks, and once several consecutive reads of a fork
+ * have followed the same stride, prefetch the blocks the stride predicts.
+ *
+ * A stride is either a contiguous forward or backward run of (possibly
+ * multi-block) reads, or a constant distance of up to STRIDE_MAX blocks
+ * between single-block reads.
+ */
+#define STRIDE_STREAMS		8
+#define STRIDE_MAX			64
+#define STRIDE_MIN_RUN		2
+
+typedef struct StrideStream
+{
+	bool		valid;
+	NRelFileInfo rinfo;
+	ForkNumber	forknum;
+	BlockNumber first;			/* first block of the last read */
+	BlockNumber last;			/* last block of the last read */
+	int32		stride;			/* distance between reads; 0 if unknown */
+	int			run;			/* number of consecutive reads that matched */
+	BlockNumber horizon;		/* furthest block prefetched for this stream */
+	uint64		last_used;
+} StrideStream;
+
+static StrideStream stride_streams[STRIDE_STREAMS];
+static uint64 stride_clock;
+
+/*
+ * Account the blocks that were prefetched for a stream but will not be read
+ * through it, because the stream was broken or evicted.
+ */
+static void
+stride_stream_forget(StrideStream *stream)
+{
+	BlockNumber pos;
+
+	if (stream->horizon != InvalidBlockNumber)
+	{
+		if (stream->stride > 0)
+		{
+			pos = stream->last;
+			if (stream->horizon > pos)
+				MyNeonCounters->getpage_stride_prefetch_waste_total +=
+					(stream->horizon - pos) / stream->stride;
+		}
+		else
+		{
+			pos = stream->first;
+			if (stream->horizon < pos)
+				MyNeonCounters->getpage_stride_prefetch_waste_total +=
+					(pos - stream->horizon) / -stream->stride;
+		}
+	}
+	stream->stride = 0;
+	stream->run = 0;
+	stream->horizon = InvalidBlockNumber;
+}
+
+/*
+ * Prefetch 'nblocks' consecutive blocks starting at 'blocknum', skipping the
+ * ones that are already in the LFC.
+ */
+static void
+stride_prefetch_range(NRelFileInfo rinfo, ForkNumber forknum,
+					  BlockNumber blocknum, BlockNumber nblocks)
+{
+	BufferTag	tag;
+
+	tag.forkNum = forknum;
+	CopyNRelFileInfoToBufTag(tag, rinfo);
+
+	while (nblocks > 0)
+	{
+		int			iterblocks = Min(nblocks, PG_IOV_MAX);
+		bits8		lfc_present[PG_IOV_MAX / 8] = {0};
+
+		if (lfc_cache_containsv(rinfo, forknum, blocknum,
+								iterblocks, lfc_present) != iterblocks)
+		{
+			tag.blockNum = blocknum;
+			communicator_prefetch_register_bufferv(tag, NULL, iterblocks, lfc_present);
+		}
+
+		nblocks -= iterblocks;
+		blocknum += iterblocks;
+	}
+}
+
+/*
+ * Feed a read of blocks [blocknum, blocknum + nblocks) to the stride
+ * detector, and prefetch the blocks predicted for its stream.
+ *
+ * This must be called after the blocks of the read itself have been looked
+ * up in the prefetch ring, as registering new prefetches may evict them.
+ */
+static void
+stride_detect(SMgrRelation reln, ForkNumber forknum,
+			  BlockNumber blocknum, BlockNumber nblocks)
+{
+	NRelFileInfo rinfo = InfoFromSMgrRel(reln);
+	StrideStream *stream = NULL;
+	BlockNumber last = blocknum + nblocks - 1;
+	BlockNumber pos;
+	BlockNumber relsize;
+	int32		stride;
+	int64		target;
+	int64		count;
+	int			window;
+
+	if (stride_prefetch_distance <= 0 || nblocks == 0)
+		return;
+
+	for (int i = 0; i < STRIDE_STREAMS; i++)
+	{
+		StrideStream *s = &stride_streams[i];
+
+		if (s->valid && s->forknum == forknum && RelFileInfoEquals(s->rinfo, rinfo))
+		{
+			stream = s;
+			break;
+		}
+		if (stream == NULL || !s->valid ||
+			(stream->valid && s->last_used < stream->last_used))
+			stream = s;
+	}
+
+	if (!stream->valid || stream->forknum != forknum ||
+		!RelFileInfoEquals(stream->rinfo, rinfo))
+	{
+		/* Start tracking a new stream, replacing the least recently used */
+		if (stream->valid)
+			stride_stream_forget(stream);
+		stream->valid = true;
+		stream->rinfo = rinfo;
+		stream->forknum = forknum;
+		stream->first = blocknum;
+		stream->last = last;
+		stream->stride = 0;
+		stream->run = 0;
+		stream->horizon = InvalidBlockNumber;
+		stream->last_used = ++stride_clock;
+		return;
+	}
+	stream->last_used = ++stride_clock;
+
+	if (blocknum == stream->last + 1)
+		stride = 1;
+	else if (last + 1 == stream->first)
+		stride = -1;
+	else if (nblocks == 1 && stream->first == stream->last &&
+			 (int64) blocknum - stream->first >= -STRIDE_MAX &&
+			 (int64) blocknum - stream->first <= STRIDE_MAX)
+		stride = (int32) ((int64) blocknum - stream->first);
+	else
+		stride = 0;
+
+	if (stride == 0 || stride != stream->stride)
+	{
+		stride_stream_forget(stream);
+		stream->stride = stride;
+		stream->run = stride != 0 ? 1 : 0;
+		stream->first = blocknum;
+		stream->last = last;
+		return;
+	}
+
+	/* The read followed the stride. Count the blocks we predicted for it. */
+	if (stream->horizon != InvalidBlockNumber)
+	{
+		if (stride > 0 && stream->horizon >= blocknum)
+			MyNeonCounters->getpage_stride_prefetch_hits_total +=
+				Min(last, stream->horizon) - blocknum + 1;
+		else if (stride < 0 && stream->horizon <= last)
+			MyNeonCounters->getpage_stride_prefetch_hits_total +=
+				last - Max(blocknum, stream->horizon) + 1;
+	}
+	stream->run++;
+	stream->first = blocknum;
+	stream->last = last;
+
+	if (stream->run < STRIDE_MIN_RUN)
+		return;
+
+	/*
+	 * Ramp the prefetch window up as the stream keeps following its stride,
+	 * so that a short run doesn't prefetch a lot of pages that are never
+	 * read.
+	 */
+	window = Min(stride_prefetch_distance,
+				 4 << Min(stream->run - STRIDE_MIN_RUN, 8));
+	window = Min(window, readahead_buffer_size);
+
+	pos = stride > 0 ? last : blocknum;
+	target = (int64) pos + (int64) stride * window;
+
+	if (stride > 0)
+	{
+		/* Don't prefetch past the end of the relation */
+		if (!get_cached_relsize(rinfo, forknum, &relsize) || relsize == 0)
+			return;
+		target = Min(target, (int64) relsize - 1);
+	}
+	else
+		target = Max(target, 0);
+
+	/* Continue from where the previous prefetches for the stream ended */
+	if (stream->horizon != InvalidBlockNumber &&
+		(stride > 0 ? stream->horizon > pos : stream->horizon < pos))
+		pos = stream->horizon;
+
+	/* Round down to the last block on the stride */
+	count = ((stride > 0) ? target - pos : pos - target) / (stride > 0 ? stride : -stride);
+	if (count <= 0)
+		return;
+	target = (int64) pos + (int64) stride * count;
+
+	if (stride == 1)
+		stride_prefetch_range(rinfo, forknum, pos + 1, (BlockNumber) (target - pos));
+	else if (stride == -1)
+		stride_prefetch_range(rinfo, forknum, (BlockNumber) target, (BlockNumber) (pos - target));
+	else
+	{
+		for (int64 blkno = (int64) pos + stride;
+			 stride > 0 ? blkno <= target : blkno >= target;
+			 blkno += stride)
+			stride_prefetch_range(rinfo, forknum, (BlockNumber) blkno, 1);
+	}
+
+	MyNeonCounters->getpage_stride_prefetches_total += count;
+	stream->horizon = (BlockNumber) target;
+}
+
 
 /*
  * neon_writeback() -- Tell the kernel to write pages back to storage.
@@ -1377,6 +1734,9 @@ neon_read(SMgrRelation reln, ForkNumber forkNum, BlockNumber blkno, void *buffer
 	neon_request_lsns request_lsns;
 	bits8		present;
 	void	   *bufferp;
+	bool		prefetch_hit;
+
+	neon_flush_pending_extends();
 
 	switch (reln->smgr_relpersistence)
 	{
@@ -1408,7 +1768,11 @@ neon_read(SMgrRelation reln, ForkNumber forkNum, BlockNumber blkno, void *buffer
 
 	present = 0;
 	bufferp = buffer;
-	if (communicator_prefetch_lookupv(InfoFromSMgrRel(reln), forkNum, blkno, &request_lsns, 1, &bufferp, &present))
+	prefetch_hit = communicator_prefetch_lookupv(InfoFromSMgrRel(reln), forkNum, blkno, &request_lsns, 1, &bufferp, &present);
+
+	stride_detect(reln, forkNum, blkno, 1);
+
+	if (prefetch_hit)
 	{
 		/* Prefetch hit */
 		if (debug_compare_local >= DEBUG_COMPARE_LOCAL_PREFETCH)
@@ -1476,6 +1840,8 @@ neon_readv(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 	int			lfc_result;
 	int			prefetch_result;
 
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:
@@ -1515,6 +1881,8 @@ neon_readv(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 													blocknum, request_lsns, nblocks,
 													buffers, read_pages);
 
+	stride_detect(reln, forknum, blocknum, nblocks);
+
 	if (debug_compare_local >= DEBUG_COMPARE_LOCAL_PREFETCH)
 	{
 		compare_with_localv(reln, forknum, blocknum, buffers, nblocks, request_lsns, read_pages);
@@ -1602,6 +1970,8 @@ neon_write(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum, const vo
 {
 	XLogRecPtr	lsn;
 
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:
@@ -1682,6 +2052,8 @@ static void
 neon_writev(SMgrRelation reln, ForkNumber forknum, BlockNumber blkno,
 			 const void **buffers, BlockNumber nblocks, bool skipFsync)
 {
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:
@@ -1815,6 +2187,8 @@ neon_truncate(SMgrRelation reln, ForkNumber forknum, BlockNumber old_blocks, Blo
 {
 	XLogRecPtr	lsn;
 
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:
@@ -1888,6 +2262,8 @@ neon_truncate(SMgrRelation reln, ForkNumber forknum, BlockNumber old_blocks, Blo
 static void
 neon_immedsync(SMgrRelation reln, ForkNumber forknum)
 {
+	neon_flush_pending_extends();
+
 	switch (reln->smgr_relpersistence)
 	{
 		case 0:
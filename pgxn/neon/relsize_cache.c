@@ -3,6 +3,19 @@
  * relsize_cache.c
  *      Relation size cache for better zentih performance.
  *
+ * The cache is a set-associative table: each relation fork maps to one set
+ * of RELSIZE_WAYS entries, chosen by the hash of its tag. Lookups are much
+ * more frequent than changes (smgrnblocks() is called at the start of every
+ * scan, for every extension and in many index operations), so they don't
+ * lock at all. Each set has a change counter, which is odd while the set is
+ * being modified; a reader copies the entry between two reads of the counter,
+ * and retries if it changed. Writers make the counter odd with
+ * compare-and-swap, so writers of different sets never contend.
+ *
+ * Instead of an LRU list, which every hit would have to relink, each entry
+ * has a "referenced" bit that hits set without locking. When a set is full,
+ * the writer replaces an entry with the clock algorithm within the set.
+ *
  * Portions Copyright (c) 1996-2021, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -11,19 +24,23 @@
 #include "postgres.h"
 
 #include "neon.h"
+#include "neon_perf_counters.h"
 #include "neon_pgversioncompat.h"
 
 #include "miscadmin.h"
 #include "pagestore_client.h"
 #include RELFILEINFO_HDR
+#include "common/hashfn.h"
+#include "port/atomics.h"
 #include "storage/smgr.h"
-#include "storage/lwlock.h"
 #include "storage/ipc.h"
+#include "storage/s_lock.h"
 #include "storage/shmem.h"
 #include "catalog/pg_tablespace_d.h"
-#include "utils/dynahash.h"
 #include "utils/guc.h"
 
+#define RELSIZE_WAYS	8
+
 typedef struct
 {
 	NRelFileInfo rinfo;
@@ -34,52 +51,162 @@ typedef struct
 {
 	RelTag		tag;
 	BlockNumber size;
-	dlist_node	lru_node;		/* LRU list node */
+	bool		used;
+	bool		referenced;		/* set on every hit, without locking */
 } RelSizeEntry;
 
 typedef struct
 {
-	size_t      size;
-	uint64		hits;
-	uint64		misses;
-	uint64		writes;
-	dlist_head	lru;			/* double linked list for LRU replacement
-								 * algorithm */
+	pg_atomic_uint32 changecount;
+	uint32		clock_hand;
+	RelSizeEntry entries[RELSIZE_WAYS];
+} RelSizeSet;
+
+typedef struct
+{
+	uint32		nsets;
+	RelSizeSet	sets[FLEXIBLE_ARRAY_MEMBER];
 } RelSizeHashControl;
 
 /*
- * Size of a cache entry is 36 bytes. So this default will take about 2.3 MB,
+ * Size of a cache entry is 24 bytes. So this default will take about 1.6 MB,
  * which seems reasonable.
  */
 #define DEFAULT_RELSIZE_HASH_SIZE (64 * 1024)
 
-static HTAB *relsize_hash;
-static LWLockId relsize_lock;
 static int	relsize_hash_size = DEFAULT_RELSIZE_HASH_SIZE;
 static RelSizeHashControl* relsize_ctl;
 
+static uint32
+relsize_num_sets(void)
+{
+	return ((uint32) relsize_hash_size + RELSIZE_WAYS - 1) / RELSIZE_WAYS;
+}
+
+static Size
+relsize_shmem_size(void)
+{
+	return add_size(offsetof(RelSizeHashControl, sets),
+					mul_size(relsize_num_sets(), sizeof(RelSizeSet)));
+}
+
 void
 RelsizeCacheShmemInit(void)
 {
-	static HASHCTL info;
 	bool found;
 
-	relsize_ctl = (RelSizeHashControl *) ShmemInitStruct("relsize_hash", sizeof(RelSizeHashControl), &found);
+	relsize_ctl = (RelSizeHashControl *) ShmemInitStruct("relsize_hash", relsize_shmem_size(), &found);
 	if (!found)
 	{
-		relsize_lock = (LWLockId) GetNamedLWLockTranche("neon_relsize");
-		info.keysize = sizeof(RelTag);
-		info.entrysize = sizeof(RelSizeEntry);
-		relsize_hash = ShmemInitHash("neon_relsize",
-									 relsize_hash_size, relsize_hash_size,
-									 &info,
-									 HASH_ELEM | HASH_BLOBS);
-		relsize_ctl->size = 0;
-		relsize_ctl->hits = 0;
-		relsize_ctl->misses = 0;
-		relsize_ctl->writes = 0;
-		dlist_init(&relsize_ctl->lru);
+		relsize_ctl->nsets = relsize_num_sets();
+		for (uint32 i = 0; i < relsize_ctl->nsets; i++)
+		{
+			RelSizeSet *set = &relsize_ctl->sets[i];
+
+			pg_atomic_init_u32(&set->changecount, 0);
+			set->clock_hand = 0;
+			MemSet(set->entries, 0, sizeof(set->entries));
+		}
+	}
+}
+
+static inline void
+relsize_make_tag(RelTag *tag, NRelFileInfo rinfo, ForkNumber forknum)
+{
+	/* clear any padding, the tag is compared and hashed as bytes */
+	MemSet(tag, 0, sizeof(RelTag));
+	tag->rinfo = rinfo;
+	tag->forknum = forknum;
+}
+
+static inline RelSizeSet *
+relsize_set_for(const RelTag *tag)
+{
+	uint32		hash = hash_bytes((const unsigned char *) tag, sizeof(RelTag));
+
+	return &relsize_ctl->sets[hash % relsize_ctl->nsets];
+}
+
+/*
+ * Lock a set for modification, by making its change counter odd.
+ */
+static void
+relsize_lock_set(RelSizeSet *set)
+{
+	SpinDelayStatus delay;
+
+	init_local_spin_delay(&delay);
+	for (;;)
+	{
+		uint32		count = pg_atomic_read_u32(&set->changecount);
+
+		if ((count & 1) == 0 &&
+			pg_atomic_compare_exchange_u32(&set->changecount, &count, count + 1))
+			break;
+		MyNeonCounters->relsize_cache_contention_total++;
+		perform_spin_delay(&delay);
 	}
+	finish_spin_delay(&delay);
+}
+
+static void
+relsize_unlock_set(RelSizeSet *set)
+{
+	/* pg_atomic_fetch_add_u32() is a full barrier */
+	pg_atomic_fetch_add_u32(&set->changecount, 1);
+}
+
+static inline RelSizeEntry *
+relsize_find(RelSizeSet *set, const RelTag *tag)
+{
+	for (int i = 0; i < RELSIZE_WAYS; i++)
+	{
+		RelSizeEntry *entry = &set->entries[i];
+
+		if (entry->used && memcmp(&entry->tag, tag, sizeof(RelTag)) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Find the entry for a tag in a locked set, or take one for it: an unused
+ * entry if there is one, otherwise the next one the clock hand finds that
+ * wasn't referenced since the hand last passed it.
+ */
+static RelSizeEntry *
+relsize_enter(RelSizeSet *set, const RelTag *tag, bool *found)
+{
+	RelSizeEntry *entry = relsize_find(set, tag);
+
+	*found = (entry != NULL);
+	if (entry != NULL)
+		return entry;
+
+	for (int i = 0; i < RELSIZE_WAYS; i++)
+	{
+		if (!set->entries[i].used)
+		{
+			entry = &set->entries[i];
+			break;
+		}
+	}
+
+	while (entry == NULL)
+	{
+		RelSizeEntry *candidate = &set->entries[set->clock_hand];
+
+		set->clock_hand = (set->clock_hand + 1) % RELSIZE_WAYS;
+		if (candidate->referenced)
+			candidate->referenced = false;
+		else
+			entry = candidate;
+	}
+
+	entry->tag = *tag;
+	entry->used = true;
+	entry->referenced = true;
+	return entry;
 }
 
 bool
@@ -90,27 +217,50 @@ get_cached_relsize(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber *size)
 	if (relsize_hash_size > 0)
 	{
 		RelTag		tag;
-		RelSizeEntry *entry;
+		RelSizeSet *set;
+		RelSizeEntry *entry = NULL;
+		BlockNumber cached_size = InvalidBlockNumber;
+		SpinDelayStatus delay;
+
+		relsize_make_tag(&tag, rinfo, forknum);
+		set = relsize_set_for(&tag);
+
+		init_local_spin_delay(&delay);
+		for (;;)
+		{
+			uint32		before = pg_atomic_read_u32(&set->changecount);
+
+			if ((before & 1) == 0)
+			{
+				pg_read_barrier();
+
+				entry = relsize_find(set, &tag);
+				if (entry != NULL)
+					cached_size = entry->size;
+
+				pg_read_barrier();
+				if (pg_atomic_read_u32(&set->changecount) == before)
+					break;
+			}
+			MyNeonCounters->relsize_cache_contention_total++;
+			perform_spin_delay(&delay);
+		}
+		finish_spin_delay(&delay);
 
-		tag.rinfo = rinfo;
-		tag.forknum = forknum;
-		/* We need exclusive lock here because of LRU list manipulation */
-		LWLockAcquire(relsize_lock, LW_EXCLUSIVE);
-		entry = hash_search(relsize_hash, &tag, HASH_FIND, NULL);
 		if (entry != NULL)
 		{
-			*size = entry->size;
-			relsize_ctl->hits += 1;
+			/*
+			 * The entry may have been replaced since, in which case we only
+			 * protect another relation from replacement for a while.
+			 */
+			if (!entry->referenced)
+				entry->referenced = true;
+			MyNeonCounters->relsize_cache_hits_total++;
+			*size = cached_size;
 			found = true;
-			/* Move entry to the LRU list tail */
-			dlist_delete(&entry->lru_node);
-			dlist_push_tail(&relsize_ctl->lru, &entry->lru_node);
 		}
 		else
-		{
-			relsize_ctl->misses += 1;
-		}
-		LWLockRelease(relsize_lock);
+			MyNeonCounters->relsize_cache_misses_total++;
 	}
 	return found;
 }
@@ -121,45 +271,17 @@ set_cached_relsize(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber size)
 	if (relsize_hash_size > 0)
 	{
 		RelTag		tag;
+		RelSizeSet *set;
 		RelSizeEntry *entry;
-		bool		found = false;
-
-		tag.rinfo = rinfo;
-		tag.forknum = forknum;
-		LWLockAcquire(relsize_lock, LW_EXCLUSIVE);
-		/*
-		 * This should actually never happen! Below we check if hash is full and delete least recently user item in this case.
-		 * But for further safety we also perform check here.
-		 */
-		while ((entry = hash_search(relsize_hash, &tag, HASH_ENTER_NULL, &found)) == NULL)
-		{
-			RelSizeEntry *victim = dlist_container(RelSizeEntry, lru_node, dlist_pop_head_node(&relsize_ctl->lru));
-			hash_search(relsize_hash, &victim->tag, HASH_REMOVE, NULL);
-			Assert(relsize_ctl->size > 0);
-			relsize_ctl->size -= 1;
-		}
+		bool		found;
+
+		relsize_make_tag(&tag, rinfo, forknum);
+		set = relsize_set_for(&tag);
+
+		relsize_lock_set(set);
+		entry = relsize_enter(set, &tag, &found);
 		entry->size = size;
-		if (!found)
-		{
-			if (++relsize_ctl->size == relsize_hash_size)
-			{
-				/*
-				 * Remove least recently used elment from the hash.
-				 * Hash size after is becomes `relsize_hash_size-1`.
-				 * But it is not considered to be a problem, because size of this hash is expecrted large enough and +-1 doesn't matter.
-				 */
-				RelSizeEntry *victim = dlist_container(RelSizeEntry, lru_node, dlist_pop_head_node(&relsize_ctl->lru));
-				hash_search(relsize_hash, &victim->tag, HASH_REMOVE, NULL);
-				relsize_ctl->size -= 1;
-			}
-		}
-		else
-		{
-			dlist_delete(&entry->lru_node);
-		}
-		dlist_push_tail(&relsize_ctl->lru, &entry->lru_node);
-		relsize_ctl->writes += 1;
-		LWLockRelease(relsize_lock);
+		relsize_unlock_set(set);
 	}
 }
 
@@ -169,31 +291,18 @@ update_cached_relsize(NRelFileInfo rinfo, ForkNumber forknum, BlockNumber size)
 	if (relsize_hash_size > 0)
 	{
 		RelTag		tag;
+		RelSizeSet *set;
 		RelSizeEntry *entry;
 		bool		found;
 
-		tag.rinfo = rinfo;
-		tag.forknum = forknum;
-		LWLockAcquire(relsize_lock, LW_EXCLUSIVE);
-		entry = hash_search(relsize_hash, &tag, HASH_ENTER, &found);
+		relsize_make_tag(&tag, rinfo, forknum);
+		set = relsize_set_for(&tag);
+
+		relsize_lock_set(set);
+		entry = relsize_enter(set, &tag, &found);
 		if (!found || entry->size < size)
 			entry->size = size;
-		if (!found)
-		{
-			if (++relsize_ctl->size == relsize_hash_size)
-			{
-				RelSizeEntry *victim = dlist_container(RelSizeEntry, lru_node, dlist_pop_head_node(&relsize_ctl->lru));
-				hash_search(relsize_hash, &victim->tag, HASH_REMOVE, NULL);
-				relsize_ctl->size -= 1;
-			}
-		}
-		else
-		{
-			dlist_delete(&entry->lru_node);
-		}
-		relsize_ctl->writes += 1;
-		dlist_push_tail(&relsize_ctl->lru, &entry->lru_node);
-		LWLockRelease(relsize_lock);
+		relsize_unlock_set(set);
 	}
 }
 
@@ -203,17 +312,20 @@ forget_cached_relsize(NRelFileInfo rinfo, ForkNumber forknum)
 	if (relsize_hash_size > 0)
 	{
 		RelTag		tag;
+		RelSizeSet *set;
 		RelSizeEntry *entry;
-		tag.rinfo = rinfo;
-		tag.forknum = forknum;
-		LWLockAcquire(relsize_lock, LW_EXCLUSIVE);
-		entry = hash_search(relsize_hash, &tag, HASH_REMOVE, NULL);
+
+		relsize_make_tag(&tag, rinfo, forknum);
+		set = relsize_set_for(&tag);
+
+		relsize_lock_set(set);
+		entry = relsize_find(set, &tag);
 		if (entry)
 		{
-			dlist_delete(&entry->lru_node);
-			relsize_ctl->size -= 1;
+			entry->used = false;
+			entry->referenced = false;
 		}
-		LWLockRelease(relsize_lock);
+		relsize_unlock_set(set);
 	}
 }
 
@@ -239,6 +351,5 @@ relsize_hash_init(void)
 void
 RelsizeCacheShmemRequest(void)
 {
-	RequestAddinShmemSpace(sizeof(RelSizeHashControl) + hash_estimate_size(relsize_hash_size, sizeof(RelSizeEntry)));
-	RequestNamedLWLockTranche("neon_relsize", 1);
+	RequestAddinShmemSpace(relsize_shmem_size());
 }
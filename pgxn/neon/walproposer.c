@@ -68,6 +68,8 @@ static void SendMessageToNode(Safekeeper *sk);
 static void BroadcastAppendRequest(WalProposer *wp);
 static void HandleActiveState(Safekeeper *sk, uint32 events);
 static bool SendAppendRequests(Safekeeper *sk);
+static WalChunk *WalChunkAcquire(WalProposer *wp, XLogRecPtr beginLsn, XLogRecPtr endLsn, bool reuse);
+static void WalChunkRelease(Safekeeper *sk);
 static bool RecvAppendResponses(Safekeeper *sk);
 static XLogRecPtr CalculateMinFlushLsn(WalProposer *wp);
 static XLogRecPtr GetAcknowledgedByQuorumWALPosition(WalProposer *wp);
@@ -180,6 +182,10 @@ WalProposerCreate(WalProposerConfig *config, walproposer_api api)
 	}
 	wp->quorum = wp->n_safekeepers / 2 + 1;
 
+	wp->n_wal_chunks = wp->n_safekeepers * 2;
+	for (int i = 0; i < wp->n_wal_chunks; i++)
+		wp->walChunks[i].buf = palloc(WAL_CHUNK_HDR_RESERVE + MAX_SEND_SIZE);
+
 	if (wp->config->proto_version != 2 && wp->config->proto_version != 3)
 		wp_log(FATAL, "unsupported safekeeper protocol version %d", wp->config->proto_version);
 	if (wp->safekeepers_generation > INVALID_GENERATION && wp->config->proto_version < 3)
@@ -222,6 +228,8 @@ WalProposerFree(WalProposer *wp)
 			pfree(sk->voteResponse.termHistory.entries);
 		sk->voteResponse.termHistory.entries = NULL;
 	}
+	for (int i = 0; i < wp->n_wal_chunks; i++)
+		pfree(wp->walChunks[i].buf);
 	if (wp->propTermHistory.entries != NULL)
 		pfree(wp->propTermHistory.entries);
 	wp->propTermHistory.entries = NULL;
@@ -360,6 +368,7 @@ ShutdownConnection(Safekeeper *sk)
 {
 	sk->state = SS_OFFLINE;
 	sk->streamingAt = InvalidXLogRecPtr;
+	WalChunkRelease(sk);
 
 	/* BEGIN_HADRON */
 	sk->wp->api.update_safekeeper_status_for_metrics(sk->wp, sk->index, 0);
@@ -1682,6 +1691,24 @@ SendAppendRequests(Safekeeper *sk)
 				endLsn = wp->availableLsn;
 			}
 
+			/*
+			 * Send the WAL from a chunk shared with the other safekeepers.
+			 * If another safekeeper has already read WAL starting here, this
+			 * sends as much as that chunk holds.
+			 *
+			 * While the WAL reader streams WAL from a donor safekeeper, it can
+			 * only read forward from where it left off, so then the reader
+			 * must read every chunk we send itself. Other safekeepers can
+			 * still reuse the chunks it reads.
+			 */
+			if (endLsn > sk->streamingAt)
+			{
+				bool		reuse = wp->api.wal_reader_events(sk) == 0;
+
+				sk->walChunk = WalChunkAcquire(wp, sk->streamingAt, endLsn, reuse);
+				endLsn = sk->walChunk->endLsn;
+			}
+
 			req = &sk->appendRequest;
 			PrepareAppendRequest(sk->wp, &sk->appendRequest, sk->streamingAt, endLsn);
 
@@ -1696,8 +1723,6 @@ SendAppendRequests(Safekeeper *sk)
 
 			/* write AppendRequest header */
 			PAMessageSerialize(wp, (ProposerAcceptorMessage *) req, &sk->outbuf, wp->config->proto_version);
-			/* prepare for reading WAL into the outbuf */
-			enlargeStringInfo(&sk->outbuf, req->endLsn - req->beginLsn);
 			sk->active_state = SS_ACTIVE_READ_WAL;
 		}
 
@@ -1713,15 +1738,16 @@ SendAppendRequests(Safekeeper *sk)
 			 * We send zero sized AppenRequests as heartbeats; don't wal_read
 			 * for these.
 			 */
-			if (req_len > 0)
+			if (req_len > 0 && !sk->walChunk->filled)
 			{
 				switch (wp->api.wal_read(sk,
-										 &sk->outbuf.data[sk->outbuf.len],
+										 sk->walChunk->buf + WAL_CHUNK_HDR_RESERVE,
 										 req->beginLsn,
 										 req_len,
 										 &errmsg))
 				{
 					case NEON_WALREAD_SUCCESS:
+						sk->walChunk->filled = true;
 						break;
 					case NEON_WALREAD_WOULDBLOCK:
 						return true;
@@ -1735,9 +1761,31 @@ SendAppendRequests(Safekeeper *sk)
 				}
 			}
 
-			sk->outbuf.len += req_len;
+			if (req_len > 0 && sk->outbuf.len <= WAL_CHUNK_HDR_RESERVE)
+			{
+				/*
+				 * Put the header right in front of the WAL in the chunk, to
+				 * send both as one message. The write copies the message out
+				 * before returning, so the next safekeeper sending from the
+				 * chunk is free to overwrite the header with its own.
+				 */
+				char	   *msg = sk->walChunk->buf + WAL_CHUNK_HDR_RESERVE - sk->outbuf.len;
 
-			writeResult = wp->api.conn_async_write(sk, sk->outbuf.data, sk->outbuf.len);
+				memcpy(msg, sk->outbuf.data, sk->outbuf.len);
+				writeResult = wp->api.conn_async_write(sk, msg, sk->outbuf.len + req_len);
+				WalChunkRelease(sk);
+			}
+			else if (req_len > 0)
+			{
+				/* The header doesn't fit in the room reserved for it, copy */
+				appendBinaryStringInfo(&sk->outbuf,
+									   sk->walChunk->buf + WAL_CHUNK_HDR_RESERVE,
+									   req_len);
+				WalChunkRelease(sk);
+				writeResult = wp->api.conn_async_write(sk, sk->outbuf.data, sk->outbuf.len);
+			}
+			else
+				writeResult = wp->api.conn_async_write(sk, sk->outbuf.data, sk->outbuf.len);
 
 			/* Mark current message as sent, whatever the result is */
 			sk->streamingAt = req->endLsn;
@@ -1775,6 +1823,62 @@ SendAppendRequests(Safekeeper *sk)
 	return true;
 }
 
+/*
+ * Get a chunk for sending WAL from beginLsn up to at most endLsn, and take a
+ * reference to it.
+ *
+ * If 'reuse' is set and a chunk with WAL starting at beginLsn has already
+ * been read, it's returned as is, even if it ends before endLsn. Otherwise, an
+ * unreferenced chunk with the lowest LSN is recycled for the range, and the
+ * caller is responsible for reading the WAL into it. The new range is cut
+ * short at the beginning of the next chunk already read, so that the chunk
+ * can be reused after this one.
+ */
+static WalChunk *
+WalChunkAcquire(WalProposer *wp, XLogRecPtr beginLsn, XLogRecPtr endLsn, bool reuse)
+{
+	WalChunk   *victim = NULL;
+
+	for (int i = 0; i < wp->n_wal_chunks; i++)
+	{
+		WalChunk   *chunk = &wp->walChunks[i];
+
+		if (reuse && chunk->filled && chunk->beginLsn == beginLsn)
+		{
+			chunk->refcnt++;
+			return chunk;
+		}
+		if (chunk->filled && chunk->beginLsn > beginLsn && chunk->beginLsn < endLsn)
+			endLsn = chunk->beginLsn;
+		if (chunk->refcnt == 0 && (victim == NULL || chunk->beginLsn < victim->beginLsn))
+			victim = chunk;
+	}
+
+	/* each safekeeper holds at most one reference */
+	Assert(victim != NULL);
+
+	victim->beginLsn = beginLsn;
+	victim->endLsn = endLsn;
+	victim->filled = false;
+	victim->refcnt = 1;
+
+	return victim;
+}
+
+/*
+ * Drop the reference of the safekeeper to its WAL chunk, if any.
+ */
+static void
+WalChunkRelease(Safekeeper *sk)
+{
+	if (sk->walChunk == NULL)
+		return;
+
+	Assert(sk->walChunk->refcnt > 0);
+	sk->walChunk->refcnt--;
+	sk->walChunk = NULL;
+}
+
 /*
  * Receive and process all available feedback.
  *
@@ -6,6 +6,7 @@
 #include "access/xlog_internal.h"
 #include "nodes/replnodes.h"
 #include "replication/walreceiver.h"
+#include "storage/condition_variable.h"
 #include "utils/uuid.h"
 
 #include "libpqwalproposer.h"
@@ -421,6 +422,16 @@ typedef struct WalproposerShmemState
 	pg_atomic_uint64 backpressureThrottlingTime;
 	pg_atomic_uint64 currentClusterSize;
 
+	/*
+	 * Backends throttled by backpressure sleep on backpressureCV, and the
+	 * walproposer wakes them up as the pageserver feedback reduces the lag.
+	 * backpressureBudget is how many bytes of WAL the woken backends may
+	 * still write while the lag is above the limit.
+	 */
+	ConditionVariable backpressureCV;
+	pg_atomic_uint32 backpressureWaiters;
+	pg_atomic_uint64 backpressureBudget;
+
 	/* last feedback from each shard */
 	PageserverFeedback shard_ps_feedback[MAX_SHARDS];
 	int			num_shards;
@@ -477,6 +488,28 @@ typedef struct AppendResponse
 struct WalProposer;
 typedef struct WalProposer WalProposer;
 
+/*
+ * Room reserved in front of the WAL in a WalChunk for the AppendRequest
+ * header, so that the header and the WAL can be sent as one message without
+ * copying the WAL.
+ */
+#define WAL_CHUNK_HDR_RESERVE 128
+
+/*
+ * Chunk of WAL read for AppendRequests. Safekeepers that stream the same
+ * range of WAL send it from the same chunk, so it is read from disk (or
+ * fetched from a safekeeper) only once.
+ */
+typedef struct WalChunk
+{
+	XLogRecPtr	beginLsn;
+	XLogRecPtr	endLsn;
+	bool		filled;			/* WAL between beginLsn and endLsn is read */
+	int			refcnt;			/* number of safekeepers sending from here */
+	/* WAL_CHUNK_HDR_RESERVE bytes, followed by up to MAX_SEND_SIZE of WAL */
+	char	   *buf;
+} WalChunk;
+
 /*
  * Descriptor of safekeeper
  */
@@ -511,6 +544,7 @@ typedef struct Safekeeper
 
 	XLogRecPtr	streamingAt;	/* current streaming position */
 	AppendRequestHeader appendRequest;	/* request for sending to safekeeper */
+	WalChunk   *walChunk;		/* WAL of appendRequest, if it has any */
 
 	SafekeeperState state;		/* safekeeper state machine state */
 	SafekeeperActiveState active_state;
@@ -870,6 +904,15 @@ typedef struct WalProposer
 	/* Safekeepers walproposer is connecting to. */
 	Safekeeper	safekeeper[MAX_SAFEKEEPERS];
 
+	/*
+	 * WAL chunks shared by the safekeepers. Each safekeeper references at
+	 * most one chunk at a time, so having twice as many chunks as
+	 * safekeepers leaves room to keep the WAL that lagging safekeepers still
+	 * need to send.
+	 */
+	int			n_wal_chunks;
+	WalChunk	walChunks[MAX_SAFEKEEPERS * 2];
+
 	/* Current local TimeLineId in use */
 	TimeLineID	localTimeLineID;
 
@@ -594,6 +594,9 @@ WalproposerShmemInit(void)
 		pg_atomic_init_u64(&walprop_shared->mineLastElectedTerm, 0);
 		pg_atomic_init_u64(&walprop_shared->backpressureThrottlingTime, 0);
 		pg_atomic_init_u64(&walprop_shared->currentClusterSize, 0);
+		ConditionVariableInit(&walprop_shared->backpressureCV);
+		pg_atomic_init_u32(&walprop_shared->backpressureWaiters, 0);
+		pg_atomic_init_u64(&walprop_shared->backpressureBudget, 0);
 		/* BEGIN_HADRON */
 		pg_atomic_init_u32(&walprop_shared->wal_rate_limiter.effective_max_wal_bytes_per_second, -1);
 		pg_atomic_init_u32(&walprop_shared->wal_rate_limiter.should_limit, 0);
@@ -612,6 +615,9 @@ WalproposerShmemInit_SyncSafekeeper(void)
 	pg_atomic_init_u64(&walprop_shared->propEpochStartLsn, 0);
 	pg_atomic_init_u64(&walprop_shared->mineLastElectedTerm, 0);
 	pg_atomic_init_u64(&walprop_shared->backpressureThrottlingTime, 0);
+	ConditionVariableInit(&walprop_shared->backpressureCV);
+	pg_atomic_init_u32(&walprop_shared->backpressureWaiters, 0);
+	pg_atomic_init_u64(&walprop_shared->backpressureBudget, 0);
 	/* BEGIN_HADRON */
 	pg_atomic_init_u32(&walprop_shared->wal_rate_limiter.effective_max_wal_bytes_per_second, -1);
 	pg_atomic_init_u32(&walprop_shared->wal_rate_limiter.should_limit, 0);
@@ -620,7 +626,54 @@ WalproposerShmemInit_SyncSafekeeper(void)
 	/* END_HADRON */
 }
 
-#define BACK_PRESSURE_DELAY 10000L // 0.01 sec
+/*
+ * Throttled backends are normally woken up by the walproposer when the lag
+ * goes down, see backpressure_release_waiters(). The timeouts only bound the
+ * wait in case no feedback arrives. When the WAL rate limiter throttles,
+ * there's no event to wait for, so wait for the short delay.
+ */
+#define BACK_PRESSURE_MAX_WAIT 100		/* ms */
+#define BACK_PRESSURE_DELAY 10			/* ms */
+
+/* How much WAL a backend let through backpressure may write, at most */
+#define BACK_PRESSURE_ADMIT_BYTES (64 * 1024)
+
+static bool in_backpressure_wait = false;
+
+/* WAL position up to which this backend may write despite the lag */
+static XLogRecPtr backpressure_admitted_until = InvalidXLogRecPtr;
+
+/*
+ * While the lag is above the limit, a throttled backend may still go on,
+ * if it can claim a share of the headroom that the last pageserver feedback
+ * freed up, see backpressure_release_waiters(). The share is used up once
+ * that much WAL has been inserted, by any backend, so the backends let
+ * through don't write more WAL than the lag went down by.
+ */
+static bool
+backpressure_admit(void)
+{
+	XLogRecPtr	insert_lsn = GetXLogInsertRecPtr();
+	uint64		budget;
+
+	if (insert_lsn < backpressure_admitted_until)
+		return true;
+
+	budget = pg_atomic_read_u64(&walprop_shared->backpressureBudget);
+	while (budget > 0)
+	{
+		uint64		share = Min(budget, BACK_PRESSURE_ADMIT_BYTES);
+
+		if (pg_atomic_compare_exchange_u64(&walprop_shared->backpressureBudget,
+										   &budget, budget - share))
+		{
+			backpressure_admitted_until = insert_lsn + share;
+			MyNeonCounters->backpressure_admissions_total++;
+			return true;
+		}
+	}
+	return false;
+}
 
 static bool
 backpressure_throttling_impl(void)
@@ -632,10 +685,15 @@ backpressure_throttling_impl(void)
 	char	   *new_status = NULL;
 	const char *old_status;
 	int			len;
+	long		timeout;
 
 	if (PointerIsValid(PrevProcessInterruptsCallback))
 		retry = PrevProcessInterruptsCallback();
 
+	/* The condition variable sleep below processes interrupts */
+	if (in_backpressure_wait)
+		return retry;
+
 	/*
 	 * Don't throttle read only transactions or wal sender. Do throttle CREATE
 	 * INDEX CONCURRENTLY, however. It performs some stages outside a
@@ -652,6 +710,11 @@ backpressure_throttling_impl(void)
 	if (lag == 0)
 		return retry;
 
+	/* The headroom is only for replication lag, not for the rate limiter */
+	if (!pg_atomic_read_u32(&walprop_shared->wal_rate_limiter.should_limit) &&
+		backpressure_admit())
+		return retry;
+
 	old_status = get_ps_display(&len);
 	new_status = (char *) palloc(len + 64 + 1);
 	memcpy(new_status, old_status, len);
@@ -661,10 +724,29 @@ backpressure_throttling_impl(void)
 								 * reset the ps */
 
 	elog(DEBUG2, "backpressure throttling: lag %lu", lag);
+	timeout = pg_atomic_read_u32(&walprop_shared->wal_rate_limiter.should_limit) ?
+		BACK_PRESSURE_DELAY : BACK_PRESSURE_MAX_WAIT;
 	start = GetCurrentTimestamp();
-	pg_usleep(BACK_PRESSURE_DELAY);
+
+	in_backpressure_wait = true;
+	pg_atomic_fetch_add_u32(&walprop_shared->backpressureWaiters, 1);
+	PG_TRY();
+	{
+		ConditionVariablePrepareToSleep(&walprop_shared->backpressureCV);
+		(void) ConditionVariableTimedSleep(&walprop_shared->backpressureCV, timeout,
+										   PG_WAIT_EXTENSION);
+		ConditionVariableCancelSleep();
+	}
+	PG_FINALLY();
+	{
+		pg_atomic_fetch_sub_u32(&walprop_shared->backpressureWaiters, 1);
+		in_backpressure_wait = false;
+	}
+	PG_END_TRY();
+
 	stop = GetCurrentTimestamp();
 	pg_atomic_add_fetch_u64(&walprop_shared->backpressureThrottlingTime, stop - start);
+	MyNeonCounters->backpressure_throttling_us_total += stop - start;
 
 	/* Reset ps display */
 	set_ps_display(new_status);
@@ -673,6 +755,42 @@ backpressure_throttling_impl(void)
 	return true;
 }
 
+/*
+ * Called in the walproposer when new pageserver feedback has arrived.
+ *
+ * If there's no lag anymore, wakes up all the throttled backends. If the lag
+ * went down but is still above the limit, the backends would only go back to
+ * sleep when they see it. Instead, the amount it went down by becomes the
+ * budget that backpressure_admit() hands out, and as many backends are woken
+ * up as it takes to use it, so that they don't all rush to write WAL at once
+ * and overshoot the limit again. Budget left over from the previous feedback
+ * is dropped, as the new lag already accounts for the WAL written since.
+ */
+static void
+backpressure_release_waiters(void)
+{
+	static uint64 last_lag = 0;
+	uint64		lag = backpressure_lag_impl();
+	uint64		freed = (lag > 0 && lag < last_lag) ? last_lag - lag : 0;
+	uint32		waiters = pg_atomic_read_u32(&walprop_shared->backpressureWaiters);
+
+	pg_atomic_write_u64(&walprop_shared->backpressureBudget, freed);
+	if (waiters > 0)
+	{
+		if (lag == 0)
+			ConditionVariableBroadcast(&walprop_shared->backpressureCV);
+		else if (freed > 0)
+		{
+			uint64		n_wakeup = (freed + BACK_PRESSURE_ADMIT_BYTES - 1) / BACK_PRESSURE_ADMIT_BYTES;
+
+			n_wakeup = Min(n_wakeup, waiters);
+			for (uint64 i = 0; i < n_wakeup; i++)
+				ConditionVariableSignal(&walprop_shared->backpressureCV);
+		}
+	}
+	last_lag = lag;
+}
+
 uint64
 BackpressureThrottlingTime(void)
 {
@@ -2163,6 +2281,8 @@ walprop_pg_process_safekeeper_feedback(WalProposer *wp, Safekeeper *sk)
 				standby_apply_lsn = min_feedback.disk_consistent_lsn;
 				needToAdvanceSlot = true;
 			}
+
+			backpressure_release_waiters();
 		}
 		else
 		{
@@ -52,6 +52,19 @@ RETURNS VOID
 AS 'MODULE_PATHNAME', 'neon_xlogflush'
 LANGUAGE C PARALLEL UNSAFE;
 
+CREATE FUNCTION bench_lwlsn_cache(nblocks int, iterations int8, write_percent int DEFAULT 10)
+RETURNS float8
+AS 'MODULE_PATHNAME', 'bench_lwlsn_cache'
+LANGUAGE C STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION bench_communicator_queue(nrequests int8, inflight int DEFAULT 8,
+                                         OUT requests_per_second float8,
+                                         OUT avg_latency_us float8,
+                                         OUT max_latency_us float8)
+RETURNS record
+AS 'MODULE_PATHNAME', 'bench_communicator_queue'
+LANGUAGE C STRICT PARALLEL UNSAFE;
+
 CREATE FUNCTION trigger_panic()
 RETURNS VOID
 AS 'MODULE_PATHNAME', 'trigger_panic'
@@ -17,6 +17,7 @@
 #include "access/xlog.h"
 #include "access/xlog_internal.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_tablespace_d.h"
 #include "fmgr.h"
 #include "funcapi.h"
 #include "miscadmin.h"
@@ -28,6 +29,9 @@
 #include "utils/rel.h"
 #include "utils/varlena.h"
 #include "utils/wait_event.h"
+#include "portability/instr_time.h"
+#include "../neon/communicator_queue.h"
+#include "../neon/neon_lwlsncache.h"
 #include "../neon/pagestore_client.h"
 
 PG_MODULE_MAGIC;
@@ -43,6 +47,8 @@ PG_FUNCTION_INFO_V1(clear_buffer_cache);
 PG_FUNCTION_INFO_V1(get_raw_page_at_lsn);
 PG_FUNCTION_INFO_V1(get_raw_page_at_lsn_ex);
 PG_FUNCTION_INFO_V1(neon_xlogflush);
+PG_FUNCTION_INFO_V1(bench_lwlsn_cache);
+PG_FUNCTION_INFO_V1(bench_communicator_queue);
 PG_FUNCTION_INFO_V1(trigger_panic);
 PG_FUNCTION_INFO_V1(trigger_segfault);
 
@@ -53,7 +59,17 @@ PG_FUNCTION_INFO_V1(trigger_segfault);
 typedef void (*neon_read_at_lsn_type) (NRelFileInfo rinfo, ForkNumber forkNum, BlockNumber blkno,
 									   neon_request_lsns request_lsns, void *buffer);
 
+typedef XLogRecPtr (*neon_get_lwlsn_type) (NRelFileInfo rlocator, ForkNumber forknum,
+											BlockNumber blkno);
+typedef XLogRecPtr (*neon_set_lwlsn_block_type) (XLogRecPtr lsn, NRelFileInfo rlocator,
+												 ForkNumber forknum, BlockNumber blkno);
+
+typedef page_server_api *(*communicator_queue_get_api_type) (void);
+
 static neon_read_at_lsn_type neon_read_at_lsn_ptr;
+static neon_get_lwlsn_type neon_get_lwlsn_ptr;
+static neon_set_lwlsn_block_type neon_set_lwlsn_block_ptr;
+static communicator_queue_get_api_type communicator_queue_get_api_ptr;
 
 /*
  * Module initialize function: fetch function pointers for cross-module calls.
@@ -66,9 +82,27 @@ _PG_init(void)
 	neon_read_at_lsn_ptr = (neon_read_at_lsn_type)
 		load_external_function("$libdir/neon", "neon_read_at_lsn",
 							   true, NULL);
+
+	AssertVariableIsOfType(&neon_get_lwlsn, neon_get_lwlsn_type);
+	neon_get_lwlsn_ptr = (neon_get_lwlsn_type)
+		load_external_function("$libdir/neon", "neon_get_lwlsn",
+							   true, NULL);
+
+	AssertVariableIsOfType(&neon_set_lwlsn_block, neon_set_lwlsn_block_type);
+	neon_set_lwlsn_block_ptr = (neon_set_lwlsn_block_type)
+		load_external_function("$libdir/neon", "neon_set_lwlsn_block",
+							   true, NULL);
+
+	AssertVariableIsOfType(&communicator_queue_get_api, communicator_queue_get_api_type);
+	communicator_queue_get_api_ptr = (communicator_queue_get_api_type)
+		load_external_function("$libdir/neon", "communicator_queue_get_api",
+							   true, NULL);
 }
 
 #define neon_read_at_lsn neon_read_at_lsn_ptr
+#define neon_get_lwlsn neon_get_lwlsn_ptr
+#define neon_set_lwlsn_block neon_set_lwlsn_block_ptr
+#define communicator_queue_get_api communicator_queue_get_api_ptr
 
 /*
  * test_consume_oids(int4), for rapidly consuming OIDs, to test wraparound.
@@ -503,6 +537,157 @@ neon_xlogflush(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
+/*
+ * bench_lwlsn_cache(nblocks int, iterations int8, write_percent int)
+ *
+ * Microbenchmark for the last-written LSN cache. Looks up random blocks of a
+ * fake relation, and updates write_percent percent of them, like a mix of
+ * page requests and WAL-logged page writes would. Returns the number of
+ * operations per second. Run it in several backends at once to measure
+ * the throughput under concurrency. All backends use the same fake
+ * relation, so they contend on the same cache entries.
+ */
+Datum
+bench_lwlsn_cache(PG_FUNCTION_ARGS)
+{
+	int32		nblocks = PG_GETARG_INT32(0);
+	int64		iterations = PG_GETARG_INT64(1);
+	int32		write_percent = PG_GETARG_INT32(2);
+	NRelFileInfo rinfo = {DEFAULTTABLESPACE_OID, MyDatabaseId, OID_MAX};
+	XLogRecPtr	lsn;
+	uint64		rnd = (uint64) MyProcPid * UINT64CONST(0x9E3779B97F4A7C15) + 1;
+	instr_time	start;
+	instr_time	elapsed;
+
+	if (nblocks <= 0 || iterations <= 0 || write_percent < 0 || write_percent > 100)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid benchmark parameters")));
+
+	if (RecoveryInProgress())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("recovery is in progress")));
+
+	lsn = GetXLogInsertRecPtr();
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (int64 i = 0; i < iterations; i++)
+	{
+		BlockNumber blkno;
+
+		/* xorshift64 */
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 7;
+		rnd ^= rnd << 17;
+		blkno = (BlockNumber) (rnd % nblocks);
+
+		if ((int32) ((rnd >> 32) % 100) < write_percent)
+			neon_set_lwlsn_block(lsn, rinfo, MAIN_FORKNUM, blkno);
+		else
+			(void) neon_get_lwlsn(rinfo, MAIN_FORKNUM, blkno);
+
+		if ((i & 0xFFFF) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	PG_RETURN_FLOAT8((double) iterations / Max(INSTR_TIME_GET_DOUBLE(elapsed), 1e-9));
+}
+
+/*
+ * bench_communicator_queue(nrequests int8, inflight int)
+ *
+ * Stress benchmark for the communicator request queue. Sends nrequests
+ * Exists requests through the queue, keeping up to 'inflight' of them in
+ * flight, to the stand-in server in the communicator process, which answers
+ * them without contacting a pageserver. That measures the cost of the queue
+ * itself: submitting a request, the communicator picking it up, and the
+ * backend being woken up with the response. Run it in several backends at
+ * once to measure it under concurrency.
+ *
+ * Returns the number of requests completed per second, and the average and
+ * maximum time from submitting a request to receiving its response, in
+ * microseconds.
+ */
+Datum
+bench_communicator_queue(PG_FUNCTION_ARGS)
+{
+	int64		nrequests = PG_GETARG_INT64(0);
+	int32		inflight = PG_GETARG_INT32(1);
+	page_server_api *api = communicator_queue_get_api();
+	NeonExistsRequest request = {0};
+	instr_time *sent_at;
+	instr_time	start;
+	instr_time	now;
+	double		total_latency_us = 0;
+	double		max_latency_us = 0;
+	int64		nsent = 0;
+	TupleDesc	tupdesc;
+	Datum		values[3];
+	bool		nulls[3] = {0};
+
+	if (nrequests <= 0 || inflight <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid benchmark parameters")));
+
+	if (api == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("neon.pageserver_transport is not set to \"communicator\"")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	request.hdr.tag = T_NeonExistsRequest;
+	request.hdr.lsn = GetXLogInsertRecPtr();
+	request.hdr.not_modified_since = request.hdr.lsn;
+	request.rinfo = (NRelFileInfo) {DEFAULTTABLESPACE_OID, MyDatabaseId, OID_MAX};
+	request.forknum = MAIN_FORKNUM;
+
+	sent_at = palloc(inflight * sizeof(instr_time));
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (int64 nreceived = 0; nreceived < nrequests; nreceived++)
+	{
+		NeonResponse *resp;
+		double		latency_us;
+
+		while (nsent < nrequests && nsent - nreceived < inflight)
+		{
+			INSTR_TIME_SET_CURRENT(sent_at[nsent % inflight]);
+			if (!api->send(CQ_STAND_IN_SHARD, &request.hdr))
+				elog(ERROR, "could not queue request");
+			nsent++;
+		}
+		if (!api->flush(CQ_STAND_IN_SHARD))
+			elog(ERROR, "could not flush requests");
+
+		resp = api->receive(CQ_STAND_IN_SHARD);
+		if (resp == NULL || messageTag(resp) != T_NeonExistsResponse)
+			elog(ERROR, "unexpected response from the stand-in server");
+		pfree(resp);
+
+		INSTR_TIME_SET_CURRENT(now);
+		INSTR_TIME_SUBTRACT(now, sent_at[nreceived % inflight]);
+		latency_us = INSTR_TIME_GET_MICROSEC(now);
+		total_latency_us += latency_us;
+		max_latency_us = Max(max_latency_us, latency_us);
+	}
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, start);
+
+	pfree(sent_at);
+
+	values[0] = Float8GetDatum((double) nrequests / Max(INSTR_TIME_GET_DOUBLE(now), 1e-9));
+	values[1] = Float8GetDatum(total_latency_us / nrequests);
+	values[2] = Float8GetDatum(max_latency_us);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
 /*
  * Function to trigger panic.
  */
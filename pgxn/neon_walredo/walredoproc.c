@@ -18,16 +18,47 @@
  *                // 'msgtype', in network byte order
  * <payload>
  *
- * There are three message types:
+ * There are these message types:
  *
  * BeginRedoForBlock ('B'): Prepare for WAL replay for given block
+ * BeginRedoForBlocks ('b'): Prepare for WAL replay for a set of blocks
  * PushPage ('P'): Copy a page image (in the payload) to buffer cache
+ * PushPageShmem ('p'): Copy a page image from a slot of the shared memory
+ *   ring to buffer cache
  * ApplyRecord ('A'): Apply a WAL record (in the payload)
+ * ApplyRecords ('a'): Apply a batch of WAL records (in the payload)
  * GetPage ('G'): Return a page image from buffer cache.
+ * GetPageShmem ('r'): Copy a page image from buffer cache to a slot of the
+ *   shared memory ring, and return the slot number as int32.
+ * GetPages ('g'): Return the images of all the blocks given in
+ *   BeginRedoForBlocks, in the same order.
+ * GetStats ('S'): Return the statistics of the process, see GetStats().
  * Ping ('H'): Return the input message.
  *
- * Currently, you only get a response to GetPage requests; the response is
- * simply a 8k page, without any headers. Errors are logged to stderr.
+ * Currently, you only get a response to GetPage, GetPageShmem, GetPages,
+ * GetStats and Ping requests; the response is simply one or more 8k pages,
+ * the slot number for GetPageShmem, or the counters for GetStats, without
+ * any headers. Errors are logged to stderr.
+ *
+ * With BeginRedoForBlocks, each record is decoded and applied only once, to
+ * all the blocks of the set that it touches, instead of once per block.
+ *
+ * When restoring a single block, the records of an ApplyRecords batch
+ * before the last one that carries a full-page image of the block are
+ * skipped, because the image overwrites whatever they would do to it. The
+ * images of XLOG_FPI and XLOG_FPI_FOR_HINT records are restored directly,
+ * without the rmgr redo.
+ *
+ * With --fork-server, the process doesn't serve requests itself. Once it's
+ * fully initialized, it acts as a template that forks ready-to-serve
+ * processes, see ForkServer().
+ *
+ * The shared memory ring is an optional memfd passed with --shmem-fd, an
+ * array of BLCKSZ slots. It's mapped before entering seccomp mode, and the
+ * page images in it are read and written in place, instead of being copied
+ * through the pipes. The pipes still carry the messages, which orders the
+ * accesses to a slot between the processes. The caller owns the slots, and
+ * only hands one to us for the duration of a request.
  *
  * FIXME:
  * - this currently requires a valid PGDATA, and creates a lock file there
@@ -50,7 +81,11 @@
 #include <limits.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/sched.h>
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
@@ -85,6 +120,7 @@
 #endif
 #include "access/xlogutils.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_control.h"
 #include "commands/async.h"
 #include "libpq/pqformat.h"
 #include "miscadmin.h"
@@ -129,19 +165,52 @@ PG_MODULE_MAGIC;
 
 static int	ReadRedoCommand(StringInfo inBuf);
 static void BeginRedoForBlock(StringInfo input_message);
-static void PushPage(StringInfo input_message);
+static void BeginRedoForBlocks(StringInfo input_message);
+static void PushPage(StringInfo input_message, bool in_shmem);
 static void ApplyRecord(StringInfo input_message);
+static void ApplyRecords(StringInfo input_message);
+static void ApplyOneRecord(XLogRecPtr lsn, XLogRecord *record);
+static void DecodeOneRecord(XLogRecPtr lsn, XLogRecord *record);
+static void ReleaseDecodedRecord(void);
+static int	TargetImageBlockId(XLogReaderState *record);
+static void RestoreTargetImage(XLogReaderState *record, uint8 block_id);
 static void apply_error_callback(void *arg);
 static bool redo_block_filter(XLogReaderState *record, uint8 block_id);
-static void GetPage(StringInfo input_message);
+static void GetPage(StringInfo input_message, bool in_shmem);
+static void GetPages(StringInfo input_message);
+static void GetStats(StringInfo input_message);
 static void Ping(StringInfo input_message);
+static void write_response(const char *data, int len);
+static void AttachShmemRing(int fd);
+static void ForkServer(void);
+static char *shmem_slot(uint32 slot);
 static ssize_t buffered_read(void *buf, size_t count);
 static void CreateFakeSharedMemoryAndSemaphores(void);
 
 static BufferTag target_redo_tag;
 
+/* The shared memory ring, if any */
+static char *shmem_ring = NULL;
+static int	shmem_ring_slots = 0;
+
+/*
+ * The blocks being restored after BeginRedoForBlocks. n_redo_targets is 0
+ * when restoring a single block with BeginRedoForBlock.
+ *
+ * The buffer cache only has a few buffers, so the rest of the blocks live
+ * in the inmem smgr meanwhile. Keep the set well below its WARN_PAGES.
+ */
+#define MAX_REDO_TARGETS 16
+
+static BufferTag redo_targets[MAX_REDO_TARGETS];
+static int	n_redo_targets = 0;
+
 static XLogReaderState *reader_state;
 
+/* Counters for GetStats, since the start of the process */
+static uint64 n_records_applied = 0;
+static uint64 n_records_skipped = 0;
+
 #define TRACE DEBUG1
 
 #ifdef HAVE_LIBSECCOMP
@@ -342,6 +411,19 @@ WalRedoMain(int argc, char *argv[])
 	}
 	reader_state = XLogReaderAllocate(wal_segment_size, NULL, XL_ROUTINE(), NULL);
 
+	/*
+	 * In fork server mode, this only returns in a forked child, which
+	 * continues from here like a freshly started process.
+	 */
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--fork-server") == 0)
+			ForkServer();
+
+	/* Map the shared memory ring while we still can */
+	for (int i = 1; i < argc - 1; i++)
+		if (strcmp(argv[i], "--shmem-fd") == 0)
+			AttachShmemRing(atoi(argv[i + 1]));
+
 #ifdef HAVE_LIBSECCOMP
 	/* We prefer opt-out to opt-in for greater security */
 	enable_seccomp = true;
@@ -384,16 +466,40 @@ WalRedoMain(int argc, char *argv[])
 				BeginRedoForBlock(&input_message);
 				break;
 
+			case 'b':			/* BeginRedoForBlocks */
+				BeginRedoForBlocks(&input_message);
+				break;
+
 			case 'P':			/* PushPage */
-				PushPage(&input_message);
+				PushPage(&input_message, false);
+				break;
+
+			case 'p':			/* PushPageShmem */
+				PushPage(&input_message, true);
 				break;
 
 			case 'A':			/* ApplyRecord */
 				ApplyRecord(&input_message);
 				break;
 
+			case 'a':			/* ApplyRecords */
+				ApplyRecords(&input_message);
+				break;
+
 			case 'G':			/* GetPage */
-				GetPage(&input_message);
+				GetPage(&input_message, false);
+				break;
+
+			case 'r':			/* GetPageShmem */
+				GetPage(&input_message, true);
+				break;
+
+			case 'g':			/* GetPages */
+				GetPages(&input_message);
+				break;
+
+			case 'S':			/* GetStats */
+				GetStats(&input_message);
 				break;
 
 			case 'H': 			/* Ping */
@@ -742,6 +848,7 @@ BeginRedoForBlock(StringInfo input_message)
 #endif
 	blknum = pq_getmsgint(input_message, 4);
 	wal_redo_buffer = InvalidBuffer;
+	n_redo_targets = 0;
 
 	InitBufferTag(&target_redo_tag, &rinfo, forknum, blknum);
 
@@ -758,11 +865,76 @@ BeginRedoForBlock(StringInfo input_message)
 	}
 }
 
+/*
+ * Prepare for WAL replay on a set of blocks
+ */
+static void
+BeginRedoForBlocks(StringInfo input_message)
+{
+	int			count;
+
+	/*
+	 * message format:
+	 *
+	 * number of blocks
+	 * for each block, the same fields as in BeginRedoForBlock
+	 */
+	count = pq_getmsgint(input_message, 4);
+	if (count < 1 || count > MAX_REDO_TARGETS)
+		elog(ERROR, "invalid number of blocks in BeginRedoForBlocks: %d", count);
+
+	/*
+	 * Records are no longer applied on a clean inmem smgr each time, so
+	 * start from a clean one here.
+	 */
+	smgrinit();
+	wal_redo_buffer = InvalidBuffer;
+
+	for (int i = 0; i < count; i++)
+	{
+		NRelFileInfo rinfo;
+		ForkNumber	forknum;
+		BlockNumber blknum;
+		SMgrRelation reln;
+
+		forknum = pq_getmsgbyte(input_message);
+#if PG_MAJORVERSION_NUM < 16
+		rinfo.spcNode = pq_getmsgint(input_message, 4);
+		rinfo.dbNode = pq_getmsgint(input_message, 4);
+		rinfo.relNode = pq_getmsgint(input_message, 4);
+#else
+		rinfo.spcOid = pq_getmsgint(input_message, 4);
+		rinfo.dbOid = pq_getmsgint(input_message, 4);
+		rinfo.relNumber = pq_getmsgint(input_message, 4);
+#endif
+		blknum = pq_getmsgint(input_message, 4);
+
+		InitBufferTag(&redo_targets[i], &rinfo, forknum, blknum);
+
+		elog(TRACE, "BeginRedoForBlocks %u/%u/%u.%d blk %u",
+			 RelFileInfoFmt(rinfo), forknum, blknum);
+
+		reln = smgropen(rinfo, INVALID_PROC_NUMBER, RELPERSISTENCE_PERMANENT);
+		if (reln->smgr_cached_nblocks[forknum] == InvalidBlockNumber ||
+			reln->smgr_cached_nblocks[forknum] < blknum + 1)
+		{
+			reln->smgr_cached_nblocks[forknum] = blknum + 1;
+		}
+	}
+	pq_getmsgend(input_message);
+
+	n_redo_targets = count;
+	target_redo_tag = redo_targets[0];
+}
+
 /*
  * Receive a page given by the client, and put it into buffer cache.
+ *
+ * The page is either in the payload or, with in_shmem, in a slot of the
+ * shared memory ring.
  */
 static void
-PushPage(StringInfo input_message)
+PushPage(StringInfo input_message, bool in_shmem)
 {
 	NRelFileInfo rinfo;
 	ForkNumber forknum;
@@ -779,7 +951,7 @@ PushPage(StringInfo input_message)
 	 * relNode
 	 * ForkNumber
 	 * BlockNumber
-	 * 8k page content
+	 * 8k page content, or the slot number with in_shmem
 	 */
 	forknum = pq_getmsgbyte(input_message);
 #if PG_MAJORVERSION_NUM < 16
@@ -792,7 +964,10 @@ PushPage(StringInfo input_message)
 	rinfo.relNumber = pq_getmsgint(input_message, 4);
 #endif
 	blknum = pq_getmsgint(input_message, 4);
-	content = pq_getmsgbytes(input_message, BLCKSZ);
+	if (in_shmem)
+		content = shmem_slot(pq_getmsgint(input_message, 4));
+	else
+		content = pq_getmsgbytes(input_message, BLCKSZ);
 
 	buf = NeonRedoReadBuffer(rinfo, forknum, blknum, RBM_ZERO_AND_LOCK);
 	wal_redo_buffer = buf;
@@ -810,17 +985,10 @@ PushPage(StringInfo input_message)
 static void
 ApplyRecord(StringInfo input_message)
 {
-	char	   *errormsg;
 	XLogRecPtr	lsn;
 	XLogRecord *record;
 	int			nleft;
 	ErrorContextCallback errcallback;
-#if PG_VERSION_NUM >= 150000
-	DecodedXLogRecord *decoded;
-#define STATIC_DECODEBUF_SIZE (64 * 1024)
-	static char *static_decodebuf = NULL;
-	size_t		required_space;
-#endif
 
 	/*
 	 * message format:
@@ -830,8 +998,6 @@ ApplyRecord(StringInfo input_message)
 	 */
 	lsn = pq_getmsgint64(input_message);
 
-	smgrinit();					/* reset inmem smgr state */
-
 	/* note: the input must be aligned here */
 	record = (XLogRecord *) pq_getmsgbytes(input_message, sizeof(XLogRecord));
 
@@ -846,6 +1012,188 @@ ApplyRecord(StringInfo input_message)
 	errcallback.previous = error_context_stack;
 	error_context_stack = &errcallback;
 
+	/* Ignore any other blocks than the ones the caller is interested in */
+	redo_read_buffer_filter = redo_block_filter;
+
+	ApplyOneRecord(lsn, record);
+
+	redo_read_buffer_filter = NULL;
+
+	/* Pop the error context stack */
+	error_context_stack = errcallback.previous;
+}
+
+/*
+ * Receive a batch of WAL records, and apply them in order.
+ *
+ * Same as a series of ApplyRecord messages, but the per-message overhead is
+ * paid only once for the whole batch.
+ */
+static void
+ApplyRecords(StringInfo input_message)
+{
+	int			count;
+	int			first = 0;
+	XLogRecPtr *lsns;
+	XLogRecord **records;
+	ErrorContextCallback errcallback;
+
+	/*
+	 * message format:
+	 *
+	 * number of records
+	 * padding (4 bytes)
+	 * for each record:
+	 *   LSN (the *end* of the record)
+	 *   record length
+	 *   padding (4 bytes)
+	 *   record, padded to a multiple of 8 bytes
+	 *
+	 * The padding keeps each record aligned, like in ApplyRecord.
+	 */
+	count = pq_getmsgint(input_message, 4);
+	(void) pq_getmsgint(input_message, 4);
+	if (count < 0 || count > (input_message->len - input_message->cursor) / 16)
+		elog(ERROR, "invalid number of records in ApplyRecords: %d", count);
+
+	lsns = palloc(count * sizeof(XLogRecPtr));
+	records = palloc(count * sizeof(XLogRecord *));
+	for (int i = 0; i < count; i++)
+	{
+		uint32		len;
+
+		lsns[i] = pq_getmsgint64(input_message);
+		len = pq_getmsgint(input_message, 4);
+		(void) pq_getmsgint(input_message, 4);
+
+		if (len < sizeof(XLogRecord) || len > input_message->len - input_message->cursor)
+			elog(ERROR, "invalid record length (%u) in ApplyRecords", len);
+		records[i] = (XLogRecord *) pq_getmsgbytes(input_message, TYPEALIGN(8, len));
+		if (records[i]->xl_tot_len != len)
+			elog(ERROR, "mismatch between record (%d) and message size (%d)",
+				 records[i]->xl_tot_len, (int) len);
+	}
+	pq_getmsgend(input_message);
+
+	errcallback.callback = apply_error_callback;
+	errcallback.arg = (void *) reader_state;
+	errcallback.previous = error_context_stack;
+	error_context_stack = &errcallback;
+
+	/*
+	 * Find the last record with a full-page image of the target block. The
+	 * records before it are skipped, their effect on the block is
+	 * overwritten anyway. This decodes the records from the end of the batch
+	 * until it finds one, so the records that don't get skipped are decoded
+	 * twice; that's cheap next to the redo. With a set of blocks, the earlier
+	 * records may still modify the other blocks, so nothing is skipped.
+	 */
+	if (n_redo_targets == 0)
+	{
+		for (int i = count - 1; i > 0; i--)
+		{
+			bool		found;
+
+			DecodeOneRecord(lsns[i], records[i]);
+			found = TargetImageBlockId(reader_state) >= 0;
+			ReleaseDecodedRecord();
+			if (found)
+			{
+				first = i;
+				break;
+			}
+		}
+	}
+	if (first > 0)
+		elog(TRACE, "skipping %d WAL records before a full-page image", first);
+	n_records_skipped += first;
+
+	redo_read_buffer_filter = redo_block_filter;
+
+	for (int i = first; i < count; i++)
+		ApplyOneRecord(lsns[i], records[i]);
+
+	redo_read_buffer_filter = NULL;
+
+	error_context_stack = errcallback.previous;
+
+	pfree(lsns);
+	pfree(records);
+}
+
+/*
+ * Decode a WAL record and apply it, for ApplyRecord and ApplyRecords. The
+ * caller has set up the error context and the block filter.
+ */
+static void
+ApplyOneRecord(XLogRecPtr lsn, XLogRecord *record)
+{
+	uint8		info = record->xl_info & ~XLR_INFO_MASK;
+	int			block_id = -1;
+
+	/*
+	 * Reset inmem smgr state. With a set of blocks, the blocks that don't fit
+	 * in the buffer cache are kept there until GetPages.
+	 */
+	if (n_redo_targets == 0)
+		smgrinit();
+
+	DecodeOneRecord(lsn, record);
+
+	/*
+	 * A full-page image record only restores the images, so restore the one
+	 * of the target block directly; the block filter would skip the others.
+	 */
+	if (n_redo_targets == 0 && record->xl_rmid == RM_XLOG_ID &&
+		(info == XLOG_FPI || info == XLOG_FPI_FOR_HINT))
+		block_id = TargetImageBlockId(reader_state);
+
+	if (block_id >= 0)
+		RestoreTargetImage(reader_state, block_id);
+	else
+		RmgrTable[record->xl_rmid].rm_redo(reader_state);
+	n_records_applied++;
+
+	/*
+	 * If no base image of the page was provided by PushPage, initialize
+	 * wal_redo_buffer here. The first WAL record must initialize the page
+	 * in that case. With a set of blocks, a block that no record initializes
+	 * is returned as zeros, like a block that isn't touched at all.
+	 */
+	if (n_redo_targets == 0 && BufferIsInvalid(wal_redo_buffer))
+	{
+		wal_redo_buffer = NeonRedoReadBuffer(BufTagGetNRelFileInfo(target_redo_tag),
+											 target_redo_tag.forkNum,
+											 target_redo_tag.blockNum,
+											 RBM_NORMAL);
+		Assert(!BufferIsInvalid(wal_redo_buffer));
+		ReleaseBuffer(wal_redo_buffer);
+	}
+
+	elog(TRACE, "applied WAL record with LSN %X/%X",
+		 (uint32) (lsn >> 32), (uint32) lsn);
+
+	ReleaseDecodedRecord();
+}
+
+#if PG_VERSION_NUM >= 150000
+#define STATIC_DECODEBUF_SIZE (64 * 1024)
+static char *static_decodebuf = NULL;
+#endif
+
+/*
+ * Decode a WAL record into reader_state. Call ReleaseDecodedRecord() when
+ * done with it.
+ */
+static void
+DecodeOneRecord(XLogRecPtr lsn, XLogRecord *record)
+{
+	char	   *errormsg;
+#if PG_VERSION_NUM >= 150000
+	DecodedXLogRecord *decoded;
+	size_t		required_space;
+#endif
+
 	XLogBeginRead(reader_state, lsn);
 
 #if PG_VERSION_NUM >= 150000
@@ -890,39 +1238,70 @@ ApplyRecord(StringInfo input_message)
 	if (!DecodeXLogRecord(reader_state, record, &errormsg))
 		elog(ERROR, "failed to decode WAL record: %s", errormsg);
 #endif
+}
 
-	/* Ignore any other blocks than the ones the caller is interested in */
-	redo_read_buffer_filter = redo_block_filter;
-
-	RmgrTable[record->xl_rmid].rm_redo(reader_state);
+static void
+ReleaseDecodedRecord(void)
+{
+#if PG_VERSION_NUM >= 150000
+	if ((char *) reader_state->record != static_decodebuf)
+		pfree(reader_state->record);
+	reader_state->record = NULL;
+#endif
+}
 
-	/*
-	 * If no base image of the page was provided by PushPage, initialize
-	 * wal_redo_buffer here. The first WAL record must initialize the page
-	 * in that case.
-	 */
-	if (BufferIsInvalid(wal_redo_buffer))
+/*
+ * Returns the block_id of the full-page image of the target block in a
+ * decoded record, if the redo would restore it over the block, or -1.
+ */
+static int
+TargetImageBlockId(XLogReaderState *record)
+{
+	for (int block_id = 0; block_id <= XLogRecMaxBlockId(record); block_id++)
 	{
-		wal_redo_buffer = NeonRedoReadBuffer(BufTagGetNRelFileInfo(target_redo_tag),
-											 target_redo_tag.forkNum,
-											 target_redo_tag.blockNum,
-											 RBM_NORMAL);
-		Assert(!BufferIsInvalid(wal_redo_buffer));
-		ReleaseBuffer(wal_redo_buffer);
+		NRelFileInfo rinfo;
+		BufferTag	tag;
+
+		if (!XLogRecHasBlockRef(record, block_id) ||
+			!XLogRecHasBlockImage(record, block_id) ||
+			!XLogRecBlockImageApply(record, block_id))
+			continue;
+
+		XLogRecGetBlockTag(record, block_id, &rinfo, &tag.forkNum, &tag.blockNum);
+		CopyNRelFileInfoToBufTag(tag, rinfo);
+		if (BufferTagsEqual(&tag, &target_redo_tag))
+			return block_id;
 	}
+	return -1;
+}
 
-	redo_read_buffer_filter = NULL;
-
-	/* Pop the error context stack */
-	error_context_stack = errcallback.previous;
+/*
+ * Restore a full-page image of the target block, decompressing it if
+ * needed. Same as XLogReadBufferForRedo() does for it in the redo of the
+ * record.
+ */
+static void
+RestoreTargetImage(XLogReaderState *record, uint8 block_id)
+{
+	Buffer		buf;
+	Page		page;
 
-	elog(TRACE, "applied WAL record with LSN %X/%X",
-		 (uint32) (lsn >> 32), (uint32) lsn);
+	buf = NeonRedoReadBuffer(BufTagGetNRelFileInfo(target_redo_tag),
+							 target_redo_tag.forkNum,
+							 target_redo_tag.blockNum,
+							 RBM_ZERO_AND_LOCK);
+	wal_redo_buffer = buf;
+	page = BufferGetPage(buf);
+	if (!RestoreBlockImage(record, block_id, (char *) page))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg_internal("%s", record->errormsg_buf)));
 
-#if PG_VERSION_NUM >= 150000
-	if ((char *) decoded != static_decodebuf)
-		pfree(decoded);
-#endif
+	/* like XLogReadBufferForRedoExtended(), a new page keeps its zero LSN */
+	if (!PageIsNew(page))
+		PageSetLSN(page, record->EndRecPtr);
+	MarkBufferDirty(buf);
+	UnlockReleaseBuffer(buf);
 }
 
 /*
@@ -971,6 +1350,23 @@ redo_block_filter(XLogReaderState *record, uint8 block_id)
 #endif
 	CopyNRelFileInfoToBufTag(target_tag, rinfo);
 
+	if (n_redo_targets > 0)
+	{
+		bool		same_rel = false;
+
+		for (int i = 0; i < n_redo_targets; i++)
+		{
+			if (BufferTagsEqual(&target_tag, &redo_targets[i]))
+				return false;
+			if (RelFileInfoEquals(rinfo, BufTagGetNRelFileInfo(redo_targets[i])))
+				same_rel = true;
+		}
+		if (!same_rel)
+			elog(WARNING, "REDO accessing unexpected page: %u/%u/%u.%u blk %u",
+				 RelFileInfoFmt(rinfo), target_tag.forkNum, target_tag.blockNum);
+		return true;
+	}
+
 	/*
 	 * Can a WAL redo function ever access a relation other than the one that
 	 * it modifies? I don't see why it would.
@@ -990,17 +1386,18 @@ redo_block_filter(XLogReaderState *record, uint8 block_id)
 /*
  * Get a page image back from buffer cache.
  *
- * After applying some records.
+ * After applying some records. With in_shmem, the page is returned in a slot
+ * of the shared memory ring, and the response only tells that it's there.
  */
 static void
-GetPage(StringInfo input_message)
+GetPage(StringInfo input_message, bool in_shmem)
 {
 	NRelFileInfo rinfo;
 	ForkNumber forknum;
 	BlockNumber blknum;
 	Buffer		buf;
 	Page		page;
-	int			tot_written;
+	uint32		slot = 0;
 
 	/*
 	 * message format:
@@ -1010,6 +1407,7 @@ GetPage(StringInfo input_message)
 	 * relNode
 	 * ForkNumber
 	 * BlockNumber
+	 * slot number, with in_shmem
 	 */
 	forknum = pq_getmsgbyte(input_message);
 #if PG_MAJORVERSION_NUM < 16
@@ -1022,6 +1420,8 @@ GetPage(StringInfo input_message)
 	rinfo.relNumber = pq_getmsgint(input_message, 4);
 #endif
 	blknum = pq_getmsgint(input_message, 4);
+	if (in_shmem)
+		slot = pq_getmsgint(input_message, 4);
 
 	/* FIXME: check that we got a BeginRedoForBlock message or this earlier */
 
@@ -1030,22 +1430,20 @@ GetPage(StringInfo input_message)
 	page = BufferGetPage(buf);
 	/* single thread, so don't bother locking the page */
 
-	/* Response: Page content */
-	tot_written = 0;
-	do {
-		ssize_t		rc;
+	if (in_shmem)
+	{
+		uint32		response = pg_hton32(slot);
 
-		rc = write(STDOUT_FILENO, &page[tot_written], BLCKSZ - tot_written);
-		if (rc < 0) {
-			/* If interrupted by signal, just retry */
-			if (errno == EINTR)
-				continue;
-			ereport(ERROR,
-					(errcode_for_file_access(),
-					 errmsg("could not write to stdout: %m")));
-		}
-		tot_written += rc;
-	} while (tot_written < BLCKSZ);
+		memcpy(shmem_slot(slot), page, BLCKSZ);
+
+		/* Response: the slot number */
+		write_response((char *) &response, sizeof(response));
+	}
+	else
+	{
+		/* Response: Page content */
+		write_response(page, BLCKSZ);
+	}
 
 	ReleaseBuffer(buf);
 	DropRelationAllLocalBuffers(rinfo);
@@ -1055,21 +1453,95 @@ GetPage(StringInfo input_message)
 }
 
 
+/*
+ * Get the images of all the blocks given in BeginRedoForBlocks.
+ *
+ * After applying some records.
+ */
+static void
+GetPages(StringInfo input_message)
+{
+	char	   *response;
+
+	/* message format: no payload */
+	pq_getmsgend(input_message);
+
+	if (n_redo_targets == 0)
+		elog(ERROR, "GetPages without BeginRedoForBlocks");
+
+	response = palloc(n_redo_targets * BLCKSZ);
+	for (int i = 0; i < n_redo_targets; i++)
+	{
+		Buffer		buf;
+
+		buf = NeonRedoReadBuffer(BufTagGetNRelFileInfo(redo_targets[i]),
+								 redo_targets[i].forkNum,
+								 redo_targets[i].blockNum,
+								 RBM_NORMAL);
+		/* single thread, so don't bother locking the page */
+		memcpy(&response[i * BLCKSZ], BufferGetPage(buf), BLCKSZ);
+		ReleaseBuffer(buf);
+	}
+
+	/* Response: the page contents, in the order of the blocks */
+	write_response(response, n_redo_targets * BLCKSZ);
+	pfree(response);
+
+	for (int i = 0; i < n_redo_targets; i++)
+		DropRelationAllLocalBuffers(BufTagGetNRelFileInfo(redo_targets[i]));
+	smgrinit();
+	wal_redo_buffer = InvalidBuffer;
+
+	elog(TRACE, "Pages sent back for %d blocks", n_redo_targets);
+	n_redo_targets = 0;
+}
+
+
+/*
+ * Return the counters of the records applied and skipped since the start of
+ * the process, as two int64s in network byte order.
+ */
+static void
+GetStats(StringInfo input_message)
+{
+	uint64		response[2];
+
+	/* message format: no payload */
+	pq_getmsgend(input_message);
+
+	response[0] = pg_hton64(n_records_applied);
+	response[1] = pg_hton64(n_records_skipped);
+	write_response((char *) response, sizeof(response));
+}
+
 static void
 Ping(StringInfo input_message)
 {
-	int			tot_written;
-	/* Response: the input message */
-	tot_written = 0;
-	do {
-		ssize_t		rc;
-		/* We don't need alignment, but it's bad practice to use char[BLCKSZ] */
+	/* We don't need alignment, but it's bad practice to use char[BLCKSZ] */
 #if PG_VERSION_NUM >= 160000
-		static const PGIOAlignedBlock response;
+	static const PGIOAlignedBlock response;
 #else
-		static const PGAlignedBlock response;
+	static const PGAlignedBlock response;
 #endif
-		rc = write(STDOUT_FILENO, &response.data[tot_written], BLCKSZ - tot_written);
+
+	/* Response: the input message */
+	write_response(response.data, BLCKSZ);
+
+	elog(TRACE, "Page sent back for ping");
+}
+
+/*
+ * Write a response to stdout, retrying on short writes.
+ */
+static void
+write_response(const char *data, int len)
+{
+	int			tot_written = 0;
+
+	do {
+		ssize_t		rc;
+
+		rc = write(STDOUT_FILENO, &data[tot_written], len - tot_written);
 		if (rc < 0) {
 			/* If interrupted by signal, just retry */
 			if (errno == EINTR)
@@ -1079,14 +1551,186 @@ Ping(StringInfo input_message)
 					 errmsg("could not write to stdout: %m")));
 		}
 		tot_written += rc;
-	} while (tot_written < BLCKSZ);
+	} while (tot_written < len);
+}
 
-	elog(TRACE, "Page sent back for ping");
+/*
+ * Serve fork requests until EOF on stdin.
+ *
+ * Spawning a walredo process from scratch goes through the whole startup
+ * above, which costs time and private memory in every process. A fork
+ * server does it once, and forks copies of itself that share the pages it
+ * initialized until they're written to.
+ *
+ * stdin is a Unix domain socket. Each request is a single byte, with the
+ * file descriptors for the stdin, stdout and stderr of the new process, and
+ * optionally the shared memory ring, attached with SCM_RIGHTS. The response
+ * is the pid of the new process as int32, with a pidfd for it attached.
+ * The caller uses the pidfd to signal and wait for the process, because it's
+ * not its parent. The fork server ignores SIGCHLD so that the kernel reaps
+ * the children. That means a child's pid can be reused as soon as it exits,
+ * possibly before we could open a pidfd for it, so the pidfd is created
+ * together with the process, with clone3(CLONE_PIDFD). The pidfd then keeps
+ * referring to the process, so that a reused pid is never signalled.
+ *
+ * The child returns, and enters seccomp mode and the main loop as usual.
+ */
+static void
+ForkServer(void)
+{
+	pqsignal(SIGCHLD, SIG_IGN);
+
+	for (;;)
+	{
+		char		cmd;
+		struct iovec iov = {.iov_base = &cmd,.iov_len = 1};
+		union
+		{
+			char		buf[CMSG_SPACE(4 * sizeof(int))];
+			struct cmsghdr align;
+		}			cmsgbuf;
+		struct msghdr msg = {0};
+		struct cmsghdr *cmsg;
+		int			fds[4];
+		int			nfds = 0;
+		ssize_t		rc;
+		pid_t		pid;
+		int			pidfd = -1;
+		int32		response;
+		struct clone_args clone_args = {0};
+
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsgbuf.buf;
+		msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+		rc = recvmsg(STDIN_FILENO, &msg, MSG_CMSG_CLOEXEC);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0)
+			ereport(FATAL,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("could not receive fork request: %m")));
+		if (rc == 0)
+			proc_exit(0);
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			{
+				nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+			}
+		}
+		if (cmd != 'F' || nfds < 3 || (msg.msg_flags & MSG_CTRUNC) != 0)
+			ereport(FATAL,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid fork request")));
+
+		/* like fork(), but also returns a pidfd for the child */
+		clone_args.flags = CLONE_PIDFD;
+		clone_args.pidfd = (uint64) (uintptr_t) &pidfd;
+		clone_args.exit_signal = SIGCHLD;
+		pid = syscall(__NR_clone3, &clone_args, sizeof(clone_args));
+		if (pid < 0)
+			ereport(FATAL,
+					(errmsg("could not fork walredo process: %m")));
+		if (pid == 0)
+		{
+			pqsignal(SIGCHLD, SIG_DFL);
+
+			/* replaces the fork request socket */
+			if (dup2(fds[0], STDIN_FILENO) < 0 ||
+				dup2(fds[1], STDOUT_FILENO) < 0 ||
+				dup2(fds[2], STDERR_FILENO) < 0)
+				ereport(FATAL,
+						(errmsg("could not set up walredo process: %m")));
+			for (int i = 0; i < 3; i++)
+				close(fds[i]);
+			if (nfds > 3)
+				AttachShmemRing(fds[3]);
+
+			InitProcessGlobals();
+			if (MyProc != NULL)
+				MyProc->pid = MyProcPid;
+			return;
+		}
+
+		for (int i = 0; i < nfds; i++)
+			close(fds[i]);
+
+		response = pg_hton32(pid);
+		iov.iov_base = &response;
+		iov.iov_len = sizeof(response);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsgbuf.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int));
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &pidfd, sizeof(int));
+
+		do
+			rc = sendmsg(STDIN_FILENO, &msg, 0);
+		while (rc < 0 && errno == EINTR);
+		if (rc != sizeof(response))
+			ereport(FATAL,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("could not send fork response: %m")));
+		close(pidfd);
+	}
 }
 
+/*
+ * Map the shared memory ring passed by the caller.
+ *
+ * This runs before enter_seccomp_mode(), which closes the file descriptor
+ * anyway; the mapping stays.
+ */
+static void
+AttachShmemRing(int fd)
+{
+	struct stat st;
+	void	   *ptr;
+
+	if (fstat(fd, &st) != 0)
+		ereport(FATAL,
+				(errcode_for_file_access(),
+				 errmsg("could not stat shared memory ring: %m")));
+	if (st.st_size < BLCKSZ || st.st_size % BLCKSZ != 0)
+		ereport(FATAL,
+				(errmsg("invalid shared memory ring size: %lld",
+						(long long) st.st_size)));
 
-/* Buffer used by buffered_read() */
-static char stdin_buf[16 * 1024];
+	ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		ereport(FATAL,
+				(errmsg("could not map shared memory ring: %m")));
+	close(fd);
+
+	shmem_ring = ptr;
+	shmem_ring_slots = st.st_size / BLCKSZ;
+}
+
+static char *
+shmem_slot(uint32 slot)
+{
+	if (shmem_ring == NULL)
+		elog(ERROR, "no shared memory ring");
+	if (slot >= shmem_ring_slots)
+		elog(ERROR, "invalid shared memory ring slot: %u", slot);
+	return &shmem_ring[(Size) slot * BLCKSZ];
+}
+
+
+/*
+ * Buffer used by buffered_read(). It's the size of the default pipe buffer
+ * on Linux, so that one read() can drain a full pipe of small messages.
+ */
+static char stdin_buf[64 * 1024];
 static size_t stdin_len = 0;	/* # of bytes in buffer */
 static size_t stdin_ptr = 0;	/* # of bytes already consumed */
 
@@ -1098,6 +1742,9 @@ static size_t stdin_ptr = 0;	/* # of bytes already consumed */
  * 'fstat' or 'newfstatat'. 'fstat' is probably harmless, but 'newfstatat'
  * seems problematic because it allows interrogating files by path name.
  *
+ * Reads that are at least as large as the buffer, like the payload of a big
+ * ApplyRecords message, bypass it once it's empty, to save a copy.
+ *
  * The return value is the number of bytes read. On error, -1 is returned, and
  * errno is set appropriately. Unlike read(), this fills the buffer completely
  * unless an error happens or EOF is reached.
@@ -1111,6 +1758,19 @@ buffered_read(void *buf, size_t count)
 	{
 		size_t		nthis;
 
+		if (stdin_ptr == stdin_len && count >= sizeof(stdin_buf))
+		{
+			ssize_t		ret;
+
+			ret = read(STDIN_FILENO, dst, count);
+			if (ret < 0)
+				return ret;
+			if (ret == 0)
+				break;
+			count -= ret;
+			dst += ret;
+			continue;
+		}
 		if (stdin_ptr == stdin_len)
 		{
 			ssize_t		ret;
@@ -0,0 +1,70 @@
+from __future__ import annotations
+
+import concurrent.futures
+from typing import TYPE_CHECKING
+
+import pytest
+from fixtures.benchmark_fixture import MetricReport
+from fixtures.log_helper import log
+
+if TYPE_CHECKING:
+    from fixtures.benchmark_fixture import NeonBenchmarker
+    from fixtures.neon_fixtures import NeonEnv
+
+
+@pytest.mark.parametrize("n_backends", [1, 8, 32])
+@pytest.mark.parametrize("inflight", [1, 16])
+def test_communicator_queue(
+    neon_simple_env: NeonEnv,
+    zenbenchmark: NeonBenchmarker,
+    n_backends: int,
+    inflight: int,
+):
+    """
+    Measure submit-to-complete latency and throughput of the communicator
+    request queue, with many backends sending requests at the same time to
+    the stand-in server in the communicator process.
+    """
+    env = neon_simple_env
+    endpoint = env.endpoints.create_start(
+        "main",
+        config_lines=[
+            "neon.pageserver_transport=communicator",
+            "max_connections=100",
+        ],
+    )
+    endpoint.safe_psql("CREATE EXTENSION neon_test_utils")
+
+    nrequests = 200_000
+
+    def run_backend(_: int) -> tuple[float, float, float]:
+        with endpoint.cursor() as cur:
+            cur.execute(
+                "SELECT requests_per_second, avg_latency_us, max_latency_us "
+                f"FROM bench_communicator_queue({nrequests}, {inflight})"
+            )
+            row = cur.fetchall()[0]
+            return float(row[0]), float(row[1]), float(row[2])
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=n_backends) as executor:
+        results = list(executor.map(run_backend, range(n_backends)))
+
+    log.info(f"per-backend results (req/s, avg us, max us): {results}")
+    zenbenchmark.record(
+        "communicator_queue_requests_per_second",
+        sum(r[0] for r in results),
+        "req/s",
+        MetricReport.HIGHER_IS_BETTER,
+    )
+    zenbenchmark.record(
+        "communicator_queue_avg_latency",
+        sum(r[1] for r in results) / n_backends,
+        "us",
+        MetricReport.LOWER_IS_BETTER,
+    )
+    zenbenchmark.record(
+        "communicator_queue_max_latency",
+        max(r[2] for r in results),
+        "us",
+        MetricReport.LOWER_IS_BETTER,
+    )
@@ -0,0 +1,53 @@
+from __future__ import annotations
+
+import concurrent.futures
+from typing import TYPE_CHECKING
+
+import pytest
+from fixtures.benchmark_fixture import MetricReport
+from fixtures.log_helper import log
+
+if TYPE_CHECKING:
+    from fixtures.benchmark_fixture import NeonBenchmarker
+    from fixtures.neon_fixtures import NeonEnv
+
+
+@pytest.mark.parametrize("n_backends", [1, 4, 16])
+@pytest.mark.parametrize("write_percent", [0, 10, 50])
+def test_lwlsn_cache_throughput(
+    neon_simple_env: NeonEnv,
+    zenbenchmark: NeonBenchmarker,
+    n_backends: int,
+    write_percent: int,
+):
+    """
+    Measure get/set throughput of the last-written LSN cache with several
+    backends hammering it at the same time.
+    """
+    env = neon_simple_env
+    endpoint = env.endpoints.create_start("main")
+    endpoint.safe_psql("CREATE EXTENSION neon_test_utils")
+
+    # More blocks than fit in the cache, so that the benchmark also covers
+    # replacement.
+    nblocks = 256 * 1024
+    iterations = 2_000_000
+
+    def run_backend(_: int) -> float:
+        with endpoint.cursor() as cur:
+            cur.execute(f"SELECT bench_lwlsn_cache({nblocks}, {iterations}, {write_percent})")
+            return float(cur.fetchall()[0][0])
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=n_backends) as executor:
+        results = list(executor.map(run_backend, range(n_backends)))
+
+    log.info(f"per-backend ops/s: {results}")
+    zenbenchmark.record(
+        "lwlsn_cache_ops_per_second", sum(results), "ops/s", MetricReport.HIGHER_IS_BETTER
+    )
+    zenbenchmark.record(
+        "lwlsn_cache_ops_per_second_per_backend",
+        min(results),
+        "ops/s",
+        MetricReport.HIGHER_IS_BETTER,
+    )
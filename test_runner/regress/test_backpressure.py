@@ -170,3 +170,96 @@ def test_backpressure_received_lsn_lag(neon_env_builder: NeonEnvBuilder):
 
 # TODO test_backpressure_disk_consistent_lsn_lag. Play with pageserver's checkpoint settings
 # TODO test_backpressure_remote_consistent_lsn_lag
+
+
+def test_backpressure_per_backend_throttling_time(neon_env_builder: NeonEnvBuilder):
+    """
+    Check that the time a backend spends throttled by backpressure is
+    reported in its own perf counters, and adds up to at most the total
+    throttling time.
+    """
+    env = neon_env_builder.init_start()
+    endpoint = env.endpoints.create(
+        "main",
+        config_lines=[
+            "max_replication_write_lag=1MB",
+            # Hadron: Need to set max_cluster_size to some value to enable any backpressure at all.
+            "neon.max_cluster_size=1GB",
+        ],
+    )
+    # CREATE EXTENSION neon is needed for the perf counter views
+    endpoint.respec(skip_pg_catalog_updates=False)
+    endpoint.start()
+
+    # Slow down the ingestion in the pageserver, to build up the write lag
+    env.pageserver.http_client().configure_failpoints(("walreceiver-after-ingest", "sleep(5)"))
+
+    with pg_cur(endpoint) as cur:
+        cur.execute("CREATE TABLE foo(x bigint)")
+        for _ in range(5):
+            cur.execute("INSERT INTO foo SELECT FROM generate_series(1, 100000)")
+
+        cur.execute(
+            "SELECT value FROM neon.neon_backend_perf_counters "
+            "WHERE metric = 'backpressure_throttling_us_total' AND pid = pg_backend_pid()"
+        )
+        backend_throttled = cur.fetchone()[0]
+        cur.execute("SELECT neon.backpressure_throttling_time()")
+        total_throttled = cur.fetchone()[0]
+
+    env.pageserver.http_client().configure_failpoints(("walreceiver-after-ingest", "off"))
+
+    log.info(f"backend throttled {backend_throttled} us, total {total_throttled} us")
+    assert backend_throttled > 0
+    assert backend_throttled <= total_throttled
+
+
+def test_backpressure_gradual_release(neon_env_builder: NeonEnvBuilder):
+    """
+    Check that while the lag goes down but stays above the limit, throttled
+    backends are let through a few at a time, rather than only once the lag
+    is gone.
+    """
+    env = neon_env_builder.init_start()
+    endpoint = env.endpoints.create(
+        "main",
+        config_lines=[
+            "max_replication_write_lag=1MB",
+            # Hadron: Need to set max_cluster_size to some value to enable any backpressure at all.
+            "neon.max_cluster_size=1GB",
+        ],
+    )
+    # CREATE EXTENSION neon is needed for the perf counter views
+    endpoint.respec(skip_pg_catalog_updates=False)
+    endpoint.start()
+
+    with pg_cur(endpoint) as cur:
+        cur.execute("CREATE TABLE foo(x bigint)")
+
+    # Slow down the ingestion in the pageserver, so that the lag goes down
+    # slowly while the writers are throttled
+    env.pageserver.http_client().configure_failpoints(("walreceiver-after-ingest", "sleep(5)"))
+
+    n_writers = 4
+    admissions = [0] * n_writers
+
+    def writer(i: int):
+        with pg_cur(endpoint) as cur:
+            for _ in range(5):
+                cur.execute("INSERT INTO foo SELECT FROM generate_series(1, 100000)")
+            cur.execute(
+                "SELECT value FROM neon.neon_backend_perf_counters "
+                "WHERE metric = 'backpressure_admissions_total' AND pid = pg_backend_pid()"
+            )
+            admissions[i] = int(cur.fetchone()[0])
+
+    threads = [threading.Thread(target=writer, args=(i,)) for i in range(n_writers)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    env.pageserver.http_client().configure_failpoints(("walreceiver-after-ingest", "off"))
+
+    log.info(f"backends let through backpressure above the limit: {admissions}")
+    assert sum(admissions) > 0
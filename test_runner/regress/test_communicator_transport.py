@@ -0,0 +1,58 @@
+from __future__ import annotations
+
+import threading
+from typing import TYPE_CHECKING
+
+import pytest
+from fixtures.utils import query_scalar
+
+if TYPE_CHECKING:
+    from fixtures.neon_fixtures import NeonEnvBuilder
+
+
+@pytest.mark.parametrize("shard_count", [None, 4])
+def test_communicator_transport(neon_env_builder: NeonEnvBuilder, shard_count: int | None):
+    """
+    Run concurrent scans with the backends' pageserver requests forwarded by
+    the communicator forwarder process.
+    """
+    if shard_count is not None:
+        neon_env_builder.num_pageservers = shard_count
+    env = neon_env_builder.init_start(
+        initial_tenant_shard_count=shard_count,
+    )
+    n_rec = 100000
+
+    endpoint = env.endpoints.create_start(
+        "main",
+        config_lines=[
+            "shared_buffers=1MB",
+            "neon.pageserver_transport=communicator",
+            # Small enough that prefetching fills the queue
+            "neon.communicator_queue_depth=4",
+            "max_parallel_workers_per_gather=0",
+            "effective_io_concurrency=32",
+        ],
+    )
+
+    cur = endpoint.connect().cursor()
+    cur.execute("CREATE TABLE t(pk integer, filler text default repeat('?', 200))")
+    cur.execute(f"insert into t (pk) values (generate_series(1,{n_rec}))")
+
+    results: list[int] = []
+
+    def scan():
+        with endpoint.connect().cursor() as c:
+            for _ in range(3):
+                results.append(query_scalar(c, "select sum(pk) from t"))
+
+    threads = [threading.Thread(target=scan) for _ in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert results == [n_rec * (n_rec + 1) // 2] * 12
+
+    # DbSize requests still go over the backend's own connection
+    assert query_scalar(cur, "select pg_database_size(current_database())") > 0
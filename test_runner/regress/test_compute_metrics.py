@@ -24,10 +24,11 @@ if TYPE_CHECKING:
     from typing import Self, TypedDict
 
     from fixtures.endpoint.http import EndpointHttpClient
-    from fixtures.neon_fixtures import NeonEnv
+    from fixtures.neon_fixtures import Endpoint, NeonEnv
     from fixtures.pg_version import PgVersion
     from fixtures.port_distributor import PortDistributor
     from prometheus_client.samples import Sample
+    from psycopg2.extensions import cursor as Cursor
 
     class Metric(TypedDict):
         metric_name: str
@@ -475,6 +476,154 @@ def test_perf_counters(neon_simple_env: NeonEnv):
     assert cur.fetchall()[0][0] == 2
 
 
+def perf_counters_endpoint(
+    env: NeonEnv, config_lines: list[str] | None = None
+) -> tuple[Endpoint, Cursor]:
+    """
+    Start an endpoint for checking the perf counters of a backend, and return a
+    cursor on it, with the neon and neon_test_utils extensions installed
+    """
+    endpoint = env.endpoints.create_start("main", config_lines=config_lines)
+    cur = endpoint.connect().cursor()
+    cur.execute("CREATE EXTENSION IF NOT EXISTS neon")
+    cur.execute("CREATE EXTENSION IF NOT EXISTS neon_test_utils")
+    return endpoint, cur
+
+
+def backend_perf_counter(cur: Cursor, name: str) -> int:
+    """
+    Get the value of a counter in neon_backend_perf_counters, for the cursor's backend
+    """
+    cur.execute(
+        f"select value from neon_backend_perf_counters where metric='{name}' and pid=pg_backend_pid()"
+    )
+    return int(cur.fetchall()[0][0])
+
+
+def test_perf_counters_getpage_copies_avoided(neon_simple_env: NeonEnv):
+    """
+    Check that synchronous reads receive the pages directly into the
+    destination buffer, and that it is reported in the perf counters
+    """
+    _, cur = perf_counters_endpoint(neon_simple_env, ["neon.file_cache_size_limit=0"])
+
+    # Disable prefetching, so that all pages are read synchronously
+    cur.execute("SET max_parallel_workers_per_gather=0")
+    cur.execute("SET effective_io_concurrency=0")
+
+    cur.execute("CREATE TABLE t (pk integer, filler text default repeat('?', 200))")
+    cur.execute("INSERT INTO t (pk) SELECT generate_series(1, 10000)")
+    cur.execute("SELECT clear_buffer_cache()")
+    cur.execute("SELECT count(*) FROM t")
+
+    assert backend_perf_counter(cur, "getpage_copies_avoided_total") > 0
+
+
+def test_perf_counters_relsize_cache(neon_simple_env: NeonEnv):
+    """
+    Check that relation size cache lookups are counted in the perf counters
+    """
+    endpoint, cur = perf_counters_endpoint(neon_simple_env)
+
+    cur.execute("CREATE TABLE t (pk integer, filler text default repeat('?', 200))")
+    cur.execute("INSERT INTO t (pk) SELECT generate_series(1, 10000)")
+
+    # Start with an empty cache
+    endpoint.stop()
+    endpoint.start()
+    cur = endpoint.connect().cursor()
+
+    misses_before = backend_perf_counter(cur, "relsize_cache_misses_total")
+    cur.execute("SELECT pg_relation_size('t')")
+    size = cur.fetchall()[0][0]
+    assert backend_perf_counter(cur, "relsize_cache_misses_total") > misses_before
+
+    hits_before = backend_perf_counter(cur, "relsize_cache_hits_total")
+    cur.execute("SELECT pg_relation_size('t')")
+    assert cur.fetchall()[0][0] == size
+    assert backend_perf_counter(cur, "relsize_cache_hits_total") > hits_before
+
+    contention = backend_perf_counter(cur, "relsize_cache_contention_total")
+    log.info(f"{contention} relsize cache lookups retried")
+
+
+def test_perf_counters_adaptive_readahead(neon_simple_env: NeonEnv):
+    """
+    Check that the effective readahead depth shrinks when prefetched pages are
+    thrown away unread, and grows again under a sequential scan that waits for
+    the pageserver
+    """
+    _, cur = perf_counters_endpoint(
+        neon_simple_env,
+        [
+            "neon.file_cache_size_limit=0",
+            "shared_buffers=1MB",
+            "effective_io_concurrency=100",
+            "autovacuum=off",
+        ],
+    )
+    cur.execute("SET max_parallel_workers_per_gather=0")
+    cur.execute("SET neon.readahead_adaptive=on")
+    cur.execute("SET neon.readahead_buffer_size=64")
+
+    cur.execute("CREATE TABLE t (pk integer, sk integer, filler text default repeat('?', 200))")
+    cur.execute("SELECT setseed(0.5)")
+    cur.execute("INSERT INTO t (pk, sk) SELECT g, random() * 100000 FROM generate_series(1, 100000) g")
+    cur.execute("CREATE INDEX ON t (sk)")
+    cur.execute("VACUUM t")
+
+    # Index scans in random heap order prefetch far ahead, but stop after a
+    # few rows, so most of their prefetched pages are never read.
+    cur.execute("SET enable_seqscan=off")
+    cur.execute("SET enable_bitmapscan=off")
+    wasted_before = backend_perf_counter(cur, "getpage_prefetch_wasted_total")
+    for i in range(20):
+        cur.execute("SELECT clear_buffer_cache()")
+        cur.execute(f"SELECT sum(pk) FROM (SELECT pk FROM t WHERE sk >= {i * 5000} LIMIT 10) s")
+    wasted = backend_perf_counter(cur, "getpage_prefetch_wasted_total") - wasted_before
+    shrunk = backend_perf_counter(cur, "getpage_prefetch_depth")
+    log.info(f"{wasted} prefetches wasted, depth {shrunk}")
+    assert wasted > 0
+    assert 0 < shrunk < 64
+
+    # A sequential scan uses everything it prefetches, and with an empty
+    # cache, its reads keep waiting for the pageserver.
+    cur.execute("RESET enable_seqscan")
+    cur.execute("RESET enable_bitmapscan")
+    cur.execute("SELECT clear_buffer_cache()")
+    cur.execute("SELECT count(*) FROM t")
+    grown = backend_perf_counter(cur, "getpage_prefetch_depth")
+    log.info(f"depth {grown} after sequential scan")
+    assert shrunk < grown <= 64
+
+
+def test_perf_counters_stride_prefetch(neon_simple_env: NeonEnv):
+    """
+    Check that index scans over a correlated index, which PostgreSQL doesn't
+    prefetch for, get their heap pages prefetched by the stride detector, in
+    both scan directions.
+    """
+    _, cur = perf_counters_endpoint(neon_simple_env, ["neon.file_cache_size_limit=0"])
+    cur.execute("SET neon.stride_prefetch_distance=32")
+    cur.execute("SET enable_seqscan=off")
+    cur.execute("SET enable_bitmapscan=off")
+
+    cur.execute("CREATE TABLE t (pk integer primary key, filler text default repeat('?', 200))")
+    cur.execute("INSERT INTO t (pk) SELECT generate_series(1, 100000)")
+    cur.execute("VACUUM ANALYZE t")
+
+    for order in ["ASC", "DESC"]:
+        hits_before = backend_perf_counter(cur, "getpage_stride_prefetch_hits_total")
+        cur.execute("SELECT clear_buffer_cache()")
+        cur.execute(f"SELECT sum(length(filler)) FROM (SELECT filler FROM t ORDER BY pk {order}) s")
+        hits = backend_perf_counter(cur, "getpage_stride_prefetch_hits_total") - hits_before
+        log.info(f"{order} index scan: {hits} stride prefetch hits")
+        assert hits > 0
+
+    hits = backend_perf_counter(cur, "getpage_stride_prefetch_hits_total")
+    assert backend_perf_counter(cur, "getpage_stride_prefetches_total") >= hits
+
+
 def collect_metric(
     client: EndpointHttpClient,
     name: str,
@@ -0,0 +1,62 @@
+from __future__ import annotations
+
+from typing import TYPE_CHECKING
+
+import pytest
+from fixtures.log_helper import log
+from fixtures.utils import USE_LFC, query_scalar
+
+if TYPE_CHECKING:
+    from fixtures.neon_fixtures import NeonEnv
+
+
+def lfc_stat(cur, key: str) -> int:
+    return query_scalar(cur, f"select lfc_value from neon_lfc_stats where lfc_key='{key}'")
+
+
+@pytest.mark.timeout(600)
+@pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
+def test_lfc_clock_scan_resistance(neon_simple_env: NeonEnv):
+    """
+    Check that with the CLOCK policy a seqscan of a table larger than the LFC
+    doesn't flush the chunks that are being hit repeatedly.
+    """
+    env = neon_simple_env
+    endpoint = env.endpoints.create_start(
+        "main",
+        config_lines=[
+            "shared_buffers=1MB",
+            "autovacuum=off",
+            "bgwriter_lru_maxpages=0",
+            "neon.max_file_cache_size=64MB",
+            "neon.file_cache_size_limit=32MB",
+            "neon.file_cache_eviction_policy=clock",
+        ],
+    )
+    cur = endpoint.connect().cursor()
+    cur.execute("create extension neon")
+    cur.execute("create table hot(pk integer primary key, payload text default repeat('?', 200))")
+    cur.execute("insert into hot values (generate_series(1, 10000))")
+    cur.execute(
+        "create table cold(pk integer, payload text default repeat('?', 1000)) with (fillfactor=10)"
+    )
+    cur.execute("insert into cold values (generate_series(1, 20000))")
+
+    # Make the hot table part of the working set
+    for _ in range(5):
+        cur.execute("select sum(pk) from hot")
+
+    # Scan a table that is several times larger than the LFC
+    cur.execute("select sum(pk) from cold")
+
+    misses_before = lfc_stat(cur, "file_cache_misses")
+    cur.execute("select sum(pk) from hot")
+    misses_after = lfc_stat(cur, "file_cache_misses")
+    hot_pages = query_scalar(cur, "select pg_relation_size('hot') / 8192")
+    log.info(f"hot table has {hot_pages} pages, {misses_after - misses_before} LFC misses")
+    assert misses_after - misses_before < hot_pages / 2
+
+    assert lfc_stat(cur, "file_cache_hot_chunks") > 0
+    assert lfc_stat(cur, "file_cache_evictions") > 0
+    assert lfc_stat(cur, "file_cache_sweep_steps") >= lfc_stat(cur, "file_cache_evictions")
+    assert lfc_stat(cur, "file_cache_hit_ratio_permille") > 0
@@ -1,11 +1,12 @@
 from __future__ import annotations
 
+import threading
 import time
 from typing import TYPE_CHECKING
 
 import pytest
 from fixtures.log_helper import log
-from fixtures.utils import USE_LFC
+from fixtures.utils import USE_LFC, query_scalar
 
 if TYPE_CHECKING:
     from fixtures.neon_fixtures import NeonEnv
@@ -13,7 +14,8 @@ if TYPE_CHECKING:
 
 @pytest.mark.timeout(600)
 @pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
-def test_lfc_prefetch(neon_simple_env: NeonEnv):
+@pytest.mark.parametrize("io_engine", ["sync", "io_uring"])
+def test_lfc_prefetch(neon_simple_env: NeonEnv, io_engine: str):
     """
     Test resizing the Local File Cache
     """
@@ -23,6 +25,7 @@ def test_lfc_prefetch(neon_simple_env: NeonEnv):
         config_lines=[
             "neon.max_file_cache_size=1GB",
             "neon.file_cache_size_limit=1GB",
+            f"neon.file_cache_io_engine={io_engine}",
             "effective_io_concurrency=100",
             "shared_buffers=1MB",
             "enable_bitmapscan=off",
@@ -102,3 +105,56 @@ def test_lfc_prefetch(neon_simple_env: NeonEnv):
 
     # No redundant prefetch requests if prefetch results are stored in LFC
     assert prefetch_expired == 0
+
+
+@pytest.mark.timeout(600)
+@pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
+def test_lfc_shared_prefetch(neon_simple_env: NeonEnv):
+    """
+    Test concurrent scans of the same table with the in-flight getpage
+    requests shared between backends
+    """
+    env = neon_simple_env
+    endpoint = env.endpoints.create_start(
+        "main",
+        config_lines=[
+            "neon.max_file_cache_size=1GB",
+            "neon.file_cache_size_limit=1GB",
+            "neon.store_prefetch_result_in_lfc=on",
+            "neon.shared_prefetch_size=4096",
+            "shared_buffers=1MB",
+            "max_parallel_workers_per_gather=0",
+            "autovacuum=off",
+        ],
+    )
+    cur = endpoint.connect().cursor()
+    cur.execute("create extension neon")
+    cur.execute("create table t(pk integer, filler text default repeat('x',200))")
+    cur.execute("insert into t values (generate_series(1,100000))")
+
+    # reset LFC
+    cur.execute("alter system set neon.file_cache_size_limit=0")
+    cur.execute("select pg_reload_conf()")
+    time.sleep(1)
+    cur.execute("alter system set neon.file_cache_size_limit='1GB'")
+    cur.execute("select pg_reload_conf()")
+
+    results: list[int] = []
+
+    def scan():
+        with endpoint.connect().cursor() as c:
+            results.append(query_scalar(c, "select sum(pk) from t"))
+
+    threads = [threading.Thread(target=scan) for _ in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert results == [100000 * 100001 // 2] * 4
+
+    shared_hits = query_scalar(
+        cur,
+        "select value from neon_perf_counters where metric='getpage_shared_prefetch_hits_total'",
+    )
+    log.info(f"Pages read from other backends' requests: {shared_hits}")
@@ -160,12 +160,17 @@ def test_lfc_prewarm(neon_simple_env: NeonEnv, method: PrewarmMethod):
     )
     lfc_used_pages = pg_cur.fetchall()[0][0]
     log.info(f"Used LFC size: {lfc_used_pages}")
-    pg_cur.execute("select * from neon.get_prewarm_info()")
-    total, prewarmed, skipped, _ = pg_cur.fetchall()[0]
+    pg_cur.execute(
+        "select total_pages, prewarmed_pages, skipped_pages, pages_per_second, eta_seconds "
+        "from neon.get_prewarm_info()"
+    )
+    total, prewarmed, skipped, pages_per_second, eta_seconds = pg_cur.fetchall()[0]
     assert lfc_used_pages > 10000
     assert total > 0
     assert prewarmed > 0
     assert total == prewarmed + skipped
+    assert pages_per_second > 0
+    assert eta_seconds == 0
 
     lfc_cur.execute("select sum(pk) from t")
     assert lfc_cur.fetchall()[0][0] == n_records * (n_records + 1) / 2
@@ -17,7 +17,8 @@ if TYPE_CHECKING:
 
 @pytest.mark.timeout(600)
 @pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
-def test_lfc_resize(neon_simple_env: NeonEnv, pg_bin: PgBin):
+@pytest.mark.parametrize("partitions", [1, 8])
+def test_lfc_resize(neon_simple_env: NeonEnv, pg_bin: PgBin, partitions: int):
     """
     Test resizing the Local File Cache
     """
@@ -30,6 +31,7 @@ def test_lfc_resize(neon_simple_env: NeonEnv, pg_bin: PgBin):
         config_lines=[
             "neon.max_file_cache_size=1GB",
             "neon.file_cache_size_limit=1GB",
+            f"neon.file_cache_partitions={partitions}",
         ],
     )
     n_resize = 10
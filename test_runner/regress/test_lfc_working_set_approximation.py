@@ -138,3 +138,100 @@ def test_sliding_working_set_approximation(neon_simple_env: NeonEnv):
 
     assert estimation_1k >= 900 and estimation_1k <= 2000
     assert estimation_10k >= 9000 and estimation_10k <= 20000
+
+
+@pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
+@pytest.mark.parametrize("n_rows", [1000, 10000, 50000])
+def test_working_set_approximation_accuracy(neon_simple_env: NeonEnv, n_rows: int):
+    """
+    The estimator keeps second resolution timestamps. Check that the
+    estimates stay close to the actual number of distinct pages accessed,
+    also when the same pages are accessed repeatedly.
+    """
+    env = neon_simple_env
+
+    endpoint = env.endpoints.create_start(
+        branch_name="main",
+        config_lines=[
+            "autovacuum = off",
+            "bgwriter_lru_maxpages=0",
+            "shared_buffers=1MB",
+            "neon.max_file_cache_size=256MB",
+            "neon.file_cache_size_limit=245MB",
+        ],
+    )
+    cur = endpoint.connect().cursor()
+    cur.execute("create extension neon")
+    cur.execute(
+        "create table t(pk integer, payload text default repeat('?', 1000)) with (fillfactor=10)"
+    )
+    cur.execute(f"insert into t (pk) values (generate_series(1,{n_rows}))")
+    pages = query_scalar(cur, "select pg_relation_size('t') / 8192")
+    cur.execute("select approximate_working_set_size(true)")
+
+    start = time.monotonic()
+    for _ in range(3):
+        cur.execute("select sum(pk) from t")
+    window = int(time.monotonic() - start) + 2
+
+    estimate = query_scalar(cur, f"select approximate_working_set_size_seconds({window})")
+    log.info(f"table has {pages} pages, working set estimate is {estimate}")
+    assert pages * 0.8 < estimate < pages * 1.2
+
+    # Nothing of the table was accessed in the last second
+    time.sleep(window + 1)
+    estimate = query_scalar(cur, "select approximate_working_set_size_seconds(1)")
+    log.info(f"working set estimate for the last second is {estimate}")
+    assert estimate < pages * 0.1
+
+
+@pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
+def test_lfc_miss_ratio_curve(neon_simple_env: NeonEnv):
+    """
+    Scan a table repeatedly, and check that the estimated hit ratio is close
+    to zero for caches smaller than the table, and high for caches larger
+    than it.
+    """
+    env = neon_simple_env
+
+    endpoint = env.endpoints.create_start(
+        branch_name="main",
+        config_lines=[
+            "autovacuum = off",
+            "bgwriter_lru_maxpages=0",
+            "shared_buffers=1MB",
+            "neon.max_file_cache_size=256MB",
+            "neon.file_cache_size_limit=245MB",
+        ],
+    )
+    cur = endpoint.connect().cursor()
+    cur.execute("create extension neon")
+    cur.execute(
+        "create table t(pk integer, payload text default repeat('?', 1000)) with (fillfactor=10)"
+    )
+    cur.execute("insert into t (pk) values (generate_series(1, 20000))")
+    table_mb = query_scalar(cur, "select pg_relation_size('t') / (1024 * 1024)")
+
+    n_scans = 4
+    for _ in range(n_scans):
+        cur.execute("select sum(pk) from t")
+
+    cur.execute("select cache_size_mb, estimated_hit_ratio from neon_lfc_miss_ratio_curve")
+    curve = cur.fetchall()
+    log.info(f"table is {table_mb} MB, miss ratio curve: {curve}")
+
+    assert curve[0][0] == 1
+    ratios = [ratio for _, ratio in curve]
+    assert ratios == sorted(ratios)
+    small = [ratio for size, ratio in curve if size * 2 <= table_mb]
+    large = [ratio for size, ratio in curve if size >= table_mb * 2]
+    assert small[-1] < 0.2
+    # At least all but the first scan hit
+    assert large[0] > 0.5 * (n_scans - 1) / n_scans
+
+    cur.execute("select window_seconds, approximate_working_set_size from neon_lfc_working_set")
+    windows = cur.fetchall()
+    log.info(f"working set windows: {windows}")
+    assert [w for w, _ in windows] == [60, 300, 900, 3600]
+    sizes = [size for _, size in windows]
+    assert sizes == sorted(sizes)
@@ -152,3 +152,93 @@ def test_local_file_cache_unlink(neon_env_builder: NeonEnvBuilder):
         n_updates_performed += n_updates_performed_q.get()
 
     assert query_scalar(cur, "SELECT SUM(n) FROM lfctest") == n_rows + n_updates_performed
+
+
+@pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
+def test_local_file_cache_extend_after_truncate(neon_simple_env: NeonEnv):
+    """
+    Truncation leaves the old pages of a relation in the LFC. Check that
+    extending the relation again, including the batched LFC writes of
+    zero-extended pages, never lets a scan see them.
+    """
+    env = neon_simple_env
+    endpoint = env.endpoints.create_start(
+        "main",
+        config_lines=[
+            "shared_buffers='1MB'",
+            "neon.max_file_cache_size='64MB'",
+            "neon.file_cache_size_limit='64MB'",
+        ],
+    )
+    cur = endpoint.connect().cursor()
+    n_rows = 100000
+
+    cur.execute("CREATE TABLE lfctest (id int4, filler text) WITH (autovacuum_enabled=off)")
+    for i in range(1, 4):
+        # INSERT ... SELECT extends the table in bulk
+        cur.execute(
+            f"INSERT INTO lfctest SELECT g, repeat('{i}', 100) FROM generate_series(1, {n_rows}) g"
+        )
+        assert query_scalar(cur, "SELECT count(*) FROM lfctest") == n_rows
+        assert (
+            query_scalar(cur, f"SELECT count(*) FROM lfctest WHERE filler = repeat('{i}', 100)")
+            == n_rows
+        )
+        cur.execute("DELETE FROM lfctest")
+        # truncates the now empty table
+        cur.execute("VACUUM lfctest")
+        assert query_scalar(cur, "SELECT pg_relation_size('lfctest')") == 0
+
+
+@pytest.mark.skipif(not USE_LFC, reason="LFC is disabled, skipping")
+def test_local_file_cache_persist(neon_simple_env: NeonEnv):
+    """
+    Check that the LFC contents survive a clean restart with
+    neon.file_cache_persist, and are discarded if another compute has
+    written to the timeline in the meantime.
+    """
+    env = neon_simple_env
+    config_lines = [
+        "shared_buffers='1MB'",
+        "neon.max_file_cache_size='64MB'",
+        "neon.file_cache_size_limit='64MB'",
+        "neon.file_cache_persist=on",
+    ]
+    endpoint = env.endpoints.create_start("main", config_lines=config_lines)
+    cur = endpoint.connect().cursor()
+    cur.execute("CREATE SCHEMA neon; CREATE EXTENSION neon WITH SCHEMA neon")
+    n_rows = 100000
+
+    cur.execute(
+        "CREATE TABLE lfctest (id int4, n int4, filler text) WITH (autovacuum_enabled=off)"
+    )
+    cur.execute(
+        f"INSERT INTO lfctest SELECT g, 1, repeat('x', 100) FROM generate_series(1, {n_rows}) g"
+    )
+    assert query_scalar(cur, "SELECT SUM(n) FROM lfctest") == n_rows
+
+    def used_pages() -> int:
+        return query_scalar(
+            endpoint.connect().cursor(),
+            "SELECT lfc_value FROM neon.neon_lfc_stats WHERE lfc_key='file_cache_used_pages'",
+        )
+
+    # A clean restart keeps the cached pages
+    endpoint.stop()
+    endpoint.start()
+    assert endpoint.log_contains("LFC: restored")
+    assert used_pages() > 0
+    cur = endpoint.connect().cursor()
+    assert query_scalar(cur, "SELECT SUM(n) FROM lfctest") == n_rows
+
+    # Another compute updates the table while the first one is down
+    endpoint.stop()
+    other = env.endpoints.create_start("main", endpoint_id="ep-other", config_lines=config_lines)
+    other.safe_psql("UPDATE lfctest SET n = 2")
+    other.stop()
+
+    # The cache is now stale, and must not be used
+    endpoint.start()
+    assert endpoint.log_contains("can't be reused")
+    cur = endpoint.connect().cursor()
+    assert query_scalar(cur, "SELECT SUM(n) FROM lfctest") == 2 * n_rows
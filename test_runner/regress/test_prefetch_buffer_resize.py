@@ -10,7 +10,10 @@ if TYPE_CHECKING:
 
 
 @pytest.mark.parametrize("shard_count", [None, 4])
-def test_prefetch(neon_env_builder: NeonEnvBuilder, shard_count: int | None):
+@pytest.mark.parametrize("protocol_version", [3, 4])
+def test_prefetch(
+    neon_env_builder: NeonEnvBuilder, shard_count: int | None, protocol_version: int
+):
     if shard_count is not None:
         neon_env_builder.num_pageservers = shard_count
     env = neon_env_builder.init_start(
@@ -23,6 +26,7 @@ def test_prefetch(neon_env_builder: NeonEnvBuilder, shard_count: int | None):
         "main",
         config_lines=[
             "shared_buffers=10MB",
+            f"neon.protocol_version={protocol_version}",
         ],
     )
 
@@ -22,6 +22,7 @@ from fixtures.neon_fixtures import (
     wait_for_last_flush_lsn,
 )
 from fixtures.pageserver.utils import assert_prefix_empty, assert_prefix_not_empty
+from fixtures.pg_version import PgVersion
 from fixtures.remote_storage import LocalFsStorage, RemoteStorageKind, s3_storage
 from fixtures.utils import skip_in_debug_build, wait_until
 from fixtures.workload import Workload
@@ -1979,6 +1980,66 @@ def test_sharding_unlogged_relation(neon_env_builder: NeonEnvBuilder):
         wait_for_last_flush_lsn(env, ep, tenant_id, timeline_id)
 
 
+def test_sharding_vectored_read(neon_env_builder: NeonEnvBuilder):
+    """
+    Check that a vectored read whose blocks are spread over several shards
+    gets its pages right when the shards respond in any order.
+    """
+    shard_count = 4
+    neon_env_builder.num_pageservers = shard_count
+    env = neon_env_builder.init_start(
+        initial_tenant_shard_count=shard_count,
+        # A stripe per page, so that every vectored read spans all shards
+        initial_tenant_shard_stripe_size=1,
+    )
+    if env.pg_version < PgVersion.V17:
+        pytest.skip("vectored reads need PostgreSQL 17")
+
+    n_rec = 100000
+    endpoint = env.endpoints.create_start(
+        "main",
+        config_lines=[
+            "neon.file_cache_size_limit=0",
+            "max_parallel_workers_per_gather=0",
+            # No prefetching, so that the pages are requested by the reads
+            "effective_io_concurrency=0",
+        ],
+    )
+
+    cur = endpoint.connect().cursor()
+    cur.execute("CREATE EXTENSION neon")
+    cur.execute("CREATE EXTENSION neon_test_utils")
+    cur.execute("CREATE TABLE t (pk integer, filler text default repeat('?', 200))")
+    cur.execute(f"INSERT INTO t (pk) SELECT generate_series(1, {n_rec})")
+
+    for _ in range(3):
+        cur.execute("SELECT clear_buffer_cache()")
+        cur.execute("SELECT sum(pk) FROM t")
+        assert cur.fetchall()[0][0] == n_rec * (n_rec + 1) // 2
+
+    # Delay the responses of one shard, so that whenever a read waits for
+    # that shard first, the other shards' pages arrive ahead of their turn.
+    shard = env.storage_controller.locate(env.initial_tenant)[0]
+    slow_pageserver = env.get_pageserver(int(shard["node_id"]))
+    slow_pageserver.http_client().configure_failpoints(("before-pagestream-msg-flush", "return(5)"))
+
+    def early_responses() -> int:
+        cur.execute(
+            "select value from neon_backend_perf_counters where metric='getpage_gather_early_responses_total' and pid=pg_backend_pid()"
+        )
+        return int(cur.fetchall()[0][0])
+
+    early_before = early_responses()
+    cur.execute("SELECT clear_buffer_cache()")
+    cur.execute("SELECT sum(pk) FROM t")
+    assert cur.fetchall()[0][0] == n_rec * (n_rec + 1) // 2
+    slow_pageserver.http_client().configure_failpoints(("before-pagestream-msg-flush", "off"))
+
+    early = early_responses() - early_before
+    log.info(f"{early} responses received ahead of their turn")
+    assert early > 0
+
+
 def test_top_tenants(neon_env_builder: NeonEnvBuilder):
     """
     The top_tenants API is used in shard auto-splitting to find candidates.
@@ -1288,6 +1288,39 @@ def test_lagging_sk(neon_env_builder: NeonEnvBuilder):
     env.stop(immediate=True)
 
 
+# Test two safekeepers catching up from the same position at the same time,
+# both fetching the WAL below basebackup LSN from a donor with neon_walreader.
+# walproposer shares the chunks of WAL it reads between safekeepers, but a
+# reader streaming from a donor can only read forward, so it must not skip the
+# chunks another safekeeper has already read.
+def test_lagging_sks_shared_wal_chunks(neon_env_builder: NeonEnvBuilder):
+    neon_env_builder.num_safekeepers = 5
+    env = neon_env_builder.init_start()
+
+    lagging = env.safekeepers[:2]
+
+    for sk in lagging:
+        sk.stop()
+    tenant_id = env.initial_tenant
+    timeline_id = env.create_branch("test_lagging_sks_shared_wal_chunks")
+    ep = env.endpoints.create_start("test_lagging_sks_shared_wal_chunks")
+    ep.safe_psql("create table t(key int, value text)")
+    # ~20MB of WAL, many chunks for both lagging safekeepers to catch up on
+    ep.safe_psql("insert into t select generate_series(1, 180000), 'payload'")
+    ep.stop()
+
+    for sk in lagging:
+        sk.start()
+    ep = env.endpoints.create_start("test_lagging_sks_shared_wal_chunks")
+    ep.safe_psql("insert into t select generate_series(1, 100), 'payload'")
+    wait_flush_lsn_align_by_ep(
+        env, "test_lagging_sks_shared_wal_chunks", tenant_id, timeline_id, ep, env.safekeepers
+    )
+    cmp_sk_wal(env.safekeepers, tenant_id, timeline_id)
+
+    env.stop(immediate=True)
+
+
 # Smaller version of test_one_sk_down testing peer recovery in isolation: that
 # it works without compute at all.
 def test_peer_recovery(neon_env_builder: NeonEnvBuilder):